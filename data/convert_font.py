@@ -6,10 +6,23 @@ import json
 import math
 
 IMAGE_PREDICTOR = "bloom"
+IMAGE_ORDER = "diagonal"
 IMAGE_ENCODER = "zero-run"
+ENTROPY_CODER = "rans"
+
+DIAGONAL_LANES = 16     # must match DiagonalLanes in src/font_codec.cpp
+RANS_SCALE_BITS = 12    # must match ScaleBits in src/font_codec.cpp
+RANS_STREAMS = 4        # must match Streams in src/font_codec.cpp
+RANS_L = 1 << 16        # lower bound of the normalized rANS state interval
 
 ###############################################################################
 
+def bloom_predict(w, n, nw):
+    p = n + w - nw
+    p = max(p, min((w, n, nw)))
+    p = min(p, max((w, n, nw)))
+    return p
+
 def predict_image(data, width):
     if IMAGE_PREDICTOR == "delta":  # simple delta predictor ##################
         prev = 0
@@ -21,17 +34,15 @@ def predict_image(data, width):
         return bytes(data)
 
     elif IMAGE_PREDICTOR == "bloom":  # Charles Bloom / Fabian Giesen #########
+        # pixels outside of the image (left and top) are zero
         new = bytearray(data)
-        data += (width + 4) * b'\x00'
-        for i in range(len(new)):
-            w = data[i-1]
-            n = data[i-width]
-            nw = data[i-width-1]
-            p = n + w - nw
-            p = max(p, min((w, n, nw)))
-            p = min(p, max((w, n, nw)))
-            new[i] = (data[i] - p) & 0xFF
-        return new
+        for i in range(len(data)):
+            x = i % width
+            w  = data[i-1]       if  x                     else 0
+            n  = data[i-width]   if (i >= width)           else 0
+            nw = data[i-width-1] if (x and (i >= width))   else 0
+            new[i] = (data[i] - bloom_predict(w, n, nw)) & 0xFF
+        return bytes(new)
 
     else:  # null predictor ###################################################
         return data
@@ -46,23 +57,57 @@ def unpredict_image(data, width):
         return bytes(data)
 
     elif IMAGE_PREDICTOR == "bloom":  # Charles Bloom / Fabian Giesen #########
-        length = len(data)
-        data = bytearray(data + b'\x00' * (width + 4))
+        data = bytearray(data)
         for i in range(len(data)):
-            w = data[i-1]
-            n = data[i-width]
-            nw = data[i-width-1]
-            p = n + w - nw
-            p = max(p, min((w, n, nw)))
-            p = min(p, max((w, n, nw)))
-            data[i] = (data[i] + p) & 0xFF
-        return bytes(data[:length])
+            x = i % width
+            w  = data[i-1]       if  x                     else 0
+            n  = data[i-width]   if (i >= width)           else 0
+            nw = data[i-width-1] if (x and (i >= width))   else 0
+            data[i] = (data[i] + bloom_predict(w, n, nw)) & 0xFF
+        return bytes(data)
 
     else:  # null predictor ###################################################
         return data
 
 ###############################################################################
 
+def reorder_image(data, width):
+    if IMAGE_ORDER == "diagonal":  # skewed bands for vectorized decoding #####
+        # The image is split into bands of DIAGONAL_LANES rows, and row r
+        # of each band is delayed by r pixels; this way, all pixels that
+        # are stored together only depend on previously stored pixels, and
+        # the decoder can unpredict a whole column of a band at once.
+        # Positions outside of the image are stored as zero.
+        height = len(data) // width
+        out = bytearray()
+        for y0 in range(0, height, DIAGONAL_LANES):
+            for t in range(width + DIAGONAL_LANES - 1):
+                for r in range(DIAGONAL_LANES):
+                    x, y = t - r, y0 + r
+                    out.append(data[y * width + x] if ((0 <= x < width) and (y < height)) else 0)
+        return bytes(out)
+
+    else:  # raster order #####################################################
+        return data
+
+def restore_order(data, width, height):
+    if IMAGE_ORDER == "diagonal":  # skewed bands for vectorized decoding #####
+        out = bytearray(width * height)
+        pos = 0
+        for y0 in range(0, height, DIAGONAL_LANES):
+            for t in range(width + DIAGONAL_LANES - 1):
+                for r in range(DIAGONAL_LANES):
+                    x, y = t - r, y0 + r
+                    if (0 <= x < width) and (y < height):
+                        out[y * width + x] = data[pos]
+                    pos += 1
+        return bytes(out)
+
+    else:  # raster order #####################################################
+        return data
+
+###############################################################################
+
 def encode_data(data):
     if IMAGE_ENCODER == "zero-run":  # zero-run encoder #######################
         end = len(data)
@@ -106,6 +151,134 @@ def decode_data(data):
 
 ###############################################################################
 
+def split_runs(enc, count):
+    # separate zero-run encoded data into run lengths and literals
+    runs, literals = bytearray(), bytearray()
+    pos = out = 0
+    while out < count:
+        length = enc[pos]; pos += 1
+        runs.append(length)
+        out += length
+        if out >= count: break
+        length = enc[pos]; pos += 1
+        runs.append(length)
+        literals += enc[pos : pos+length]
+        pos += length
+        out += length
+    return bytes(runs), bytes(literals)
+
+def join_runs(runs, literals, count):
+    # inverse of split_runs(), taking the data from two iterators
+    enc = bytearray()
+    out = 0
+    while out < count:
+        length = next(runs)
+        enc.append(length)
+        out += length
+        if out >= count: break
+        length = next(runs)
+        enc.append(length)
+        enc += bytes(next(literals) for i in range(length))
+        out += length
+    return bytes(enc)
+
+###############################################################################
+
+def normalize_freqs(hist, total):
+    # scale the histogram to the given total, keeping every used symbol
+    # representable, then fix up rounding errors where they cost the least
+    count = sum(hist)
+    freqs = [(max(1, round(h * total / count)) if h else 0) for h in hist]
+    while sum(freqs) > total:
+        s = min((h * math.log2(f / (f - 1)), s) for s, (h, f) in enumerate(zip(hist, freqs)) if f > 1)[1]
+        freqs[s] -= 1
+    while sum(freqs) < total:
+        s = max((h * math.log2((f + 1) / f), s) for s, (h, f) in enumerate(zip(hist, freqs)) if f)[1]
+        freqs[s] += 1
+    return freqs
+
+def rans_encode(data, tables):
+    # 32-bit state with 16-bit renormalization; symbol i is coded with
+    # frequency table i % len(tables); the result is a list of 16-bit
+    # words, starting with the final encoder state
+    cums = [[sum(freqs[:s]) for s in range(256)] for freqs in tables]
+    x = RANS_L
+    words = []
+    for i in reversed(range(len(data))):
+        s, t = data[i], i % len(tables)
+        f = tables[t][s]
+        if x >= ((RANS_L >> RANS_SCALE_BITS) << 16) * f:
+            words.append(x & 0xFFFF)
+            x >>= 16
+        x = ((x // f) << RANS_SCALE_BITS) + (x % f) + cums[t][s]
+    words += [x & 0xFFFF, x >> 16]
+    words.reverse()
+    return words
+
+def rans_decode(words, tables, count):
+    mask = (1 << RANS_SCALE_BITS) - 1
+    cums = [[sum(freqs[:s]) for s in range(256)] for freqs in tables]
+    slots = [sum(([s] * freqs[s] for s in range(256)), []) for freqs in tables]
+    x = (words[0] << 16) | words[1]
+    pos = 2
+    out = bytearray(count)
+    for i in range(count):
+        t = i % len(tables)
+        s = slots[t][x & mask]
+        x = tables[t][s] * (x >> RANS_SCALE_BITS) + (x & mask) - cums[t][s]
+        if x < RANS_L:
+            x = (x << 16) | words[pos]
+            pos += 1
+        out[i] = s
+    assert (pos == len(words)) and (x == RANS_L)
+    return out
+
+def histogram(data):
+    hist = [0] * 256
+    for b in data: hist[b] += 1
+    return hist
+
+def entropy_encode(runs, literals):
+    if ENTROPY_CODER == "rans":  # static rANS ################################
+        # The zero-run and literal-run lengths (which alternate) are coded
+        # with one frequency table each. They are split into RANS_STREAMS
+        # parts (of an even number of symbols; the last one is padded with
+        # zeros) that are coded independently, so the decoder can advance
+        # all coders at once. The literals are close to random and would
+        # gain little from entropy coding, but cost a lot of decoding time,
+        # so they are stored as they are.
+        # Returns the concatenated streams and literals as 16-bit words, the
+        # frequency tables, the sizes of the streams (in words) and the
+        # number of (padded) run lengths.
+        size = -(-len(runs) // (RANS_STREAMS * 2)) * 2
+        runs += bytes(size * RANS_STREAMS - len(runs))
+        parts = [runs[i * size : (i + 1) * size] for i in range(RANS_STREAMS)]
+        tables = [normalize_freqs(histogram(runs[i::2]), 1 << RANS_SCALE_BITS) for i in range(2)]
+        streams = [rans_encode(p, tables) for p in parts]
+        literals += bytes(len(literals) & 1)
+        words = sum(streams, []) + [literals[i] | (literals[i+1] << 8) for i in range(0, len(literals), 2)]
+        return words, sum(tables, []), [len(s) for s in streams], len(runs)
+
+def entropy_decode(words, freqs, sizes, run_count):
+    if ENTROPY_CODER == "rans":  # static rANS ################################
+        tables = [freqs[:256], freqs[256:]]
+        runs = b''
+        for size in sizes:
+            runs += rans_decode(words[:size], tables, run_count // RANS_STREAMS)
+            words = words[size:]
+        return runs, b''.join(w.to_bytes(2, 'little') for w in words)
+
+###############################################################################
+
+def write_array(f, ctype, name, values, digits):
+    f.write(f"const {ctype} {name}[] = {{")
+    comma = ""
+    VPL = (254 - 4) // (digits + 3)
+    for pos in range(0, len(values), VPL):
+        f.write(comma + "\n    " + ','.join(f"0x{v:0{digits}X}" for v in values[pos : pos + VPL]))
+        comma = ","
+    f.write("\n};\n\n")
+
 if __name__ == "__main__":
     with open("font.json") as f:
         data = json.load(f)
@@ -120,16 +293,32 @@ if __name__ == "__main__":
         glyphs = { g['unicode']: g for g in data['glyphs'] }
 
     img = Image.open("font.png")
+    w, h = img.size
     raw = b''
+    res = b''
     enc = b''
-    dec = b''
+    runs = b''
+    literals = b''
+    chenc = []
     for band in img.split():
         band = band.tobytes()
-        benc = bytes(encode_data(predict_image(band, img.size[0])))
-        bdec = unpredict_image(bytes(decode_data(benc)), img.size[0])
+        bres = reorder_image(predict_image(band, w), w)
+        benc = bytes(encode_data(bres))
         raw += band
+        res += bres
         enc += benc
-        dec += bdec
+        chenc.append(benc)
+        if ENTROPY_CODER:
+            brun, blit = split_runs(benc, len(bres))
+            runs += brun
+            literals += blit
+    if ENTROPY_CODER == "rans":
+        assert IMAGE_ENCODER == "zero-run"
+        words, freqs, sizes, run_count = entropy_encode(runs, literals)
+        enc = b''.join(w.to_bytes(2, 'little') for w in words)
+        runs, literals = map(iter, entropy_decode(words, freqs, sizes, run_count))
+        chenc = [join_runs(runs, literals, len(res) // len(chenc)) for benc in chenc]
+    dec = b''.join(unpredict_image(restore_order(bytes(decode_data(benc)), w, h), w) for benc in chenc)
     with open("font_raw.bin", 'wb') as f: f.write(raw)
     with open("font_enc.bin", 'wb') as f: f.write(enc)
     with open("font_dec.bin", 'wb') as f: f.write(dec)
@@ -137,35 +326,38 @@ if __name__ == "__main__":
     assert raw == dec
 
     print("encoded image size:", len(enc), "bytes")
-    hist = {x:enc.count(x) for x in set(enc)}
-    print(len(hist), "out of 256 values used")
-    entropy = -sum(f * math.log2(f / len(enc)) for f in hist.values()) / len(enc)
-    print(f"Shannon entropy: {entropy:.2f} bits -> ideal size = {math.ceil(len(enc) / 8 * entropy):.0f} bytes")
+    hist = {x:res.count(x) for x in set(res)}
+    print(len(hist), "out of 256 residual values used")
+    entropy = -sum(f * math.log2(f / len(res)) for f in hist.values()) / len(res)
+    print(f"Shannon entropy: {entropy:.2f} bits -> ideal size = {math.ceil(len(res) / 8 * entropy):.0f} bytes")
 
     maxlinhist = max(hist.values())
     maxloghist = max(math.log(n) for n in hist.values())
     with open("font_hist.txt", 'w') as f:
-        f.write(f"{IMAGE_PREDICTOR=}\n{IMAGE_ENCODER=}\n\n")
+        f.write(f"{IMAGE_PREDICTOR=}\n{IMAGE_ORDER=}\n{IMAGE_ENCODER=}\n{ENTROPY_CODER=}\n\n")
         for x in range(256):
             nlin = hist.get(x, 0)
             linbar = "#" * int(nlin / maxlinhist * 32 + 0.9)
             logbar = "#" * int(math.log(nlin) / maxloghist * 31 + 1.0) if nlin else ""
             f.write(f"${x:02X} | {nlin:6d}x |{linbar:<32} |{logbar}\n")
 
-    w, h = img.size
     order = sorted(glyphs)
     for cp in (0xFFFD, ord('?')):
         if cp in order:
             fgi = order.index(cp)
             break
 
+    assert (IMAGE_PREDICTOR, IMAGE_ORDER, IMAGE_ENCODER, ENTROPY_CODER) == ("bloom", "diagonal", "zero-run", "rans"), \
+           "src/font_codec.cpp only supports the default configuration"
     with open("font_data.cpp", 'w') as f:
         f.write("// This file has been generated automatically, DO NOT EDIT!\n\n")
         f.write('#include "font_data.h"\n\n')
         f.write("namespace FontData {\n\n")
         f.write(f"const int TexWidth           = {w:6};\n")
         f.write(f"const int TexHeight          = {h:6};\n")
-        f.write(f"const int TexDataSize        = {len(enc):6};\n\n")
+        f.write(f"const int TexDataSize        = {len(words):6};\n")
+        f.write(f"const int TexStreamSize[]    = {{ {', '.join(map(str, sizes))} }};\n")
+        f.write(f"const int TexRunCount        = {run_count:6};\n\n")
         f.write(f"const int NumGlyphs          = {len(glyphs):6};\n")
         f.write(f"const int FallbackGlyphIndex = {fgi:6};\n")
         f.write(f"const float Baseline         = {mbase:.6f}f;\n\n")
@@ -194,10 +386,6 @@ if __name__ == "__main__":
             f.write(f"    {{ 0x{cp:08X}, {adv:8.6f}f, {space} {{{px0:9.6f}f,{py0:9.6f}f,{px1:9.6f}f,{py1:9.6f}f }}, {{{tx0:6.1f}f/{w},{ty0:6.1f}f/{h},{tx1:6.1f}f/{w},{ty1:6.1f}f/{h} }} }},\n")
         f.write("};\n\n")
 
-        f.write("const uint8_t TexData[] = {")
-        comma = ""
-        BPL = (254 - 4) // 5
-        for pos in range(0, len(enc), BPL):
-            f.write(comma + "\n    " + ','.join(f"0x{b:02X}" for b in enc[pos : pos + BPL]))
-            comma = ","
-        f.write("\n};\n\n} // namespace FontData\n")
+        write_array(f, "uint16_t", "TexFreq", freqs, 4)
+        write_array(f, "uint16_t", "TexData", words, 4)
+        f.write("} // namespace FontData\n")
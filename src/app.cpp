@@ -6,12 +6,13 @@
 #include <cstdio>
 #include <cstring>
 
-#include "glad.h"
-
 #include "event.h"
 #include "renderer.h"
+#include "damage.h"
 #include "dirview.h"
 #include "menu.h"
+#include "perfhud.h"
+#include "scheduler.h"
 #include "file_assoc.h"
 #include "sysutil.h"
 
@@ -19,6 +20,15 @@
 
 constexpr const char* favFileName = "glbrowser.fav";
 
+constexpr uint32_t barBackTrans = 0x404040;
+constexpr uint32_t barBackOpaque = barBackTrans | 0xFF000000;
+constexpr uint32_t controlBarColor = 0xFFAAAAAA;
+
+constexpr double ProgramPollInterval = 0.100;  // seconds, only if the process supervisor isn't active
+constexpr double MaxInputLatency = 0.150;  // seconds after which automatic repeats are dropped
+constexpr uint64_t PrefetchProgramBytes = 64u << 20;
+constexpr uint64_t PrefetchFileBytes = 4u << 20;
+
 namespace MenuItemID {
     constexpr int Dismiss         =  0;
     constexpr int QuitApplication = -1;
@@ -37,68 +47,128 @@ bool GLBrowserApp::isValidFavID(int id) {
     return MenuItemID::IsFav(id) && (MenuItemID::GetFav(id) < int(m_favs.size()));
 }
 
-bool GLBrowserApp::init(const char *initial) {
-    glClearColor(0.125f, 0.25f, 0.375f, 1.0f);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    if (!m_renderer.init()) { return false; }
+bool GLBrowserApp::init(const char *initial, SoftRasterizer* soft) {
+    m_renderer.setGlyphNotify([this] () { m_actionCallback(AppAction::Wakeup); });
+    if (!m_renderer.init(soft)) { return false; }
+    m_renderer.setClearColor(0.125f, 0.25f, 0.375f);
     m_geometry.update(m_renderer.viewportWidth(), m_renderer.viewportHeight());
+    m_damage.setScreenSize(m_geometry.screenWidth, m_geometry.screenHeight);
     m_dirView.navigate(initial ? initial : GetCurrentDir());
+    m_workers.init(m_drawThreads);
+    m_dirView.setWorkerPool(&m_workers);
+    m_jobs.init(0, [this] () { m_actionCallback(AppAction::Wakeup); });
+    m_idle.setJobSystem(&m_jobs);
+    m_dirView.setJobSystem(&m_jobs);
+    if (!m_supervisor.init([this] () { m_actionCallback(AppAction::Wakeup); })) {
+        #ifdef _DEBUG
+            printf("process supervisor initialization failed, falling back to polling\n");
+        #endif
+    }
     FileAssocInit(m_argv0);
+    for (int i = 1;  GetFileAssoc(i).index;  ++i) {
+        m_supervisor.prespawn(GetFileAssoc(i).executablePath.c_str(), GetFileAssoc(i).protocol);
+    }
     m_favFile = PathJoin(GetConfigDir(), favFileName);
     return true;
 }
 
 void GLBrowserApp::shutdown() {
+    m_supervisor.shutdown();
+    m_dirView.setJobSystem(nullptr);
+    m_jobs.shutdown();
+    m_dirView.setWorkerPool(nullptr);
+    m_workers.shutdown();
+    m_dirView.releaseResources();
+    m_menu.releaseResources();
+    m_renderer.releaseCached(m_titleLayer);
+    m_renderer.releaseCached(m_controlsLayer);
     m_renderer.shutdown();
 }
 
 bool GLBrowserApp::draw(double dt) {
-    if (m_framesRequested > 0) { --m_framesRequested; }
+    processInput();
 
-    // wait for running program
-    if (m_runningProgram) {
-        if (PollForProgram(m_runningProgram)) {
-            m_actionCallback(AppAction::Restore);
-        } else {
-            requestFrame();
+    // background work that waits for the UI to be idle; input pauses it
+    // right away (in queueEvent()), so this needs to come before deliver()
+    m_idle.update(m_scheduler.idle());
+    m_jobs.deliver();
+    if (m_idle.waiting()) { m_scheduler.addDeadline(m_scheduler.idleStart()); }
+
+    // while external programs are running, stay idle; the supervisor
+    // wakes up the event loop when one of them exits
+    if (m_programRunning) {
+        if (m_supervisor.update()) {
+            m_scheduler.setAnimating(false);
+            if (!m_supervisor.active()) { m_scheduler.addDeadline(FrameScheduler::now() + ProgramPollInterval); }
             return false;
         }
+        m_programRunning = false;
+        m_actionCallback(AppAction::Restore);
+        m_damage.invalidate();
     }
 
+    // move glyphs that have been generated in the background into the
+    // atlas; the generator thread wakes up the event loop when there are new ones
+    m_renderer.updateGlyphAtlas();
+
     // process animations
+    const bool timing = m_perfHUD.active();
+    FrameScheduler::Time t0 = timing ? FrameScheduler::now() : 0.0;
     m_geometry.setTimeDelta(float(dt));
-    if (m_dirView.animate() + m_menu.animate()) { requestFrame(); }
+    m_renderer.setAnimTime(m_geometry.animTime);
+    m_scheduler.setAnimating((m_dirView.animate() + m_menu.animate()) > 0);
+    FrameScheduler::Time t1 = timing ? FrameScheduler::now() : 0.0;
+
+    // determine title, and skip the frame altogether if nothing changed
+    const char* title = (m_menu.active() && !m_menu.mainTitle().empty())
+                      ?  m_menu.mainTitle().c_str()
+                      :  m_dirView.currentDir().c_str();
+    if (!title || !title[0]) { title = "drive selection"; }
+    updateDamage(title);
+    if (m_damage.empty()) { return false; }
 
-    // clear screen and draw main views
-    glClear(GL_COLOR_BUFFER_BIT);
+    // clear (damaged parts of the) screen and draw main views
+    m_renderer.beginFrame(m_damage);
     m_dirView.draw();
     m_menu.draw();
 
-    // draw title and status bar background
-    constexpr uint32_t barBackTrans = 0x404040;
-    constexpr uint32_t barBackOpaque = barBackTrans | 0xFF000000;
+    // draw title and control bars; they only change occasionally, so they
+    // are drawn through render layers (their damage keys identify the contents)
+    int barHeight = 2 * m_geometry.outerMarginY + m_geometry.textSize + m_geometry.gradientHeight;
+    m_renderer.drawCached(m_titleLayer, 0.0f, 0.0f, m_geometry.screenWidth, barHeight, m_damageTitle.key,
+        [&] () { drawTitleBar(title); });
+    m_renderer.drawCached(m_controlsLayer, 0.0f, float(m_geometry.screenHeight - barHeight), m_geometry.screenWidth, barHeight, m_damageControls.key,
+        [&] () { drawControlBar(); });
+
+    m_perfHUD.draw();
+    m_renderer.endFrame();
+    if (timing) { m_perfHUD.frameDone(t1 - t0, FrameScheduler::now() - t1); }
+    m_damage.reset();
+    return true;
+}
+
+void GLBrowserApp::drawTitleBar(const char* title) {
+    // background
     int y = 2 * m_geometry.outerMarginY + m_geometry.textSize;
     m_renderer.box(0, 0, m_geometry.screenWidth, y, barBackOpaque);
     m_renderer.box(0, y, m_geometry.screenWidth, y + m_geometry.gradientHeight, barBackOpaque, barBackTrans);
-    y = m_geometry.screenHeight - y;
-    m_renderer.box(0, y - m_geometry.gradientHeight, m_geometry.screenWidth, y, barBackTrans, barBackOpaque);
-    m_renderer.box(0, y, m_geometry.screenWidth, m_geometry.screenHeight, barBackOpaque);
-    y += m_geometry.outerMarginY;  // move to upper end of controls line, used below
 
-    // draw title contents
-    const char* title = (m_menu.active() && !m_menu.mainTitle().empty())
-                      ?  m_menu.mainTitle().c_str()
-                      :  m_dirView.currentDir().c_str();
-    if (!title || !title[0]) { title = "drive selection"; }
+    // contents
     m_renderer.text(
         std::min(float(m_geometry.outerMarginX),
                  float(m_geometry.screenWidth - m_geometry.outerMarginX)
                - float(m_geometry.textSize) * m_renderer.textWidth(title)),
         float(m_geometry.outerMarginY), float(m_geometry.textSize), title, 0);
+}
 
-    // draw control bar contents
-    constexpr uint32_t controlBarColor = 0xFFAAAAAA;
+void GLBrowserApp::drawControlBar() {
+    // background
+    int y = m_geometry.screenHeight - 2 * m_geometry.outerMarginY - m_geometry.textSize;
+    m_renderer.box(0, y - m_geometry.gradientHeight, m_geometry.screenWidth, y, barBackTrans, barBackOpaque);
+    m_renderer.box(0, y, m_geometry.screenWidth, m_geometry.screenHeight, barBackOpaque);
+    y += m_geometry.outerMarginY;  // move to upper end of controls line
+
+    // contents
     int x = m_geometry.outerMarginX;
     if (m_menu.active()) {
         m_menu.controls([&] (bool keyboard, const std::string& control, const std::string& label) {
@@ -120,9 +190,29 @@ bool GLBrowserApp::draw(double dt) {
         x = m_renderer.control(x, y, m_geometry.textSize, 0, true, "Esc", "Menu", controlBarColor, barBackOpaque);
         x = m_renderer.control(x, y, m_geometry.textSize, 0, true, "Q", "Quit", controlBarColor, barBackOpaque);
     }
+}
 
-    m_renderer.flush();
-    return true;
+void GLBrowserApp::updateDamage(const char* title) {
+    m_dirView.updateDamage(m_damage);
+    m_menu.updateDamage(m_damage);
+    m_perfHUD.updateDamage(m_damage);
+
+    // title and control bars (including the gradients)
+    int barHeight = 2 * m_geometry.outerMarginY + m_geometry.textSize + m_geometry.gradientHeight;
+    m_damage.update(m_damageTitle,
+        Rect(0, 0, m_geometry.screenWidth, barHeight),
+        DamageKey(DamageKeyInit, title));
+    uint32_t key = DamageKey(DamageKeyInit, m_haveController);
+    if (m_menu.active()) {
+        m_menu.controls([&] (bool keyboard, const std::string& control, const std::string& label) {
+            key = DamageKey(DamageKey(DamageKey(key, keyboard), control.c_str()), label.c_str());
+        });
+    } else {
+        key = DamageKey(DamageKey(key, 0xFFFFu), m_dirView.atRoot());
+    }
+    m_damage.update(m_damageControls,
+        Rect(0, m_geometry.screenHeight - barHeight, m_geometry.screenWidth, m_geometry.screenHeight),
+        key);
 }
 
 void GLBrowserApp::loadFavs() {
@@ -193,12 +283,22 @@ void GLBrowserApp::showOpenWithMenu() {
     m_menu.clear();
     m_menu.setMainTitle(m_dirView.currentItemFullPath());
     m_menu.setBoxTitle("Open With");
+    // while the user makes up their mind, get the candidate programs and
+    // the beginning of the file itself into the page cache; opening them
+    // may block for a while (e.g. on network file systems), so that's done
+    // in the background, and given up on if the panel is closed meanwhile
+    const CancelToken& token = m_dirView.currentPanel().jobToken();
+    auto prefetch = [&] (const std::string& path, uint64_t maxBytes) {
+        if (m_prefetch) { m_jobs.submit(JobPriority::Prefetch, token, [path, maxBytes] () { PrefetchFile(path, maxBytes); }); }
+    };
+    prefetch(m_dirView.currentItemFullPath(), m_dirView.currentItem().isExec ? PrefetchProgramBytes : PrefetchFileBytes);
     if (m_dirView.currentItem().isExec) {
         m_menu.addItem(MenuItemID::RunExecutable, "Run");
     }
     m_menu.addSeparator();
     FileAssocLookup(m_dirView.currentItem().extCode, [&] (const FileAssociation& assoc) -> bool {
         m_menu.addItem(assoc.index, assoc.displayName);
+        prefetch(assoc.executablePath, PrefetchProgramBytes);
         return true;
     });
     m_menu.addSeparator();
@@ -246,14 +346,64 @@ void GLBrowserApp::itemSelected() {
         runProgramWrapper(m_dirView.currentItemFullPath().c_str());
     } else {
         runProgramWrapper(assoc.executablePath.c_str(),
-                          m_dirView.currentItemFullPath().c_str());
+                          m_dirView.currentItemFullPath().c_str(), assoc.protocol);
     }
 }
 
-void GLBrowserApp::runProgramWrapper(const char* program, const char* argument) {
-    WaitForProgram(m_runningProgram);
-    m_actionCallback(AppAction::Minimize);
-    m_runningProgram = RunProgram(program, argument);
+void GLBrowserApp::runProgramWrapper(const char* program, const char* argument, ViewerProtocol protocol) {
+    if (m_supervisor.launch(program, argument, protocol)) {
+        m_programRunning = true;
+        m_actionCallback(AppAction::Minimize);
+    }
+}
+
+void GLBrowserApp::queueEvent(AppEvent ev, bool repeat, FrameScheduler::Time time, int count) {
+    m_idle.pause();
+    m_inputQueue.push_back({ ev, repeat, (time > 0.0) ? time : FrameScheduler::now(), std::max(1, count) });
+    m_scheduler.noteInput(m_inputQueue.back().time);
+    requestFrame();
+}
+
+void GLBrowserApp::processInput() {
+    if (m_inputQueue.empty()) { return; }
+    FrameScheduler::Time now = FrameScheduler::now();
+    // runs of relative cursor movements are merged into a single absolute
+    // one, with the same clamping at the ends as if done step by step
+    int target = -1;
+    auto flush = [&] () {
+        if (target >= 0) { m_dirView.moveCursor(target, false);  target = -1; }
+    };
+    for (const auto& q : m_inputQueue) {
+        if (q.repeat && ((now - q.time) > MaxInputLatency)) { continue; }
+        int delta = 0;
+        if (!m_menu.active()) {
+            switch (q.ev) {
+                case AppEvent::Up:       delta = -1; break;
+                case AppEvent::Down:     delta = +1; break;
+                case AppEvent::LT:
+                case AppEvent::PageUp:   delta = -m_geometry.itemsPerPage; break;
+                case AppEvent::RT:
+                case AppEvent::PageDown: delta = +m_geometry.itemsPerPage; break;
+                default: break;
+            }
+        }
+        if (delta && m_dirView.currentPanel().building()) {
+            // the panel doesn't know where it ends yet, so it has to keep
+            // track of moves beyond its last item itself
+            m_dirView.moveCursor(delta * q.count, true);
+        } else if (delta) {
+            const DirPanel& panel = m_dirView.currentPanel();
+            target = std::min(std::max(0, ((target >= 0) ? target : panel.cursor()) + delta * q.count), panel.itemCount() - 1);
+        } else {
+            // anything else acts on the item under the cursor, so that
+            // must be the one the cursor has been moved to
+            flush();
+            m_dirView.finishBuild();
+            for (int i = q.count;  i;  --i) { handleEvent(q.ev); }
+        }
+    }
+    flush();
+    m_inputQueue.clear();
 }
 
 void GLBrowserApp::handleEvent(AppEvent ev) {
@@ -269,8 +419,9 @@ void GLBrowserApp::handleEvent(AppEvent ev) {
                 case MenuItemID::AddFav:          addFav(); saveFavs(); showFavMenu(); break;
                 default:
                     if (MenuItemID::IsFileAssoc(m_menu.result())) {
-                        runProgramWrapper(GetFileAssoc(m_menu.result()).executablePath.c_str(),
-                                          m_dirView.currentItemFullPath().c_str());
+                        const FileAssociation& assoc = GetFileAssoc(m_menu.result());
+                        runProgramWrapper(assoc.executablePath.c_str(),
+                                          m_dirView.currentItemFullPath().c_str(), assoc.protocol);
                     } else if (isValidFavID(m_menu.result())) {
                         m_dirView.navigate(m_favs[MenuItemID::GetFav(m_menu.result())]);
                     }
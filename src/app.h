@@ -9,45 +9,115 @@
 
 #include "event.h"
 #include "renderer.h"
+#include "damage.h"
+#include "scheduler.h"
 #include "sysutil.h"
 #include "dirview.h"
 #include "menu.h"
+#include "perfhud.h"
+#include "workers.h"
+#include "jobs.h"
+#include "idle.h"
+#include "supervisor.h"
 
 class GLBrowserApp {
     std::function<void(AppAction action)> m_actionCallback;
     const char* m_argv0;
-    int m_framesRequested = 1;
-    ProgramHandle m_runningProgram = 0;
+    FrameScheduler m_scheduler;
+    ProcessSupervisor m_supervisor;
+    bool m_programRunning = false;
+    bool m_prefetch = true;
     bool m_haveController = false;
     TextBoxRenderer m_renderer;
     Geometry m_geometry;
     DirView m_dirView;
     ModalMenu m_menu;
+    PerfHUD m_perfHUD;
+    WorkerPool m_workers;
+    int m_drawThreads = 0;
+    JobSystem m_jobs;
+    IdleScheduler m_idle;
+    DamageTracker m_damage;
+    DamageState m_damageTitle;
+    DamageState m_damageControls;
+    TextBoxRenderer::CachedLayer m_titleLayer;
+    TextBoxRenderer::CachedLayer m_controlsLayer;
     std::string m_favFile;
     std::vector<std::string> m_favs;
+    struct QueuedEvent {
+        AppEvent ev;
+        bool repeat;
+        FrameScheduler::Time time;
+        int count;
+    };
+    std::vector<QueuedEvent> m_inputQueue;
 
     bool isValidFavID(int id);
     void loadFavs();
     void saveFavs();
     void addFav();
-    void runProgramWrapper(const char* program=nullptr, const char* argument=nullptr);
+    void runProgramWrapper(const char* program=nullptr, const char* argument=nullptr,
+                           ViewerProtocol protocol=ViewerProtocol::None);
     void itemSelected();
     void showMainMenu();
     void showOpenWithMenu();
     void showFavMenu();
+    void updateDamage(const char* title);
+    void drawTitleBar(const char* title);
+    void drawControlBar();
 
 public:
     explicit inline GLBrowserApp(std::function<void(AppAction action)> actionCallback, const char *argv0=nullptr)
         : m_actionCallback(actionCallback), m_argv0(argv0)
         , m_dirView(m_renderer, m_geometry)
-        , m_menu   (m_renderer, m_geometry) {}
+        , m_menu   (m_renderer, m_geometry)
+        , m_perfHUD(m_renderer, m_geometry) {}
 
     inline void haveController() { m_haveController = true; }
 
-    bool init(const char* initial);
+    //! number of threads used to generate the vertices of the directory
+    //! panels (0 = one per CPU core, 1 = no extra threads); call before init()
+    inline void setDrawThreads(int threads) { m_drawThreads = threads; }
+
+    //! time per frame that may be spent on building new directory panels
+    //! [s]; 0 = build them completely at once; call before init()
+    inline void setPanelBuildBudget(double seconds) { m_dirView.setBuildBudget(seconds); }
+
+    //! what to do when a program is started while another one is running
+    inline void setLaunchPolicy(ProcessSupervisor::Policy policy) { m_supervisor.setPolicy(policy); }
+
+    //! keep viewers that support it running between files; call before init()
+    inline void setResidentViewers(ProcessSupervisor::Resident mode) { m_supervisor.setResident(mode); }
+
+    //! read the programs listed in the "Open With" menu (and the file)
+    //! ahead into the page cache, so they start faster
+    inline void setPrefetch(bool enable) { m_prefetch = enable; }
+
+    //! the background job system; completions are delivered at the start
+    //! of each frame
+    inline JobSystem& jobs() { return m_jobs; }
+    //! work that is only done while the UI is idle
+    inline IdleScheduler& idleWork() { return m_idle; }
+
+    //! initialize the application; pass a software rasterizer to render
+    //! without OpenGL
+    bool init(const char* initial, SoftRasterizer* soft=nullptr);
     void shutdown();
     bool draw(double dt);
     void handleEvent(AppEvent ev);
-    inline int framesRequested() const { return m_framesRequested; }
-    inline void requestFrame(int frames=1) { if (frames > m_framesRequested) { m_framesRequested = frames; } }
+    //! queue an input event, to be handled at the start of the next frame;
+    //! consecutive cursor movements are merged into one, and automatic
+    //! repeats ('repeat' = true) that have been waiting for too long since
+    //! 'time' (0 = now) are dropped, so a slow frame doesn't make the UI
+    //! keep moving long after the key has been released; 'count' > 1 makes
+    //! a single event act like that many (for accelerated repeats)
+    void queueEvent(AppEvent ev, bool repeat=false, FrameScheduler::Time time=0.0, int count=1);
+    //! handle all queued input events right now
+    void processInput();
+    inline void invalidate() { m_damage.invalidate(); requestFrame(); }
+    inline FrameScheduler& scheduler() { return m_scheduler; }
+    inline TextBoxRenderer& renderer() { return m_renderer; }
+    inline void togglePerfHUD() { m_perfHUD.toggle(); requestFrame(); }
+    inline bool openPerfLog(const char* filename) { return m_perfHUD.openLog(filename); }
+    inline void requestFrame(int frames=1) { m_scheduler.requestFrame(frames); }
 };
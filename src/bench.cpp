@@ -0,0 +1,772 @@
+// SPDX-FileCopyrightText: 2023 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#ifndef _WIN32
+    #include <sys/types.h>
+    #include <sys/wait.h>
+    #include <unistd.h>
+#endif
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+#include "glad.h"
+
+#include "renderer.h"
+#include "damage.h"
+#include "scheduler.h"
+#include "softraster.h"
+#include "headless.h"
+#include "font_data.h"
+#include "font_codec.h"
+#include "sysutil.h"
+#include "geometry.h"
+#include "dirview.h"
+#include "supervisor.h"
+#include "jobs.h"
+#include "idle.h"
+
+#include "bench.h"
+
+constexpr int DefaultBenchFrames = 100;
+constexpr int WarmupFrames = 5;
+
+///////////////////////////////////////////////////////////////////////////////
+
+// fill-rate benchmark scenes; each returns the number of pixels it covers
+// (not counting text, where that isn't known in advance), or 0 if unknown
+
+static double sceneBoxes(TextBoxRenderer& r, int w, int h) {
+    // stacked translucent full-screen boxes: pure box fill rate
+    constexpr int layers = 8;
+    for (int i = 0;  i < layers;  ++i) {
+        r.box(0, 0, w, h, 0x20FFC080u, 0x2080C0FFu, h / 8);
+    }
+    return double(layers) * double(w) * double(h);
+}
+
+static const char* benchText = "The quick brown fox jumps over the lazy dog. 0123456789 ";
+
+static double sceneText(TextBoxRenderer& r, int w, int h) {
+    // a screen full of text: pure MSDF fill rate
+    int size = std::max(16, h / 24);
+    for (int y = 0;  y < h;  y += size) {
+        float x = 0.0f;
+        while (x < float(w)) { x = r.text(x, float(y), float(size), benchText); }
+    }
+    return 0.0;
+}
+
+static double sceneGlyphs(TextBoxRenderer& r, int w, int h) {
+    // the same as sceneText(), but from pre-converted glyph indices
+    static TextBoxRenderer::GlyphString glyphs;
+    if (glyphs.empty()) { glyphs = r.toGlyphs(benchText); }
+    int size = std::max(16, h / 24);
+    for (int y = 0;  y < h;  y += size) {
+        float x = 0.0f;
+        while (x < float(w)) { x = r.glyphText(x, float(y), float(size), glyphs); }
+    }
+    return 0.0;
+}
+
+static double sceneMixed(TextBoxRenderer& r, int w, int h) {
+    // list-like layout with a bar behind each line: worst case for
+    // pipeline splitting, since the pipeline changes with every item
+    int size = std::max(16, h / 24);
+    for (int y = 0;  y < h;  y += size) {
+        r.box(0, y, w, y + size, 0x40000000u, 0x40000000u, size / 4);
+        r.text(float(size / 4), float(y), float(size), benchText);
+    }
+    return 0.0;
+}
+
+static double sceneOutlines(TextBoxRenderer& r, int w, int h) {
+    // a column of selected-looking items and shadowed, outlined text
+    int size = std::max(16, h / 24);
+    int margin = size / 4;
+    for (int y = 0;  y < h;  y += size * 2) {
+        r.outlineBox(margin, y + margin, w / 2 - margin, y + size * 2 - margin,
+                     0xA98765, 0x876543, 0xFFFFFFFF, -std::max(1, size / 16),
+                     size / 4, std::max(1, size / 8), 0.0f, 0.125f);
+        r.outlineText(float(w / 2 + margin), float(y + size / 2), float(size), benchText, 0,
+                      0xFFFFFFFF, 0xFFFFFFFF, 0xFF000000, 0.5f, std::max(1, size / 16), 1.0f, 0.5f);
+    }
+    return 0.0;
+}
+
+typedef double (*SceneFunc)(TextBoxRenderer& r, int w, int h);
+
+// common state of the renderer benchmarks
+class RendererBench {
+    HeadlessContext m_ctx;
+    SoftRasterizer m_soft;
+    const HeadlessOptions& m_options;
+    DamageTracker m_damage;  // always full
+    int m_frames;
+    bool m_initialized = false;
+    bool m_headerPrinted = false;
+public:
+    TextBoxRenderer renderer;
+
+    inline RendererBench(const HeadlessOptions& options) : m_options(options) {
+        m_frames = (options.frames > 0) ? options.frames : DefaultBenchFrames;
+    }
+    inline ~RendererBench() { if (m_initialized) { renderer.shutdown(); }  m_soft.shutdown(); }
+
+    bool init(const char* title) {
+        if (m_options.software) {
+            if (!m_soft.init(m_options.width, m_options.height)) { return false; }
+            printf("software renderer (%d threads)\n", m_soft.threads());
+        } else {
+            if (!m_ctx.init(m_options.width, m_options.height)) { return false; }
+            printf("OpenGL renderer: %s (%s)\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+        }
+        if (!renderer.init(m_options.software ? &m_soft : nullptr)) {
+            fprintf(stderr, "FATAL: failed to initialize renderer\n");
+            return false;
+        }
+        m_initialized = true;
+        renderer.setClearColor(0.125f, 0.25f, 0.375f);
+        renderer.setTiming(true);
+        printf("%s: %dx%d, %d frames per test\n\n", title, renderer.viewportWidth(), renderer.viewportHeight(), m_frames);
+        return true;
+    }
+    inline int frames() const { return m_frames; }
+
+    //! draw a scene repeatedly and print a line of statistics
+    void run(const char* scene, const char* variant, SceneFunc draw) {
+        if (!m_headerPrinted) {
+            printf("scene    variant      ms/frame   GPU ms  quads  draws    Mpix/s\n");
+            m_headerPrinted = true;
+        }
+        int w = renderer.viewportWidth(), h = renderer.viewportHeight();
+        double pixels = 0.0, gpuTime = 0.0;
+        int gpuFrames = 0;
+        FrameScheduler::Time t0 = 0.0;
+        for (int frame = -WarmupFrames;  frame < m_frames;  ++frame) {
+            if (!frame) { t0 = FrameScheduler::now(); }
+            renderer.beginFrame(m_damage);
+            if ((frame >= 0) && (renderer.frameStats().gpuTime >= 0.0)) {
+                gpuTime += renderer.frameStats().gpuTime;
+                ++gpuFrames;
+            }
+            pixels = draw(renderer, w, h);
+            renderer.endFrame();  // includes a glFinish()
+        }
+        double ms = (FrameScheduler::now() - t0) * 1000.0 / double(m_frames);
+        const auto& stats = renderer.frameStats();
+        printf("%-8s %-12s %8.2f ", scene, variant, ms);
+        if (gpuFrames) { printf("%8.2f ", gpuTime / double(gpuFrames)); }
+        else           { printf("     n/a "); }
+        printf("%6d %6d ", stats.quads, stats.drawCalls);
+        if (pixels > 0.0) { printf("%9.1f\n", pixels / (ms * 1000.0)); }
+        else              { printf("      n/a\n"); }
+    }
+};
+
+static int benchFill(const HeadlessOptions& options) {
+    RendererBench bench(options);
+    if (!bench.init("fill-rate benchmark")) { return 1; }
+    static const struct Scene {
+        const char* name;
+        SceneFunc draw;
+    } scenes[] = {
+        { "boxes", sceneBoxes },
+        { "text",  sceneText  },
+        { "glyphs", sceneGlyphs },
+        { "mixed", sceneMixed },
+        { nullptr, nullptr }
+    };
+    for (const Scene* scene = scenes;  scene->name;  ++scene) {
+        bench.renderer.setUberShader(false);
+        bench.run(scene->name, "specialized", scene->draw);
+        if (options.software) { continue; }
+        bench.renderer.setUberShader(true);
+        bench.run(scene->name, "uber", scene->draw);
+    }
+    return 0;
+}
+
+static int benchOutline(const HeadlessOptions& options) {
+    RendererBench bench(options);
+    if (!bench.init("outline benchmark")) { return 1; }
+    bench.renderer.setCompositeOutlines(true);
+    bench.run("outlines", "single-pass", sceneOutlines);
+    bench.renderer.setCompositeOutlines(false);
+    bench.run("outlines", "multi-pass", sceneOutlines);
+    return 0;
+}
+
+static int countCodepoints(const char* text) {
+    int n = 0;
+    for (;  *text;  ++text) { if ((uint8_t(*text) & 0xC0u) != 0x80u) { ++n; } }
+    return n;
+}
+
+static int benchTextGen(const HeadlessOptions& options) {
+    // CPU cost of turning strings into quads (or glyph instances), without
+    // drawing anything: a screen full of text is recorded into a staging buffer
+    RendererBench bench(options);
+    if (!bench.init("text generation benchmark")) { return 1; }
+    TextBoxRenderer& r = bench.renderer;
+    static const struct Sample {
+        const char* name;
+        const char* text;
+    } samples[] = {
+        { "ascii", benchText },
+        { "utf-8", "Gr\xC3\xB6\xC3\x9F" "enordnung: 5 \xE2\x82\xAC f\xC3\xBC" "r na\xC3\xAF" "ve Caf\xC3\xA9s \xE2\x80\x93 " },
+        { nullptr, nullptr }
+    };
+    int w = r.viewportWidth(), h = r.viewportHeight();
+    int size = std::max(16, h / 24);
+    TextBoxRenderer::Recording staging;
+    static const char* variants[] = { "simd", "scalar", "glyph-index" };
+    printf("text     variant      ms/frame  glyphs  Mglyphs/s  bytes/glyph\n");
+    for (const Sample* sample = samples;  sample->name;  ++sample) {
+        int perString = countCodepoints(sample->text);
+        TextBoxRenderer::GlyphString glyphString = r.toGlyphs(sample->text);
+        for (int variant = 0;  variant < 3;  ++variant) {
+            if ((variant == 2) && !r.gpuGlyphs()) { continue; }
+            r.setSIMDText(variant == 0);
+            int glyphs = 0;
+            FrameScheduler::Time t0 = 0.0;
+            for (int frame = -WarmupFrames;  frame < bench.frames();  ++frame) {
+                if (!frame) { t0 = FrameScheduler::now(); }
+                glyphs = 0;
+                r.beginRecording(staging);
+                for (int y = 0;  y < h;  y += size) {
+                    float x = 0.0f;
+                    while (x < float(w)) {
+                        x = (variant == 2) ? r.glyphText(x, float(y), float(size), glyphString)
+                                           : r.text(x, float(y), float(size), sample->text);
+                        glyphs += perString;
+                    }
+                }
+                r.endRecording();
+            }
+            double ms = (FrameScheduler::now() - t0) * 1000.0 / double(bench.frames());
+            size_t bytes = staging.vertices.size() * sizeof(TextBoxRenderer::Vertex) + staging.glyphs.size() * sizeof(TextBoxRenderer::GlyphInstance);
+            printf("%-8s %-12s %8.3f %7d %10.2f %12.1f\n", sample->name, variants[variant], ms, glyphs, double(glyphs) / (ms * 1000.0), double(bytes) / double(glyphs));
+        }
+    }
+    r.setSIMDText(true);
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// the font texture format that was used before font_codec.cpp: the clamped
+// gradient predictor in raster order over the interleaved RGB image (with
+// zeros above the image, and the previous row's last pixel left of it),
+// and the zero-run coded residuals of each channel, one after another
+
+static void encodeLegacyFont(const uint8_t* img, int width, int height, std::vector<uint8_t>& out) {
+    const int stride = width * 3, size = stride * height;
+    std::vector<uint8_t> res(size);
+    for (int pos = 0;  pos < size;  ++pos) {
+        int w  = (pos >= 3)              ? img[pos - 3]          : 0;
+        int n  = (pos >= stride)         ? img[pos - stride]     : 0;
+        int nw = (pos >= (stride + 3))   ? img[pos - stride - 3] : 0;
+        int p = n + w - nw;
+        p = std::max(p, std::min(std::min(n, w), nw));
+        p = std::min(p, std::max(std::max(n, w), nw));
+        res[pos] = uint8_t(img[pos] - p);
+    }
+    out.clear();
+    for (int c = 0;  c < 3;  ++c) {
+        const int end = size / 3;
+        const uint8_t term = res[size - 3 + c] ? 0 : 1;  // terminator after the last residual
+        auto at = [&] (int i) -> uint8_t { return (i < end) ? res[i * 3 + c] : term; };
+        int pos = 0;
+        while (pos < end) {
+            int length = 0;
+            while (!at(pos + length) && (length < 255)) { ++length; }
+            out.push_back(uint8_t(length));
+            pos += length;
+            if (pos >= end) { break; }
+            // literal run (single zero bytes are accepted in it)
+            length = 0;
+            while ((at(pos + length) && (length < 255)) || (at(pos + length + 1) && (length < 254))) { ++length; }
+            out.push_back(uint8_t(length));
+            for (int i = 0;  i < length;  ++i) { out.push_back(at(pos + i)); }
+            pos += length;
+        }
+    }
+}
+
+static uint8_t* decodeLegacyFont(const uint8_t* data, int width, int height) {
+    int texStride = width * 3;
+    int texSize = height * texStride;
+    int texOffset = texStride + 16;
+    uint8_t* texBuffer = static_cast<uint8_t*>(::calloc(texSize + texOffset, 1));
+    if (!texBuffer) { return nullptr; }
+    uint8_t* texImg = &texBuffer[texOffset];
+    for (int c = 0;  c < 3;  ++c) {
+        int texPos = c;
+        while (texPos < texSize) {
+            int length = *data++;
+            texPos += length * 3;
+            if (texPos >= texSize) { break; }
+            length = *data++;
+            while ((length--) && (texPos < texSize)) {
+                texImg[texPos] = *data++;
+                texPos += 3;
+            }
+        }
+    }
+    for (int texPos = 0;  texPos < texSize;  ++texPos) {
+        int w  = texImg[texPos - 3];
+        int n  = texImg[texPos - texStride];
+        int nw = texImg[texPos - texStride - 3];
+        int p = n + w - nw;
+        p = std::max(p, std::min(std::min(n, w), nw));
+        p = std::min(p, std::max(std::max(n, w), nw));
+        texImg[texPos] += uint8_t(p);
+    }
+    return texBuffer;
+}
+
+static int benchFont(const HeadlessOptions& options) {
+    // startup cost of decoding the baked font's texture, including the
+    // allocation of the image (as in TextBoxRenderer::loadFontTexture());
+    // the legacy data is generated from the decoded texture
+    const int width = FontData::TexWidth, height = FontData::TexHeight;
+    const size_t imageSize = size_t(width) * size_t(height) * 3u;
+    std::vector<uint8_t> ref(imageSize);
+    if (!DecodeFontTexture(ref.data())) {
+        fprintf(stderr, "FATAL: failed to decode font texture\n");
+        return 1;
+    }
+    std::vector<uint8_t> legacy;
+    encodeLegacyFont(ref.data(), width, height, legacy);
+    const int frames = (options.frames > 0) ? options.frames : DefaultBenchFrames;
+    printf("font texture decoding benchmark: %dx%d, %d runs per test\n\n", width, height, frames);
+    static const char* names[][2] = { { "legacy", "scalar" }, { "current", "simd" }, { "current", "scalar" } };
+    printf("format   variant      ms/decode  data bytes  MB/s (image)  result\n");
+    for (int variant = 0;  variant < 3;  ++variant) {
+        bool ok = true;
+        FrameScheduler::Time t0 = 0.0;
+        for (int run = -WarmupFrames;  run < frames;  ++run) {
+            if (!run) { t0 = FrameScheduler::now(); }
+            if (!variant) {
+                uint8_t* buffer = decodeLegacyFont(legacy.data(), width, height);
+                ok = ok && buffer && !memcmp(&buffer[width * 3 + 16], ref.data(), imageSize);
+                ::free(buffer);
+            } else {
+                uint8_t* img = static_cast<uint8_t*>(::malloc(imageSize));
+                ok = ok && img && DecodeFontTexture(img, variant == 1) && !memcmp(img, ref.data(), imageSize);
+                ::free(img);
+            }
+        }
+        double ms = (FrameScheduler::now() - t0) * 1000.0 / double(frames);
+        size_t bytes = variant ? (size_t(FontData::TexDataSize) * sizeof(uint16_t) + 512u * sizeof(uint16_t)) : legacy.size();
+        printf("%-8s %-12s %9.3f %11d %13.1f  %s\n", names[variant][0], names[variant][1], ms, int(bytes), double(imageSize) / (ms * 1000.0), ok ? "ok" : "MISMATCH");
+    }
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+constexpr int DefaultBuildRuns = 5;
+
+static int benchBuild(const HeadlessOptions& options) {
+    // how long opening a large directory blocks the UI thread: the call
+    // that opens it (including reading the directory, which is also timed
+    // on its own), and each of the frames that complete the panel, with all
+    // of it done at once vs. within the default per-frame budget, and with
+    // the directory read on the UI thread vs. by a background job (during
+    // which no frames are needed); only the layout work is timed, nothing
+    // is drawn
+    RendererBench bench(options);
+    if (!bench.init("panel construction benchmark")) { return 1; }
+    std::string path = options.initialPath ? options.initialPath : GetCurrentDir();
+    int runs = (options.frames > 0) ? options.frames : DefaultBuildRuns;
+    Geometry geometry;
+    geometry.update(bench.renderer.viewportWidth(), bench.renderer.viewportHeight());
+    geometry.setTimeDelta(1.0f / 60.0f);
+
+    int items = 0;
+    FrameScheduler::Time t0 = FrameScheduler::now();
+    for (int run = 0;  run < runs;  ++run) {
+        items = 0;
+        ScanDirectory(path.c_str(), [&] (const char*, bool, bool) { ++items; });
+    }
+    printf("%s: %d items, reading the directory takes %.3f ms\n\n", path.c_str(), items, (FrameScheduler::now() - t0) * 1000.0 / double(runs));
+
+    JobSystem jobs;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool notified = false;
+    jobs.init(0, [&] () { std::unique_lock<std::mutex> lock(mutex);  notified = true;  wakeup.notify_all(); });
+
+    printf("%-9s  %-10s %9s %7s %13s %9s\n", "budget ms", "read in", "open ms", "frames", "max frame ms", "total ms");
+    static const double budgets[] = { 0.0, -1.0, -1.0 };
+    for (int variant = 0;  variant < 3;  ++variant) {
+        const double budget = budgets[variant];
+        const bool background = (variant == 2);
+        DirView view(bench.renderer, geometry);
+        if (budget >= 0.0) { view.setBuildBudget(budget); }
+        if (background) { view.setJobSystem(&jobs); }
+        double openTotal = 0.0, maxFrame = 0.0, total = 0.0;
+        int frames = 0;
+        for (int run = -1;  run < runs;  ++run) {
+            FrameScheduler::Time start = FrameScheduler::now();
+            view.navigate(path);
+            FrameScheduler::Time t = FrameScheduler::now();
+            double open = t - start, frameMax = 0.0;
+            int n = 0;
+            while (view.currentPanel().building()) {
+                if (view.currentPanel().scanning()) {
+                    // sleep until the job has completed, like the event loop
+                    std::unique_lock<std::mutex> lock(mutex);
+                    wakeup.wait_for(lock, std::chrono::milliseconds(100), [&] { return notified; });
+                    notified = false;
+                }
+                jobs.deliver();
+                if (view.currentPanel().scanning()) { continue; }
+                FrameScheduler::Time f0 = FrameScheduler::now();
+                view.animate();
+                frameMax = std::max(frameMax, FrameScheduler::now() - f0);
+                ++n;
+            }
+            if (run < 0) { continue; }  // warm-up run
+            openTotal += open;
+            maxFrame = std::max(maxFrame, frameMax);
+            total += FrameScheduler::now() - start;
+            frames += n;
+        }
+        char label[16];
+        if (budget >= 0.0) { snprintf(label, sizeof(label), "%.0f (all)", budget * 1000.0); }
+        else               { snprintf(label, sizeof(label), "default"); }
+        printf("%-9s  %-10s %9.3f %7.1f %13.3f %9.3f\n", label, background ? "background" : "UI thread", openTotal * 1000.0 / double(runs), double(frames) / double(runs), maxFrame * 1000.0, total * 1000.0 / double(runs));
+        view.releaseResources();
+    }
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+constexpr int BacklogJobsPerThread = 20;
+constexpr double BacklogJobTime = 0.0005;  // seconds
+
+static int benchJobs(const HeadlessOptions& options) {
+    // time from submitting a job until it starts on a worker thread, and
+    // until its completion callback has run on the calling thread (which
+    // sleeps until it's notified, like the event loop), with idle workers
+    // and with a backlog of busy low-priority jobs for every worker, which
+    // is cancelled right away in the last test
+    const int runs = (options.frames > 0) ? options.frames : DefaultBenchFrames;
+    JobSystem jobs;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool notified = false;
+    jobs.init(0, [&] () { std::unique_lock<std::mutex> lock(mutex);  notified = true;  wakeup.notify_all(); });
+    auto waitDelivered = [&] (const bool& flag) {
+        while (!flag) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeup.wait_for(lock, std::chrono::milliseconds(100), [&] { return notified; });
+                notified = false;
+            }
+            jobs.deliver();
+        }
+    };
+    auto spin = [] () {
+        FrameScheduler::Time end = FrameScheduler::now() + BacklogJobTime;
+        while (FrameScheduler::now() < end) {}
+    };
+    printf("job system scheduling latency benchmark: %d worker threads, %d runs per test\n", jobs.threads(), runs);
+    printf("backlog: %d jobs of %.1f ms per thread\n\n", BacklogJobsPerThread, BacklogJobTime * 1000.0);
+    static const struct Scenario {
+        const char* name;
+        bool backlog;
+        JobPriority priority;
+        bool cancel;
+    } scenarios[] = {
+        { "idle",                false, JobPriority::Visible, false },
+        { "backlog, same class", true,  JobPriority::Index,   false },
+        { "backlog, visible",    true,  JobPriority::Visible, false },
+        { "backlog, cancelled",  true,  JobPriority::Index,   true  },
+    };
+    printf("scenario             start ms  max ms   done ms  max ms\n");
+    for (const auto& sc : scenarios) {
+        double startTotal = 0.0, startMax = 0.0, doneTotal = 0.0, doneMax = 0.0;
+        for (int run = -WarmupFrames;  run < runs;  ++run) {
+            CancelToken backlogToken;
+            if (sc.backlog) {
+                for (int i = BacklogJobsPerThread * jobs.threads();  i;  --i) {
+                    jobs.submit(JobPriority::Index, backlogToken, spin);
+                }
+            }
+            if (sc.cancel) { backlogToken.cancel(); }
+            std::atomic<double> started(0.0);
+            FrameScheduler::Time finished = 0.0;
+            bool done = false;
+            FrameScheduler::Time t0 = FrameScheduler::now();
+            jobs.submit(sc.priority, CancelToken(),
+                [&] () { started.store(FrameScheduler::now()); },
+                [&] () { finished = FrameScheduler::now();  done = true; });
+            waitDelivered(done);
+
+            // let the backlog drain before the next run
+            bool drained = false;
+            jobs.submit(JobPriority::Index, CancelToken(), nullptr, [&] () { drained = true; });
+            waitDelivered(drained);
+            if (sc.backlog) { spin(); }
+
+            if (run < 0) { continue; }
+            double ts = started.load() - t0, td = finished - t0;
+            startTotal += ts;  startMax = std::max(startMax, ts);
+            doneTotal  += td;  doneMax  = std::max(doneMax,  td);
+        }
+        double scale = 1000.0 / double(runs);
+        printf("%-20s %9.3f %7.3f %9.3f %7.3f\n", sc.name, startTotal * scale, startMax * 1000.0, doneTotal * scale, doneMax * 1000.0);
+    }
+    return 0;
+}
+
+constexpr double IdleBenchDelay = 0.02;      // seconds until the UI counts as idle
+constexpr double IdleBenchInterval = 0.05;   // seconds between input events
+constexpr double IdleBenchFrameTime = 0.002; // CPU time of a frame
+
+static int benchIdle(const HeadlessOptions& options) {
+    // time from an input event until the frame that handles it is done,
+    // with the same main loop as the application (which sleeps until input,
+    // a wakeup or a deadline arrives) and a fixed amount of CPU work per
+    // frame, while the job system is busy with CPU-bound background work:
+    // none at all, plain low-priority jobs, or slices of an idle task
+    const int runs = (options.frames > 0) ? options.frames : DefaultBenchFrames;
+    auto spin = [] (double seconds) {
+        FrameScheduler::Time end = FrameScheduler::now() + seconds;
+        while (FrameScheduler::now() < end) {}
+    };
+    printf("idle-time scheduling benchmark: %d runs per test, %.0f ms between inputs, %.0f ms per frame\n\n",
+           runs, IdleBenchInterval * 1000.0, IdleBenchFrameTime * 1000.0);
+    printf("background work    latency ms  95%% ms  max ms   slices  busy %%\n");
+    static const char* variants[] = { "none", "plain jobs", "idle scheduler" };
+    for (int variant = 0;  variant < 3;  ++variant) {
+        JobSystem jobs;
+        std::mutex mutex;
+        std::condition_variable wakeup;
+        bool notified = false;
+        jobs.init(0, [&] () { std::unique_lock<std::mutex> lock(mutex);  notified = true;  wakeup.notify_all(); });
+        FrameScheduler scheduler;
+        scheduler.setIdleDelay(IdleBenchDelay);
+        IdleScheduler idle;
+        idle.setJobSystem(&jobs);
+        CancelToken token;
+        std::function<void()> plainJob;
+        if (variant == 1) {
+            plainJob = [&] () {
+                spin(0.001);
+                jobs.submit(JobPriority::Index, token, plainJob);
+            };
+            for (int i = 0;  i < jobs.threads();  ++i) { jobs.submit(JobPriority::Index, token, plainJob); }
+        } else if (variant == 2) {
+            idle.add(token, [] (const IdleScheduler::YieldFunc& yield) {
+                while (!yield()) {}
+                return true;
+            });
+        }
+
+        std::vector<double> latencies;
+        FrameScheduler::Time start = FrameScheduler::now();
+        for (int run = -WarmupFrames;  run < runs;  ++run) {
+            // the main loop, until it's time for the next input event
+            FrameScheduler::Time nextInput = FrameScheduler::now() + IdleBenchInterval;
+            for (;;) {
+                FrameScheduler::Time t = FrameScheduler::now();
+                if (t >= nextInput) { break; }
+                scheduler.addDeadline(nextInput);
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    wakeup.wait_for(lock, std::chrono::microseconds(int64_t(std::max(0, scheduler.waitTimeout())) * 1000),
+                                    [&] { return notified; });
+                    notified = false;
+                }
+                scheduler.requestFrame();
+                scheduler.beginFrame();
+                idle.update(scheduler.idle());
+                jobs.deliver();
+                if (idle.waiting()) { scheduler.addDeadline(scheduler.idleStart()); }
+                scheduler.endFrame();
+            }
+
+            // an input event arrives, and the next frame handles it
+            FrameScheduler::Time t0 = FrameScheduler::now();
+            idle.pause();
+            scheduler.noteInput(t0);
+            scheduler.requestFrame();
+            scheduler.beginFrame();
+            idle.update(scheduler.idle());
+            jobs.deliver();
+            if (idle.waiting()) { scheduler.addDeadline(scheduler.idleStart()); }
+            spin(IdleBenchFrameTime);
+            scheduler.endFrame();
+            if (run >= 0) { latencies.push_back(FrameScheduler::now() - t0); }
+        }
+        double total = FrameScheduler::now() - start;
+        token.cancel();
+        jobs.shutdown();
+
+        std::sort(latencies.begin(), latencies.end());
+        double sum = 0.0;
+        for (double l : latencies) { sum += l; }
+        printf("%-16s %12.3f %7.3f %7.3f ", variants[variant], sum * 1000.0 / double(runs),
+               latencies[(runs * 95) / 100] * 1000.0, latencies.back() * 1000.0);
+        if (variant == 2) { printf("%8llu %7.1f\n", (unsigned long long) idle.stats().slices, idle.stats().busyTime * 100.0 / total); }
+        else              { printf("     n/a     n/a\n"); }
+    }
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _WIN32
+
+// how RunProgram() used to start programs
+static pid_t launchWithFork(const char* program) {
+    pid_t pid = fork();
+    if (!pid) {
+        char * const argv[2] = { const_cast<char*>(program), nullptr };
+        execv(program, argv);
+        _exit(0xBE);
+    }
+    return pid;
+}
+
+static int benchLaunch(const HeadlessOptions& options) {
+    // time that the launch call blocks the caller, and total time until
+    // the (trivial) program has run and exited; the renderer is set up
+    // first, so the process has the same kind of address space (GL driver
+    // and all) that fork() has to duplicate
+    RendererBench bench(options);
+    if (!bench.init("program launch benchmark")) { return 1; }
+    std::string program = FindProgram("true");
+    if (program.empty()) {
+        fprintf(stderr, "FATAL: 'true' program not found\n");
+        return 1;
+    }
+    printf("method        call ms  max ms   exit ms  max ms\n");
+    static const char* variants[] = { "fork", "posix_spawn" };
+    for (int variant = 0;  variant < 2;  ++variant) {
+        double callTotal = 0.0, callMax = 0.0, exitTotal = 0.0, exitMax = 0.0;
+        for (int run = -WarmupFrames;  run < bench.frames();  ++run) {
+            FrameScheduler::Time t0 = FrameScheduler::now();
+            pid_t pid = variant ? pid_t(RunProgram(program.c_str())) : launchWithFork(program.c_str());
+            FrameScheduler::Time t1 = FrameScheduler::now();
+            if (pid <= 0) {
+                fprintf(stderr, "FATAL: failed to start '%s'\n", program.c_str());
+                return 1;
+            }
+            waitpid(pid, nullptr, 0);
+            FrameScheduler::Time t2 = FrameScheduler::now();
+            if (run < 0) { continue; }
+            callTotal += t1 - t0;  callMax = std::max(callMax, t1 - t0);
+            exitTotal += t2 - t0;  exitMax = std::max(exitMax, t2 - t0);
+        }
+        double scale = 1000.0 / double(bench.frames());
+        printf("%-12s %8.3f %7.3f %9.3f %7.3f\n", variants[variant], callTotal * scale, callMax * 1000.0, exitTotal * scale, exitMax * 1000.0);
+    }
+    return 0;
+}
+
+static int benchViewer(const HeadlessOptions& options) {
+    // time from opening a file until the viewer reports that it's visible,
+    // with a new viewer process for every file vs. a resident viewer; uses
+    // the stub viewer (or the one given as the path argument), which
+    // simulates the startup cost of a real viewer
+    std::string viewer = options.initialPath ? options.initialPath : FindProgram("glbrowser-stub-viewer");
+    if (viewer.empty() && IsExecutable("tools/stub_viewer.py")) { viewer = "tools/stub_viewer.py"; }
+    if (viewer.empty()) {
+        fprintf(stderr, "FATAL: stub viewer not found; run from the source directory or pass its path\n");
+        return 1;
+    }
+    setenv("STUB_VIEWER_VIEW_TIME", "0", 1);  // report "done" right after the first frame
+    const int runs = (options.frames > 0) ? options.frames : 20;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    auto waitUntil = [&] (std::function<bool()> cond) -> bool {
+        FrameScheduler::Time timeout = FrameScheduler::now() + 10.0;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!cond()) {
+            if (FrameScheduler::now() > timeout) { return false; }
+            wakeup.wait_for(lock, std::chrono::milliseconds(5));
+        }
+        return true;
+    };
+    printf("method        first frame ms  max ms\n");
+    static const char* variants[] = { "cold start", "resident" };
+    for (int variant = 0;  variant < 2;  ++variant) {
+        ProcessSupervisor supervisor;
+        supervisor.setResident(ProcessSupervisor::Resident::OnDemand);
+        double total = 0.0, maxTime = 0.0;
+        for (int run = -WarmupFrames;  run < runs;  ++run) {
+            if (!variant || (run == -WarmupFrames)) {
+                // restarting the supervisor makes the viewer quit
+                supervisor.init([&] () { std::unique_lock<std::mutex> lock(mutex);  wakeup.notify_all(); });
+            }
+            uint32_t shown = supervisor.framesShown();
+            FrameScheduler::Time t0 = FrameScheduler::now();
+            if (!supervisor.launch(viewer.c_str(), viewer.c_str(), ViewerProtocol::Line)
+            ||  !waitUntil([&] () { return supervisor.framesShown() != shown; })) {
+                fprintf(stderr, "FATAL: viewer '%s' didn't show the file\n", viewer.c_str());
+                return 1;
+            }
+            FrameScheduler::Time t1 = FrameScheduler::now();
+            if (!waitUntil([&] () { return !supervisor.update(); })) {
+                fprintf(stderr, "FATAL: viewer '%s' didn't finish\n", viewer.c_str());
+                return 1;
+            }
+            if (run < 0) { continue; }
+            total += t1 - t0;  maxTime = std::max(maxTime, t1 - t0);
+        }
+        printf("%-12s %15.3f %7.3f\n", variants[variant], total * 1000.0 / double(runs), maxTime * 1000.0);
+    }
+    return 0;
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+
+static const struct Benchmark {
+    const char* name;
+    const char* description;
+    int (*run)(const HeadlessOptions& options);
+} benchmarks[] = {
+    { "fill",    "renderer fill rate, specialized pipelines vs. uber-shader", benchFill },
+    { "outline", "outlined and shadowed boxes and text, single-pass vs. multi-pass", benchOutline },
+    { "textgen", "text quad generation rate (CPU only), SIMD vs. scalar vs. glyph instances", benchTextGen },
+    { "font",    "font texture decoding time and data size, current vs. legacy format", benchFont },
+    { "build",   "time the UI thread is blocked when opening a large directory, at once vs. per-frame budget", benchBuild },
+    { "jobs",    "background job scheduling latency, idle vs. loaded vs. cancelled", benchJobs },
+    { "idle",    "input-to-frame latency under background load, plain jobs vs. idle-time slices", benchIdle },
+#ifndef _WIN32
+    { "launch",  "program start latency, posix_spawn vs. fork", benchLaunch },
+    { "viewer",  "time to first frame when opening a file, cold start vs. resident viewer", benchViewer },
+#endif
+    { nullptr, nullptr, nullptr }
+};
+
+int RunBenchmark(const char* name, const HeadlessOptions& options) {
+    for (const Benchmark* b = benchmarks;  b->name;  ++b) {
+        if (!strcmp(b->name, name)) { return b->run(options); }
+    }
+    fprintf(stderr, "FATAL: unknown benchmark '%s'; available benchmarks:\n", name);
+    for (const Benchmark* b = benchmarks;  b->name;  ++b) {
+        fprintf(stderr, "  %-8s %s\n", b->name, b->description);
+    }
+    return 2;
+}
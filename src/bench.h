@@ -0,0 +1,11 @@
+// SPDX-FileCopyrightText: 2023 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include "headless.h"
+
+//! run a named micro-benchmark (see bench.cpp for the list) off-screen,
+//! using the headless mode's resolution, frame count and renderer choice;
+//! returns the process exit code
+int RunBenchmark(const char* name, const HeadlessOptions& options);
@@ -0,0 +1,64 @@
+// SPDX-FileCopyrightText: 2023 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#include <cstdint>
+
+#include <vector>
+#include <algorithm>
+
+#include "damage.h"
+
+uint32_t DamageKey(uint32_t key, const char* str) {
+    if (!str) { return DamageKey(key, 0u); }
+    while (*str) { key = DamageKey(key, uint32_t(uint8_t(*str++))); }
+    return DamageKey(key, 0xFFu);  // terminator, so that "ab"+"c" != "a"+"bc"
+}
+
+void DamageTracker::add(const Rect& rect) {
+    if (m_full) { return; }
+    Rect r(std::max(rect.x0, 0), std::max(rect.y0, 0), std::min(rect.x1, m_width), std::min(rect.y1, m_height));
+    if (r.empty()) { return; }
+
+    // merge with all existing rectangles the new one touches; since the
+    // merged rectangle may now touch others, repeat until nothing changes
+    bool merged;
+    do {
+        merged = false;
+        for (auto it = m_rects.begin();  it != m_rects.end();  ++it) {
+            if (it->touches(r)) {
+                r.unite(*it);
+                m_rects.erase(it);
+                merged = true;
+                break;
+            }
+        }
+    } while (merged);
+
+    if (int(m_rects.size()) >= MaxRects) {
+        // too fragmented -> just use a single bounding rectangle
+        for (const auto& other : m_rects) { r.unite(other); }
+        m_rects.clear();
+    }
+    m_rects.push_back(r);
+}
+
+void DamageTracker::update(DamageState& state, const Rect& rect, uint32_t key) {
+    if (rect.empty()) {
+        if (state.valid) { add(state.rect); }
+        state.valid = false;
+        return;
+    }
+    if (state.valid && (state.key == key) && (state.rect == rect)) { return; }
+    if (state.valid) { add(state.rect); }
+    add(rect);
+    state.valid = true;
+    state.rect = rect;
+    state.key = key;
+}
+
+Rect DamageTracker::bounds() const {
+    if (m_full) { return Rect(0, 0, m_width, m_height); }
+    Rect r;
+    for (const auto& rect : m_rects) { r.unite(rect); }
+    return r;
+}
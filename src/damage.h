@@ -0,0 +1,79 @@
+// SPDX-FileCopyrightText: 2023 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstdint>
+
+#include <vector>
+#include <algorithm>
+
+//! integer screen rectangle; x1/y1 are exclusive
+struct Rect {
+    int x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+    inline Rect() {}
+    inline Rect(int x0_, int y0_, int x1_, int y1_) : x0(x0_), y0(y0_), x1(x1_), y1(y1_) {}
+    inline bool empty() const { return (x1 <= x0) || (y1 <= y0); }
+    inline bool touches(const Rect& r) const
+        { return (r.x0 <= x1) && (x0 <= r.x1) && (r.y0 <= y1) && (y0 <= r.y1); }
+    inline bool intersects(float fx0, float fy0, float fx1, float fy1) const
+        { return (fx0 < float(x1)) && (float(x0) < fx1) && (fy0 < float(y1)) && (float(y0) < fy1); }
+    inline void unite(const Rect& r) {
+        if (r.empty()) { return; }
+        if (empty()) { *this = r; return; }
+        x0 = std::min(x0, r.x0);  y0 = std::min(y0, r.y0);
+        x1 = std::max(x1, r.x1);  y1 = std::max(y1, r.y1);
+    }
+    inline bool operator== (const Rect& r) const
+        { return (x0 == r.x0) && (y0 == r.y0) && (x1 == r.x1) && (y1 == r.y1); }
+    inline bool operator!= (const Rect& r) const { return !(*this == r); }
+};
+
+//! what a widget (or a part thereof) looked like in the previous frame
+struct DamageState {
+    bool valid = false;
+    Rect rect;
+    uint32_t key = 0u;
+};
+
+//! helpers to compute compact state keys
+inline uint32_t DamageKey(uint32_t key, uint32_t value)
+    { return (key ^ value) * 16777619u; }
+inline uint32_t DamageKey(uint32_t key, int value)
+    { return DamageKey(key, uint32_t(value)); }
+inline uint32_t DamageKey(uint32_t key, bool value)
+    { return DamageKey(key, value ? 1u : 0u); }
+uint32_t DamageKey(uint32_t key, const char* str);
+constexpr uint32_t DamageKeyInit = 2166136261u;
+
+//! collects the screen regions that need to be redrawn in the next frame
+class DamageTracker {
+    int m_width = 0;
+    int m_height = 0;
+    bool m_full = true;
+    std::vector<Rect> m_rects;
+
+public:
+    static constexpr int MaxRects = 8;  //!< more than that will be merged into one
+
+    inline void setScreenSize(int width, int height)
+        { m_width = width;  m_height = height;  invalidate(); }
+
+    //! start a new frame with no damage at all
+    inline void reset()      { m_full = false;  m_rects.clear(); }
+    //! mark the whole screen as damaged
+    inline void invalidate() { m_full = true;   m_rects.clear(); }
+
+    //! add a damaged rectangle (clipped to the screen)
+    void add(const Rect& rect);
+
+    //! compare a widget's state with what was drawn in the last frame;
+    //! if anything changed, damage both the old and the new area
+    //! (an empty rect means "not visible")
+    void update(DamageState& state, const Rect& rect, uint32_t key);
+
+    inline bool full()  const { return m_full; }
+    inline bool empty() const { return !m_full && m_rects.empty(); }
+    inline const std::vector<Rect>& rects() const { return m_rects; }
+    Rect bounds() const;
+};
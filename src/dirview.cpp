@@ -11,9 +11,14 @@
 #include <algorithm>
 
 #include "renderer.h"
+#include "damage.h"
+#include "scheduler.h"
 #include "sysutil.h"
 #include "dirview.h"
 
+constexpr int BuildChunk = 256;  // items processed between checks of the time budget
+constexpr int HeapChunk = 32;    // items taken out of the heap between checks of the time budget
+
 ///////////////////////////////////////////////////////////////////////////////
 
 bool DirItem::operator< (const DirItem& other) const {
@@ -51,48 +56,219 @@ bool DirItem::operator== (const std::string& other) const {
 
 ///////////////////////////////////////////////////////////////////////////////
 
+static void ReadDirectory(const std::string& path, std::vector<DirItem>& items) {
+    ScanDirectory(path.c_str(), [&] (const char* name, bool isDir, bool isExec) {
+        items.push_back(DirItem(name, isDir, isExec));
+    });
+}
+
 DirPanel::DirPanel(DirView& parent, const std::string& path, int x0, bool active, const std::string& preselect)
-    : m_parent(parent), m_geometry(parent.m_geometry), m_path(path), m_active(active), m_cursor(0), m_x0(x0)
+    : m_parent(parent), m_geometry(parent.m_geometry), m_path(path), m_active(active), m_cursor(0), m_x0(x0), m_width(0)
 {
     bool isSubdir = !IsRoot(path);
     if (isSubdir) {
         m_items.push_back(DirItem("", true, false, "\xE2\x97\x84 back"));
     }
-    ScanDirectory(path.c_str(), [&] (const char* name, bool isDir, bool isExec) {
-        m_items.push_back(DirItem(name, isDir, isExec));
-    });
-    std::sort(m_items.begin() + (isSubdir ? 1 : 0), m_items.end());
+    m_build.reset(new Build);
+    Build& b = *m_build;
+    b.preselect = preselect;
 
-    float w = 0.0f;
-    for (const auto& item : m_items) {
-        w = std::max(w, m_parent.m_renderer.textWidth(item.displayText().c_str()));
+    m_y0 = m_geometry.dirViewY0;
+    m_animY0      = AnimValue(float(m_y0));
+    m_animActive  = AnimValue(m_active ? 1.0f : 0.0f);
+    m_animCursorY = AnimValue(0.0f);
+
+    // reading the directory can take a while (or even block, e.g. on
+    // network file systems), so it's done by a job; the panel shows just
+    // the "back" item until that has completed, and the job is cancelled
+    // with everything else if the panel is closed before
+    double budget = m_parent.m_buildBudget;
+    bool incremental = isSubdir && (budget > 0.0);
+    b.scan = std::make_shared<Scan>();
+    if (incremental && m_parent.m_jobs) {
+        std::shared_ptr<Scan> scan = b.scan;
+        m_parent.m_jobs->submit(JobPriority::Visible, m_jobToken,
+            [scan, path] () { if (!scan->abandoned.load()) { ReadDirectory(path, scan->items); } },
+            [scan] () { scan->done = true; });
+    } else {
+        ReadDirectory(path, b.scan->items);
+        b.scan->done = true;
     }
 
-    if (!preselect.empty()) {
-        for (int i = 0;  i < int(m_items.size());  ++i) {
-            if (m_items[i] == preselect) {
-                m_cursor = i;
-                break;
+    // as much as the budget allows is done right away, which is everything
+    // for small directories; the root panel has no "back" item, so it needs
+    // to be complete in any case
+    build(incremental ? (FrameScheduler::now() + budget) : -1.0);
+}
+
+bool DirPanel::build(double deadline) {
+    if (!m_build) { return false; }
+    int oldWidth = m_width;
+    Build& b = *m_build;
+    if (b.scan && (b.scan->done || (deadline < 0.0))) {
+        if (b.scan->done) {
+            b.scanned.swap(b.scan->items);
+        } else {
+            // the panel is needed in full right now, so don't wait for the
+            // job; if it hasn't started yet, it won't do anything either
+            b.scan->abandoned.store(true);
+            ReadDirectory(m_path, b.scanned);
+        }
+        b.scan.reset();
+        b.heap.resize(b.scanned.size());
+        for (int i = 0;  i < int(b.heap.size());  ++i) { b.heap[i] = uint32_t(i); }
+        b.heapify = int(b.heap.size()) / 2;
+    }
+    while (m_build && !m_build->scan && ((deadline < 0.0) || (FrameScheduler::now() < deadline))) {
+        buildStep();
+    }
+
+    // the items on screen, now and at the end of the scroll animation,
+    // are needed in this frame, whatever the budget says
+    int first, last, targetFirst, targetLast;
+    visibleItems(m_geometry.animValue(m_animY0), first, last);
+    visibleItems(float(m_y0), targetFirst, targetLast);
+    bool changed = false;
+    for (int i = first;        i <= last;        ++i) { changed = measure(i) || changed; }
+    for (int i = targetFirst;  i <= targetLast;  ++i) { changed = measure(i) || changed; }
+    if (changed) { ++m_version; }
+    updateWidth();
+    return (m_width != oldWidth);
+}
+
+void DirPanel::buildStep() {
+    Build& b = *m_build;
+    const int n = int(b.scanned.size());
+    auto siftDown = [&] (int i) {
+        // (a min-heap: the first item in sort order is at the top)
+        const int size = int(b.heap.size());
+        uint32_t x = b.heap[i];
+        for (;;) {
+            int c = 2 * i + 1;
+            if (c >= size) { break; }
+            if (((c + 1) < size) && (b.scanned[b.heap[c + 1]] < b.scanned[b.heap[c]])) { ++c; }
+            if (!(b.scanned[b.heap[c]] < b.scanned[x])) { break; }
+            b.heap[i] = b.heap[c];
+            i = c;
+        }
+        b.heap[i] = x;
+    };
+    if (b.heapify > 0) {
+        // build the heap bottom-up ...
+        int end = std::max(0, b.heapify - BuildChunk);
+        while (b.heapify > end) { siftDown(--b.heapify); }
+    } else if (b.moved < n) {
+        // ... then take the items out of it in order and move them into
+        // place, and look for the preselected one
+        int end = std::min(n, b.moved + HeapChunk);
+        for (;  b.moved < end;  ++b.moved) {
+            uint32_t index = b.heap[0];
+            b.heap[0] = b.heap.back();
+            b.heap.pop_back();
+            if (!b.heap.empty()) { siftDown(0); }
+            m_items.push_back(std::move(b.scanned[index]));
+            if (!b.preselect.empty() && (m_items.back() == b.preselect)) {
+                // put the cursor there, plus what has been pressed meanwhile
+                b.preselect.clear();
+                m_cursor = int(m_items.size()) - 1;
+                moveCursor(0, true);
+                m_animY0      = AnimValue(float(m_y0));
+                m_animCursorY = AnimValue(float(m_cursor * m_geometry.itemHeight));
             }
         }
+        if (b.moved >= n) { b.preselect.clear(); }  // it's not there at all
+        if (b.preselect.empty() && b.pendingMove) { moveCursor(0, true); }
+    } else {
+        // names are converted into glyph indices once, so that drawing them
+        // only needs to look up the glyph metrics (or lets the GPU do that)
+        int end = std::min(int(m_items.size()), b.measured + BuildChunk);
+        for (;  b.measured < end;  ++b.measured) { measure(b.measured); }
+        if (b.measured >= int(m_items.size())) { m_build.reset(); }
     }
+}
+
+bool DirPanel::measure(int index) {
+    DirItem& item = m_items[index];
+    if (!item.glyphs.empty()) { return false; }
+    if (m_parent.m_renderer.toGlyphs(item.displayText().c_str(), item.glyphs)) { m_dynamicGlyphs = true; }
+    m_textWidth = std::max(m_textWidth, m_parent.m_renderer.glyphWidth(item.glyphs));
+    return true;
+}
 
+void DirPanel::updateWidth() {
     m_width = 2 * m_geometry.panelMarginX
             + 2 * m_geometry.itemMarginX
-            + int(std::ceil(w * float(m_geometry.textSize)));
-    m_y0 = m_geometry.dirViewY0;
-    moveCursor(0, true);
-    m_animY0      = float(m_y0);
-    m_animActive  = (m_active ? 1.0f : 0.0f);
-    m_animCursorY = float(m_cursor * m_geometry.itemHeight);
+            + int(std::ceil(m_textWidth * float(m_geometry.textSize)));
+}
+
+DirPanel::DrawState DirPanel::currentState(float xOffset) const {
+    DrawState state;
+    state.xOffset = xOffset;
+    state.y0      = m_geometry.animValue(m_animY0);
+    state.cursorY = state.y0 + m_geometry.animValue(m_animCursorY);
+    state.active  = m_geometry.animValue(m_animActive);
+    visibleItems(state.y0, state.first, state.last);
+    return state;
 }
 
-void DirPanel::draw(float xOffset) {
+void DirPanel::visibleItems(float y0, int& first, int& last) const {
+    first = std::max(0, int(std::floor((-y0) / float(m_geometry.itemHeight))) - 1);
+    last = std::min(int(m_items.size()) - 1,
+        int(std::floor((float(m_geometry.screenHeight - m_geometry.itemMarginY) - y0) / float(m_geometry.itemHeight))));
+}
+
+void DirPanel::updateDamage(DamageTracker& damage, float xOffset) {
+    // this needs to mirror the coordinate computations in draw()
+    DrawState state = currentState(xOffset);
     float x = xOffset + float(m_x0 + m_geometry.panelMarginX + m_geometry.itemMarginX);
     int ix = int(std::floor(x + 0.5f));
 
+    // panel contents: the full screen height, because items may scroll
+    // partially under the title and control bars
+    int alpha = int(state.active * 255.0f + 0.5f);
+    uint32_t key = DamageKey(DamageKeyInit, int(std::floor(x * 64.0f)));
+    key = DamageKey(key, int(std::floor(state.y0 * 64.0f)));
+    key = DamageKey(key, alpha);
+    key = DamageKey(key, int(m_items.size()));
+    key = DamageKey(key, m_version);
+    if (alpha < 255) { key = DamageKey(key, m_cursor); }  // inactive cursor item is drawn brighter
+    if (m_dynamicGlyphs) { key = DamageKey(key, int(m_parent.m_renderer.glyphVersion())); }  // glyphs have been generated
+    damage.update(m_damageContent,
+        Rect(ix - m_geometry.panelMarginX - 2 * m_geometry.itemMarginX, 0,
+             ix + m_width + m_geometry.itemMarginX + m_geometry.itemShadowOffset, m_geometry.screenHeight),
+        key);
+
+    // cursor highlight box; the key uses the exact position, because it's
+    // drawn at subpixel precision when it's animated by the GPU
     if (m_active) {
-        int iy = int(std::floor(m_animY0 + m_animCursorY + 0.5f));
+        int iy = int(std::floor(state.cursorY));
+        int margin = m_geometry.itemOutlineOffset + 1;
+        damage.update(m_damageCursor,
+            Rect(ix - m_geometry.itemMarginX - margin,
+                 iy - margin,
+                 ix - m_geometry.itemMarginX + m_width - 2 * m_geometry.panelMarginX + m_geometry.itemShadowOffset + margin,
+                 iy + m_geometry.itemHeight + m_geometry.itemShadowOffset + margin),
+            DamageKey(DamageKey(DamageKeyInit, int(std::floor(x * 64.0f))), int(std::floor(state.cursorY * 64.0f))));
+    } else {
+        damage.update(m_damageCursor, Rect(), 0u);
+    }
+}
+
+bool DirPanel::onScreen(float xOffset) const {
+    // same horizontal extent as the panel contents damage rectangle
+    float x = xOffset + float(m_x0 + m_geometry.panelMarginX + m_geometry.itemMarginX);
+    int ix = int(std::floor(x + 0.5f));
+    return ((ix + m_width + m_geometry.itemMarginX + m_geometry.itemShadowOffset) > 0)
+        && ((ix - m_geometry.panelMarginX - 2 * m_geometry.itemMarginX) < m_geometry.screenWidth);
+}
+
+void DirPanel::draw(const DrawState& state) {
+    float x = state.xOffset + float(m_x0 + m_geometry.panelMarginX + m_geometry.itemMarginX);
+    int ix = int(std::floor(x + 0.5f));
+
+    if (m_active) {
+        TextBoxRenderer::bindAnim(state.animX, state.animCursorY);
+        int iy = int(std::floor(state.cursorY + 0.5f));
         m_parent.m_renderer.outlineBox(
             ix - m_geometry.itemMarginX - m_geometry.itemOutlineOffset,
             iy - m_geometry.itemOutlineOffset,
@@ -102,18 +278,70 @@ void DirPanel::draw(float xOffset) {
             m_geometry.itemBorderRadius, m_geometry.itemShadowOffset, 0.0f, 0.125f);
     }
 
-    for (int i = 0;  i < int(m_items.size());  ++i) {
-        float y = m_animY0 + float(i * m_geometry.itemHeight + m_geometry.itemMarginY);
-        float alpha = m_animActive + (1.0f - m_animActive) * ((i == m_cursor) ? 0.75f : 0.25f);
-        m_parent.m_renderer.text(x, y, float(m_geometry.textSize),
-            m_items[i].displayText().c_str(),
-            Align::Left + Align::Top,
+    TextBoxRenderer::bindAnim(state.animX, state.animY0, state.animActive);
+    for (int i = state.first;  i <= state.last;  ++i) {
+        float y = state.y0 + float(i * m_geometry.itemHeight + m_geometry.itemMarginY);
+        float alpha = state.active + (1.0f - state.active) * ((i == m_cursor) ? 0.75f : 0.25f);
+        m_parent.m_renderer.glyphText(x, y, float(m_geometry.textSize),
+            m_items[i].glyphs,
             TextBoxRenderer::makeAlpha(alpha) | 0xFFFFFF);
     }
+    TextBoxRenderer::bindAnim(0);
+}
+
+uint32_t DirPanel::streamKey() const {
+    uint32_t key = DamageKey(DamageKeyInit, m_path.c_str());
+    key = DamageKey(key, int(m_items.size()));
+    key = DamageKey(key, m_version);
+    key = DamageKey(DamageKey(key, m_x0), m_width);
+    key = DamageKey(key, m_active ? 1 : 0);
+    // the cursor position only affects the item brightness,
+    // which doesn't matter any longer once the panel is fully active
+    if (!m_active || (m_geometry.animValue(m_animActive) != 1.0f)) { key = DamageKey(key, m_cursor); }
+    return key;
+}
+
+uint32_t DirPanel::layerKey() const {
+    // only valid for stable panels, where the animations are at their targets
+    uint32_t key = DamageKey(DamageKeyInit, m_path.c_str());
+    key = DamageKey(key, m_y0);
+    key = DamageKey(key, m_cursor);
+    key = DamageKey(DamageKey(key, m_x0), m_width);
+    if (m_dynamicGlyphs) { key = DamageKey(key, int(m_parent.m_renderer.glyphVersion())); }
+    return DamageKey(key, int(m_items.size()));
+}
+
+int DirPanel::layerWidth() const {
+    // same horizontal extent as the panel contents damage rectangle
+    return m_geometry.panelMarginX + 3 * m_geometry.itemMarginX + m_width + m_geometry.itemShadowOffset;
+}
+
+float DirPanel::layerX(float xOffset) const {
+    return xOffset + float(m_x0 - m_geometry.itemMarginX);
+}
+
+int DirPanel::layerY() const {
+    // vertically, only the on-screen part of the items
+    return std::max(0, m_y0);
+}
+
+int DirPanel::layerHeight() const {
+    return std::max(1, std::min(m_geometry.screenHeight, m_y0 + int(m_items.size()) * m_geometry.itemHeight) - layerY());
 }
 
 void DirPanel::moveCursor(int target, bool relative) {
     if (relative) { target += m_cursor; }
+    if (m_build) {
+        // while the items are still coming in, relative moves wait for the
+        // preselected item, and the part of a move that goes beyond the
+        // items that are already there is continued as more of them arrive
+        Build& b = *m_build;
+        bool complete = !b.scan && (b.moved >= int(b.scanned.size()));
+        if (relative && !complete && !b.preselect.empty()) { b.pendingMove += target - m_cursor;  return; }
+        if (relative) { target += b.pendingMove; }
+        b.preselect.clear();  // don't move it away from here later
+        b.pendingMove = complete ? 0 : std::max(0, target - (int(m_items.size()) - 1));
+    }
     target = std::min(std::max(0, target), int(m_items.size()) - 1);
     m_cursor = target;
     m_y0 += std::max(0, m_geometry.dirViewY0 - cursorY())
@@ -159,6 +387,7 @@ void DirView::navigate(const std::string& path) {
     }
 
     // populate panels
+    for (const auto& panel : m_panels) { panel.cancelJobs(); }
     m_panels.clear();
     int x = 0;
     while (!pathComponents.empty()) {
@@ -169,9 +398,10 @@ void DirView::navigate(const std::string& path) {
     }
 
     // update geometry
+    ++m_generation;
     m_xScroll = -m_geometry.outerMarginX;
     updateScroll();
-    m_animXOffset = float(-m_xScroll);
+    m_animXOffset = AnimValue(float(-m_xScroll));
 }
 
 void DirView::updateScroll() {
@@ -188,25 +418,203 @@ void DirView::updateScroll() {
     if (m_xScroll > scrollL) { m_xScroll = scrollL; }
 }
 
+void DirView::updatePanelPositions() {
+    // lay out the panels side by side again, after one of them got wider
+    int x = 0;
+    for (auto& panel : m_panels) {
+        panel.setStartX(x);
+        x = panel.endX();
+    }
+    updateScroll();
+}
+
 int DirView::animate() {
-    int res = m_geometry.animUpdate(m_animXOffset, float(-m_xScroll));
+    // continue building panels within the frame's time budget, the current
+    // one first; while that goes on, new frames are needed just like for
+    // an animation
+    int res = 0;
+    bool moved = false;
+    double deadline = (m_buildBudget > 0.0) ? (FrameScheduler::now() + m_buildBudget) : -1.0;
+    for (int i = int(m_panels.size()) - 1;  i >= 0;  --i) {
+        if (!m_panels[i].building()) { continue; }
+        if (m_panels[i].build(deadline)) { moved = true; }
+        // (waiting for a directory to be read doesn't need any frames;
+        // the job's completion wakes up the main loop)
+        if (m_panels[i].building() && !m_panels[i].scanning()) { ++res; }
+    }
+    if (moved) { updatePanelPositions(); }
+
+    res += m_geometry.animUpdate(m_animXOffset, float(-m_xScroll));
     for (auto& panel : m_panels) {
         res += panel.animate();
     }
     return res;
 }
 
-void DirView::draw() {
+void DirView::updateDamage(DamageTracker& damage) {
+    if (m_generation != m_damageGeneration) {
+        // panels appeared or vanished -> everything moves anyway
+        damage.invalidate();
+        m_damageGeneration = m_generation;
+    }
     for (auto& panel : m_panels) {
-        panel.draw(m_animXOffset);
+        panel.updateDamage(damage, m_geometry.animValue(m_animXOffset));
     }
 }
 
+void DirView::draw() {
+    // drop the layers and streams of panels that went away
+    while (m_layers.size() > m_panels.size()) {
+        m_renderer.releaseCached(m_layers.back());
+        m_layers.pop_back();
+    }
+    m_layers.resize(m_panels.size());
+    while (m_streams.size() > m_panels.size()) {
+        releaseStream(m_streams.back());
+        m_streams.pop_back();
+    }
+    m_streams.resize(m_panels.size());
+    m_panelDraw.resize(m_panels.size());
+
+    // horizontal scrolling is animated on the GPU if possible
+    if (!m_animX) { m_animX = m_renderer.createAnim(); }
+    m_renderer.setAnim(m_animX, m_animXOffset);
+    float xOffset = m_geometry.animValue(m_animXOffset);
+
+    // decide how to draw each panel: stable panels go through a layer;
+    // the others are drawn from their stream, which is (re-)recorded if
+    // it's outdated; if there's no stream, they are drawn directly
+    const bool layers = m_renderer.layers();
+    const uint32_t viewKey = DamageKey(DamageKey(DamageKeyInit, m_renderer.viewportWidth()), m_renderer.viewportHeight());
+    m_drawItems.clear();
+    for (int i = 0;  i < int(m_panels.size());  ++i) {
+        DirPanel& panel = m_panels[i];
+        PanelStream& ps = m_streams[i];
+        if (!panel.onScreen(xOffset)) {
+            m_panelDraw[i] = PanelDraw::Hidden;
+        } else if (layers && panel.stable()) {
+            m_panelDraw[i] = PanelDraw::Layer;
+        } else if (!m_animX || !setupStream(ps)) {
+            m_panelDraw[i] = PanelDraw::Direct;
+            m_drawItems.push_back({ i, false, panel.currentState(xOffset) });
+        } else {
+            m_panelDraw[i] = PanelDraw::Stream;
+            m_renderer.setAnim(ps.animY0,      panel.animY0());
+            m_renderer.setAnim(ps.animCursorY, panel.animCursorY());
+            m_renderer.setAnim(ps.animActive,  panel.animActive());
+
+            // the stream needs to contain the items that are on screen now
+            // and at the end of the scroll animation (and thus, everything
+            // in between); if it contains a lot more than that, it's
+            // recorded again too, so that it doesn't grow indefinitely
+            int first, last, targetFirst, targetLast;
+            panel.visibleItems(m_geometry.animValue(panel.animY0()), first, last);
+            panel.visibleItems(panel.animY0().target, targetFirst, targetLast);
+            first = std::min(first, targetFirst);
+            last  = std::max(last,  targetLast);
+            uint32_t key = DamageKey(panel.streamKey(), viewKey);
+            if (ps.valid && (ps.key == key) && (ps.first <= first) && (ps.last >= last)
+            && ((ps.last - ps.first) <= (2 * (last - first) + 2))) {
+                continue;  // still up to date
+            }
+            ps.key = key;
+            ps.first = first;
+            ps.last = last;
+            ps.valid = true;
+            DirPanel::DrawState state;
+            state.first       = first;
+            state.last        = last;
+            state.animX       = m_animX;
+            state.animY0      = ps.animY0;
+            state.animCursorY = ps.animCursorY;
+            state.animActive  = ps.animActive;
+            m_drawItems.push_back({ i, true, state });
+        }
+    }
+
+    // record the streams and directly drawn panels, in parallel if possible
+    int count = int(m_drawItems.size());
+    if (int(m_staging.size()) < count) { m_staging.resize(count); }
+    auto record = [&] (int index) {
+        m_renderer.beginRecording(m_staging[index]);
+        m_panels[m_drawItems[index].panel].draw(m_drawItems[index].state);
+        m_renderer.endRecording();
+    };
+    bool parallel = m_workers && (m_workers->threads() >= 2) && (count >= 2);
+    if (parallel) {
+        m_workers->parallelFor(count, record);
+    } else {
+        for (int index = 0;  index < count;  ++index) {
+            if (m_drawItems[index].retained) { record(index); }
+        }
+    }
+
+    // draw everything in panel order
+    int next = 0;
+    for (int i = 0;  i < int(m_panels.size());  ++i) {
+        DirPanel& panel = m_panels[i];
+        bool recorded = (next < count) && (m_drawItems[next].panel == i);
+        switch (m_panelDraw[i]) {
+            case PanelDraw::Layer:
+                m_renderer.drawCached(m_layers[i], panel.layerX(xOffset), float(panel.layerY()),
+                    panel.layerWidth(), panel.layerHeight(), panel.layerKey(),
+                    [&] () { panel.draw(xOffset); });
+                break;
+            case PanelDraw::Stream:
+                if (recorded) { m_renderer.updateStream(m_streams[i].stream, m_staging[next]); }
+                m_renderer.drawStream(m_streams[i].stream);
+                break;
+            case PanelDraw::Direct:
+                if (parallel) { m_renderer.submit(m_staging[next]); }
+                else          { panel.draw(m_drawItems[next].state); }
+                break;
+            default:
+                break;
+        }
+        if (recorded) { ++next; }
+    }
+}
+
+bool DirView::setupStream(PanelStream& ps) {
+    // channels first, so that nothing else is created if we're out of them
+    if (!ps.stream) {
+        ps.animY0      = m_renderer.createAnim();
+        ps.animCursorY = m_renderer.createAnim();
+        ps.animActive  = m_renderer.createAnim();
+        if (ps.animY0 && ps.animCursorY && ps.animActive) { ps.stream = m_renderer.createStream(); }
+        ps.valid = false;
+    }
+    if (!ps.stream) { releaseStream(ps);  return false; }
+    return true;
+}
+
+void DirView::releaseStream(PanelStream& ps) {
+    m_renderer.deleteStream(ps.stream);
+    m_renderer.deleteAnim(ps.animY0);
+    m_renderer.deleteAnim(ps.animCursorY);
+    m_renderer.deleteAnim(ps.animActive);
+    ps = PanelStream();
+}
+
+void DirView::releaseResources() {
+    for (auto& layer : m_layers) { m_renderer.releaseCached(layer); }
+    m_layers.clear();
+    for (auto& ps : m_streams) { releaseStream(ps); }
+    m_streams.clear();
+    m_renderer.deleteAnim(m_animX);
+    m_animX = 0;
+}
+
 void DirView::moveCursor(int target, bool relative) {
     if (m_panels.empty()) { return; }
     m_panels.back().moveCursor(target, relative);
 }
 
+void DirView::finishBuild() {
+    if (m_panels.empty() || !m_panels.back().cursorPending()) { return; }
+    if (m_panels.back().build(-1.0)) { updatePanelPositions(); }
+}
+
 std::string DirView::currentItemFullPath() const {
     return PathJoin(currentDir(), currentItem().name);
 }
@@ -217,12 +625,15 @@ void DirView::push() {
     if (current.name.empty()) { pop(); return; }
     m_panels.back().deactivate();
     m_panels.push_back(DirPanel(*this, PathJoin(currentDir(), current.name), m_panels.back().endX()));
+    ++m_generation;
     updateScroll();
 }
 
 void DirView::pop() {
     if (m_panels.size() <= 1) { return; }
+    m_panels.back().cancelJobs();
     m_panels.pop_back();
     m_panels.back().activate();
+    ++m_generation;
     updateScroll();
 }
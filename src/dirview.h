@@ -3,12 +3,17 @@
 
 #pragma once
 
+#include <atomic>
 #include <string>
 #include <vector>
+#include <memory>
 
 #include "renderer.h"
 #include "geometry.h"
+#include "damage.h"
 #include "sysutil.h"
+#include "workers.h"
+#include "jobs.h"
 
 class DirView;
 
@@ -20,6 +25,7 @@ struct DirItem {
     bool isDir;
     bool isExec;
     std::string display;
+    TextBoxRenderer::GlyphString glyphs;  //!< displayText(), converted into glyph indices
     bool operator< (const DirItem& other) const;
     bool operator== (const std::string& other) const;
     inline const std::string& displayText() const { return display.empty() ? name : display; }
@@ -41,9 +47,43 @@ class DirPanel {
     int m_x0;
     int m_width;
     int m_y0;
-    float m_animY0;
-    float m_animActive;
-    float m_animCursorY;
+    bool m_dynamicGlyphs = false;  // some items contain glyphs from the dynamic atlas
+    AnimValue m_animY0;
+    AnimValue m_animActive;
+    AnimValue m_animCursorY;  // relative to m_animY0
+    DamageState m_damageContent;
+    DamageState m_damageCursor;
+    CancelToken m_jobToken;
+
+    // incremental construction (see build()): the directory is read by a
+    // background job; then the indices of the scanned items are arranged
+    // into a heap, a few at a time, and then the items
+    // are taken out of it in order and moved into m_items, so the first
+    // ones are there long before the last ones are sorted; their glyphs are
+    // generated and measured as they become visible, and all the others
+    // afterwards
+    struct Scan {
+        std::vector<DirItem> items;     // filled by the job
+        bool done = false;              // set on the UI thread when the job has completed
+        std::atomic<bool> abandoned;    // the UI thread has read the directory itself
+        inline Scan() : abandoned(false) {}
+    };
+    struct Build {
+        std::shared_ptr<Scan> scan;  // until the items are in 'scanned'
+        std::vector<DirItem> scanned;
+        std::vector<uint32_t> heap;  // items that haven't been moved yet
+        int heapify = 0;       // number of heap nodes that are yet to be sifted down
+        int moved = 0;         // number of items moved into m_items
+        int measured = 0;      // number of items in m_items checked for glyphs
+        std::string preselect; // item to put the cursor on once it's there
+        int pendingMove = 0;   // cursor movement that can't be done yet
+    };
+    std::unique_ptr<Build> m_build;
+    float m_textWidth = 0.0f;
+    int m_version = 0;  // incremented whenever visible items get their glyphs
+    void buildStep();
+    bool measure(int index);
+    void updateWidth();
 
 public:
     explicit DirPanel(DirView& parent, const std::string& path, int x0, bool active=true, const std::string& preselect="");
@@ -53,11 +93,65 @@ public:
     inline int endX()                   const { return m_x0 + m_width; }
     inline const std::string& path()    const { return m_path; }
     inline const DirItem& currentItem() const { return m_items[m_cursor]; }
+    inline int cursor()                 const { return m_cursor; }
+    inline int itemCount()              const { return int(m_items.size()); }
     inline void deactivate()                  { m_active = false; }
     inline void activate()                    { m_active = true; }
+    inline void setStartX(int x0)             { m_x0 = x0; }
+
+    //! continue the construction of the panel until the deadline (< 0 =
+    //! until it's complete); the visible items are always made drawable,
+    //! even after the deadline; returns true if the panel's width changed
+    bool build(double deadline);
+    inline bool building() const { return !!m_build; }
+    //! true while the directory is still being read in the background
+    inline bool scanning() const { return m_build && m_build->scan && !m_build->scan->done; }
+    //! true if the cursor is yet to be moved to an item that isn't there yet
+    //! (the preselected one, or one beyond the last item so far)
+    inline bool cursorPending() const { return m_build && (!m_build->preselect.empty() || m_build->pendingMove); }
+
+    //! background jobs on behalf of the panel should use this token;
+    //! they are cancelled when the panel is closed
+    inline const CancelToken& jobToken() const { return m_jobToken; }
+    inline void cancelJobs()             const { m_jobToken.cancel(); }
+
+    //! what to draw: either the current animation state, or (for retained
+    //! vertex streams) all-zero positions and alpha, with the renderer's
+    //! animation channels adding the actual values on the GPU
+    struct DrawState {
+        float xOffset = 0.0f;
+        float y0 = 0.0f;       //!< vertical position of the first item
+        float cursorY = 0.0f;  //!< vertical position of the cursor
+        float active = 0.0f;   //!< fade state (0 = inactive, 1 = active)
+        int first = 0;         //!< first item to draw
+        int last = -1;         //!< last item to draw
+        TextBoxRenderer::AnimRef animX = 0, animY0 = 0, animCursorY = 0, animActive = 0;
+    };
+    DrawState currentState(float xOffset=0.0f) const;
+    //! items that are on screen at a given vertical position
+    void visibleItems(float y0, int& first, int& last) const;
+
+    // animation state, for the renderer's animation channels
+    inline const AnimValue& animY0()     const { return m_animY0; }
+    inline const AnimValue& animActive() const { return m_animActive; }
+    inline AnimValue animCursorY()       const { return AnimValue::sum(m_animY0, m_animCursorY); }
 
     int animate();
-    void draw(float xOffset=0.0f);
+    void updateDamage(DamageTracker& damage, float xOffset=0.0f);
+    bool onScreen(float xOffset=0.0f) const;
+    void draw(const DrawState& state);
+    inline void draw(float xOffset=0.0f) { draw(currentState(xOffset)); }
+
+    //! an inactive panel whose animations have finished only changes when
+    //! it's scrolled horizontally, so it can be drawn through a render layer
+    inline bool stable() const { return !m_active && !m_build && (m_geometry.animValue(m_animActive) == 0.0f) && (m_geometry.animValue(m_animY0) == float(m_y0)); }
+    //! identifies what a retained vertex stream of the panel contains
+    uint32_t streamKey() const;
+    uint32_t layerKey() const;
+    float layerX(float xOffset=0.0f) const;
+    int layerWidth() const;
+    int layerY() const;
+    int layerHeight() const;
     void moveCursor(int target, bool relative);
 };
 
@@ -73,8 +167,55 @@ protected:
     std::vector<DirPanel> m_panels;
 
     int m_xScroll = 0;
-    float m_animXOffset = 0.0f;
+    AnimValue m_animXOffset;
+    int m_generation = 0;  // incremented whenever panels are added or removed
+    int m_damageGeneration = -1;
     void updateScroll();
+    void updatePanelPositions();
+
+    // time per frame that may be spent on building panels [s]
+    static constexpr double DefaultBuildBudget = 0.004;
+    double m_buildBudget = DefaultBuildBudget;
+
+    // parallel drawing: each panel that needs to be drawn or recorded
+    // records its quads into its own staging buffer on a worker thread;
+    // the buffers are then submitted to the renderer in panel order
+    WorkerPool* m_workers = nullptr;
+    std::vector<TextBoxRenderer::Recording> m_staging;
+
+    // directories of new panels are read by jobs of this system, if any
+    JobSystem* m_jobs = nullptr;
+
+    // render layers of the stable panels, indexed like m_panels
+    std::vector<TextBoxRenderer::CachedLayer> m_layers;
+
+    // GPU-side animation: each panel is recorded once into a retained
+    // vertex stream, relative to animation channels for the horizontal
+    // scroll offset and for the panel's vertical scroll position, cursor
+    // position and fade state; it's only recorded again when its contents
+    // change or items scroll into view that the stream doesn't contain
+    struct PanelStream {
+        TextBoxRenderer::StreamRef stream = 0;
+        TextBoxRenderer::AnimRef animY0 = 0, animCursorY = 0, animActive = 0;
+        uint32_t key = 0u;
+        int first = 0, last = -1;  // range of items in the stream
+        bool valid = false;
+    };
+    std::vector<PanelStream> m_streams;  // indexed like m_panels
+    TextBoxRenderer::AnimRef m_animX = 0;
+    enum class PanelDraw : uint8_t { Hidden, Layer, Stream, Direct };
+    std::vector<PanelDraw> m_panelDraw;  // indexed like m_panels
+    bool setupStream(PanelStream& ps);
+    void releaseStream(PanelStream& ps);
+
+    // panels that are drawn directly or recorded into their stream
+    // in the current frame, in drawing order
+    struct DrawItem {
+        int panel;
+        bool retained;
+        DirPanel::DrawState state;
+    };
+    std::vector<DrawItem> m_drawItems;
 
 public:
     inline DirView(TextBoxRenderer& renderer, const Geometry& geometry)
@@ -92,10 +233,29 @@ public:
 
     void navigate(const std::string& path);
 
+    //! draw panels in parallel using this worker pool (nullptr = serially)
+    inline void setWorkerPool(WorkerPool* workers) { m_workers = workers; }
+
+    //! read the directories of new panels in the background with jobs of
+    //! this system (nullptr = read them right away, on the calling thread);
+    //! only applies if there's a build budget (see setBuildBudget())
+    inline void setJobSystem(JobSystem* jobs) { m_jobs = jobs; }
+
+    //! time per frame that may be spent on sorting and measuring the items
+    //! of new panels [s]; the rest is done in the following frames, while
+    //! the panels are already shown (0 = always build panels completely)
+    inline void setBuildBudget(double seconds) { m_buildBudget = seconds; }
+
     int animate();
+    void updateDamage(DamageTracker& damage);
     void draw();
+    //! release all render layers, vertex streams and animation channels
+    void releaseResources();
 
     void moveCursor(int target, bool relative);
+    //! complete the current panel right away if its cursor is still
+    //! waiting for an item, so that it is where the user moved it to
+    void finishBuild();
     void push();
     void pop();
 };
@@ -14,5 +14,6 @@ enum class AppEvent {
 enum class AppAction {
     Quit,
     Minimize,
-    Restore
+    Restore,
+    Wakeup    //!< wake up the event loop; may be sent from any thread
 };
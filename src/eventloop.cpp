@@ -0,0 +1,204 @@
+// SPDX-FileCopyrightText: 2023 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <vector>
+
+#include <SDL.h>
+#include <SDL_syswm.h>
+
+#ifdef __linux__
+    #include <sys/epoll.h>
+    #include <sys/eventfd.h>
+    #include <unistd.h>
+    #include <fcntl.h>
+    #include <errno.h>
+    #define EVENTLOOP_EPOLL
+#endif
+
+#include "eventloop.h"
+
+//! how often to check for input that can't be waited for [ms]
+constexpr int InputPollInterval = 10;
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool EventLoop::init(SDL_Window* win) {
+    shutdown();
+    m_wakeupEvent.store(SDL_RegisterEvents(1));
+    #ifdef EVENTLOOP_EPOLL
+        // find the connection to the window system
+        int displayFD = -1;
+        SDL_SysWMinfo info;
+        SDL_VERSION(&info.version);
+        if (win && SDL_GetWindowWMInfo(win, &info)) {
+            switch (info.subsystem) {
+                #ifdef SDL_VIDEO_DRIVER_X11
+                case SDL_SYSWM_X11:
+                    displayFD = ConnectionNumber(info.info.x11.display);
+                    break;
+                #endif
+                #ifdef SDL_VIDEO_DRIVER_WAYLAND
+                case SDL_SYSWM_WAYLAND: {
+                    // we don't link against libwayland-client, but SDL has
+                    // loaded it already, so just borrow the function
+                    typedef int (*wl_display_get_fd_func)(struct wl_display*);
+                    void* lib = SDL_LoadObject("libwayland-client.so.0");
+                    wl_display_get_fd_func getFD = lib ? reinterpret_cast<wl_display_get_fd_func>(SDL_LoadFunction(lib, "wl_display_get_fd")) : nullptr;
+                    if (getFD) { displayFD = getFD(info.info.wl.display); }
+                    if (lib) { SDL_UnloadObject(lib); }
+                    break; }
+                #endif
+                default:
+                    break;
+            }
+        }
+        if (displayFD < 0) {
+            #ifdef _DEBUG
+                printf("event loop: window system connection unknown, using SDL_WaitEvent\n");
+            #endif
+            return false;
+        }
+
+        m_epoll = epoll_create1(EPOLL_CLOEXEC);
+        int wakeFD = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if ((m_epoll < 0) || (wakeFD < 0)
+        || !addFD(displayFD, false, false)
+        || !addFD(wakeFD, true, true)) {
+            bool added = !m_sources.empty() && (m_sources.back().fd == wakeFD);
+            if ((wakeFD >= 0) && !added) { close(wakeFD); }
+            shutdown();
+            return false;
+        }
+        m_wakeFD.store(wakeFD);
+        #ifdef _DEBUG
+            printf("event loop: waiting with epoll\n");
+        #endif
+        return true;
+    #else
+        (void)win;
+        return false;
+    #endif
+}
+
+void EventLoop::shutdown() {
+    m_wakeFD.store(-1);
+    #ifdef EVENTLOOP_EPOLL
+        for (const auto& s : m_sources) {
+            if (s.owned) { close(s.fd); }
+        }
+        if (m_epoll >= 0) { close(m_epoll); }
+    #endif
+    m_sources.clear();
+    m_polledControllers.clear();
+    m_epoll = -1;
+}
+
+bool EventLoop::addFD(int fd, bool drain, bool owned, int controller) {
+    #ifdef EVENTLOOP_EPOLL
+        if ((m_epoll < 0) || (fd < 0)) { return false; }
+        struct epoll_event ev;
+        ::memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &ev) < 0) { return false; }
+        m_sources.push_back({ fd, drain, owned, controller });
+        return true;
+    #else
+        (void)fd, (void)drain, (void)owned, (void)controller;
+        return false;
+    #endif
+}
+
+void EventLoop::removeFD(int fd) {
+    for (auto it = m_sources.begin();  it != m_sources.end();  ++it) {
+        if (it->fd != fd) { continue; }
+        #ifdef EVENTLOOP_EPOLL
+            epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, nullptr);
+            if (it->owned) { close(fd); }
+        #endif
+        m_sources.erase(it);
+        return;
+    }
+}
+
+void EventLoop::addController(int joystickIndex) {
+    int id = int(SDL_JoystickGetDeviceInstanceID(joystickIndex));
+    #if defined(EVENTLOOP_EPOLL) && SDL_VERSION_ATLEAST(2, 24, 0)
+        // SDL reads the device itself; our own descriptor for it gets a
+        // copy of every event, which is all we need to wake up
+        const char* path = SDL_JoystickPathForIndex(joystickIndex);
+        int fd = (path && (m_epoll >= 0)) ? open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC) : -1;
+        if (addFD(fd, true, true, id)) { return; }
+        if (fd >= 0) { close(fd); }
+    #endif
+    m_polledControllers.push_back(id);
+}
+
+void EventLoop::removeController(int instanceID) {
+    for (const auto& s : m_sources) {
+        if (s.controller == instanceID) { removeFD(s.fd);  return; }
+    }
+    for (auto it = m_polledControllers.begin();  it != m_polledControllers.end();  ++it) {
+        if (*it == instanceID) { m_polledControllers.erase(it);  return; }
+    }
+}
+
+void EventLoop::wakeup() {
+    #ifdef EVENTLOOP_EPOLL
+        int fd = m_wakeFD.load();
+        if (fd >= 0) {
+            uint64_t one = 1u;
+            if (write(fd, &one, sizeof(one)) < 0) { /* counter saturated -- that's fine */ }
+            return;
+        }
+    #endif
+    uint32_t type = m_wakeupEvent.load();
+    if (type != ~0u) {
+        SDL_Event ev;
+        SDL_zero(ev);
+        ev.type = type;
+        SDL_PushEvent(&ev);
+    }
+}
+
+void EventLoop::wait(int timeout) {
+    #ifdef EVENTLOOP_EPOLL
+    if (m_epoll >= 0) {
+        // SDL may have read events from the window system connection
+        // already (e.g. while swapping buffers), which won't make it
+        // readable again, so look into SDL's queue first
+        SDL_PumpEvents();
+        if (SDL_HasEvents(SDL_FIRSTEVENT, SDL_LASTEVENT)) { return; }
+        if (!m_polledControllers.empty() && ((timeout < 0) || (timeout > InputPollInterval))) { timeout = InputPollInterval; }
+
+        struct epoll_event ready[16];
+        int n = epoll_wait(m_epoll, ready, 16, timeout);
+        for (int i = 0;  i < n;  ++i) {
+            int fd = ready[i].data.fd;
+            for (const auto& s : m_sources) {
+                if (s.fd != fd) { continue; }
+                if (s.drain) {
+                    uint8_t buf[512];
+                    while (read(s.fd, buf, sizeof(buf)) > 0) {}
+                }
+                break;
+            }
+            // a descriptor that hung up (e.g. an unplugged controller) or
+            // failed stays ready forever, so it must leave the set
+            if (ready[i].events & (EPOLLHUP | EPOLLERR)) {
+                #ifdef _DEBUG
+                    printf("event loop: removing source %d (events 0x%x)\n", fd, unsigned(ready[i].events));
+                #endif
+                removeFD(fd);
+            }
+        }
+        return;
+    }
+    #endif
+    if (timeout < 0) { SDL_WaitEvent(nullptr); }
+    else             { SDL_WaitEventTimeout(nullptr, timeout); }
+}
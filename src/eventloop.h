@@ -0,0 +1,65 @@
+// SPDX-FileCopyrightText: 2023 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstdint>
+
+#include <atomic>
+#include <vector>
+
+struct SDL_Window;
+
+//! the main loop's single wait primitive: sleeps until something actually
+//! happens -- an SDL event, a wakeup from another thread, activity on one
+//! of the registered file descriptors, or the scheduler's deadline.
+//!
+//! On Linux with X11 or Wayland, this is an epoll set that contains the
+//! window system connection, an eventfd for wakeups from other threads
+//! (the job system, the process supervisor, the glyph generator and the
+//! render thread all use that), and the device nodes of the open game
+//! controllers (which SDL reads itself, so they are only opened to be
+//! woken up by them). Everywhere else, it falls back to
+//! SDL_WaitEventTimeout() plus an SDL user event for wakeups.
+class EventLoop {
+    struct Source {
+        int fd;
+        bool drain;   // read and discard everything when readable
+        bool owned;   // close when removed
+        int controller;  // joystick instance ID, or -1
+    };
+    std::vector<Source> m_sources;
+    std::vector<int> m_polledControllers;  // input that can't be waited for, so poll
+    int m_epoll = -1;
+    std::atomic<int> m_wakeFD;             // eventfd for wakeup(), or -1
+    std::atomic<uint32_t> m_wakeupEvent;   // SDL event type for wakeup() in the fallback
+
+    bool addFD(int fd, bool drain, bool owned, int controller=-1);
+    void removeFD(int fd);
+
+public:
+    inline EventLoop() : m_wakeFD(-1), m_wakeupEvent(~0u) {}
+    inline ~EventLoop() { shutdown(); }
+
+    //! set up the wait primitive for the window; returns false if only the
+    //! fallback is available (which works nonetheless)
+    bool init(SDL_Window* win);
+    void shutdown();
+
+    //! true if init() has set up the multiplexed wait
+    inline bool multiplexed() const { return (m_epoll >= 0); }
+
+    //! make sure that input from a game controller wakes up the loop
+    void addController(int joystickIndex);
+    //! forget a disconnected game controller, by its joystick instance ID
+    void removeController(int instanceID);
+
+    //! wake up the loop; may be called from any thread
+    void wakeup();
+
+    //! wait until something happens, at most 'timeout' milliseconds
+    //! (-1 = indefinitely); descriptors that hang up or fail (e.g. those
+    //! of unplugged controllers) are removed; SDL's events are left in its
+    //! queue for SDL_PollEvent()
+    void wait(int timeout);
+};
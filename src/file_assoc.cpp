@@ -3,6 +3,7 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <cstdlib>
 
 #include <string>
 #include <vector>
@@ -22,37 +23,73 @@
 #endif
 
 static const FileAssociationRegistryItem fileAssocRegistry[] = {
-    { "GLISS",     EXE("gliss"),     false, "/ jpg jpeg jpe" },
-    { "XnView",    EXE("xnview"),    false, "/ jpg jpeg jpe jfif png bmp tif tiff tga pcx gif" },
+    { "GLISS",     EXE("gliss"),     false, "/ jpg jpeg jpe", ViewerProtocol::None },
+    { "XnView",    EXE("xnview"),    false, "/ jpg jpeg jpe jfif png bmp tif tiff tga pcx gif", ViewerProtocol::None },
 
-    { "MPV",       EXE("mpv"),       false, "mp4 mov mkv webm mts m2ts m2t m2p mpg ogv wmv asf flv avi" },
-    { "MPC-HC",    EXE("mpc-hc64"),  false, "mp4 mov mkv webm mts m2ts m2t m2p mpg ogv wmv asf flv avi" },
-    { "VLC",       EXE("vlc"),       false, "mp4 mov mkv webm mts m2ts m2t m2p mpg ogv wmv asf flv avi" },
+    { "MPV",       EXE("mpv"),       false, "mp4 mov mkv webm mts m2ts m2t m2p mpg ogv wmv asf flv avi", ViewerProtocol::MPV },
+    { "MPC-HC",    EXE("mpc-hc64"),  false, "mp4 mov mkv webm mts m2ts m2t m2p mpg ogv wmv asf flv avi", ViewerProtocol::None },
+    { "VLC",       EXE("vlc"),       false, "mp4 mov mkv webm mts m2ts m2t m2p mpg ogv wmv asf flv avi", ViewerProtocol::None },
 
-    { "MuPDF",     EXE("mupdf"),     false, "pdf" },
+    { "MuPDF",     EXE("mupdf"),     false, "pdf", ViewerProtocol::None },
 
-    { "Vivaldi",   EXE("vivaldi"),   false, "/ htm html" },
-    { "Chrome",    EXE("chrome"),    false, "/ htm html" },
-    { "Chromium",  EXE("chromium"),  false, "/ htm html" },
-    { "Firefox",   EXE("firefox"),   false, "/ htm html" },
+    { "Vivaldi",   EXE("vivaldi"),   false, "/ htm html", ViewerProtocol::None },
+    { "Chrome",    EXE("chrome"),    false, "/ htm html", ViewerProtocol::None },
+    { "Chromium",  EXE("chromium"),  false, "/ htm html", ViewerProtocol::None },
+    { "Firefox",   EXE("firefox"),   false, "/ htm html", ViewerProtocol::None },
 
-    { "Notepad++", EXE("notepad++"), false,   "txt md c cc cpp cxx h hh hpp hxx rs java cs kt js htm html py pl php rb sh pas dpr inc asm diz nfo json xml yaml ini conf" },
-    { "GEdit",     EXE("gedit"),     false,   "txt md c cc cpp cxx h hh hpp hxx rs java cs kt js htm html py pl php rb sh pas dpr inc asm diz nfo json xml yaml ini conf" },
-    { "VS Code",   EXE("code"),      false, "/ txt md c cc cpp cxx h hh hpp hxx rs java cs kt js htm html py pl php rb sh pas dpr inc asm diz nfo json xml yaml ini conf" },
+    { "Notepad++", EXE("notepad++"), false,   "txt md c cc cpp cxx h hh hpp hxx rs java cs kt js htm html py pl php rb sh pas dpr inc asm diz nfo json xml yaml ini conf", ViewerProtocol::None },
+    { "GEdit",     EXE("gedit"),     false,   "txt md c cc cpp cxx h hh hpp hxx rs java cs kt js htm html py pl php rb sh pas dpr inc asm diz nfo json xml yaml ini conf", ViewerProtocol::None },
+    { "VS Code",   EXE("code"),      false, "/ txt md c cc cpp cxx h hh hpp hxx rs java cs kt js htm html py pl php rb sh pas dpr inc asm diz nfo json xml yaml ini conf", ViewerProtocol::None },
 
     // stuff that executes scripts is put last, so it never becomes the default
-    { "Python",    EXE("py"),        true,  "py" },
-    { "Python",    EXE("python"),    true,  "py" },
-    { "Perl",      EXE("perl"),      true,  "pl" },
-    { "bash",      EXE("bash"),      true,  "sh" },
-    { nullptr, nullptr, false, nullptr },
+    { "Python",    EXE("py"),        true,  "py", ViewerProtocol::None },
+    { "Python",    EXE("python"),    true,  "py", ViewerProtocol::None },
+    { "Perl",      EXE("perl"),      true,  "pl", ViewerProtocol::None },
+    { "bash",      EXE("bash"),      true,  "sh", ViewerProtocol::None },
+    { nullptr, nullptr, false, nullptr, ViewerProtocol::None },
 };
 
+// test stand-in for a viewer with resident mode (see tools/stub_viewer.py);
+// only offered if the GLBROWSER_STUB_VIEWER environment variable is set to
+// its path
+static const FileAssociationRegistryItem stubViewerAssoc =
+    { "Stub Viewer", "stub_viewer.py", false, "jpg jpeg jpe png gif bmp", ViewerProtocol::Line };
+
 ///////////////////////////////////////////////////////////////////////////////
 
 static std::vector<FileAssociation> assocList;
 static std::unordered_map<uint32_t, std::vector<int>> extMap;
 
+static void addFileAssoc(const FileAssociationRegistryItem& item, const std::string& executablePath) {
+    FileAssociation assoc;
+    assoc.executablePath = executablePath;
+    assoc.displayName    = item.displayName;
+    assoc.executableName = item.executableName;
+    assoc.allowExec      = item.allowExec;
+    assoc.extensions     = item.extensions;
+    assoc.protocol       = item.protocol;
+    assoc.index          = int(assocList.size());
+    assocList.push_back(assoc);
+
+    #ifndef NDEBUG
+        printf("found program: %-10s -> %s\n", item.displayName, assoc.executablePath.c_str());
+    #endif
+
+    // parse extension list
+    const char* pos = item.extensions;
+    uint32_t code = 0u;
+    char c;
+    do {
+        c = *pos++;
+        if (!c || (c == ' ')) {
+            if (code) { extMap[code].push_back(assoc.index); }
+            code = 0u;
+        } else if (code < (1u << 24)) {
+            code = (code << 8) | uint8_t(c);
+        }
+    } while (c);
+}
+
 void FileAssocInit(const char* argv0) {
     assocList.clear();
     extMap.clear();
@@ -63,37 +100,16 @@ void FileAssocInit(const char* argv0) {
     FileAssociation assoc;
     assoc.displayName = assoc.executableName = assoc.extensions = nullptr;
     assoc.allowExec = true;
+    assoc.protocol = ViewerProtocol::None;
     assoc.index = 0;
     assocList.push_back(assoc);
 
     for (const auto* item = fileAssocRegistry;  item->displayName && item->executableName && item->extensions;  ++item) {
-        assoc.executablePath = FindProgram(item->executableName);
-        if (assoc.executablePath.empty()) { continue; }
-        assoc.displayName    = item->displayName;
-        assoc.executableName = item->executableName;
-        assoc.allowExec      = item->allowExec;
-        assoc.extensions     = item->extensions;
-        assoc.index          = int(assocList.size());
-        assocList.push_back(assoc);
-
-        #ifndef NDEBUG
-            printf("found program: %-10s -> %s\n", item->displayName, assoc.executablePath.c_str());
-        #endif
-
-        // parse extension list
-        const char* pos = item->extensions;
-        uint32_t code = 0u;
-        char c;
-        do {
-            c = *pos++;
-            if (!c || (c == ' ')) {
-                if (code) { extMap[code].push_back(assoc.index); }
-                code = 0u;
-            } else if (code < (1u << 24)) {
-                code = (code << 8) | uint8_t(c);
-            }
-        } while (c);
+        std::string path = FindProgram(item->executableName);
+        if (!path.empty()) { addFileAssoc(*item, path); }
     }
+    const char* stubViewer = getenv("GLBROWSER_STUB_VIEWER");
+    if (stubViewer && stubViewer[0]) { addFileAssoc(stubViewerAssoc, stubViewer); }
 
     #if 0  // DEBUG: dump file associations
         for (int i = 1;  i < int(assocList.size());  ++i) {
@@ -8,11 +8,23 @@
 #include <string>
 #include <functional>
 
+//! IPC protocol of viewers that can stay resident, i.e. that can be kept
+//! running and be told which file to show next; the viewer gets a connected
+//! Unix domain socket as file descriptor 3
+enum class ViewerProtocol {
+    None,  //!< no IPC; start a new process for every file
+    Line,  //!< started with "--ipc-fd=3"; receives "open <path>" and "quit"
+           //!< lines, replies "shown" (first frame of the file is visible)
+           //!< and "done" (the user is finished viewing it); see tools/stub_viewer.py
+    MPV,   //!< mpv's JSON IPC ("--input-ipc-client=fd://3", mpv 0.35 or newer)
+};
+
 struct FileAssociationRegistryItem {
     const char* displayName;
     const char* executableName;
     bool        allowExec;
     const char* extensions;
+    ViewerProtocol protocol;
 };
 
 struct FileAssociation : public FileAssociationRegistryItem {
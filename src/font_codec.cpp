@@ -0,0 +1,351 @@
+// SPDX-FileCopyrightText: 2023 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+    #define FONTCODEC_SSE2
+    #include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    #define FONTCODEC_NEON
+    #include <arm_neon.h>
+#endif
+
+#include "font_data.h"
+#include "font_codec.h"
+
+constexpr int Channels = 3;
+constexpr int DiagonalLanes = 16;  // must match DIAGONAL_LANES in data/convert_font.py
+constexpr int ScaleBits = 12;      // must match RANS_SCALE_BITS in data/convert_font.py
+constexpr int Streams = 4;         // must match RANS_STREAMS in data/convert_font.py
+constexpr uint32_t ScaleMask = (1u << ScaleBits) - 1u;
+constexpr uint32_t RansL = 1u << 16;
+
+///////////////////////////////////////////////////////////////////////////////
+
+// rANS decoding table: for each frequency slot, the symbol's frequency
+// (upper 16 bits) and the slot's offset from the symbol's cumulative
+// frequency (lower 16 bits), and the symbol itself
+struct DecodeTable {
+    uint32_t entry[1u << ScaleBits];
+    uint8_t symbol[1u << ScaleBits];
+};
+
+static bool buildDecodeTable(DecodeTable& table, const uint16_t* freqs) {
+    uint32_t cum = 0u;
+    for (uint32_t sym = 0u;  sym < 256u;  ++sym) {
+        uint32_t freq = freqs[sym];
+        if ((cum + freq) > (1u << ScaleBits)) { return false; }
+        for (uint32_t i = 0u;  i < freq;  ++i) {
+            table.entry[cum + i] = (freq << 16) | i;
+            table.symbol[cum + i] = uint8_t(sym);
+        }
+        cum += freq;
+    }
+    return (cum == (1u << ScaleBits));
+}
+
+static inline uint8_t decodeSymbol(uint32_t& x, const DecodeTable& table, const uint16_t*& data) {
+    uint32_t slot = x & ScaleMask;
+    uint32_t e = table.entry[slot];
+    x = (e >> 16) * (x >> ScaleBits) + (e & 0xFFFFu);
+    if (x < RansL) { x = (x << 16) | *data++; }
+    return table.symbol[slot];
+}
+
+// decode Streams parts of 'count' symbols each into consecutive areas of
+// 'out', advancing all coders at once; even symbols of each part are
+// coded with table 'even', odd ones with table 'odd'
+static bool decodeParts(uint8_t* out, int count, const DecodeTable& even, const DecodeTable& odd, const uint16_t*& data, const int* sizes) {
+    static_assert(Streams == 4, "decoding loop assumes four streams");
+    const uint16_t* end[Streams];
+    const uint16_t* pos = data;
+    for (int i = 0;  i < Streams;  ++i) {
+        if (sizes[i] < 2) { return false; }
+        pos += sizes[i];
+        end[i] = pos;
+    }
+    const uint16_t* d0 = data;
+    const uint16_t* d1 = end[0];
+    const uint16_t* d2 = end[1];
+    const uint16_t* d3 = end[2];
+    uint32_t x0 = (uint32_t(d0[0]) << 16) | d0[1];  d0 += 2;
+    uint32_t x1 = (uint32_t(d1[0]) << 16) | d1[1];  d1 += 2;
+    uint32_t x2 = (uint32_t(d2[0]) << 16) | d2[1];  d2 += 2;
+    uint32_t x3 = (uint32_t(d3[0]) << 16) | d3[1];  d3 += 2;
+    uint8_t* o0 = out;
+    uint8_t* o1 = &out[count];
+    uint8_t* o2 = &out[count * 2];
+    uint8_t* o3 = &out[count * 3];
+    for (int i = 0;  i < count;  i += 2) {
+        o0[i] = decodeSymbol(x0, even, d0);
+        o1[i] = decodeSymbol(x1, even, d1);
+        o2[i] = decodeSymbol(x2, even, d2);
+        o3[i] = decodeSymbol(x3, even, d3);
+        o0[i + 1] = decodeSymbol(x0, odd, d0);
+        o1[i + 1] = decodeSymbol(x1, odd, d1);
+        o2[i + 1] = decodeSymbol(x2, odd, d2);
+        o3[i + 1] = decodeSymbol(x3, odd, d3);
+    }
+    data = pos;
+    // the encoder started with all states at RansL, so after consuming
+    // all of the data, that's where the decoders must end up too
+    return (d0 == end[0]) && (d1 == end[1]) && (d2 == end[2]) && (d3 == end[3])
+        && (x0 == RansL) && (x1 == RansL) && (x2 == RansL) && (x3 == RansL);
+}
+
+// zero-run decoder that can stop and resume at any position, so a channel
+// can be expanded one band at a time; the run lengths alternate between
+// zeros and literals, starting with zeros at the beginning of each channel
+struct RunCursor {
+    const uint8_t* runs;
+    const uint8_t* runsEnd;
+    const uint8_t* literals;
+    const uint8_t* literalsEnd;
+    int zeros = 0;
+    int copy = 0;
+    bool literalRun = false;
+
+    inline void nextChannel() { zeros = copy = 0;  literalRun = false; }
+
+    // expand the next 'count' residuals, or just skip them if 'out' is null
+    bool expand(uint8_t* out, int count) {
+        int pos = 0;
+        while (pos < count) {
+            if (!zeros && !copy && !literalRun) {
+                // fast path for pairs of runs that can't reach the end of
+                // the buffer: short runs are written with 16-byte stores that
+                // may overshoot, as the next store starts where the run ended
+                constexpr int Margin = 2 * 255 + 16;
+                while (((count - pos) >= Margin) && ((runsEnd - runs) >= 2) && ((literalsEnd - literals) >= 256)) {
+                    int z = runs[0], n = runs[1];
+                    if (out) {
+                        if (z <= 16) { storeZeros16(&out[pos]); } else { ::memset(&out[pos], 0, z); }
+                        if (n <= 16) { copy16(&out[pos + z], literals); } else { ::memcpy(&out[pos + z], literals, n); }
+                    }
+                    pos += z + n;
+                    literals += n;
+                    runs += 2;
+                }
+            }
+            if (zeros) {
+                int n = std::min(zeros, count - pos);
+                if (out) { ::memset(&out[pos], 0, n); }
+                pos += n;
+                zeros -= n;
+            } else if (copy) {
+                int n = std::min(copy, count - pos);
+                if ((literalsEnd - literals) < n) { return false; }
+                if (out) { ::memcpy(&out[pos], literals, n); }
+                literals += n;
+                pos += n;
+                copy -= n;
+            } else if (pos < count) {
+                if (runs >= runsEnd) { return false; }
+                if (literalRun) { copy = *runs++; } else { zeros = *runs++; }
+                literalRun = !literalRun;
+            }
+        }
+        return true;
+    }
+
+    #if defined(FONTCODEC_SSE2)
+        static inline void storeZeros16(uint8_t* dest)                  { _mm_storeu_si128(reinterpret_cast<__m128i*>(dest), _mm_setzero_si128()); }
+        static inline void copy16(uint8_t* dest, const uint8_t* src)   { _mm_storeu_si128(reinterpret_cast<__m128i*>(dest), _mm_loadu_si128(reinterpret_cast<const __m128i*>(src))); }
+    #elif defined(FONTCODEC_NEON)
+        static inline void storeZeros16(uint8_t* dest)                  { vst1q_u8(dest, vdupq_n_u8(0)); }
+        static inline void copy16(uint8_t* dest, const uint8_t* src)   { vst1q_u8(dest, vld1q_u8(src)); }
+    #else
+        static inline void storeZeros16(uint8_t* dest)                  { ::memset(dest, 0, 16); }
+        static inline void copy16(uint8_t* dest, const uint8_t* src)   { ::memcpy(dest, src, 16); }
+    #endif
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Unpredict all channels of a band in place; the channels are stored one
+// after another, 'bandSize' bytes apart, and so are their last rows of the
+// previous band in 'above', 'steps' bytes apart. Step t of a band contains
+// the pixels (t - r, y0 + r) for all lanes r, so the west neighbor of
+// each lane is the same lane in the previous step, and the north
+// neighbor is the previous lane in the previous step; for lane 0, it's
+// taken from the row above the band instead.
+
+static void unpredictBandScalar(uint8_t* data, int steps, int bandSize, const uint8_t* above) {
+    for (int c = 0;  c < Channels;  ++c) {
+        uint8_t* pos = &data[c * bandSize];
+        uint8_t w[DiagonalLanes] = { 0 };
+        uint8_t nw[DiagonalLanes] = { 0 };
+        for (int t = 0;  t < steps;  ++t) {
+            uint8_t n[DiagonalLanes];
+            n[0] = above[c * steps + t];
+            for (int r = 1;  r < DiagonalLanes;  ++r) { n[r] = w[r - 1]; }
+            for (int r = 0;  r < DiagonalLanes;  ++r) {
+                int p = int(n[r]) + int(w[r]) - int(nw[r]);
+                p = std::max(p, int(std::min(std::min(n[r], w[r]), nw[r])));
+                p = std::min(p, int(std::max(std::max(n[r], w[r]), nw[r])));
+                *pos = uint8_t(*pos + p);
+                w[r] = *pos++;
+                nw[r] = n[r];
+            }
+        }
+    }
+}
+
+#if defined(FONTCODEC_SSE2) || defined(FONTCODEC_NEON)
+
+// The clamped gradient predictor is the same as the median of n, w and
+// n + w - nw; it can be computed with 8-bit arithmetic by selecting
+// between min(n, w), max(n, w) and the (then non-overflowing) gradient.
+// Each step depends on the previous one, so the three channels are
+// processed in the same loop to keep more than one chain in flight.
+
+#ifdef FONTCODEC_SSE2
+    typedef __m128i LaneVector;
+    static inline LaneVector unpredictStep(LaneVector& w, LaneVector& nw, uint8_t above, uint8_t* pos) {
+        __m128i n = _mm_or_si128(_mm_slli_si128(w, 1), _mm_cvtsi32_si128(above));
+        __m128i mn = _mm_min_epu8(n, w);
+        __m128i mx = _mm_max_epu8(n, w);
+        __m128i p = _mm_sub_epi8(_mm_add_epi8(n, w), nw);
+        __m128i sel = _mm_cmpeq_epi8(_mm_min_epu8(nw, mn), nw);  // nw <= min(n, w)
+        p = _mm_or_si128(_mm_and_si128(sel, mx), _mm_andnot_si128(sel, p));
+        sel = _mm_cmpeq_epi8(_mm_max_epu8(nw, mx), nw);          // nw >= max(n, w)
+        p = _mm_or_si128(_mm_and_si128(sel, mn), _mm_andnot_si128(sel, p));
+        w = _mm_add_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pos)), p);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pos), w);
+        nw = n;
+        return w;
+    }
+    static inline LaneVector zeroLanes() { return _mm_setzero_si128(); }
+#else  // NEON
+    typedef uint8x16_t LaneVector;
+    static inline LaneVector unpredictStep(LaneVector& w, LaneVector& nw, uint8_t above, uint8_t* pos) {
+        uint8x16_t n = vextq_u8(vdupq_n_u8(above), w, 15);
+        uint8x16_t mn = vminq_u8(n, w);
+        uint8x16_t mx = vmaxq_u8(n, w);
+        uint8x16_t p = vsubq_u8(vaddq_u8(n, w), nw);
+        p = vbslq_u8(vcleq_u8(nw, mn), mx, p);
+        p = vbslq_u8(vcgeq_u8(nw, mx), mn, p);
+        w = vaddq_u8(vld1q_u8(pos), p);
+        vst1q_u8(pos, w);
+        nw = n;
+        return w;
+    }
+    static inline LaneVector zeroLanes() { return vdupq_n_u8(0); }
+#endif
+
+static void unpredictBandSIMD(uint8_t* data, int steps, int bandSize, const uint8_t* above) {
+    static_assert(Channels == 3, "unpredict loop assumes three channels");
+    LaneVector w0 = zeroLanes(), w1 = zeroLanes(), w2 = zeroLanes();
+    LaneVector nw0 = zeroLanes(), nw1 = zeroLanes(), nw2 = zeroLanes();
+    uint8_t* pos = data;
+    for (int t = 0;  t < steps;  ++t) {
+        unpredictStep(w0, nw0, above[t],             pos);
+        unpredictStep(w1, nw1, above[t + steps],     &pos[bandSize]);
+        unpredictStep(w2, nw2, above[t + steps * 2], &pos[bandSize * 2]);
+        pos += DiagonalLanes;
+    }
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool DecodeFontTexture(uint8_t* rgb, bool vectorized) {
+    const int width = FontData::TexWidth;
+    const int height = FontData::TexHeight;
+    const int steps = width + DiagonalLanes - 1;
+    const int bandSize = steps * DiagonalLanes;
+    const int runCount = FontData::TexRunCount;
+    int streamSize = 0;
+    for (int i = 0;  i < Streams;  ++i) { streamSize += FontData::TexStreamSize[i]; }
+    const int literalCount = (FontData::TexDataSize - streamSize) * 2;
+    if ((runCount % (Streams * 2)) || (literalCount < 0)) { return false; }
+    #if defined(FONTCODEC_SSE2) || defined(FONTCODEC_NEON)
+        auto unpredictBand = vectorized ? unpredictBandSIMD : unpredictBandScalar;
+    #else
+        (void)vectorized;
+        auto unpredictBand = unpredictBandScalar;
+    #endif
+
+    // decoding tables, run lengths, the residuals of the current band
+    // (in coding order) and the last row of the previous band (zero for
+    // the first band; columns that are only used by lanes outside of the
+    // image stay zero too), all channels one after another
+    constexpr size_t tablesSize = 2 * sizeof(DecodeTable);
+    size_t size = tablesSize + runCount + Channels * (bandSize + steps);
+    #if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+        size += literalCount;
+    #endif
+    void* buffer = ::calloc(size, 1);
+    if (!buffer) { return false; }
+    DecodeTable* tables = static_cast<DecodeTable*>(buffer);
+    uint8_t* runs = &static_cast<uint8_t*>(buffer)[tablesSize];
+    uint8_t* band = &runs[runCount];
+    uint8_t* above = &band[Channels * bandSize];
+    #if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+        uint8_t* literalBytes = &above[Channels * steps];
+    #endif
+
+    // entropy decoding of the run lengths; the literals follow directly
+    bool ok = buildDecodeTable(tables[0], &FontData::TexFreq[0])
+           && buildDecodeTable(tables[1], &FontData::TexFreq[256]);
+    const uint16_t* data = FontData::TexData;
+    ok = ok && decodeParts(runs, runCount / Streams, tables[0], tables[1], data, FontData::TexStreamSize);
+    #if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+        // the literals are stored in pairs, low byte first
+        for (int i = 0;  i < literalCount;  ++i) {
+            literalBytes[i] = uint8_t(data[i >> 1] >> ((i & 1) * 8));
+        }
+    #else
+        const uint8_t* literalBytes = reinterpret_cast<const uint8_t*>(data);
+    #endif
+    RunCursor cursor[Channels];
+    cursor[0].runs = runs;
+    cursor[0].runsEnd = &runs[runCount];
+    cursor[0].literals = literalBytes;
+    cursor[0].literalsEnd = &literalBytes[literalCount];
+
+    // the run lengths and literals of the channels follow each other, so
+    // find out where the second and third channel start by skipping over
+    // the previous one; then zero-run decode each band of all channels,
+    // unpredict it, and move its pixels into place
+    const int channelSize = ((height + DiagonalLanes - 1) / DiagonalLanes) * bandSize;
+    for (int c = 1;  ok && (c < Channels);  ++c) {
+        cursor[c] = cursor[c - 1];
+        ok = cursor[c].expand(nullptr, channelSize);
+        cursor[c].nextChannel();
+    }
+    for (int y0 = 0;  ok && (y0 < height);  y0 += DiagonalLanes) {
+        int rows = std::min(DiagonalLanes, height - y0);
+        for (int c = 0;  ok && (c < Channels);  ++c) {
+            ok = cursor[c].expand(&band[c * bandSize], bandSize);
+        }
+        if (!ok) { break; }
+        unpredictBand(band, steps, bandSize, above);
+        for (int r = 0;  r < rows;  ++r) {
+            const uint8_t* src = &band[r * DiagonalLanes + r];
+            uint8_t* dest = &rgb[((y0 + r) * width) * Channels];
+            for (int x = 0;  x < width;  ++x) {
+                dest[0] = src[0];
+                dest[1] = src[bandSize];
+                dest[2] = src[bandSize * 2];
+                src += DiagonalLanes;
+                dest += Channels;
+            }
+        }
+        if (rows == DiagonalLanes) {
+            for (int c = 0;  c < Channels;  ++c) {
+                const uint8_t* src = &band[c * bandSize + (DiagonalLanes - 1) * (DiagonalLanes + 1)];
+                for (int x = 0;  x < width;  ++x) { above[c * steps + x] = src[x * DiagonalLanes]; }
+            }
+        }
+    }
+
+    ::free(buffer);
+    return ok;
+}
@@ -0,0 +1,22 @@
+// SPDX-FileCopyrightText: 2023 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstdint>
+
+//! decode the baked font's texture (FontData::TexData) into an RGB image
+//! of FontData::TexWidth x FontData::TexHeight pixels without padding
+//! between the rows; returns false if the data is inconsistent or if
+//! there's not enough memory
+//!
+//! The texture is stored as the residuals of Bloom's clamped gradient
+//! predictor, in bands of 16 rows that are skewed by one pixel per row, so
+//! that a whole column of a band can be unpredicted at once with SIMD
+//! instructions, and all three channels in the same loop. The residuals
+//! are zero-run coded; the run lengths are entropy-coded with static rANS
+//! in four independent streams that are decoded side by side, while the
+//! literals are stored as they are. 'vectorized' = false selects a scalar
+//! implementation of the unpredict step (for benchmarks); the result is
+//! the same.
+bool DecodeFontTexture(uint8_t* rgb, bool vectorized=true);
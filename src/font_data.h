@@ -18,8 +18,11 @@ namespace FontData {
 
     extern const int TexWidth;
     extern const int TexHeight;
-    extern const int TexDataSize;
-    extern const uint8_t TexData[];
+    extern const int TexDataSize;       //!< in 16-bit words
+    extern const int TexStreamSize[];   //!< rANS streams of run lengths, in 16-bit words
+    extern const int TexRunCount;       //!< number of run lengths, including padding
+    extern const uint16_t TexFreq[];    //!< rANS symbol frequencies, 256 per table
+    extern const uint16_t TexData[];    //!< coded residuals, see font_codec.h
 
     extern const float Baseline;
     extern const int NumGlyphs;
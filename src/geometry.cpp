@@ -39,12 +39,36 @@ void Geometry::update(int screenWidth_, int screenHeight_) {
 }
 
 void Geometry::setTimeDelta(float dt) {
-    _filterCoeff = std::exp2(dt * (-1.0f / 0.05f));
+    _prevAnimTime = animTime;
+    animTime += double(dt);
 }
 
-int Geometry::animUpdate(float &value, float newValue) const {
-    value = newValue + _filterCoeff * (value - newValue);
-    bool running = (std::abs(value - newValue) > 1E-3f);
-    if (!running) { value = newValue; }
-    return running ? 1 : 0;
+int Geometry::animUpdate(AnimValue &value, float newValue) const {
+    if (newValue != value.target) {
+        value.start  = value.at(_prevAnimTime);
+        value.t0     = _prevAnimTime;
+        value.target = newValue;
+    }
+    return (value.at(animTime) != value.target) ? 1 : 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+float AnimValue::delta(double t) const {
+    if (start == target) { return 0.0f; }
+    return (start - target) * std::exp2(float(t - t0) * (-1.0f / AnimTimeConstant));
+}
+
+float AnimValue::at(double t) const {
+    // NOTE: the vertex shader does the same computation
+    float d = delta(t);
+    return (std::abs(d) > 1E-3f) ? (target + d) : target;
+}
+
+AnimValue AnimValue::sum(const AnimValue& a, const AnimValue& b) {
+    AnimValue res;
+    res.t0 = std::max(a.t0, b.t0);
+    res.target = a.target + b.target;
+    res.start = res.target + a.delta(res.t0) + b.delta(res.t0);
+    return res;
 }
@@ -5,6 +5,35 @@
 
 #include <algorithm>
 
+//! time constant of all animations (in seconds); the distance to the
+//! target value is halved after that time
+constexpr float AnimTimeConstant = 0.05f;
+
+//! an animated value: an exponential decay from a start value towards a
+//! target, in closed form, so it can be evaluated at any point in time
+//! (including in the vertex shader, see TextBoxRenderer::setAnim())
+struct AnimValue {
+    float start = 0.0f;   //!< value at time t0
+    float target = 0.0f;  //!< value that is approached
+    double t0 = 0.0;      //!< time at which the animation started
+
+    inline AnimValue() {}
+    inline explicit AnimValue(float value) : start(value), target(value) {}
+
+    //! value at time t, snapped to the target once it's close enough
+    float at(double t) const;
+    //! distance from the target at time t, without snapping
+    float delta(double t) const;
+
+    //! sum of two animations; since all animations use the same time
+    //! constant, that's an animation again (valid until either is retargeted)
+    static AnimValue sum(const AnimValue& a, const AnimValue& b);
+
+    inline bool operator== (const AnimValue& other) const
+        { return (start == other.start) && (target == other.target) && (t0 == other.t0); }
+    inline bool operator!= (const AnimValue& other) const { return !(*this == other); }
+};
+
 struct Geometry {
     int screenWidth;
     int screenHeight;
@@ -36,8 +65,13 @@ struct Geometry {
 
     void update(int screenWidth, int screenHeight);
 
-    // animation filter API
-    float _filterCoeff;
+    // animation API: the animation time advances by the time delta in each
+    // frame; a new target takes effect from the start of the frame, i.e. the
+    // previous frame's time
+    double animTime = 0.0;
+    double _prevAnimTime = 0.0;
     void setTimeDelta(float dt);
-    int animUpdate(float &value, float newValue) const;
+    //! retarget an animation if needed; returns 1 if it's still running
+    int animUpdate(AnimValue &value, float newValue) const;
+    inline float animValue(const AnimValue& value) const { return value.at(animTime); }
 };
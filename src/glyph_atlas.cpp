@@ -0,0 +1,459 @@
+// SPDX-FileCopyrightText: 2023 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+
+#include <new>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <condition_variable>
+
+#ifdef HAVE_FREETYPE
+    #include <ft2build.h>
+    #include FT_FREETYPE_H
+    #include FT_OUTLINE_H
+#endif
+
+#include "glad.h"
+
+#include "font_data.h"
+#include "glyph_atlas.h"
+
+constexpr int Padding = int(GlyphAtlas::Range);  // distance field border around the outline (in pixels)
+constexpr int NotifyInterval = 10;  // milliseconds between notifications while rendering a long batch
+
+///////////////////////////////////////////////////////////////////////////////
+
+#ifdef HAVE_FREETYPE
+
+// fonts that are tried if none has been specified, in that order
+static const char* const DefaultFonts[] = {
+#ifdef _WIN32
+    "C:\\Windows\\Fonts\\segoeui.ttf",
+    "C:\\Windows\\Fonts\\arial.ttf",
+    "C:\\Windows\\Fonts\\msyh.ttc",
+#else
+    "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf",
+    "/usr/share/fonts/TTF/DejaVuSans.ttf",
+    "/usr/share/fonts/dejavu/DejaVuSans.ttf",
+    "/usr/share/fonts/truetype/noto/NotoSans-Regular.ttf",
+    "/usr/share/fonts/noto/NotoSans-Regular.ttf",
+    "/usr/share/fonts/google-noto/NotoSans-Regular.ttf",
+    "/usr/share/fonts/truetype/droid/DroidSansFallbackFull.ttf",
+    "/usr/share/fonts/opentype/noto/NotoSansCJK-Regular.ttc",
+    "/usr/share/fonts/noto-cjk/NotoSansCJK-Regular.ttc",
+    "/usr/share/fonts/truetype/freefont/FreeSans.ttf",
+    "/usr/share/fonts/gnu-free/FreeSans.ttf",
+#endif
+    nullptr
+};
+
+static bool openFont(const char* file, FT_Library& library, FT_Face& face) {
+    if (FT_Init_FreeType(&library)) { library = nullptr;  return false; }
+    if (FT_New_Face(library, file, 0, &face) || !(face->face_flags & FT_FACE_FLAG_SCALABLE)) {
+        FT_Done_FreeType(library);
+        library = nullptr;
+        face = nullptr;
+        return false;
+    }
+    return true;
+}
+
+// placement of a glyph's distance field bitmap, in pixels relative to the
+// pen position (y pointing down), along with the scale of the outline
+struct GlyphLayout {
+    float scale;  // pixels per font unit
+    int x0, y0;
+    int width, height;
+};
+
+// load a glyph's outline (in font units) and determine its metrics in the
+// same units as the baked font, i.e. relative to the line height, with the
+// baseline at the same position; large glyphs are scaled down to fit a cell
+static bool loadGlyph(FT_Face face, uint32_t codepoint, FontData::Glyph& g, GlyphLayout& l) {
+    FT_UInt index = FT_Get_Char_Index(face, FT_ULong(codepoint));
+    if (!index || FT_Load_Glyph(face, index, FT_LOAD_NO_SCALE | FT_LOAD_NO_HINTING | FT_LOAD_NO_BITMAP)
+    || (face->glyph->format != FT_GLYPH_FORMAT_OUTLINE)) { return false; }
+    float lineHeight = float(face->height);
+    if (lineHeight <= 0.0f) { lineHeight = float(face->ascender - face->descender); }
+    if (lineHeight <= 0.0f) { lineHeight = float(face->units_per_EM); }
+    g.codepoint = codepoint;
+    g.advance = float(face->glyph->metrics.horiAdvance) / lineHeight;
+    g.space = (face->glyph->outline.n_contours <= 0);
+    g.pos = g.tc = FontData::Box{ 0.0f, 0.0f, 0.0f, 0.0f };
+    if (g.space) { return true; }
+
+    FT_BBox box;
+    FT_Outline_Get_CBox(&face->glyph->outline, &box);
+    l.scale = GlyphAtlas::PixelsPerEm / float(face->units_per_EM);
+    float extent = float(std::max(box.xMax - box.xMin, box.yMax - box.yMin));
+    float maxExtent = float(GlyphAtlas::CellSize - 3 - 2 * Padding);
+    if ((extent * l.scale) > maxExtent) { l.scale = maxExtent / extent; }
+    l.x0 = int(std::floor(float(box.xMin) * l.scale)) - Padding;
+    l.y0 = int(std::floor(float(-box.yMax) * l.scale)) - Padding;
+    l.width  = int(std::ceil(float(box.xMax) * l.scale)) + Padding - l.x0;
+    l.height = int(std::ceil(float(-box.yMin) * l.scale)) + Padding - l.y0;
+    float k = 1.0f / (l.scale * lineHeight);  // pixels -> line height units
+    g.pos.x0 = float(l.x0) * k;
+    g.pos.x1 = float(l.x0 + l.width) * k;
+    g.pos.y0 = FontData::Baseline + float(l.y0) * k;
+    g.pos.y1 = FontData::Baseline + float(l.y0 + l.height) * k;
+    return true;
+}
+
+// glyph outline, flattened into line segments in bitmap coordinates
+struct Outline {
+    struct Point { float x, y; };
+    std::vector<Point> seg;  // pairs of points
+    Point pos;
+    float scale, x0, y0;
+    inline Point map(const FT_Vector* v) const
+        { return Point{ float(v->x) * scale - x0, float(-v->y) * scale - y0 }; }
+    inline void lineTo(Point p) { seg.push_back(pos);  seg.push_back(p);  pos = p; }
+    void curveTo(const Point* c, int n);  // n = number of control points after the current position
+};
+
+void Outline::curveTo(const Point* c, int n) {
+    // subdivide into segments of about two pixels (based on the length of
+    // the control polygon), evaluating the Bezier curve with de Casteljau
+    Point p[4] = { pos, c[0], c[1], (n > 2) ? c[2] : c[1] };
+    float len = 0.0f;
+    for (int i = 0;  i < n;  ++i) { len += std::hypot(p[i + 1].x - p[i].x, p[i + 1].y - p[i].y); }
+    int steps = std::max(2, std::min(32, int(len * 0.5f) + 1));
+    for (int s = 1;  s <= steps;  ++s) {
+        float t = float(s) / float(steps);
+        Point q[4];
+        std::copy(p, p + n + 1, q);
+        for (int k = n;  k > 0;  --k) {
+            for (int i = 0;  i < k;  ++i) {
+                q[i].x += (q[i + 1].x - q[i].x) * t;
+                q[i].y += (q[i + 1].y - q[i].y) * t;
+            }
+        }
+        lineTo(q[0]);
+    }
+}
+
+static bool renderGlyph(FT_Face face, uint32_t codepoint, std::vector<uint8_t>& data, int& width, int& height) {
+    data.assign(size_t(GlyphAtlas::CellSize * GlyphAtlas::CellSize), 0u);
+    width = height = 0;
+    FontData::Glyph g;
+    GlyphLayout l;
+    if (!loadGlyph(face, codepoint, g, l) || g.space) { return false; }
+    width = l.width;
+    height = l.height;
+
+    Outline o;
+    o.scale = l.scale;  o.x0 = float(l.x0);  o.y0 = float(l.y0);
+    FT_Outline_Funcs funcs;
+    funcs.move_to  = [] (const FT_Vector* to, void* user) -> int
+        { Outline* o = static_cast<Outline*>(user);  o->pos = o->map(to);  return 0; };
+    funcs.line_to  = [] (const FT_Vector* to, void* user) -> int
+        { Outline* o = static_cast<Outline*>(user);  o->lineTo(o->map(to));  return 0; };
+    funcs.conic_to = [] (const FT_Vector* c, const FT_Vector* to, void* user) -> int
+        { Outline* o = static_cast<Outline*>(user);  Outline::Point p[2] = { o->map(c), o->map(to) };  o->curveTo(p, 2);  return 0; };
+    funcs.cubic_to = [] (const FT_Vector* c1, const FT_Vector* c2, const FT_Vector* to, void* user) -> int
+        { Outline* o = static_cast<Outline*>(user);  Outline::Point p[3] = { o->map(c1), o->map(c2), o->map(to) };  o->curveTo(p, 3);  return 0; };
+    funcs.shift = 0;
+    funcs.delta = 0;
+    if (FT_Outline_Decompose(&face->glyph->outline, &funcs, static_cast<void*>(&o))) { return false; }
+
+    // signed distance of each pixel center to the nearest segment; the sign
+    // comes from the winding number (TrueType and CFF both use nonzero fill)
+    const size_t n = o.seg.size();
+    for (int y = 0;  y < l.height;  ++y) {
+        float py = float(y) + 0.5f;
+        for (int x = 0;  x < l.width;  ++x) {
+            float px = float(x) + 0.5f;
+            float best = 1E30f;
+            int winding = 0;
+            for (size_t i = 0;  i < n;  i += 2) {
+                const Outline::Point& a = o.seg[i];
+                const Outline::Point& b = o.seg[i + 1];
+                float dx = b.x - a.x, dy = b.y - a.y;
+                float ax = px - a.x, ay = py - a.y;
+                float len2 = dx * dx + dy * dy;
+                float t = (len2 > 0.0f) ? std::min(1.0f, std::max(0.0f, (ax * dx + ay * dy) / len2)) : 0.0f;
+                float ex = ax - t * dx, ey = ay - t * dy;
+                best = std::min(best, ex * ex + ey * ey);
+                float cross = dx * ay - dy * ax;
+                if (a.y <= py) {
+                    if ((b.y > py) && (cross > 0.0f)) { ++winding; }
+                } else {
+                    if ((b.y <= py) && (cross < 0.0f)) { --winding; }
+                }
+            }
+            float d = std::sqrt(best) * (winding ? 1.0f : -1.0f);
+            float v = (0.5f + d / GlyphAtlas::Range) * 255.0f + 0.5f;
+            data[size_t(y * GlyphAtlas::CellSize + x)] = uint8_t(std::min(255.0f, std::max(0.0f, v)));
+        }
+    }
+    return true;
+}
+
+#endif  // HAVE_FREETYPE
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool GlyphAtlas::init(const char* fontFile) {
+    shutdown();
+    #ifdef HAVE_FREETYPE
+        FT_Library library = nullptr, threadLibrary = nullptr;
+        FT_Face face = nullptr, threadFace = nullptr;
+        if (fontFile) {
+            if (!openFont(fontFile, library, face)) { return false; }
+        } else {
+            for (const char* const* f = DefaultFonts;  *f && !face;  ++f) {
+                if (openFont(*f, library, face)) { fontFile = *f; }
+            }
+            if (!face) { return false; }
+        }
+        // the background thread gets its own FreeType instance, because
+        // FreeType objects must not be used by multiple threads at once
+        if (!openFont(fontFile, threadLibrary, threadFace)) {
+            FT_Done_FreeType(library);
+            return false;
+        }
+        m_slots = new(std::nothrow) Slot[MaxGlyphs];
+        if (!m_slots) {
+            FT_Done_FreeType(threadLibrary);
+            FT_Done_FreeType(library);
+            return false;
+        }
+        m_library = library;              m_face = face;
+        m_threadLibrary = threadLibrary;  m_threadFace = threadFace;
+        m_fontFile = fontFile;
+        m_quit = false;
+        m_thread = std::thread([this] { threadMain(); });
+        #ifdef _DEBUG
+            printf("dynamic glyph atlas font: %s\n", fontFile);
+        #endif
+        return true;
+    #else
+        (void)fontFile;
+        return false;
+    #endif
+}
+
+void GlyphAtlas::shutdown() {
+    if (m_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_queueMutex);
+            m_quit = true;
+        }
+        m_wake.notify_one();
+        m_thread.join();
+    }
+    #ifdef HAVE_FREETYPE
+        if (m_threadLibrary) { FT_Done_FreeType(m_threadLibrary); }
+        if (m_library)       { FT_Done_FreeType(m_library); }
+    #endif
+    m_threadLibrary = m_library = nullptr;
+    m_threadFace = m_face = nullptr;
+    if (m_tex) {
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        glActiveTexture(GL_TEXTURE0);
+        glDeleteTextures(1, &m_tex);
+        m_tex = 0;
+    }
+    m_pages = 0;
+    m_cellOwner.clear();
+    m_freeCells.clear();
+    m_requests.clear();
+    m_done.clear();
+    m_pending.store(0);
+    m_slotMap.clear();
+    m_slotCount = 0;
+    delete[] m_slots;
+    m_slots = nullptr;
+}
+
+int GlyphAtlas::lookup(uint32_t codepoint) {
+    if (!active()) { return -1; }
+    std::lock_guard<std::mutex> lock(m_slotMutex);
+    auto it = m_slotMap.find(codepoint);
+    if (it != m_slotMap.end()) { return it->second; }
+    int id = -1;
+    #ifdef HAVE_FREETYPE
+        GlyphLayout l;
+        if ((m_slotCount < MaxGlyphs) && loadGlyph(m_face, codepoint, m_slots[m_slotCount].glyph, l)) {
+            // spaces are never drawn, so there's no need to render them
+            if (m_slots[m_slotCount].glyph.space) { m_slots[m_slotCount].state.store(Resident); }
+            id = m_slotCount++;
+        }
+    #endif
+    m_slotMap[codepoint] = id;
+    return id;
+}
+
+void GlyphAtlas::request(int id) {
+    // only the thread that moves the glyph out of the Missing state queues it
+    int expected = Missing;
+    if (!m_slots[id].state.compare_exchange_strong(expected, Requested)) { return; }
+    m_pending.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        m_requests.push_back(id);
+    }
+    m_wake.notify_one();
+}
+
+void GlyphAtlas::threadMain() {
+    std::vector<int> requests;
+    std::unique_lock<std::mutex> lock(m_queueMutex);
+    for (;;) {
+        m_wake.wait(lock, [this] { return m_quit || !m_requests.empty(); });
+        if (m_quit) { break; }
+        requests.swap(m_requests);
+        m_busy = true;
+        lock.unlock();
+        // tell the main thread about new glyphs at the end of the batch,
+        // and in between if it takes long, so they appear progressively
+        auto lastNotify = std::chrono::steady_clock::now();
+        for (int id : requests) {
+            Bitmap bmp;
+            bmp.id = id;
+            bmp.width = bmp.height = 0;
+            #ifdef HAVE_FREETYPE
+                // on failure, the result is an empty cell
+                renderGlyph(m_threadFace, m_slots[id].glyph.codepoint, bmp.data, bmp.width, bmp.height);
+            #endif
+            {
+                std::lock_guard<std::mutex> doneLock(m_queueMutex);
+                m_done.push_back(std::move(bmp));
+                if (m_quit) { break; }
+            }
+            auto now = std::chrono::steady_clock::now();
+            if (m_notify && ((now - lastNotify) > std::chrono::milliseconds(NotifyInterval))) {
+                m_notify();
+                lastNotify = now;
+            }
+        }
+        if (m_notify) { m_notify(); }
+        requests.clear();
+        lock.lock();
+        m_busy = false;
+        m_idle.notify_all();
+    }
+}
+
+void GlyphAtlas::finish() {
+    if (!m_thread.joinable()) { return; }
+    std::unique_lock<std::mutex> lock(m_queueMutex);
+    m_idle.wait(lock, [this] { return m_quit || (m_requests.empty() && !m_busy); });
+}
+
+int GlyphAtlas::allocateCell(std::vector<int>& changed) {
+    if (!m_freeCells.empty()) {
+        int cell = m_freeCells.back();
+        m_freeCells.pop_back();
+        return cell;
+    }
+
+    // add a new page; the texture array is created with all pages at once
+    // (by upload(), when the first glyph is copied into it)
+    if (m_pages < MaxPages) {
+        int first = m_pages * CellsPerPage;
+        ++m_pages;
+        m_cellOwner.resize(size_t(m_pages * CellsPerPage), -1);
+        for (int cell = m_pages * CellsPerPage - 1;  cell > first;  --cell) { m_freeCells.push_back(cell); }
+        return first;
+    }
+
+    // evict the least recently used glyph, unless it has been used in the
+    // current or the previous frame (i.e. it may be on screen right now)
+    int victim = -1;
+    uint32_t maxAge = 1u;
+    for (int cell = 0;  cell < int(m_cellOwner.size());  ++cell) {
+        uint32_t age = m_frame - m_slots[m_cellOwner[cell]].lastUsed.load(std::memory_order_relaxed);
+        if (age > maxAge) { maxAge = age;  victim = cell; }
+    }
+    if (victim < 0) { return -1; }
+    int id = m_cellOwner[victim];
+    m_slots[id].cell = -1;
+    m_slots[id].state.store(Missing);
+    changed.push_back(id);
+    return victim;
+}
+
+void GlyphAtlas::update(std::vector<int>& changed, std::vector<Upload>& uploads) {
+    changed.clear();
+    uploads.clear();
+    ++m_frame;
+    if (!active()) { return; }
+    std::vector<Bitmap> done;
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        if (m_done.empty()) { return; }
+        done.swap(m_done);
+    }
+
+    bool added = false;
+    for (size_t i = 0;  i < done.size();  ++i) {
+        int cell = allocateCell(changed);
+        if (cell < 0) {
+            // everything in the atlas is in use; try again in the next frame
+            std::lock_guard<std::mutex> lock(m_queueMutex);
+            m_done.insert(m_done.end(), std::make_move_iterator(done.begin() + ptrdiff_t(i)), std::make_move_iterator(done.end()));
+            break;
+        }
+        Bitmap& bmp = done[i];
+        Slot& s = m_slots[bmp.id];
+        float u0 = float((cell % CellsPerRow) * CellSize) * (1.0f / float(PageSize));
+        float v0 = float(((cell % CellsPerPage) / CellsPerRow) * CellSize) * (1.0f / float(PageSize));
+        s.glyph.tc = FontData::Box{ u0, v0, u0 + float(bmp.width)  * (1.0f / float(PageSize)),
+                                            v0 + float(bmp.height) * (1.0f / float(PageSize)) };
+        s.cell = cell;
+        s.lastUsed.store(m_frame, std::memory_order_relaxed);  // don't evict it right away
+        m_cellOwner[size_t(cell)] = bmp.id;
+        s.state.store(Resident);
+        m_pending.fetch_sub(1);
+        changed.push_back(bmp.id);
+        uploads.push_back({ cell, std::move(bmp.data) });
+        added = true;
+    }
+    if (added) { ++m_version; }
+}
+
+void GlyphAtlas::upload(const std::vector<Upload>& uploads) {
+    if (uploads.empty()) { return; }
+    // texture unit 2 is reserved for the atlas, so it stays bound
+    glActiveTexture(GL_TEXTURE2);
+    if (!m_tex) {
+        glGenTextures(1, &m_tex);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, m_tex);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R8, PageSize, PageSize, MaxPages, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (const Upload& u : uploads) {
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0,
+            (u.cell % CellsPerRow) * CellSize, ((u.cell % CellsPerPage) / CellsPerRow) * CellSize, u.cell / CellsPerPage,
+            CellSize, CellSize, 1, GL_RED, GL_UNSIGNED_BYTE, static_cast<const void*>(u.data.data()));
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void GlyphAtlas::metrics(int id, float* m) const {
+    const Slot& s = m_slots[id];
+    const FontData::Glyph& g = (s.cell >= 0) ? s.glyph : FontData::GlyphData[FontData::FallbackGlyphIndex];
+    const float r[MetricsSize] = {
+        g.pos.x0, g.pos.y0, g.pos.x1, g.pos.y1,
+        g.tc.x0,  g.tc.y0,  g.tc.x1,  g.tc.y1,
+        (s.cell >= 0) ? float(s.cell / CellsPerPage + 1) : 0.0f, 0.0f, 0.0f, 0.0f
+    };
+    memcpy(static_cast<void*>(m), static_cast<const void*>(r), sizeof(r));
+}
@@ -0,0 +1,166 @@
+// SPDX-FileCopyrightText: 2023 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstdint>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <string>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <condition_variable>
+
+#include "glad.h"
+
+#include "font_data.h"
+
+struct FT_LibraryRec_;
+struct FT_FaceRec_;
+
+//! glyphs for characters that are not part of the baked font: they are
+//! rendered on demand from a system font (with FreeType, if available) by
+//! a background thread, and packed into the cells of a texture array with
+//! LRU eviction; until a glyph is ready, the fallback glyph is drawn instead
+//!
+//! The atlas contains single-channel signed distance fields; as all three
+//! channels of an MSDF texel are equal then, the median in the text shader
+//! simply turns into the distance itself.
+class GlyphAtlas {
+public:
+    static constexpr int MaxGlyphs = 8192;     //!< number of glyph IDs (characters) that can be assigned
+    static constexpr int PageSize = 1024;      //!< width and height of a texture array layer
+    static constexpr int CellSize = 48;        //!< width and height of a glyph cell, including a gap to the next cell
+    static constexpr int MaxPages = 4;         //!< number of texture array layers
+    static constexpr int CellsPerRow = PageSize / CellSize;
+    static constexpr int CellsPerPage = CellsPerRow * CellsPerRow;
+    static constexpr float PixelsPerEm = 40.0f;  //!< same resolution as the baked font
+    static constexpr float Range = 3.0f;         //!< distance range (in pixels) from value 0 to value 1, like the baked font
+    static constexpr int MetricsSize = 12;     //!< number of floats per glyph in metrics()
+
+private:
+    enum State : int {
+        Missing   = 0,  // not in the atlas, and not requested yet
+        Requested = 1,  // queued for (or being) rendered
+        Resident  = 2,  // in the atlas
+    };
+
+    struct Slot {
+        FontData::Glyph glyph;   // true metrics (tc is the atlas cell, if resident)
+        int cell = -1;           // page * CellsPerPage + cell in page; -1 = none
+        std::atomic<int> state;
+        std::atomic<uint32_t> lastUsed;
+        inline Slot() : state(Missing), lastUsed(0u) {}
+    };
+    Slot* m_slots = nullptr;
+    int m_slotCount = 0;
+    std::unordered_map<uint32_t, int> m_slotMap;  // codepoint -> ID; -1 = not in the font
+    std::mutex m_slotMutex;
+    uint32_t m_frame = 2u;
+    uint32_t m_version = 0u;
+
+    // main thread font face (for metrics only)
+    FT_LibraryRec_* m_library = nullptr;
+    FT_FaceRec_* m_face = nullptr;
+    std::string m_fontFile;
+
+    // background thread: renders the requested glyphs into the done queue
+    struct Bitmap {
+        int id;
+        int width, height;          // size of the distance field
+        std::vector<uint8_t> data;  // CellSize x CellSize, distance field in the top-left corner
+    };
+    std::thread m_thread;
+    std::mutex m_queueMutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_idle;
+    std::vector<int> m_requests;
+    std::vector<Bitmap> m_done;
+    std::atomic<int> m_pending;
+    bool m_quit = false;
+    bool m_busy = false;
+    std::function<void()> m_notify;
+    FT_LibraryRec_* m_threadLibrary = nullptr;  // the thread's own FreeType instance
+    FT_FaceRec_* m_threadFace = nullptr;
+    void threadMain();
+    void request(int id);
+
+    // atlas texture (created when the first glyph arrives) and cell usage
+    GLuint m_tex = 0;
+    int m_pages = 0;
+    std::vector<int> m_cellOwner;  // ID of the glyph in each cell; -1 = free
+    std::vector<int> m_freeCells;
+    int allocateCell(std::vector<int>& changed);
+
+public:
+    inline GlyphAtlas() : m_pending(0) {}
+    inline ~GlyphAtlas() { shutdown(); }
+
+    //! load the font (nullptr = search a few well-known system fonts)
+    //! and start the background thread; returns false if no font could
+    //! be loaded or FreeType isn't available, in which case lookup()
+    //! always fails
+    bool init(const char* fontFile=nullptr);
+    void shutdown();
+    inline bool active() const { return (m_face != nullptr); }
+
+    //! set a function that the background thread calls when new glyphs
+    //! are ready for update(); call before init()
+    inline void setNotify(std::function<void()> notify) { m_notify = notify; }
+    inline const std::string& fontFile() const { return m_fontFile; }
+
+    //! get the glyph ID for a codepoint, assigning a new one if needed;
+    //! returns -1 if the font doesn't contain the character (or all IDs
+    //! are in use); thread-safe
+    int lookup(uint32_t codepoint);
+
+    //! true metrics of a glyph, in the same units as FontData::GlyphData;
+    //! thread-safe for IDs that lookup() has returned
+    inline const FontData::Glyph& glyph(int id) const { return m_slots[id].glyph; }
+
+    //! mark a glyph as used in the current frame, and request it if it
+    //! isn't in the atlas yet; thread-safe
+    inline void touch(int id) {
+        Slot& s = m_slots[id];
+        s.lastUsed.store(m_frame, std::memory_order_relaxed);
+        if (s.state.load(std::memory_order_relaxed) == Missing) { request(id); }
+    }
+
+    //! a rendered glyph that needs to be copied into an atlas cell
+    struct Upload {
+        int cell;                   //!< page * CellsPerPage + cell in page
+        std::vector<uint8_t> data;  //!< CellSize x CellSize distance field
+    };
+
+    //! start a new frame: move glyphs that have been rendered in the
+    //! meantime into the atlas (evicting the least recently used ones, if
+    //! necessary) and return the IDs whose metrics() changed, along with
+    //! the cell contents that upload() needs to copy into the texture; main
+    //! thread only, but doesn't need the OpenGL context
+    void update(std::vector<int>& changed, std::vector<Upload>& uploads);
+
+    //! copy glyphs from update() into the atlas texture (creating it first,
+    //! if necessary); may be called from another thread than update(), but
+    //! needs to be the thread that holds the OpenGL context
+    void upload(const std::vector<Upload>& uploads);
+
+    //! wait until all requested glyphs have been rendered, so that the
+    //! next update() moves them into the atlas (for reproducible results)
+    void finish();
+
+    //! number of glyphs that have been requested, but aren't in the atlas yet
+    inline int pending() const { return m_pending.load(std::memory_order_relaxed); }
+
+    //! incremented whenever glyphs have been added to the atlas, i.e. when
+    //! everything that draws dynamic glyphs should be redrawn
+    inline uint32_t version() const { return m_version; }
+
+    //! metrics of a glyph as the glyph shader sees them (MetricsSize
+    //! floats): position box, texture coordinate box, and the texture array
+    //! layer plus one in the first component of the last four (0 = the glyph
+    //! isn't resident, draw the fallback glyph from the baked font instead)
+    void metrics(int id, float* m) const;
+};
@@ -0,0 +1,363 @@
+// SPDX-FileCopyrightText: 2023 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <vector>
+#include <algorithm>
+
+#ifdef HAVE_EGL
+    #include <EGL/egl.h>
+    #include <EGL/eglext.h>
+#endif
+
+#include "glad.h"
+
+#include "event.h"
+#include "scheduler.h"
+#include "softraster.h"
+#include "app.h"
+
+#include "headless.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool WritePPM(const char* filename, int width, int height, const uint8_t* rgb) {
+    FILE* f = fopen(filename, "wb");
+    if (!f) { return false; }
+    fprintf(f, "P6\n%d %d\n255\n", width, height);
+    bool ok = (fwrite(static_cast<const void*>(rgb), size_t(width) * 3u, size_t(height), f) == size_t(height));
+    fclose(f);
+    return ok;
+}
+
+void HeadlessContext::readPixels(std::vector<uint8_t>& rgb) {
+    int stride = m_width * 3;
+    std::vector<uint8_t> flipped(size_t(stride) * size_t(m_height));
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_fbo);
+    glReadPixels(0, 0, m_width, m_height, GL_RGB, GL_UNSIGNED_BYTE, static_cast<void*>(flipped.data()));
+    rgb.resize(flipped.size());
+    for (int y = 0;  y < m_height;  ++y) {
+        memcpy(&rgb[size_t(y) * size_t(stride)], &flipped[size_t(m_height - 1 - y) * size_t(stride)], size_t(stride));
+    }
+}
+
+#ifdef HAVE_EGL ///////////////////////////////////////////////////////////////
+
+static void* eglLoader(const char* name) {
+    return reinterpret_cast<void*>(eglGetProcAddress(name));
+}
+
+bool HeadlessContext::init(int width, int height) {
+    m_width = width;
+    m_height = height;
+
+    // prefer a surfaceless display (no X11/Wayland/DRM device needed at all)
+    EGLDisplay dpy = EGL_NO_DISPLAY;
+    auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    if (getPlatformDisplay) {
+        dpy = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+    if ((dpy == EGL_NO_DISPLAY) || !eglInitialize(dpy, nullptr, nullptr)) {
+        dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        if ((dpy == EGL_NO_DISPLAY) || !eglInitialize(dpy, nullptr, nullptr)) {
+            fprintf(stderr, "FATAL: failed to initialize EGL display\n");
+            return false;
+        }
+    }
+    m_display = static_cast<void*>(dpy);
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        fprintf(stderr, "FATAL: EGL doesn't support desktop OpenGL\n");
+        return false;
+    }
+
+    const EGLint configAttribs[] = {
+        EGL_SURFACE_TYPE,    EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint numConfigs = 0;
+    if (!eglChooseConfig(dpy, configAttribs, &config, 1, &numConfigs) || (numConfigs < 1)) {
+        fprintf(stderr, "FATAL: no suitable EGL configuration found\n");
+        return false;
+    }
+
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION,       3,
+        EGL_CONTEXT_MINOR_VERSION,       3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext ctx = eglCreateContext(dpy, config, EGL_NO_CONTEXT, contextAttribs);
+    if (ctx == EGL_NO_CONTEXT) {
+        fprintf(stderr, "FATAL: failed to create OpenGL context (EGL error 0x%04X)\n", eglGetError());
+        return false;
+    }
+    m_context = static_cast<void*>(ctx);
+
+    // try without any surface first; use a dummy pbuffer if that fails
+    EGLSurface surf = EGL_NO_SURFACE;
+    if (!eglMakeCurrent(dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, ctx)) {
+        const EGLint pbufferAttribs[] = { EGL_WIDTH, 16, EGL_HEIGHT, 16, EGL_NONE };
+        surf = eglCreatePbufferSurface(dpy, config, pbufferAttribs);
+        if ((surf == EGL_NO_SURFACE) || !eglMakeCurrent(dpy, surf, surf, ctx)) {
+            fprintf(stderr, "FATAL: failed to activate OpenGL context (EGL error 0x%04X)\n", eglGetError());
+            return false;
+        }
+        m_surface = static_cast<void*>(surf);
+    }
+
+    if (!gladLoadGLLoader(eglLoader)) {
+        fprintf(stderr, "FATAL: failed to import OpenGL functions\n");
+        return false;
+    }
+
+    // set up the off-screen framebuffer that stands in for the window
+    glGenRenderbuffers(1, &m_rb);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_rb);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glGenFramebuffers(1, &m_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_rb);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "FATAL: failed to create off-screen framebuffer\n");
+        return false;
+    }
+    glViewport(0, 0, width, height);
+    return true;
+}
+
+void HeadlessContext::shutdown() {
+    if (!m_display) { return; }
+    EGLDisplay dpy = static_cast<EGLDisplay>(m_display);
+    if (m_context) {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (m_fbo) { glDeleteFramebuffers(1, &m_fbo); }
+        if (m_rb)  { glDeleteRenderbuffers(1, &m_rb); }
+        eglMakeCurrent(dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(dpy, static_cast<EGLContext>(m_context));
+    }
+    if (m_surface) { eglDestroySurface(dpy, static_cast<EGLSurface>(m_surface)); }
+    eglTerminate(dpy);
+    m_display = m_context = m_surface = nullptr;
+    m_fbo = m_rb = 0;
+}
+
+#else // !HAVE_EGL ////////////////////////////////////////////////////////////
+
+bool HeadlessContext::init(int width, int height) {
+    m_width = width;
+    m_height = height;
+    fprintf(stderr, "FATAL: headless mode is not supported in this build (no EGL)\n");
+    return false;
+}
+
+void HeadlessContext::shutdown() {}
+
+#endif // HAVE_EGL ////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+
+// input script: one character per frame; '.' (or any other character not
+// listed here) means "no input in this frame", 'p' toggles the performance
+// overlay; the script is repeated until the requested number of frames has
+// been rendered
+static const struct ScriptEvent {
+    char c;
+    AppEvent ev;
+} scriptEvents[] = {
+    { 'u', AppEvent::Up },       { 'd', AppEvent::Down },
+    { 'U', AppEvent::PageUp },   { 'D', AppEvent::PageDown },
+    { 'h', AppEvent::Home },     { 'e', AppEvent::End },
+    { 'r', AppEvent::RS },       { 'l', AppEvent::LS },      // enter directory / parent directory
+    { 'x', AppEvent::X },        { 'y', AppEvent::Y },
+    { 'b', AppEvent::B },        { 's', AppEvent::Start },
+    { 0, AppEvent::Logo }
+};
+static const char* defaultScript =
+    "d...d...d...d...dddddddddddddddd................"
+    "r..........d...d...d..............l............"
+    "D.......D.......U.......U.......e.......h......."
+    "x.........d.....d.....b.........y.........b....."
+    "uuuuuuuuuuuuuuuu................................";
+constexpr int DefaultHeadlessFrames = 600;
+
+static bool initApp(GLBrowserApp& app, const HeadlessOptions& options, SoftRasterizer* soft) {
+    app.setDrawThreads(options.drawThreads);
+    app.setPanelBuildBudget(0.0);  // the same frames on every run
+    app.renderer().setFallbackFont(options.fallbackFont);
+    if (!app.init(options.initialPath, soft)) { return false; }
+    app.renderer().setUberShader(options.uberShader);
+    app.renderer().setCompositeOutlines(!options.multipassOutlines);
+    app.renderer().setLayers(!options.noLayers);
+    app.renderer().setGPUAnimation(!options.cpuAnimation);
+    app.renderer().setGPUGlyphs(!options.cpuGlyphs);
+    return true;
+}
+
+// feed a script character into the application and draw the next frame;
+// returns true if the frame has been presented
+static bool runFrame(GLBrowserApp& app, char c) {
+    if (c == 'p') { app.togglePerfHUD(); }
+    for (const auto* se = scriptEvents;  se->c;  ++se) {
+        if (se->c == c) { app.handleEvent(se->ev); break; }
+    }
+
+    // use a fixed time step, so that runs are reproducible; for the
+    // same reason, glyphs that have been requested in the previous
+    // frame are always there in the current frame
+    app.renderer().finishGlyphs();
+    app.requestFrame();
+    app.scheduler().beginFrame();
+    bool present = app.draw(1.0 / 60.0);
+    app.scheduler().endFrame();
+    return present;
+}
+
+int RunHeadless(const HeadlessOptions& options, const char* argv0) {
+    if (options.compare) { return RunHeadlessCompare(options, argv0); }
+    HeadlessContext ctx;
+    static SoftRasterizer soft;
+    if (options.software) {
+        if (!soft.init(options.width, options.height)) { return 1; }
+        printf("software renderer (%d threads)\n", soft.threads());
+    } else {
+        if (!ctx.init(options.width, options.height)) { return 1; }
+        printf("OpenGL renderer: %s (%s)\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+    }
+
+    bool active = true;
+    static GLBrowserApp app([&] (AppAction action) { if (action == AppAction::Quit) { active = false; } }, argv0);
+    if (!initApp(app, options, options.software ? &soft : nullptr)) { return 1; }
+    if (options.perfLog && !app.openPerfLog(options.perfLog)) {
+        fprintf(stderr, "WARNING: can not open performance log file '%s'\n", options.perfLog);
+    }
+    FrameScheduler& scheduler = app.scheduler();
+
+    const char* script = (options.script && options.script[0]) ? options.script : defaultScript;
+    const char* scriptPos = script;
+    std::vector<uint8_t> pixels;
+    char filename[1024];
+    int presented = 0;
+    int frames = (options.frames > 0) ? options.frames : DefaultHeadlessFrames;
+    for (int frame = 0;  active && (frame < frames);  ++frame) {
+        if (!*scriptPos) { scriptPos = script; }
+        bool present = runFrame(app, *scriptPos++);
+        if (!present) { continue; }
+        ++presented;
+        if (options.dumpPrefix) {
+            if (options.software) { soft.readPixels(pixels); }
+            else                  { ctx.readPixels(pixels); }
+            snprintf(filename, sizeof(filename), "%s%05d.ppm", options.dumpPrefix, frame);
+            if (!WritePPM(filename, options.width, options.height, pixels.data())) {
+                fprintf(stderr, "ERROR: failed to write '%s'\n", filename);
+            }
+        }
+    }
+
+    printf("%d frames rendered at %dx%d, %d presented\n", frames, options.width, options.height, presented);
+    scheduler.dumpStats(stdout);
+    app.shutdown();
+    soft.shutdown();
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+int RunHeadlessCompare(const HeadlessOptions& options, const char* argv0) {
+    HeadlessContext ctx;
+    static SoftRasterizer soft;
+    if (!ctx.init(options.width, options.height)) { return 1; }
+    if (!soft.init(options.width, options.height)) { return 1; }
+    printf("comparing OpenGL renderer: %s (%s)\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+    printf("     with software renderer (%d threads)\n", soft.threads());
+
+    // two instances of the application that get exactly the same input;
+    // the software renderer has no dynamic glyphs, so OpenGL mustn't use
+    // them either (they'd differ by design, not by accident)
+    bool active = true;
+    auto actionCallback = [&] (AppAction action) { if (action == AppAction::Quit) { active = false; } };
+    static GLBrowserApp glApp(actionCallback, argv0);
+    static GLBrowserApp softApp(actionCallback, argv0);
+    glApp.renderer().setDynamicGlyphs(false);
+    if (!initApp(glApp, options, nullptr) || !initApp(softApp, options, &soft)) { return 1; }
+
+    const char* script = (options.script && options.script[0]) ? options.script : defaultScript;
+    const char* scriptPos = script;
+    std::vector<uint8_t> glPixels, softPixels;
+    char filename[1024];
+    int compared = 0, failed = 0, mismatched = 0;
+    int maxDiff = 0, worstFrame = -1, maxBad = 0;
+    double sumDiff = 0.0, maxMean = 0.0;
+    int frames = (options.frames > 0) ? options.frames : DefaultHeadlessFrames;
+    for (int frame = 0;  active && (frame < frames);  ++frame) {
+        if (!*scriptPos) { scriptPos = script; }
+        char c = *scriptPos++;
+        bool glPresent = runFrame(glApp, c);
+        bool softPresent = runFrame(softApp, c);
+        if (glPresent != softPresent) { ++mismatched; }
+        if (!glPresent && !softPresent) { continue; }
+
+        // both framebuffers keep their contents, so the complete images
+        // can be compared even if only one of them has been updated; a few
+        // isolated pixels may differ a lot (in particular at the corners of
+        // MSDF glyphs, where the GPU's lower texture filtering precision can
+        // tip the balance), so only frames with more of them than that fail
+        ctx.readPixels(glPixels);
+        soft.readPixels(softPixels);
+        int frameMax = 0, frameBad = 0;
+        uint64_t frameSum = 0u;
+        for (size_t i = 0;  i < glPixels.size();  i += 3u) {
+            int pixelMax = 0;
+            for (size_t c = i;  c < (i + 3u);  ++c) {
+                int d = std::abs(int(glPixels[c]) - int(softPixels[c]));
+                pixelMax = std::max(pixelMax, d);
+                frameSum += uint64_t(d);
+            }
+            frameMax = std::max(frameMax, pixelMax);
+            if (pixelMax > options.compareThreshold) { ++frameBad; }
+        }
+        double frameMean = double(frameSum) / double(glPixels.size());
+        ++compared;
+        sumDiff += frameMean;
+        maxMean = std::max(maxMean, frameMean);
+        maxBad = std::max(maxBad, frameBad);
+        if (frameMax > maxDiff) { maxDiff = frameMax;  worstFrame = frame; }
+        if (frameBad <= options.compareOutliers) { continue; }
+        ++failed;
+        if (options.dumpPrefix) {
+            snprintf(filename, sizeof(filename), "%s%05d-gl.ppm", options.dumpPrefix, frame);
+            if (!WritePPM(filename, options.width, options.height, glPixels.data())) {
+                fprintf(stderr, "ERROR: failed to write '%s'\n", filename);
+            }
+            snprintf(filename, sizeof(filename), "%s%05d-soft.ppm", options.dumpPrefix, frame);
+            if (!WritePPM(filename, options.width, options.height, softPixels.data())) {
+                fprintf(stderr, "ERROR: failed to write '%s'\n", filename);
+            }
+        }
+    }
+
+    printf("%d frames rendered at %dx%d, %d compared\n", frames, options.width, options.height, compared);
+    printf("per-channel difference: max %d (frame %d), mean %.4f (worst frame: %.4f)\n",
+           maxDiff, worstFrame, compared ? (sumDiff / double(compared)) : 0.0, maxMean);
+    printf("pixels differing by more than %d: at most %d per frame (%d allowed)\n",
+           options.compareThreshold, maxBad, options.compareOutliers);
+    if (mismatched) {
+        printf("%d frames presented by only one of the renderers\n", mismatched);
+    }
+    bool ok = !failed && !mismatched;
+    if (ok) { printf("PASSED\n"); }
+    else    { printf("FAILED: %d frames differ too much\n", failed); }
+    glApp.shutdown();
+    softApp.shutdown();
+    soft.shutdown();
+    return ok ? 0 : 3;
+}
@@ -0,0 +1,69 @@
+// SPDX-FileCopyrightText: 2023 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstdint>
+
+#include <vector>
+
+//! an OpenGL 3.3 context without any window system, rendering into an
+//! off-screen framebuffer; uses EGL (surfaceless or pbuffer), so it works
+//! on GPU-less machines with Mesa's llvmpipe
+class HeadlessContext {
+    void* m_display = nullptr;
+    void* m_context = nullptr;
+    void* m_surface = nullptr;
+    unsigned m_fbo = 0;
+    unsigned m_rb = 0;
+    int m_width = 0;
+    int m_height = 0;
+
+public:
+    //! create the context and make it current; the off-screen framebuffer
+    //! is bound and the viewport is set up when this returns successfully
+    bool init(int width, int height);
+    void shutdown();
+    inline ~HeadlessContext() { shutdown(); }
+
+    inline int width()  const { return m_width; }
+    inline int height() const { return m_height; }
+
+    //! read back the framebuffer contents as top-down RGB
+    void readPixels(std::vector<uint8_t>& rgb);
+};
+
+//! options for the headless mode
+struct HeadlessOptions {
+    int width = 1920;
+    int height = 1080;
+    int frames = 0;                     //!< 0 = default (600 frames in headless mode)
+    const char* script = nullptr;       //!< input script (see headless.cpp); nullptr = default
+    const char* dumpPrefix = nullptr;   //!< if set, presented frames are written to <prefix>NNNNN.ppm
+    const char* initialPath = nullptr;
+    bool software = false;              //!< use the software rasterizer instead of OpenGL (no EGL needed)
+    const char* perfLog = nullptr;      //!< if set, per-frame performance statistics are written into this file
+    bool uberShader = false;            //!< use the uber-shader instead of the specialized pipelines
+    bool multipassOutlines = false;     //!< draw outlined boxes and text in multiple passes
+    bool noLayers = false;              //!< don't use render layers for the bars and stable panels
+    bool cpuAnimation = false;          //!< regenerate all quads in every frame instead of animating on the GPU
+    bool cpuGlyphs = false;             //!< generate the quads of directory entries on the CPU instead of the GPU
+    int drawThreads = 0;                //!< threads for vertex generation (0 = one per CPU core)
+    const char* fallbackFont = nullptr; //!< font for characters that aren't in the baked font (nullptr = search system fonts)
+    bool compare = false;               //!< render with OpenGL and the software rasterizer, and compare the frames
+    int compareThreshold = 16;          //!< largest per-channel difference between the two that is acceptable
+    int compareOutliers = 16;           //!< number of pixels per frame that may differ by more than that
+};
+
+//! run the application off-screen for a fixed number of frames with
+//! scripted input and a fixed time step, then print frame statistics
+int RunHeadless(const HeadlessOptions& options, const char* argv0=nullptr);
+
+//! run the same scripted frames through OpenGL and the software rasterizer
+//! side by side and compare the results pixel by pixel; returns a non-zero
+//! exit code if any frame has more than options.compareOutliers pixels that
+//! differ by more than options.compareThreshold
+int RunHeadlessCompare(const HeadlessOptions& options, const char* argv0=nullptr);
+
+//! write an RGB image into a binary PPM file
+bool WritePPM(const char* filename, int width, int height, const uint8_t* rgb);
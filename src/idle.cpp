@@ -0,0 +1,68 @@
+// SPDX-FileCopyrightText: 2023 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#include <cstdint>
+
+#include <atomic>
+#include <memory>
+#include <deque>
+#include <algorithm>
+#include <functional>
+
+#include "jobs.h"
+#include "scheduler.h"
+#include "idle.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+void IdleScheduler::add(const CancelToken& token, Task task) {
+    std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+    entry->token = token;
+    entry->task = task;
+    m_tasks.push_back(entry);
+    if (!m_paused.load()) { runNext(); }
+}
+
+void IdleScheduler::update(bool idle) {
+    if (!idle) { m_paused.store(true); return; }
+    m_paused.store(false);
+    runNext();
+}
+
+void IdleScheduler::runNext() {
+    while (!m_tasks.empty() && m_tasks.front()->token.cancelled()) { m_tasks.pop_front(); }
+    if (m_running || m_tasks.empty() || !m_jobs || !m_jobs->threads()) { return; }
+    m_running = true;
+    std::shared_ptr<Entry> entry = m_tasks.front();
+    double budget = m_sliceBudget;
+
+    // the job itself gets a token of its own, because the completion
+    // always needs to be delivered, even if the task has been cancelled
+    m_jobs->submit(JobPriority::Index, CancelToken(),
+        [this, entry, budget] () {
+            FrameScheduler::Time start = FrameScheduler::now();
+            FrameScheduler::Time end = start + budget;
+            const Entry& e = *entry;
+            YieldFunc yield = [this, &e, end] () {
+                return m_paused.load(std::memory_order_relaxed) || e.token.cancelled() || (FrameScheduler::now() >= end);
+            };
+            if (!yield()) { entry->more = entry->task(yield); }
+            entry->time = FrameScheduler::now() - start;
+        },
+        [this, entry] () { sliceDone(entry); });
+}
+
+void IdleScheduler::sliceDone(const std::shared_ptr<Entry>& entry) {
+    m_running = false;
+    ++m_stats.slices;
+    m_stats.busyTime += entry->time;
+    m_stats.maxSlice = std::max(m_stats.maxSlice, entry->time);
+
+    // the tasks take turns; finished ones are dropped
+    auto it = std::find(m_tasks.begin(), m_tasks.end(), entry);
+    if (it != m_tasks.end()) {
+        m_tasks.erase(it);
+        if (entry->more && !entry->token.cancelled()) { m_tasks.push_back(entry); }
+    }
+    if (!m_paused.load()) { runNext(); }
+}
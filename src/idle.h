@@ -0,0 +1,79 @@
+// SPDX-FileCopyrightText: 2023 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstdint>
+
+#include <atomic>
+#include <memory>
+#include <deque>
+#include <functional>
+
+#include "jobs.h"
+
+//! runs deferred background work (indexing, thumbnails and the like) only
+//! while the UI is idle, so that it never competes with interactive frames
+//!
+//! The work is done in slices of limited length on the job system, one
+//! slice at a time, taking turns between the tasks. update() opens the gate
+//! when the UI has become idle (see FrameScheduler::idle()) and closes it
+//! otherwise; pause() closes it right away when input arrives, and the
+//! running slice stops at its next yield() check. All functions except the
+//! task slices themselves are for the UI thread only.
+class IdleScheduler {
+public:
+    //! returns true if the slice should return now
+    typedef std::function<bool()> YieldFunc;
+    //! does a slice of a task's work, calling yield() often (e.g. once per
+    //! item) and returning as soon as it returns true; the return value is
+    //! true if there is more work to do
+    typedef std::function<bool(const YieldFunc& yield)> Task;
+
+    struct Stats {
+        uint64_t slices = 0;    //!< number of slices run so far
+        double busyTime = 0.0;  //!< total time spent in slices [s]
+        double maxSlice = 0.0;  //!< longest slice [s]
+    };
+
+private:
+    static constexpr double DefaultSliceBudget = 0.004;
+    struct Entry {
+        CancelToken token;
+        Task task;
+        bool more = true;
+        double time = 0.0;
+    };
+    JobSystem* m_jobs = nullptr;
+    std::deque<std::shared_ptr<Entry>> m_tasks;  // the first one runs next
+    std::atomic<bool> m_paused;
+    bool m_running = false;
+    double m_sliceBudget = DefaultSliceBudget;
+    Stats m_stats;
+    void runNext();
+    void sliceDone(const std::shared_ptr<Entry>& entry);
+
+public:
+    inline IdleScheduler() : m_paused(true) {}
+
+    //! the job system that runs the slices (nothing runs without one, or
+    //! if it doesn't have any worker threads)
+    inline void setJobSystem(JobSystem* jobs) { m_jobs = jobs; }
+    //! maximum length of a slice [s]
+    inline void setSliceBudget(double seconds) { m_sliceBudget = seconds; }
+
+    //! add a task; it's dropped when it's done or the token is cancelled
+    void add(const CancelToken& token, Task task);
+
+    //! let the work run (or not), depending on whether the UI is idle
+    void update(bool idle);
+    //! stop the work immediately, until the next update(true)
+    inline void pause() { m_paused.store(true); }
+
+    //! true if there are tasks left
+    inline bool pending() const { return !m_tasks.empty(); }
+    //! true if there are tasks that are waiting for the UI to become idle
+    inline bool waiting() const { return !m_tasks.empty() && !m_running; }
+
+    inline const Stats& stats() const { return m_stats; }
+};
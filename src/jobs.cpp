@@ -0,0 +1,178 @@
+// SPDX-FileCopyrightText: 2023 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#include <cstdint>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+#include "jobs.h"
+
+// the pool and worker index of the current thread, if it's a worker
+static thread_local const JobSystem* t_pool = nullptr;
+static thread_local int t_index = -1;
+
+///////////////////////////////////////////////////////////////////////////////
+
+void JobSystem::init(int threads, Func notify) {
+    shutdown();
+    if (threads <= 0) { threads = std::max(1, int(std::thread::hardware_concurrency()) - 1); }
+    m_notify = notify;
+    m_quit.store(false);
+    for (int i = 0;  i < threads;  ++i) {
+        m_workers.emplace_back(new Worker);
+    }
+    // all workers need to exist before any of them starts stealing
+    for (int i = 0;  i < threads;  ++i) {
+        m_workers[i]->thread = std::thread(&JobSystem::workerMain, this, i);
+    }
+}
+
+void JobSystem::shutdown() {
+    if (m_workers.empty()) { return; }
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_quit.store(true);
+    }
+    m_wake.notify_all();
+    for (auto& w : m_workers) { w->thread.join(); }
+    for (auto& w : m_workers) {
+        for (auto& q : w->queues) { for (Job* job : q) { delete job; } }
+    }
+    m_workers.clear();
+    for (auto& q : m_inject) {
+        for (Job* job : q) { delete job; }
+        q.clear();
+    }
+    m_queued.store(0);
+    for (Job* job = m_completed.exchange(nullptr);  job;) {
+        Job* next = job->next;
+        delete job;
+        job = next;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void JobSystem::submit(JobPriority priority, const CancelToken& token, Func work, Func done) {
+    if (m_workers.empty()) {
+        if (token.cancelled()) { return; }
+        if (work) { work(); }
+        if (done && !token.cancelled()) { done(); }
+        return;
+    }
+    Job* job = new Job;
+    job->work = work;
+    job->done = done;
+    job->token = token;
+    int p = int(priority);
+    if (t_pool == this) {
+        Worker& w = *m_workers[t_index];
+        std::lock_guard<std::mutex> lock(w.mutex);
+        w.queues[p].push_back(job);
+    } else {
+        std::lock_guard<std::mutex> lock(m_injectMutex);
+        m_inject[p].push_back(job);
+    }
+
+    // a worker that is about to go to sleep either sees the new job, or is
+    // counted as sleeping here (both counters are sequentially consistent)
+    m_queued.fetch_add(1);
+    if (m_sleeping.load() > 0) {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_wake.notify_one();
+    }
+}
+
+JobSystem::Job* JobSystem::take(int index) {
+    const int count = int(m_workers.size());
+    for (int p = 0;  p < JobPriorityCount;  ++p) {
+        Job* job = nullptr;
+        {   // own jobs first, newest first (they're likely to be related to
+            // the job that submitted them, which has just run)
+            Worker& w = *m_workers[index];
+            std::lock_guard<std::mutex> lock(w.mutex);
+            if (!w.queues[p].empty()) { job = w.queues[p].back();  w.queues[p].pop_back(); }
+        }
+        if (!job) {
+            std::lock_guard<std::mutex> lock(m_injectMutex);
+            if (!m_inject[p].empty()) { job = m_inject[p].front();  m_inject[p].pop_front(); }
+        }
+        for (int i = 1;  !job && (i < count);  ++i) {
+            Worker& w = *m_workers[(index + i) % count];
+            std::lock_guard<std::mutex> lock(w.mutex);
+            if (!w.queues[p].empty()) { job = w.queues[p].front();  w.queues[p].pop_front(); }
+        }
+        if (job) {
+            m_queued.fetch_sub(1);
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+void JobSystem::finish(Job* job) {
+    if (!job->done || job->token.cancelled()) {
+        delete job;
+        return;
+    }
+    job->work = nullptr;  // release whatever it has captured right away
+    Job* head = m_completed.load(std::memory_order_relaxed);
+    do {
+        job->next = head;
+    } while (!m_completed.compare_exchange_weak(head, job, std::memory_order_release, std::memory_order_relaxed));
+    // the UI thread takes the whole list at once, so it only needs to be
+    // woken up for the first job in it
+    if (!head && m_notify) { m_notify(); }
+}
+
+void JobSystem::workerMain(int index) {
+    t_pool = this;
+    t_index = index;
+    while (!m_quit.load()) {
+        Job* job = take(index);
+        if (!job) {
+            std::unique_lock<std::mutex> lock(m_sleepMutex);
+            m_sleeping.fetch_add(1);
+            m_wake.wait(lock, [this] { return m_quit.load() || (m_queued.load() > 0); });
+            m_sleeping.fetch_sub(1);
+            continue;
+        }
+        if (job->work && !job->token.cancelled()) { job->work(); }
+        finish(job);
+    }
+    t_pool = nullptr;
+    t_index = -1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+int JobSystem::deliver() {
+    Job* list = m_completed.exchange(nullptr, std::memory_order_acquire);
+    if (!list) { return 0; }
+
+    // the list is newest first; reverse it
+    Job* job = nullptr;
+    while (list) {
+        Job* next = list->next;
+        list->next = job;
+        job = list;
+        list = next;
+    }
+
+    int count = 0;
+    while (job) {
+        Job* next = job->next;
+        if (!job->token.cancelled()) { job->done();  ++count; }
+        delete job;
+        job = next;
+    }
+    return count;
+}
@@ -0,0 +1,103 @@
+// SPDX-FileCopyrightText: 2023 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstdint>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <deque>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+//! priority classes of background jobs, most urgent first
+enum class JobPriority : uint8_t {
+    Visible  = 0,  //!< needed for what's on screen right now
+    Prefetch = 1,  //!< likely to be needed soon
+    Index    = 2,  //!< everything else
+};
+constexpr int JobPriorityCount = 3;
+
+//! cooperative cancellation flag, shared between the owner of some work
+//! (e.g. a directory panel) and the jobs that do it; copies of a token
+//! refer to the same flag
+class CancelToken {
+    std::shared_ptr<std::atomic<bool>> m_flag;
+public:
+    inline CancelToken() : m_flag(std::make_shared<std::atomic<bool>>(false)) {}
+    inline void cancel() const    { m_flag->store(true, std::memory_order_relaxed); }
+    inline bool cancelled() const { return m_flag->load(std::memory_order_relaxed); }
+};
+
+//! a pool of background threads for work that may take a while (I/O in
+//! particular) and must not hold up the UI thread
+//!
+//! Jobs run strictly by priority class. Within a class, jobs submitted from
+//! outside the pool run in order; a worker runs the jobs that it has
+//! submitted itself first (newest first), and steals the oldest ones from
+//! the other workers when it runs out of work. Jobs whose token has been
+//! cancelled are skipped, and long-running jobs are expected to check their
+//! token now and then. Completion callbacks are collected in a lock-free
+//! list and run on the UI thread by deliver().
+class JobSystem {
+public:
+    typedef std::function<void()> Func;
+
+private:
+    struct Job {
+        Func work;
+        Func done;
+        CancelToken token;
+        Job* next = nullptr;
+    };
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Job*> queues[JobPriorityCount];  // jobs submitted by this worker
+        std::thread thread;
+    };
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::mutex m_injectMutex;
+    std::deque<Job*> m_inject[JobPriorityCount];  // jobs submitted from other threads
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wake;
+    std::atomic<int> m_queued;
+    std::atomic<int> m_sleeping;
+    std::atomic<bool> m_quit;
+    std::atomic<Job*> m_completed;  // newest first
+    Func m_notify;
+
+    void workerMain(int index);
+    Job* take(int index);
+    void finish(Job* job);
+
+public:
+    inline JobSystem() : m_queued(0), m_sleeping(0), m_quit(false), m_completed(nullptr) {}
+    inline ~JobSystem() { shutdown(); }
+
+    //! start the worker threads (0 = one per CPU core, except for the one
+    //! that the UI thread is going to use); 'notify' is called (from a
+    //! worker thread) when there are completion callbacks to deliver()
+    void init(int threads=0, Func notify=nullptr);
+    //! stop the worker threads after the jobs they're currently running;
+    //! queued jobs and undelivered completions are dropped
+    void shutdown();
+
+    inline int threads() const { return int(m_workers.size()); }
+    //! number of jobs that have been submitted, but not started yet
+    inline int queued() const { return m_queued.load(); }
+
+    //! queue a job; 'work' runs on a worker thread, and 'done' (if any)
+    //! runs on the UI thread in deliver() afterwards, unless the token has
+    //! been cancelled in the meantime; may be called from any thread,
+    //! including the workers; without worker threads, both run right away
+    void submit(JobPriority priority, const CancelToken& token, Func work, Func done=nullptr);
+
+    //! run the completion callbacks of the jobs that have finished since
+    //! the last call, in the order they finished; UI thread only;
+    //! returns the number of callbacks that have been run
+    int deliver();
+};
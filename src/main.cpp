@@ -3,12 +3,24 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <vector>
+#include <algorithm>
 
 #include <SDL.h>
 
 #include "glad.h"
 
+#include "damage.h"
+#include "scheduler.h"
+#include "softraster.h"
 #include "app.h"
+#include "eventloop.h"
+#include "renderthread.h"
+#include "headless.h"
+#include "bench.h"
 
 #ifndef NDEBUG
     #define IFRELEASE(a,b) (b)
@@ -18,9 +30,14 @@
 
 ///////////////////////////////////////////////////////////////////////////////
 
-static constexpr Uint64 TypematicDelay    =   250u;
-static constexpr Uint64 TypematicRate     =    50u;
-static constexpr Sint16 AnalogSensitivity = 16384;
+static constexpr double TypematicDelay      = 0.250;  // time until the first repeat
+static constexpr double TypematicRate       = 0.050;  // initial repeat interval
+static constexpr double TypematicFastRate   = 0.020;  // repeat interval after acceleration
+static constexpr double TypematicAccelStart = 1.000;  // hold time after which repeats speed up
+static constexpr double TypematicAccelTime  = 1.000;  // time to reach the fast rate; afterwards, time to double the step size
+static constexpr int    TypematicMaxSteps   = 32;     // maximum number of items per repeat (vertical directions only)
+static constexpr Sint16 AnalogSensitivity   = 16384;
+static constexpr double RenderLatchMargin   = 0.002;  // how early a frame is finished before the render thread picks it up
 
 namespace FTDirection {
     constexpr int Left  = 0;
@@ -40,10 +57,15 @@ namespace FTSource {
     constexpr int Mask       = 0x0C;
 };
 
+// Repeats are scheduled relative to the previous repeat's deadline, not to
+// the time they actually fired, so wakeup latency doesn't accumulate. Long
+// holds accelerate: first the repeat rate increases, then (for up and down
+// only) each repeat moves the cursor by more and more items.
 class FakeTypematic {
     GLBrowserApp& m_app;
     uint16_t m_buttons;
-    Uint64 m_timeouts[14];
+    FrameScheduler::Time m_timeouts[14];
+    FrameScheduler::Time m_pressed[14];
     void fireEvent(int button, bool initial);
 public:
     inline FakeTypematic(GLBrowserApp& app) : m_app(app), m_buttons(0u) {}
@@ -54,25 +76,43 @@ public:
         setState(axis + 1, (value > +AnalogSensitivity));
     }
     bool update();
+    FrameScheduler::Time nextDeadline() const;
 };
 
 void FakeTypematic::fireEvent(int button, bool initial) {
+    FrameScheduler::Time now = FrameScheduler::now();
+    FrameScheduler::Time due = initial ? now : m_timeouts[button];
+    int steps = 1;
+    if (initial) {
+        m_pressed[button] = now;
+        m_timeouts[button] = now + TypematicDelay;
+    } else {
+        // acceleration, based on the time this repeat was due
+        double t = (m_timeouts[button] - m_pressed[button] - TypematicAccelStart) / TypematicAccelTime;
+        double interval = TypematicRate + (TypematicFastRate - TypematicRate) * std::min(1.0, std::max(0.0, t));
+        if ((t >= 2.0) && (button < FTSource::Trigger) && ((button & FTDirection::Mask) >= FTDirection::Up)) {
+            steps = std::min(TypematicMaxSteps, 1 << std::min(30, int(t - 1.0)));
+        }
+        m_timeouts[button] += interval;
+        // if we're late by more than a full interval (e.g. because a frame
+        // took long), don't try to catch up with a burst of repeats
+        if (m_timeouts[button] < now) { m_timeouts[button] = now + interval; }
+    }
     if (button >= FTSource::Trigger) {
         switch (button) {
-            case FTSource::Trigger + FTDirection::Left:  m_app.handleEvent(AppEvent::LT); break;
-            case FTSource::Trigger + FTDirection::Right: m_app.handleEvent(AppEvent::RT); break;
+            case FTSource::Trigger + FTDirection::Left:  m_app.queueEvent(AppEvent::LT, !initial, due); break;
+            case FTSource::Trigger + FTDirection::Right: m_app.queueEvent(AppEvent::RT, !initial, due); break;
             default: break;
         }
     } else {
         switch (button & FTDirection::Mask) {
-            case FTDirection::Left:  m_app.handleEvent(AppEvent::Left);  break;
-            case FTDirection::Right: m_app.handleEvent(AppEvent::Right); break;
-            case FTDirection::Up:    m_app.handleEvent(AppEvent::Up);    break;
-            case FTDirection::Down:  m_app.handleEvent(AppEvent::Down);  break;
+            case FTDirection::Left:  m_app.queueEvent(AppEvent::Left, !initial, due);         break;
+            case FTDirection::Right: m_app.queueEvent(AppEvent::Right, !initial, due);        break;
+            case FTDirection::Up:    m_app.queueEvent(AppEvent::Up, !initial, due, steps);    break;
+            case FTDirection::Down:  m_app.queueEvent(AppEvent::Down, !initial, due, steps);  break;
             default: break;
         }
     }
-    m_timeouts[button] = SDL_GetTicks64() + (initial ? TypematicDelay : TypematicRate);
 }
 
 void FakeTypematic::setState(int button, bool state) {
@@ -86,7 +126,7 @@ void FakeTypematic::setState(int button, bool state) {
 }
 
 bool FakeTypematic::update() {
-    Uint64 now = SDL_GetTicks64();
+    FrameScheduler::Time now = FrameScheduler::now();
     bool res = false;
     // only up to 12 -- no actual typematic for the triggers, just state tracking!
     for (int button = 0;  button < 12;  ++button) {
@@ -98,28 +138,36 @@ bool FakeTypematic::update() {
     return res;
 }
 
-///////////////////////////////////////////////////////////////////////////////
-
-int main(int argc, char* argv[]) {
-    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_GAMECONTROLLER) < 0) {
-        fprintf(stderr, "FATAL: SDL initialization failed - %s\n", SDL_GetError());
-        return 1;
+FrameScheduler::Time FakeTypematic::nextDeadline() const {
+    FrameScheduler::Time deadline = -1.0;
+    for (int button = 0;  button < 12;  ++button) {
+        if ((m_buttons & (1u << button)) && ((deadline < 0.0) || (m_timeouts[button] < deadline))) {
+            deadline = m_timeouts[button];
+        }
     }
+    return deadline;
+}
+
+///////////////////////////////////////////////////////////////////////////////
 
+static SDL_Window* createWindow(bool openGL) {
     SDL_Window* win = SDL_CreateWindow(
         "GL Launcher",
         SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
         IFRELEASE(0, 1280),
         IFRELEASE(0,  720),
-        IFRELEASE(SDL_WINDOW_FULLSCREEN_DESKTOP, 0) | SDL_WINDOW_OPENGL);
+        IFRELEASE(SDL_WINDOW_FULLSCREEN_DESKTOP, 0) | (openGL ? SDL_WINDOW_OPENGL : 0));
     if (!win) {
         fprintf(stderr, "FATAL: failed to create window - %s\n", SDL_GetError());
-        return 1;
+        return nullptr;
     }
     #ifdef NDEBUG
         SDL_ShowCursor(SDL_DISABLE);
     #endif
+    return win;
+}
 
+static SDL_GLContext createGLContext(SDL_Window* win) {
     SDL_GL_SetAttribute(SDL_GL_RED_SIZE,     8);
     SDL_GL_SetAttribute(SDL_GL_GREEN_SIZE,   8);
     SDL_GL_SetAttribute(SDL_GL_BLUE_SIZE,    8);
@@ -133,99 +181,311 @@ int main(int argc, char* argv[]) {
 
     SDL_GLContext glctx = SDL_GL_CreateContext(win);
     if (!glctx) {
-        fprintf(stderr, "FATAL: failed to create OpenGL context - %s\n", SDL_GetError());
-        return 1;
+        fprintf(stderr, "ERROR: failed to create OpenGL context - %s\n", SDL_GetError());
+        return nullptr;
     }
     SDL_GL_MakeCurrent(win, glctx);
     SDL_GL_SetSwapInterval(1);
 
     if (!gladLoadGL()) {
-        fprintf(stderr, "FATAL: failed to import OpenGL functions - %s\n", SDL_GetError());
-        return 1;
+        fprintf(stderr, "ERROR: failed to import OpenGL functions - %s\n", SDL_GetError());
+        SDL_GL_MakeCurrent(win, nullptr);
+        SDL_GL_DeleteContext(glctx);
+        return nullptr;
     }
     #ifdef _DEBUG
         printf("OpenGL version:  %s\n", glGetString(GL_VERSION));
         printf("OpenGL vendor:   %s\n", glGetString(GL_VENDOR));
         printf("OpenGL renderer: %s\n", glGetString(GL_RENDERER));
     #endif
+    return glctx;
+}
+
+static void presentSoftware(SDL_Window* win, SDL_Surface* frame, const std::vector<Rect>& rects) {
+    SDL_Surface* dest = SDL_GetWindowSurface(win);
+    if (!dest) { return; }
+    std::vector<SDL_Rect> sdlRects;
+    for (const auto& r : rects) {
+        SDL_Rect src = { r.x0, r.y0, r.x1 - r.x0, r.y1 - r.y0 };
+        SDL_Rect dst = src;
+        SDL_BlitSurface(frame, &src, dest, &dst);
+        sdlRects.push_back(src);
+    }
+    SDL_UpdateWindowSurfaceRects(win, sdlRects.data(), int(sdlRects.size()));
+}
 
+///////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char* argv[]) {
+    const char* initialPath = nullptr;
+    bool frameStats = false;
+    float maxAnimFPS = 0.0f;
+    bool headless = false;
+    bool software = false;
+    const char* perfLog = nullptr;
+    bool uberShader = false;
+    bool multipassOutlines = false;
+    bool noLayers = false;
+    bool cpuAnimation = false;
+    bool cpuGlyphs = false;
+    #ifdef __APPLE__
+        bool useRenderThread = false;  // Cocoa wants OpenGL on the main thread
+    #else
+        bool useRenderThread = true;
+    #endif
+    int drawThreads = 0;
+    const char* fallbackFont = nullptr;
+    const char* bench = nullptr;
+    ProcessSupervisor::Policy launchPolicy = ProcessSupervisor::Policy::Queue;
+    bool prefetch = true;
+    ProcessSupervisor::Resident residentViewers = ProcessSupervisor::Resident::Off;
+    HeadlessOptions headlessOptions;
+    for (int i = 1;  i < argc;  ++i) {
+        const char* arg = argv[i];
+        if (!strcmp(arg, "--frame-stats")) {
+            frameStats = true;
+        } else if (!strncmp(arg, "--battery-saver", 15) && (!arg[15] || (arg[15] == '='))) {
+            maxAnimFPS = arg[15] ? float(atof(&arg[16])) : 30.0f;
+        } else if (!strncmp(arg, "--perf-log=", 11)) {
+            perfLog = &arg[11];
+        } else if (!strcmp(arg, "--software")) {
+            software = true;
+        } else if (!strcmp(arg, "--uber-shader")) {
+            uberShader = true;
+        } else if (!strcmp(arg, "--multipass-outlines")) {
+            multipassOutlines = true;
+        } else if (!strcmp(arg, "--no-layers")) {
+            noLayers = true;
+        } else if (!strcmp(arg, "--cpu-animation")) {
+            cpuAnimation = true;
+        } else if (!strcmp(arg, "--cpu-glyphs")) {
+            cpuGlyphs = true;
+        } else if (!strcmp(arg, "--no-render-thread")) {
+            useRenderThread = false;
+        } else if (!strcmp(arg, "--render-thread")) {
+            useRenderThread = true;
+        } else if (!strncmp(arg, "--fallback-font=", 16)) {
+            fallbackFont = &arg[16];
+        } else if (!strncmp(arg, "--launch-policy=", 16)) {
+            if (!ProcessSupervisor::parsePolicy(&arg[16], launchPolicy)) {
+                fprintf(stderr, "FATAL: invalid launch policy '%s'\n", &arg[16]);
+                return 2;
+            }
+        } else if (!strcmp(arg, "--no-prefetch")) {
+            prefetch = false;
+        } else if (!strcmp(arg, "--resident-viewers")) {
+            residentViewers = ProcessSupervisor::Resident::OnDemand;
+        } else if (!strcmp(arg, "--resident-viewers=prespawn")) {
+            residentViewers = ProcessSupervisor::Resident::Prespawn;
+        } else if (!strncmp(arg, "--draw-threads=", 15)) {
+            drawThreads = atoi(&arg[15]);
+        } else if (!strncmp(arg, "--headless", 10) && (!arg[10] || (arg[10] == '='))) {
+            headless = true;
+            if (arg[10] && (sscanf(&arg[11], "%dx%d", &headlessOptions.width, &headlessOptions.height) != 2)) {
+                fprintf(stderr, "FATAL: invalid headless resolution '%s'\n", &arg[11]);
+                return 2;
+            }
+        } else if (!strncmp(arg, "--frames=", 9)) {
+            headlessOptions.frames = atoi(&arg[9]);
+        } else if (!strncmp(arg, "--script=", 9)) {
+            headlessOptions.script = &arg[9];
+        } else if (!strncmp(arg, "--compare", 9) && (!arg[9] || (arg[9] == '='))) {
+            headless = true;
+            headlessOptions.compare = true;
+            if (arg[9] && (sscanf(&arg[10], "%d,%d", &headlessOptions.compareThreshold, &headlessOptions.compareOutliers) < 1)) {
+                fprintf(stderr, "FATAL: invalid comparison threshold '%s'\n", &arg[10]);
+                return 2;
+            }
+        } else if (!strncmp(arg, "--dump-frames=", 14)) {
+            headlessOptions.dumpPrefix = &arg[14];
+        } else if (!strncmp(arg, "--bench=", 8)) {
+            bench = &arg[8];
+        } else if ((arg[0] == '-') && (arg[1] == '-')) {
+            fprintf(stderr, "FATAL: unknown option '%s'\n", arg);
+            return 2;
+        } else {
+            initialPath = arg;
+        }
+    }
+
+    headlessOptions.initialPath = initialPath;
+    headlessOptions.software = software;
+    headlessOptions.perfLog = perfLog;
+    headlessOptions.uberShader = uberShader;
+    headlessOptions.multipassOutlines = multipassOutlines;
+    headlessOptions.noLayers = noLayers;
+    headlessOptions.cpuAnimation = cpuAnimation;
+    headlessOptions.cpuGlyphs = cpuGlyphs;
+    headlessOptions.drawThreads = drawThreads;
+    headlessOptions.fallbackFont = fallbackFont;
+    if (bench)    { return RunBenchmark(bench, headlessOptions); }
+    if (headless) { return RunHeadless(headlessOptions, argv[0]); }
+
+    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_GAMECONTROLLER) < 0) {
+        fprintf(stderr, "FATAL: SDL initialization failed - %s\n", SDL_GetError());
+        return 1;
+    }
+
+    SDL_Window* win = nullptr;
+    SDL_GLContext glctx = nullptr;
     bool active = true;
+    EventLoop eventLoop;
+    RenderThread renderThread;
     auto actionCallback = [&] (AppAction action) {
         switch (action) {
             case AppAction::Quit:     active = false; break;
             case AppAction::Minimize: SDL_MinimizeWindow(win); break;
             case AppAction::Restore:  SDL_RestoreWindow(win);  break;
+            case AppAction::Wakeup:   eventLoop.wakeup(); break;
             default: break;
         }
     };
-
     static GLBrowserApp app(actionCallback, argv[0]);
-    if (!app.init((argc > 1) ? argv[1] : nullptr)) {
-        return 1;
+    app.setDrawThreads(drawThreads);
+    app.setLaunchPolicy(launchPolicy);
+    app.setPrefetch(prefetch);
+    app.setResidentViewers(residentViewers);
+    app.renderer().setFallbackFont(fallbackFont);
+
+    // try OpenGL first, unless told otherwise; if anything goes wrong
+    // there, fall back to software rendering in a new, non-GL window
+    if (!software) {
+        win = createWindow(true);
+        if (!win) { return 1; }
+        glctx = createGLContext(win);
+        if (glctx && !app.init(initialPath)) {
+            fprintf(stderr, "ERROR: failed to initialize OpenGL renderer\n");
+            SDL_GL_MakeCurrent(win, nullptr);
+            SDL_GL_DeleteContext(glctx);
+            glctx = nullptr;
+        }
+        if (!glctx) {
+            fprintf(stderr, "WARNING: falling back to software rendering\n");
+            SDL_DestroyWindow(win);
+            software = true;
+        }
+    }
+    static SoftRasterizer soft;
+    SDL_Surface* softFrame = nullptr;
+    if (software) {
+        win = createWindow(false);
+        if (!win) { return 1; }
+        SDL_Surface* surface = SDL_GetWindowSurface(win);
+        if (!surface || !soft.init(surface->w, surface->h)) {
+            fprintf(stderr, "FATAL: failed to create window surface - %s\n", SDL_GetError());
+            return 1;
+        }
+        softFrame = SDL_CreateRGBSurfaceWithFormatFrom(static_cast<void*>(soft.pixels()),
+            soft.width(), soft.height(), 32, soft.pitch(), SDL_PIXELFORMAT_RGB888);
+        if (!softFrame || !app.init(initialPath, &soft)) {
+            return 1;
+        }
+        #ifdef _DEBUG
+            printf("software rendering with %d threads\n", soft.threads());
+        #endif
+        // there's no vsync to pace animations, so do it ourselves
+        if (maxAnimFPS <= 0.0f) { maxAnimFPS = 60.0f; }
     }
 
-    for (int i = 0;  i < SDL_NumJoysticks();  ++i) {
-        if (SDL_IsGameController(i)) {
-            if (SDL_GameControllerOpen(i)) { app.haveController(); }
+    app.renderer().setUberShader(uberShader);
+    app.renderer().setCompositeOutlines(!multipassOutlines);
+    app.renderer().setLayers(!noLayers);
+    app.renderer().setGPUAnimation(!cpuAnimation);
+    app.renderer().setGPUGlyphs(!cpuGlyphs);
+    if (perfLog && !app.openPerfLog(perfLog)) {
+        fprintf(stderr, "WARNING: can not open performance log file '%s'\n", perfLog);
+    }
+
+    // hand the OpenGL context over to a render thread; from now on, frames
+    // are only recorded here, and the render thread draws and presents them
+    if (glctx && useRenderThread) {
+        if (renderThread.start(win, glctx, app.renderer(), [&] () { eventLoop.wakeup(); })) {
+            app.renderer().setDeferred();
+        } else {
+            fprintf(stderr, "WARNING: failed to start render thread, rendering on the main thread\n");
         }
     }
+
+    eventLoop.init(win);
+    auto openController = [&] (int index) {
+        // SDL also reports the controllers that are present at startup
+        // as added, so don't open them twice
+        if (!SDL_IsGameController(index) || SDL_GameControllerFromInstanceID(SDL_JoystickGetDeviceInstanceID(index))) { return; }
+        if (SDL_GameControllerOpen(index)) { app.haveController();  eventLoop.addController(index); }
+    };
+    for (int i = 0;  i < SDL_NumJoysticks();  ++i) { openController(i); }
     SDL_GameControllerEventState(SDL_ENABLE);
     FakeTypematic typematic(app);
+    FrameScheduler& scheduler = app.scheduler();
+    scheduler.setMaxAnimationFPS(maxAnimFPS);
+
+    // with a render thread, a frame must never replace one that it hasn't
+    // picked up yet (the render thread wakes us up when it does), and while
+    // it draws continuously, frames start as late as possible, so that
+    // input is sampled just before the frame is picked up
+    auto syncWithRenderThread = [&] () {
+        if (!renderThread.active()) { return; }
+        scheduler.setHeld(renderThread.pending());
+        FrameScheduler::Time pickup = renderThread.nextPickup();
+        scheduler.setEarliestStart((pickup < 0.0) ? -1.0 : (pickup - scheduler.cpuTimeEstimate() - RenderLatchMargin));
+    };
 
-    Uint64 prevTime = SDL_GetPerformanceCounter();
     while (active) {
-        // wait for events, if we need to
-        bool wait = !app.framesRequested();
-        if (wait) {
-            if (typematic.buttonsPressed()) {
-                do {
-                    SDL_Delay(10);
-                } while (!SDL_PollEvent(nullptr) && typematic.buttonsPressed() && !typematic.update());
-            } else { SDL_WaitEvent(nullptr); }
+        // sleep until something happens (input, the next typematic
+        // repeat, a program started from the browser exiting, glyphs
+        // arriving from the background thread), if we need to
+        syncWithRenderThread();
+        if (!scheduler.frameDue()) {
+            eventLoop.wait(scheduler.waitTimeout());
+            app.requestFrame();
         }
-        if (wait) { app.requestFrame(); }
 
-        // event processing loop
+        // event processing loop; the events are only queued here, and
+        // handled all at once at the start of the next frame
         typematic.update();
         SDL_Event ev;
+        FrameScheduler::Time sdlTimeBase = FrameScheduler::now() - 0.001 * double(SDL_GetTicks());
+        auto key = [&] (AppEvent e) { app.queueEvent(e, (ev.key.repeat != 0), sdlTimeBase + 0.001 * double(ev.key.timestamp)); };
+        auto button = [&] (AppEvent e) { app.queueEvent(e, false, sdlTimeBase + 0.001 * double(ev.cbutton.timestamp)); };
         while (SDL_PollEvent(&ev)) {
             switch (ev.type) {
                 case SDL_KEYDOWN:
                     switch (ev.key.keysym.sym) {
-                        case SDLK_LEFT:      app.handleEvent(AppEvent::Left);     break;
-                        case SDLK_RIGHT:     app.handleEvent(AppEvent::Right);    break;
-                        case SDLK_UP:        app.handleEvent(AppEvent::Up);       break;
-                        case SDLK_DOWN:      app.handleEvent(AppEvent::Down);     break;
-                        case SDLK_PAGEUP:    app.handleEvent(AppEvent::PageUp);   break;
-                        case SDLK_PAGEDOWN:  app.handleEvent(AppEvent::PageDown); break;
-                        case SDLK_HOME:      app.handleEvent(AppEvent::Home);     break;
-                        case SDLK_END:       app.handleEvent(AppEvent::End);      break;
+                        case SDLK_LEFT:      key(AppEvent::Left);     break;
+                        case SDLK_RIGHT:     key(AppEvent::Right);    break;
+                        case SDLK_UP:        key(AppEvent::Up);       break;
+                        case SDLK_DOWN:      key(AppEvent::Down);     break;
+                        case SDLK_PAGEUP:    key(AppEvent::PageUp);   break;
+                        case SDLK_PAGEDOWN:  key(AppEvent::PageDown); break;
+                        case SDLK_HOME:      key(AppEvent::Home);     break;
+                        case SDLK_END:       key(AppEvent::End);      break;
                         case SDLK_RETURN:
-                        case SDLK_a:         app.handleEvent(AppEvent::A);        break;
+                        case SDLK_a:         key(AppEvent::A);        break;
                         case SDLK_BACKSPACE:
-                        case SDLK_b:         app.handleEvent(AppEvent::B);        break;
+                        case SDLK_b:         key(AppEvent::B);        break;
                         case SDLK_SPACE:
-                        case SDLK_x:         app.handleEvent(AppEvent::X);        break;
+                        case SDLK_x:         key(AppEvent::X);        break;
                         case SDLK_RSHIFT:
                         case SDLK_z:
-                        case SDLK_y:         app.handleEvent(AppEvent::Y);        break;
-                        case SDLK_TAB:       app.handleEvent(AppEvent::Select);   break;
-                        case SDLK_ESCAPE:    app.handleEvent(AppEvent::Start);    break;
-                        case SDLK_q:         active = false;                      break;
+                        case SDLK_y:         key(AppEvent::Y);        break;
+                        case SDLK_TAB:       key(AppEvent::Select);   break;
+                        case SDLK_F3:        app.togglePerfHUD();     break;
+                        case SDLK_ESCAPE:    key(AppEvent::Start);    break;
+                        case SDLK_q:         active = false;          break;
                         default: break;
                     }
                     break;
                 case SDL_CONTROLLERBUTTONDOWN:
                     switch (ev.cbutton.button) {
-                        case SDL_CONTROLLER_BUTTON_A:             app.handleEvent(AppEvent::A);      break;
-                        case SDL_CONTROLLER_BUTTON_B:             app.handleEvent(AppEvent::B);      break;
-                        case SDL_CONTROLLER_BUTTON_X:             app.handleEvent(AppEvent::X);      break;
-                        case SDL_CONTROLLER_BUTTON_Y:             app.handleEvent(AppEvent::Y);      break;
-                        case SDL_CONTROLLER_BUTTON_LEFTSHOULDER:  app.handleEvent(AppEvent::LS);     break;
-                        case SDL_CONTROLLER_BUTTON_RIGHTSHOULDER: app.handleEvent(AppEvent::RS);     break;
-                        case SDL_CONTROLLER_BUTTON_BACK:          app.handleEvent(AppEvent::Select); break;
-                        case SDL_CONTROLLER_BUTTON_START:         app.handleEvent(AppEvent::Start);  break;
-                        case SDL_CONTROLLER_BUTTON_GUIDE:         app.handleEvent(AppEvent::Logo);   break;
+                        case SDL_CONTROLLER_BUTTON_A:             button(AppEvent::A);      break;
+                        case SDL_CONTROLLER_BUTTON_B:             button(AppEvent::B);      break;
+                        case SDL_CONTROLLER_BUTTON_X:             button(AppEvent::X);      break;
+                        case SDL_CONTROLLER_BUTTON_Y:             button(AppEvent::Y);      break;
+                        case SDL_CONTROLLER_BUTTON_LEFTSHOULDER:  button(AppEvent::LS);     break;
+                        case SDL_CONTROLLER_BUTTON_RIGHTSHOULDER: button(AppEvent::RS);     break;
+                        case SDL_CONTROLLER_BUTTON_BACK:          button(AppEvent::Select); break;
+                        case SDL_CONTROLLER_BUTTON_START:         button(AppEvent::Start);  break;
+                        case SDL_CONTROLLER_BUTTON_GUIDE:         button(AppEvent::Logo);   break;
                         case SDL_CONTROLLER_BUTTON_DPAD_LEFT:     typematic.setState(FTSource::DPad + FTDirection::Left,  true); break;
                         case SDL_CONTROLLER_BUTTON_DPAD_RIGHT:    typematic.setState(FTSource::DPad + FTDirection::Right, true); break;
                         case SDL_CONTROLLER_BUTTON_DPAD_UP:       typematic.setState(FTSource::DPad + FTDirection::Up,    true); break;
@@ -253,6 +513,16 @@ int main(int argc, char* argv[]) {
                         default: break;
                     }
                     break;
+                case SDL_CONTROLLERDEVICEADDED:
+                    openController(ev.cdevice.which);
+                    break;
+                case SDL_CONTROLLERDEVICEREMOVED:
+                    eventLoop.removeController(ev.cdevice.which);
+                    if (SDL_GameController* gc = SDL_GameControllerFromInstanceID(ev.cdevice.which)) { SDL_GameControllerClose(gc); }
+                    break;
+                case SDL_WINDOWEVENT:
+                    app.invalidate();
+                    break;
                 case SDL_QUIT:
                     active = false;
                     break;
@@ -260,20 +530,38 @@ int main(int argc, char* argv[]) {
                     break;
             }   // END switch (ev.type)
         }   // END while (SDL_PollEvent())
+        if (typematic.buttonsPressed()) {
+            scheduler.addDeadline(typematic.nextDeadline());
+        }
 
-        // finally, draw the app
-        Uint64 now = SDL_GetPerformanceCounter();
-        if (app.draw(wait ? 0.0 : (double(now - prevTime) / double(SDL_GetPerformanceFrequency())))) {
+        // finally, draw the app -- or, if the frame is held back for the
+        // render thread, only keep the input queued until it's due
+        syncWithRenderThread();
+        if (renderThread.active()) {
+            if (!scheduler.frameDue()) { continue; }
+            app.renderer().setFrameTarget(&renderThread.frame());
+        }
+        bool present = app.draw(scheduler.beginFrame());
+        scheduler.endFrame();
+        if (present && renderThread.active()) {
+            renderThread.publish();
+        } else if (present && software) {
+            presentSoftware(win, softFrame, soft.updatedRects());
+        } else if (present) {
             SDL_GL_SwapWindow(win);
-        } else {
-            SDL_Delay(100);
         }
-        prevTime = now;
     }
 
+    if (frameStats) { scheduler.dumpStats(stdout); }
+    renderThread.stop();
     app.shutdown();
-    SDL_GL_MakeCurrent(nullptr, nullptr);
-    SDL_GL_DeleteContext(glctx);
+    eventLoop.shutdown();
+    if (glctx) {
+        SDL_GL_MakeCurrent(nullptr, nullptr);
+        SDL_GL_DeleteContext(glctx);
+    }
+    if (softFrame) { SDL_FreeSurface(softFrame); }
+    soft.shutdown();
     SDL_DestroyWindow(win);
     SDL_Quit();
     return 0;
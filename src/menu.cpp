@@ -10,6 +10,7 @@
 
 #include "renderer.h"
 #include "geometry.h"
+#include "damage.h"
 #include "event.h"
 
 #include "menu.h"
@@ -25,7 +26,7 @@ void ModalMenu::clear() {
 
 void ModalMenu::addItem(int id, const std::string& text) {
     if (m_layoutFinished) { return; }
-    m_items.push_back(MenuItem(id, text));
+    m_items.push_back(MenuItem(id, text, m_renderer.internText(text)));
 }
 
 void ModalMenu::addSeparator() {
@@ -56,7 +57,7 @@ void ModalMenu::finishLayout() {
     m_targetY0 = m_height;
     for (auto& item : m_items) {
         item.y = m_height;
-        item.textX = m_renderer.textWidth(item.text.c_str()) * float(m_geometry.textSize);
+        item.textX = m_renderer.textWidth(item.textRef) * float(m_geometry.textSize);
         m_width = std::max(m_width, int(std::ceil(item.textX)));
         m_height += m_geometry.itemHeight;
         if (item.separatorFollows) { m_height += m_geometry.itemSeparatorDistance; }
@@ -99,13 +100,14 @@ void ModalMenu::activate(int selectID) {
     for (int i = 0;  i < int(m_items.size());  ++i) {
         if (m_items[i].id == selectID) { setCursor(i); break; }
     }
-    m_animCursorY = float(m_items[m_cursor].y + m_y0);
+    m_animCursorY = AnimValue(float(m_items[m_cursor].y + m_y0));
     float cx = float(m_x0) + 0.5f * float(m_width);
     m_boxTitleTextX = cx - 0.5f * m_boxTitleTextX;
     for (auto& item : m_items) {
         item.textX = cx - 0.5f * item.textX;
     }
     m_active = true;
+    ++m_generation;
 }
 
 int ModalMenu::animate() {
@@ -113,6 +115,38 @@ int ModalMenu::animate() {
     return m_geometry.animUpdate(m_animCursorY, float(m_items[m_cursor].y + m_y0));
 }
 
+void ModalMenu::updateDamage(DamageTracker& damage) {
+    if (!m_active) {
+        damage.update(m_damageBox,    Rect(), 0u);
+        damage.update(m_damageCursor, Rect(), 0u);
+        return;
+    }
+
+    // the whole box, including outline and shadow
+    int padX = m_geometry.itemMarginX + m_geometry.panelMarginX + m_geometry.itemOutlineOffset
+             + m_geometry.itemOutlineWidth + 2 * m_geometry.menuBoxShadowSize + 1;
+    int padY = padX - m_geometry.panelMarginX + m_geometry.panelMarginY;
+    uint32_t key = DamageKey(DamageKeyInit, m_generation);
+    damage.update(m_damageBox,
+        Rect(m_x0 - padX,
+             m_y0 - padY,
+             m_x0 + m_width  + padX + m_geometry.itemShadowOffset,
+             m_y0 + m_height + padY + m_geometry.itemShadowOffset),
+        key);
+
+    // cursor highlight box; the key uses the exact position, because it's
+    // drawn at subpixel precision when it's animated by the GPU
+    float cursorY = m_geometry.animValue(m_animCursorY);
+    int iy = int(std::floor(cursorY));
+    int margin = m_geometry.itemOutlineOffset + 1;
+    damage.update(m_damageCursor,
+        Rect(m_x0 - m_geometry.itemMarginX - margin,
+             iy - margin,
+             m_x0 + m_width + m_geometry.itemMarginX + m_geometry.itemShadowOffset + margin,
+             iy + m_geometry.itemHeight + m_geometry.itemShadowOffset + margin),
+        DamageKey(key, int(std::floor(cursorY * 64.0f))));
+}
+
 void ModalMenu::draw() {
     if (!m_active) { return; }
 
@@ -138,13 +172,22 @@ void ModalMenu::draw() {
             float(m_geometry.textSize), m_boxTitle.c_str());
     }
 
+    // the cursor box is moved by an animation channel, if there is one
+    if (!m_cursorAnim) { m_cursorAnim = m_renderer.createAnim(); }
+    int cursorY = int(m_geometry.animValue(m_animCursorY) + 0.5f);
+    if (m_cursorAnim) {
+        m_renderer.setAnim(m_cursorAnim, m_animCursorY);
+        TextBoxRenderer::bindAnim(0, m_cursorAnim);
+        cursorY = 0;
+    }
     m_renderer.outlineBox(
-        m_x0           - m_geometry.itemMarginX           - m_geometry.itemOutlineOffset,
-        int(m_animCursorY + 0.5f)                         - m_geometry.itemOutlineOffset,
-        m_x0 + m_width + m_geometry.itemMarginX           + m_geometry.itemOutlineOffset,
-        int(m_animCursorY + 0.5f) + m_geometry.itemHeight + m_geometry.itemOutlineOffset,
+        m_x0           - m_geometry.itemMarginX   - m_geometry.itemOutlineOffset,
+        cursorY                                   - m_geometry.itemOutlineOffset,
+        m_x0 + m_width + m_geometry.itemMarginX   + m_geometry.itemOutlineOffset,
+        cursorY + m_geometry.itemHeight           + m_geometry.itemOutlineOffset,
         0xA98765, 0x876543, 0xFFFFFFFF, -m_geometry.itemOutlineWidth,
         m_geometry.itemBorderRadius, m_geometry.itemShadowOffset, 0.0f, 0.125f);
+    TextBoxRenderer::bindAnim(0);
 
     for (auto& item : m_items) {
         m_renderer.text(
@@ -153,6 +196,11 @@ void ModalMenu::draw() {
     }
 }
 
+void ModalMenu::releaseResources() {
+    m_renderer.deleteAnim(m_cursorAnim);
+    m_cursorAnim = 0;
+}
+
 void ModalMenu::controls(std::function<void(bool keyboard, const std::string& control, const std::string& label)> callback) {
     if (!m_active) { return; }
     callback(false, "A", "Select");  callback(true, "Enter", "Select");
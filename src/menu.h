@@ -6,6 +6,7 @@
 #include "renderer.h"
 #include "geometry.h"
 #include "dirview.h"
+#include "damage.h"
 #include "event.h"
 
 #include <string>
@@ -22,10 +23,12 @@ class ModalMenu {
     struct MenuItem {
         int id;
         std::string text;
+        TextBoxRenderer::TextRef textRef;
         bool separatorFollows = false;
         float textX;
         int y;
-        inline MenuItem(int id_, const std::string& text_) : id(id_), text(text_) {}
+        inline MenuItem(int id_, const std::string& text_, TextBoxRenderer::TextRef textRef_)
+            : id(id_), text(text_), textRef(textRef_) {}
     };
     std::vector<MenuItem> m_items;
 
@@ -49,9 +52,13 @@ class ModalMenu {
     int m_cursor;
     int m_resultID;
     float m_boxTitleTextX;
-    float m_animCursorY;
+    AnimValue m_animCursorY;
+    TextBoxRenderer::AnimRef m_cursorAnim = 0;  // animation channel for m_animCursorY
     bool m_confirmed = false;
     bool m_dismissed = false;
+    int m_generation = 0;  // incremented on every activation
+    DamageState m_damageBox;
+    DamageState m_damageCursor;
 
     void setCursor(int pos);
     void finishLayout();
@@ -81,7 +88,9 @@ public:
     void activate(int selectID=0x80000000);
 
     int animate();
+    void updateDamage(DamageTracker& damage);
     void draw();
+    void releaseResources();
     void controls(std::function<void(bool keyboard, const std::string& control, const std::string& label)> callback);
 
     enum class EventType {
@@ -0,0 +1,114 @@
+// SPDX-FileCopyrightText: 2023 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+
+#include "renderer.h"
+#include "geometry.h"
+#include "damage.h"
+
+#include "perfhud.h"
+
+constexpr float GraphFullScale = 33.3f;  // frame time at the top of the graph [ms]
+
+PerfHUD::PerfHUD(TextBoxRenderer& renderer, const Geometry& geometry)
+    : m_renderer(renderer), m_geometry(geometry)
+{
+    for (auto& line : m_lines) { line[0] = '\0'; }
+    for (auto& value : m_graph) { value = 0.0f; }
+}
+
+bool PerfHUD::openLog(const char* filename) {
+    closeLog();
+    m_log = fopen(filename, "w");
+    if (!m_log) { return false; }
+    fprintf(m_log, "frame,animate_ms,draw_ms,flush_ms,gpu_ms,quads,batches,draw_calls\n");
+    updateTiming();
+    return true;
+}
+
+void PerfHUD::closeLog() {
+    if (!m_log) { return; }
+    fclose(m_log);
+    m_log = nullptr;
+    updateTiming();
+}
+
+void PerfHUD::updateTiming() {
+    m_renderer.setTiming(active());
+}
+
+void PerfHUD::frameDone(double animateTime, double drawTime) {
+    const auto& stats = m_renderer.frameStats();
+    double animateMS = animateTime * 1000.0;
+    double flushMS   = stats.flushTime;
+    double drawMS    = std::max(0.0, drawTime * 1000.0 - flushMS);
+    double totalMS   = animateMS + drawMS + flushMS;
+    ++m_frameNumber;
+
+    if (m_log) {
+        fprintf(m_log, "%llu,%.3f,%.3f,%.3f,%.3f,%d,%d,%d\n",
+                (unsigned long long) m_frameNumber, animateMS, drawMS, flushMS, stats.gpuTime, stats.quads, stats.batches, stats.drawCalls);
+    }
+
+    m_graph[m_graphPos] = float(totalMS);
+    m_graphPos = (m_graphPos + 1) % GraphSize;
+    snprintf(m_lines[0], LineLength, "CPU %6.2f ms", totalMS);
+    snprintf(m_lines[1], LineLength, "anim %.2f  draw %.2f  flush %.2f", animateMS, drawMS, flushMS);
+    if (stats.gpuTime >= 0.0) { snprintf(m_lines[2], LineLength, "GPU %6.2f ms", stats.gpuTime); }
+    else                      { snprintf(m_lines[2], LineLength, "GPU    n/a"); }
+    snprintf(m_lines[3], LineLength, "%d quads, %d batches, %d draws", stats.quads, stats.batches, stats.drawCalls);
+}
+
+Rect PerfHUD::rect() const {
+    int lineHeight = std::max(10, m_geometry.textSize / 2);
+    int width  = lineHeight * 18;
+    int height = lineHeight * (NumLines + 4);
+    int x1 = m_geometry.screenWidth - m_geometry.outerMarginX;
+    int y0 = m_geometry.dirViewY0;
+    return Rect(x1 - width, y0, x1, y0 + height);
+}
+
+void PerfHUD::updateDamage(DamageTracker& damage) {
+    if (!m_visible) {
+        damage.update(m_damageState, Rect(), 0u);
+        return;
+    }
+    uint32_t key = DamageKey(DamageKeyInit, uint32_t(m_frameNumber));
+    for (const auto& line : m_lines) { key = DamageKey(key, line); }
+    damage.update(m_damageState, rect(), key);
+}
+
+void PerfHUD::draw() {
+    if (!m_visible) { return; }
+    Rect r = rect();
+    int lineHeight = std::max(10, m_geometry.textSize / 2);
+    int margin = lineHeight / 2;
+    m_renderer.box(r.x0, r.y0, r.x1, r.y1, 0xC0000000u, 0xC0000000u, margin);
+    int y = r.y0 + margin;
+    for (const auto& line : m_lines) {
+        m_renderer.text(float(r.x0 + margin), float(y), float(lineHeight), line);
+        y += lineHeight;
+    }
+
+    // frame time graph, oldest frame first; green = fits into a 60 Hz
+    // frame, yellow = fits into two frames, red = slower than that
+    int gx0 = r.x0 + margin, gx1 = r.x1 - margin;
+    int gy0 = y + margin / 2, gy1 = r.y1 - margin;
+    int gh = gy1 - gy0;
+    m_renderer.box(gx0, gy0 + gh / 2, gx1, gy0 + gh / 2 + 1, 0x40FFFFFFu);  // 16.7 ms line
+    for (int i = 0;  i < GraphSize;  ++i) {
+        float value = m_graph[(m_graphPos + i) % GraphSize];
+        if (value <= 0.0f) { continue; }
+        int h = std::max(1, int(float(gh) * std::min(1.0f, value / GraphFullScale) + 0.5f));
+        uint32_t color = (value < 16.7f) ? 0xFF40FF40u : (value < 33.3f) ? 0xFF40FFFFu : 0xFF4040FFu;
+        m_renderer.box(gx0 + (gx1 - gx0) * i / GraphSize, gy1 - h,
+                       gx0 + (gx1 - gx0) * (i + 1) / GraphSize, gy1, color);
+    }
+}
@@ -0,0 +1,53 @@
+// SPDX-FileCopyrightText: 2023 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+#include "renderer.h"
+#include "geometry.h"
+#include "damage.h"
+
+//! performance overlay: shows CPU and GPU frame times, quad and batch
+//! counts and a rolling frame time graph; can also log everything into
+//! a CSV file (even if the overlay itself isn't visible)
+class PerfHUD {
+    TextBoxRenderer& m_renderer;
+    const Geometry& m_geometry;
+    bool m_visible = false;
+    FILE* m_log = nullptr;
+    uint64_t m_frameNumber = 0u;
+    static constexpr int NumLines = 4;
+    static constexpr int LineLength = 64;
+    char m_lines[NumLines][LineLength];
+    static constexpr int GraphSize = 120;
+    float m_graph[GraphSize];  // total CPU time per frame [ms]
+    int m_graphPos = 0;
+    DamageState m_damageState;
+
+    Rect rect() const;
+    void updateTiming();
+
+public:
+    PerfHUD(TextBoxRenderer& renderer, const Geometry& geometry);
+    inline ~PerfHUD() { closeLog(); }
+
+    //! start logging per-frame statistics into a file
+    bool openLog(const char* filename);
+    void closeLog();
+
+    inline bool visible() const { return m_visible; }
+    inline void toggle() { m_visible = !m_visible;  updateTiming(); }
+
+    //! true if statistics need to be collected
+    inline bool active() const { return m_visible || m_log; }
+
+    //! record a finished frame's statistics; animate and draw times are
+    //! in seconds, draw time includes the time spent in flush()
+    void frameDone(double animateTime, double drawTime);
+
+    void updateDamage(DamageTracker& damage);
+    void draw();
+};
@@ -1,72 +1,428 @@
 // SPDX-FileCopyrightText: 2023 Martin J. Fiedler <keyj@emphy.de>
 // SPDX-License-Identifier: MIT
 
+#include <cstddef>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <cmath>
 
 #include <new>
+#include <string>
+#include <iterator>
 #include <algorithm>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+    #define RENDERER_SSE2
+    #include <emmintrin.h>
+    #ifdef __AVX2__
+        #include <immintrin.h>
+    #endif
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    #define RENDERER_NEON
+    #include <arm_neon.h>
+#endif
+
 #include "glad.h"
 
+#include "scheduler.h"
 #include "renderer.h"
+#include "softraster.h"
 #include "font_data.h"
+#include "font_codec.h"
 
 constexpr uint32_t GlyphCacheMin = 32u;
 constexpr uint32_t GlyphCacheMax = 255u;
 constexpr int BatchSize = 4096;  // must be 16384 or less
+constexpr int GlyphBatchSize = BatchSize * 4;
+constexpr uint32_t WidthCacheSize = 256u;  // must be a power of two
+
+// per-thread drawing state: the staging buffer of an active recording,
+// the target for culled quads, and the bound animation channels
+static thread_local TextBoxRenderer::Recording* t_staging = nullptr;
+static thread_local TextBoxRenderer::Vertex t_scratch[4];
+static thread_local TextBoxRenderer::CompositeVertex t_compositeScratch[4];
+static thread_local uint32_t t_anim = 0u;
+constexpr uint32_t AnimPositionMask = 0xFFFFu;  // x and y channel bits of t_anim
+
+static const TextBoxRenderer::Pipeline modePipelines[] = {
+    TextBoxRenderer::Pipeline::Box,          TextBoxRenderer::Pipeline::Text,
+    TextBoxRenderer::Pipeline::CompositeBox, TextBoxRenderer::Pipeline::CompositeText,
+    TextBoxRenderer::Pipeline::Image
+};
 
 ///////////////////////////////////////////////////////////////////////////////
 
+// shader sources are templates for all pipelines; compileShader() puts a
+// "#version" line and the PIPELINE_* and MODE_* definitions in front of them
+static const char* shaderCommon =
+     "#define HAS_BOX       (PIPELINE == PIPELINE_UBER || PIPELINE == PIPELINE_BOX  || PIPELINE == PIPELINE_COMPOSITE_BOX)"
+"\n" "#define HAS_TEXT      (PIPELINE == PIPELINE_UBER || PIPELINE == PIPELINE_TEXT || PIPELINE == PIPELINE_COMPOSITE_TEXT || PIPELINE == PIPELINE_GLYPHS)"
+"\n" "#define HAS_COMPOSITE (PIPELINE == PIPELINE_UBER || PIPELINE == PIPELINE_COMPOSITE_BOX || PIPELINE == PIPELINE_COMPOSITE_TEXT)"
+"\n" "#define HAS_IMAGE     (PIPELINE == PIPELINE_UBER || PIPELINE == PIPELINE_IMAGE)"
+"\n";
+
 static const char* vsSrc =
-     "#version 330"
-"\n" "layout(location=0) in vec2 aPos;"
-"\n" "layout(location=1) in vec2 aTC;         out vec2 vTC;"
-"\n" "layout(location=2) in vec3 aSize;  flat out vec3 vSize;"
-"\n" "layout(location=3) in vec2 aBR;    flat out vec2 vBR;"
-"\n" "layout(location=4) in vec4 aColor;      out vec4 vColor;"
-"\n" "layout(location=5) in uint aMode;  flat out uint vMode;"
+     "#if PIPELINE == PIPELINE_GLYPHS"
+"\n" "layout(location=0)  in vec2 aPen;               out vec2 vTC;"
+"\n" "layout(location=1)  in float aSize;       flat out vec2 vBR;"
+"\n" "layout(location=4)  in vec4 aColor;             out vec4 vColor;"
+"\n" "layout(location=5)  in uint aGlyph;        flat out int vPage;"
+"\n" "uniform samplerBuffer uGlyphs;  // per glyph: position box, texture coordinate box, dynamic atlas page"
+"\n" "uniform vec2 uViewBias;  // pixels -> NDC, together with uAnimScale"
+"\n" "#else"
+"\n" "layout(location=0)  in vec2 aPos;"
+"\n" "layout(location=1)  in vec2 aTC;                out vec2 vTC;"
+"\n" "#if HAS_BOX"
+"\n" "layout(location=2)  in vec3 aSize;         flat out vec3 vSize;"
+"\n" "#endif"
+"\n" "layout(location=3)  in vec2 aBR;           flat out vec2 vBR;"
+"\n" "layout(location=4)  in vec4 aColor;             out vec4 vColor;"
+"\n" "layout(location=5)  in uint aMode;  // bits 0-7 = mode, 8-31 = animation channels"
+"\n" "#if PIPELINE == PIPELINE_UBER"
+"\n" "flat out uint vMode;"
+"\n" "#endif"
+"\n" "#if HAS_COMPOSITE"
+"\n" "layout(location=6)  in vec4 aOutlineColor; flat out vec4 vOutlineColor;"
+"\n" "layout(location=7)  in vec4 aShadowColor;  flat out vec4 vShadowColor;"
+"\n" "layout(location=8)  in vec2 aOutline;      flat out vec2 vOutline;"
+"\n" "layout(location=9)  in vec4 aShadow;       flat out vec4 vShadow;"
+"\n" "#endif"
+"\n" "#if HAS_COMPOSITE && HAS_TEXT"
+"\n" "layout(location=10) in vec4 aClip;         flat out vec4 vClip;"
+"\n" "#endif"
+"\n" "#endif"
+"\n" "#if PIPELINE == PIPELINE_GLYPHS"
+"\n" "layout(location=11) in uint aAnim;"
+"\n" "#else"
+"\n" "#define aAnim (aMode >> 8u)"
+"\n" "#endif"
+"\n" "uniform vec4 uAnim[MAX_ANIM_CHANNELS];  // x = start value, y = target value, z = start time"
+"\n" "uniform float uAnimTime;"
+"\n" "uniform vec2 uAnimScale;  // pixels -> NDC"
+"\n" ""
+"\n" "// same as AnimValue::at()"
+"\n" "float anim(uint ch) {"
+"\n" "    if (ch == 0u) { return 0.0; }"
+"\n" "    vec4 a = uAnim[ch];"
+"\n" "    float d = (a.x - a.y) * exp2((uAnimTime - a.z) * (-1.0 / ANIM_TIME_CONSTANT));"
+"\n" "    return (abs(d) > 1e-3) ? (a.y + d) : a.y;"
+"\n" "}"
+"\n" ""
 "\n" "void main() {"
-"\n" "    gl_Position = vec4(aPos, 0., 1.);"
+"\n" "    vec2 offset = vec2(anim(aAnim & 255u), anim((aAnim >> 8u) & 255u));"
+"\n" "    vColor = vec4(aColor.rgb, mix(aColor.a, 1.0, anim((aAnim >> 16u) & 255u)));"
+"\n" "#if PIPELINE == PIPELINE_GLYPHS"
+"\n" "    // same as the quads that text() generates; gl_VertexID is the corner"
+"\n" "    vec4 box = texelFetch(uGlyphs, int(aGlyph) * 3);"
+"\n" "    vec4 tc  = texelFetch(uGlyphs, int(aGlyph) * 3 + 1);"
+"\n" "    vPage  = int(texelFetch(uGlyphs, int(aGlyph) * 3 + 2).x);"
+"\n" "    bvec2 corner = bvec2((gl_VertexID & 1) != 0, (gl_VertexID & 2) != 0);"
+"\n" "    vec2 pos = aPen + mix(box.xy, box.zw, corner) * aSize;"
+"\n" "    gl_Position = vec4((pos * uAnimScale + uViewBias) + offset * uAnimScale, 0., 1.);"
+"\n" "    vTC    = mix(tc.xy, tc.zw, corner);"
+"\n" "    vBR    = vec2(0.0, 1.33);"
+"\n" "#else"
+"\n" "    gl_Position = vec4(aPos + offset * uAnimScale, 0., 1.);"
 "\n" "    vTC    = aTC;"
+"\n" "#if HAS_BOX"
 "\n" "    vSize  = aSize;"
+"\n" "#endif"
 "\n" "    vBR    = aBR;"
-"\n" "    vColor = aColor;"
-"\n" "    vMode  = aMode;"
+"\n" "#if PIPELINE == PIPELINE_UBER"
+"\n" "    vMode  = aMode & 255u;"
+"\n" "#endif"
+"\n" "#if HAS_COMPOSITE"
+"\n" "    vOutlineColor = aOutlineColor;"
+"\n" "    vShadowColor  = aShadowColor;"
+"\n" "    vOutline      = aOutline;"
+"\n" "    vShadow       = aShadow;"
+"\n" "#endif"
+"\n" "#if HAS_COMPOSITE && HAS_TEXT"
+"\n" "    vClip  = aClip;"
+"\n" "#endif"
+"\n" "#endif"
 "\n" "}"
 "\n";
 
 static const char* fsSrc =
-     "#version 330"
-"\n" "     in vec2 vTC;"
+     "     in vec2 vTC;"
+"\n" "#if HAS_BOX"
 "\n" "flat in vec3 vSize;"
+"\n" "#endif"
 "\n" "flat in vec2 vBR;"
 "\n" "     in vec4 vColor;"
+"\n" "#if PIPELINE == PIPELINE_UBER"
 "\n" "flat in uint vMode;"
+"\n" "#endif"
+"\n" "#if HAS_COMPOSITE"
+"\n" "flat in vec4 vOutlineColor;"
+"\n" "flat in vec4 vShadowColor;"
+"\n" "flat in vec2 vOutline;"
+"\n" "flat in vec4 vShadow;"
+"\n" "#endif"
+"\n" "#if HAS_COMPOSITE && HAS_TEXT"
+"\n" "flat in vec4 vClip;"
+"\n" "#endif"
+"\n" "#if HAS_TEXT || HAS_IMAGE"
 "\n" "uniform sampler2D uTex;"
+"\n" "#endif"
+"\n" "#if PIPELINE == PIPELINE_GLYPHS"
+"\n" "flat in int vPage;  // 0 = baked font, otherwise dynamic glyph atlas layer + 1"
+"\n" "uniform sampler2DArray uPages;"
+"\n" "#endif"
 "\n" "layout(location=0) out vec4 outColor;"
+"\n" ""
+"\n" "float coverage(float d, vec2 br) {"
+"\n" "    return clamp((d - br.x) * br.y + 0.5, 0.0, 1.0);"
+"\n" "}"
+"\n" "vec4 single(float d) {"
+"\n" "    return vec4(vColor.rgb, vColor.a * coverage(d, vBR));"
+"\n" "}"
+"\n" "#if HAS_BOX"
+"\n" "float boxDist(vec2 tc) {"
+"\n" "    vec2 p = abs(tc) - vSize.xy;"
+"\n" "    return (min(p.x, p.y) > (-vSize.z))"
+"\n" "         ? (vSize.z - length(p + vec2(vSize.z)))"
+"\n" "         : min(-p.x, -p.y);"
+"\n" "}"
+"\n" "#endif"
+"\n" "#if HAS_TEXT"
+"\n" "float textDist(vec2 tc) {"
+"\n" "#if PIPELINE == PIPELINE_GLYPHS"
+"\n" "    // the dynamic atlas has single-channel distance fields"
+"\n" "    vec3 s = (vPage > 0) ? texture(uPages, vec3(tc, float(vPage - 1))).rrr : texture(uTex, tc).rgb;"
+"\n" "#else"
+"\n" "    vec3 s = texture(uTex, tc).rgb;"
+"\n" "#endif"
+"\n" "    float d = max(min(s.r, s.g), min(max(s.r, s.g), s.b)) - 0.5;"
+"\n" "    return d / fwidth(d);"
+"\n" "}"
+"\n" "#endif"
+"\n" "#if HAS_COMPOSITE"
+"\n" "// shadow, outline and fill layers, blended over each other in that order"
+"\n" "vec4 composite(float dFill, float dShadow) {"
+"\n" "    float aS = vShadowColor.a  * coverage(dShadow, vShadow.xy);"
+"\n" "    float aO = vOutlineColor.a * coverage(dFill,   vOutline);"
+"\n" "    float aF = vColor.a        * coverage(dFill,   vBR);"
+"\n" "    vec3 c = vShadowColor.rgb * aS;  float a = aS;"
+"\n" "    c = mix(c, vOutlineColor.rgb, aO);  a = mix(a, 1.0, aO);"
+"\n" "    c = mix(c, vColor.rgb,        aF);  a = mix(a, 1.0, aF);"
+"\n" "    return vec4(c / max(a, 1.0 / 1024.0), a);"
+"\n" "}"
+"\n" "#endif"
+"\n" "#if HAS_IMAGE"
+"\n" "// layers are stored with premultiplied alpha; undo that, so that the"
+"\n" "// normal blend function can be used (which cancels out the division)"
+"\n" "vec4 image(vec2 tc) {"
+"\n" "    vec4 s = texture(uTex, tc);"
+"\n" "    return (s.a > 0.0) ? vec4(s.rgb / s.a, s.a * vColor.a) : vec4(0.0);"
+"\n" "}"
+"\n" "#endif"
+"\n" ""
 "\n" "void main() {"
-"\n" "    float d = 0.;"
-"\n" "    if (vMode == 0u) {  // box mode"
-"\n" "        vec2 p = abs(vTC) - vSize.xy;"
-"\n" "        d = (min(p.x, p.y) > (-vSize.z))"
-"\n" "          ? (vSize.z - length(p + vec2(vSize.z)))"
-"\n" "          : min(-p.x, -p.y);"
-"\n" "    } else { // text mode"
-"\n" "        vec3 s = texture(uTex, vTC).rgb;"
-"\n" "        d = max(min(s.r, s.g), min(max(s.r, s.g), s.b)) - 0.5;"
-"\n" "        d /= fwidth(d);"
+"\n" "#if PIPELINE == PIPELINE_UBER"
+"\n" "    if (vMode == MODE_BOX) {"
+"\n" "        outColor = single(boxDist(vTC));"
+"\n" "    } else if (vMode == MODE_TEXT) {"
+"\n" "        outColor = single(textDist(vTC));"
+"\n" "    } else if (vMode == MODE_COMPOSITE_BOX) {"
+"\n" "        outColor = composite(boxDist(vTC), boxDist(vTC - vShadow.zw));"
+"\n" "    } else if (vMode == MODE_IMAGE) {"
+"\n" "        outColor = image(vTC);"
+"\n" "    } else {"
+"\n" "        outColor = composite(textDist(clamp(vTC,              vClip.xy, vClip.zw)),"
+"\n" "                             textDist(clamp(vTC - vShadow.zw, vClip.xy, vClip.zw)));"
 "\n" "    }"
-"\n" "    outColor = vec4(vColor.rgb, vColor.a * clamp((d - vBR.x) * vBR.y + 0.5, 0.0, 1.0));"
+"\n" "#elif PIPELINE == PIPELINE_BOX"
+"\n" "    outColor = single(boxDist(vTC));"
+"\n" "#elif PIPELINE == PIPELINE_TEXT || PIPELINE == PIPELINE_GLYPHS"
+"\n" "    outColor = single(textDist(vTC));"
+"\n" "#elif PIPELINE == PIPELINE_COMPOSITE_BOX"
+"\n" "    outColor = composite(boxDist(vTC), boxDist(vTC - vShadow.zw));"
+"\n" "#elif PIPELINE == PIPELINE_IMAGE"
+"\n" "    outColor = image(vTC);"
+"\n" "#else"
+"\n" "    outColor = composite(textDist(clamp(vTC,              vClip.xy, vClip.zw)),"
+"\n" "                         textDist(clamp(vTC - vShadow.zw, vClip.xy, vClip.zw)));"
+"\n" "#endif"
 "\n" "}"
 "\n";
 
-bool TextBoxRenderer::init() {
+static GLuint compileShader(GLenum type, int pipeline, const char* src) {
+    typedef TextBoxRenderer R;
+    char header[1024];
+    snprintf(header, sizeof(header),
+        "#version 330\n"
+        "#define MAX_ANIM_CHANNELS %d\n#define ANIM_TIME_CONSTANT %.9g\n"
+        "#define PIPELINE_UBER %d\n#define PIPELINE_BOX %d\n#define PIPELINE_TEXT %d\n"
+        "#define PIPELINE_COMPOSITE_BOX %d\n#define PIPELINE_COMPOSITE_TEXT %d\n#define PIPELINE_IMAGE %d\n#define PIPELINE_GLYPHS %d\n"
+        "#define MODE_BOX %uu\n#define MODE_TEXT %uu\n#define MODE_COMPOSITE_BOX %uu\n#define MODE_COMPOSITE_TEXT %uu\n#define MODE_IMAGE %uu\n"
+        "#define PIPELINE %d\n",
+        R::MaxAnimChannels, double(AnimTimeConstant),
+        int(R::Pipeline::Uber), int(R::Pipeline::Box), int(R::Pipeline::Text),
+        int(R::Pipeline::CompositeBox), int(R::Pipeline::CompositeText), int(R::Pipeline::Image), int(R::Pipeline::Glyphs),
+        unsigned(R::ModeBox), unsigned(R::ModeText), unsigned(R::ModeCompositeBox), unsigned(R::ModeCompositeText), unsigned(R::ModeImage),
+        pipeline);
+    const char* parts[3] = { header, shaderCommon, src };
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 3, parts, nullptr);
+    glCompileShader(shader);
+    GLint res;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &res);
+    if (res != GL_TRUE) {
+        #ifdef _DEBUG
+            ::puts(header);
+            ::puts(shaderCommon);
+            ::puts(src);
+            printf("%s Shader compilation failed.\n", (type == GL_VERTEX_SHADER) ? "Vertex" : "Fragment");
+            glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &res);
+            char* msg = new(std::nothrow) char[res];
+            if (msg) {
+                glGetShaderInfoLog(shader, res, nullptr, msg);
+                ::puts(msg);
+                delete[] msg;
+            }
+        #endif
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+static GLuint compileProgram(int pipeline) {
+    GLuint vs = compileShader(GL_VERTEX_SHADER, pipeline, vsSrc);
+    if (!vs) { return 0; }
+    GLuint fs = compileShader(GL_FRAGMENT_SHADER, pipeline, fsSrc);
+    if (!fs) { glDeleteShader(vs);  return 0; }
+
+    GLuint prog = glCreateProgram();
+    glAttachShader(prog, vs);
+    glAttachShader(prog, fs);
+    glLinkProgram(prog);
+    glDeleteShader(fs);
+    glDeleteShader(vs);
     GLint res;
+    glGetProgramiv(prog, GL_LINK_STATUS, &res);
+    if (res != GL_TRUE) {
+        #ifdef _DEBUG
+            printf("Shader Program linking failed.\n");
+            glGetProgramiv(prog, GL_INFO_LOG_LENGTH, &res);
+            char* msg = new(std::nothrow) char[res];
+            if (msg) {
+                glGetProgramInfoLog(prog, res, nullptr, msg);
+                ::puts(msg);
+                delete[] msg;
+            }
+        #endif
+        glDeleteProgram(prog);
+        return 0;
+    }
+    return prog;
+}
+
+static void setupVertexAttributes(bool composite) {
+    // GL_ARRAY_BUFFER and the vertex array object must be bound; the
+    // composite attributes only exist in composite vertex buffers
+    typedef TextBoxRenderer::Vertex Vertex;
+    typedef TextBoxRenderer::CompositeVertex CV;
+    GLsizei stride = composite ? sizeof(CV) : sizeof(Vertex);
+    for (GLuint i = 0;  i <= (composite ? 10u : 5u);  ++i) { glEnableVertexAttribArray(i); }
+    glVertexAttribPointer (0, 2, GL_FLOAT,        GL_FALSE, stride, &(static_cast<Vertex*>(0)->pos[0]));
+    glVertexAttribPointer (1, 2, GL_FLOAT,        GL_FALSE, stride, &(static_cast<Vertex*>(0)->tc[0]));
+    glVertexAttribPointer (2, 3, GL_FLOAT,        GL_FALSE, stride, &(static_cast<Vertex*>(0)->size[0]));
+    glVertexAttribPointer (3, 2, GL_FLOAT,        GL_FALSE, stride, &(static_cast<Vertex*>(0)->br[0]));
+    glVertexAttribPointer (4, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, &(static_cast<Vertex*>(0)->color));
+    glVertexAttribIPointer(5, 1, GL_UNSIGNED_INT,           stride, &(static_cast<Vertex*>(0)->mode));
+    if (!composite) { return; }
+    glVertexAttribPointer (6, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, &(static_cast<CV*>(0)->outlineColor));
+    glVertexAttribPointer (7, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, &(static_cast<CV*>(0)->shadowColor));
+    glVertexAttribPointer (8, 2, GL_FLOAT,        GL_FALSE, stride, &(static_cast<CV*>(0)->outline[0]));
+    glVertexAttribPointer (9, 4, GL_FLOAT,        GL_FALSE, stride, &(static_cast<CV*>(0)->shadow[0]));
+    glVertexAttribPointer(10, 4, GL_FLOAT,        GL_FALSE, stride, &(static_cast<CV*>(0)->clip[0]));
+}
+
+static GLuint createVertexArray(GLuint vbo, GLuint ibo, bool composite) {
+    // vertex array object for quads from a (composite) vertex buffer
+    GLuint vao = 0;
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    setupVertexAttributes(composite);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);  // part of the vertex array state
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return vao;
+}
+
+static void setupGlyphAttributes(int first) {
+    // GL_ARRAY_BUFFER and the glyph vertex array object must be bound;
+    // there's no way to start drawing at an instance other than the first
+    // in OpenGL 3.3, so the attributes are pointed at the first glyph of
+    // each run that is drawn
+    typedef TextBoxRenderer::GlyphInstance G;
+    auto at = [first] (size_t offset) { return reinterpret_cast<const void*>(size_t(first) * sizeof(G) + offset); };
+    glVertexAttribPointer (0, 2, GL_FLOAT,        GL_FALSE, sizeof(G), at(offsetof(G, pen)));
+    glVertexAttribPointer (1, 1, GL_FLOAT,        GL_FALSE, sizeof(G), at(offsetof(G, size)));
+    glVertexAttribPointer (4, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(G), at(offsetof(G, color)));
+    glVertexAttribIPointer(5, 1, GL_UNSIGNED_INT,           sizeof(G), at(offsetof(G, glyph)));
+    glVertexAttribIPointer(11, 1, GL_UNSIGNED_INT,          sizeof(G), at(offsetof(G, anim)));
+}
 
+static GLuint createGlyphArray(GLuint vbo) {
+    // vertex array object for glyph instances from a vertex buffer
+    GLuint vao = 0;
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    static const GLuint attribs[] = { 0, 1, 4, 5, 11 };
+    for (GLuint i : attribs) {
+        glEnableVertexAttribArray(i);
+        glVertexAttribDivisor(i, 1);
+    }
+    setupGlyphAttributes(0);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return vao;
+}
+
+bool TextBoxRenderer::init(SoftRasterizer* soft) {
+    m_soft = soft;
+    if (!m_glyphCache) {
+        m_glyphCache = static_cast<int*>(::calloc(GlyphCacheMax - GlyphCacheMin + 1u, sizeof(int)));
+        // fill the cache completely, so getGlyph() never writes to it later
+        // (which makes it safe to call from multiple threads)
+        for (uint32_t cp = GlyphCacheMin;  cp <= GlyphCacheMax;  ++cp) { getGlyph(cp); }
+    }
+    if (!m_ascii) {
+        m_ascii = new(std::nothrow) AsciiGlyphs;
+        if (!m_ascii) { return false; }
+        for (uint32_t cp = 1u;  cp < 128u;  ++cp) {
+            const FontData::Glyph* g = getGlyph(cp);
+            m_ascii->advance[cp] = g->advance;
+            m_ascii->x0[cp] = g->pos.x0;  m_ascii->y0[cp] = g->pos.y0;
+            m_ascii->x1[cp] = g->pos.x1;  m_ascii->y1[cp] = g->pos.y1;
+            m_ascii->u0[cp] = g->tc.x0;   m_ascii->v0[cp] = g->tc.y0;
+            m_ascii->u1[cp] = g->tc.x1;   m_ascii->v1[cp] = g->tc.y1;
+            m_ascii->space[cp] = g->space;
+        }
+    }
+    m_widthCache.resize(WidthCacheSize);
+    m_anims.resize(1);
     viewportChanged();
+    if (m_soft) {
+        m_softVertices.resize(BatchSize * 4);
+        m_softComposites.resize(BatchSize * 4);
+        m_vertices = nullptr;
+        m_quadCount = 0;
+        return loadFontTexture();
+    }
+    glEnable(GL_BLEND);
+    // alpha is accumulated like premultiplied color, so that the contents
+    // of render layers end up with correct premultiplied alpha
+    glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &m_targetFBO);
 
     glGenBuffers(1, &m_vbo);
     glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
@@ -74,25 +430,25 @@ bool TextBoxRenderer::init() {
     m_vertices = nullptr;
     m_quadCount = 0;
 
-    glGenVertexArrays(1, &m_vao);
-    glBindVertexArray(m_vao);
-    // GL_ARRAY_BUFFER is still bound
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(2);
-    glEnableVertexAttribArray(3);
-    glEnableVertexAttribArray(4);
-    glEnableVertexAttribArray(5);
-    glVertexAttribPointer (0, 2, GL_FLOAT,        GL_FALSE, sizeof(Vertex), &(static_cast<Vertex*>(0)->pos[0]));
-    glVertexAttribPointer (1, 2, GL_FLOAT,        GL_FALSE, sizeof(Vertex), &(static_cast<Vertex*>(0)->tc[0]));
-    glVertexAttribPointer (2, 3, GL_FLOAT,        GL_FALSE, sizeof(Vertex), &(static_cast<Vertex*>(0)->size[0]));
-    glVertexAttribPointer (3, 2, GL_FLOAT,        GL_FALSE, sizeof(Vertex), &(static_cast<Vertex*>(0)->br[0]));
-    glVertexAttribPointer (4, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), &(static_cast<Vertex*>(0)->color));
-    glVertexAttribIPointer(5, 1, GL_UNSIGNED_INT,           sizeof(Vertex), &(static_cast<Vertex*>(0)->mode));
-    glBindVertexArray(0);
+    glGenBuffers(1, &m_ibo);
+    m_vao = createVertexArray(m_vbo, m_ibo, false);
+
+    glGenBuffers(1, &m_compositeVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, m_compositeVBO);
+    glBufferData(GL_ARRAY_BUFFER, BatchSize * 4 * sizeof(CompositeVertex), nullptr, GL_STREAM_DRAW);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
+    m_compositeVAO = createVertexArray(m_compositeVBO, m_ibo, true);
+    m_composites = nullptr;
+    m_compositeCount = 0;
+
+    glGenBuffers(1, &m_glyphVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, m_glyphVBO);
+    glBufferData(GL_ARRAY_BUFFER, GlyphBatchSize * sizeof(GlyphInstance), nullptr, GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    m_glyphVAO = createGlyphArray(m_glyphVBO);
+    m_glyphs = nullptr;
+    m_glyphCount = 0;
 
-    glGenBuffers(1, &m_ibo);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
     auto iboData = new(std::nothrow) uint16_t[BatchSize * 6];
     if (!iboData) { return false; }
@@ -110,98 +466,84 @@ bool TextBoxRenderer::init() {
     glFlush(); glFinish();
     delete[] iboData;
 
-    GLuint vs = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vs, 1, &vsSrc, nullptr);
-    glCompileShader(vs);
-    glGetShaderiv(vs, GL_COMPILE_STATUS, &res);
-    if (res != GL_TRUE) {
-        #ifdef _DEBUG
-            ::puts(vsSrc);
-            printf("Vertex Shader compilation failed.\n");
-            glGetShaderiv(vs, GL_INFO_LOG_LENGTH, &res);
-            char* msg = new(std::nothrow) char[res];
-            if (msg) {
-                glGetShaderInfoLog(vs, res, nullptr, msg);
-                puts(msg);
-                delete[] msg;
-            }
-        #endif
-        return false;
+    for (int i = 0;  i < PipelineCount;  ++i) {
+        m_prog[i] = compileProgram(i);
+        if (!m_prog[i]) { return false; }
+        m_uAnim[i]      = glGetUniformLocation(m_prog[i], "uAnim");
+        m_uAnimTime[i]  = glGetUniformLocation(m_prog[i], "uAnimTime");
+        m_uAnimScale[i] = glGetUniformLocation(m_prog[i], "uAnimScale");
+        m_uViewBias[i]  = glGetUniformLocation(m_prog[i], "uViewBias");
+        m_progAnimVersion[i] = 0u;
+        glUseProgram(m_prog[i]);
+        glUniform1i(glGetUniformLocation(m_prog[i], "uGlyphs"), 1);
+        glUniform1i(glGetUniformLocation(m_prog[i], "uPages"), 2);
     }
+    glUseProgram(0);
 
-    GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fs, 1, &fsSrc, nullptr);
-    glCompileShader(fs);
-    glGetShaderiv(fs, GL_COMPILE_STATUS, &res);
-    if (res != GL_TRUE) {
+    if (!loadFontTexture()) { return false; }
+
+    // the dynamic glyph atlas is optional; without it, characters that
+    // aren't in the baked font simply become the fallback glyph
+    if (m_dynamicGlyphs) { m_atlas.init(m_fallbackFont.empty() ? nullptr : m_fallbackFont.c_str()); }
+
+    // glyph metrics for the glyph pipeline; the buffer texture stays bound
+    // to texture unit 1 all the time (and the dynamic glyph atlas to unit 2),
+    // everything else only uses unit 0; dynamic glyphs start out as copies
+    // of the fallback glyph
+    constexpr size_t M = size_t(GlyphAtlas::MetricsSize);
+    int metricsCount = FontData::NumGlyphs + (m_atlas.active() ? GlyphAtlas::MaxGlyphs : 0);
+    std::vector<float> metrics(size_t(metricsCount) * M);
+    for (int i = 0;  i < metricsCount;  ++i) {
+        const FontData::Glyph& g = FontData::GlyphData[(i < FontData::NumGlyphs) ? i : FontData::FallbackGlyphIndex];
+        const float m[M] = { g.pos.x0, g.pos.y0, g.pos.x1, g.pos.y1, g.tc.x0, g.tc.y0, g.tc.x1, g.tc.y1, 0.0f, 0.0f, 0.0f, 0.0f };
+        memcpy(&metrics[size_t(i) * M], m, sizeof(m));
+    }
+    glGenBuffers(1, &m_glyphMetricsBuffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, m_glyphMetricsBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, metrics.size() * sizeof(float), static_cast<const void*>(metrics.data()), GL_STATIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glGenTextures(1, &m_glyphMetricsTex);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_BUFFER, m_glyphMetricsTex);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_glyphMetricsBuffer);
+    glActiveTexture(GL_TEXTURE0);
+
+    // create the framebuffer that keeps the previous frame's contents;
+    // if that fails, we simply fall back to full redraws
+    glGenRenderbuffers(1, &m_frameRB);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_frameRB);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, m_vpWidth, m_vpHeight);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glGenFramebuffers(1, &m_frameFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_frameFBO);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_frameRB);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
         #ifdef _DEBUG
-            ::puts(fsSrc);
-            printf("Fragment Shader compilation failed.\n");
-            glGetShaderiv(fs, GL_INFO_LOG_LENGTH, &res);
-            char* msg = new(std::nothrow) char[res];
-            if (msg) {
-                glGetShaderInfoLog(fs, res, nullptr, msg);
-                ::puts(msg);
-                delete[] msg;
-            }
+            printf("frame FBO incomplete, partial redraw disabled\n");
         #endif
-        return false;
+        glDeleteFramebuffers(1, &m_frameFBO);   m_frameFBO = 0;
+        glDeleteRenderbuffers(1, &m_frameRB);   m_frameRB = 0;
     }
+    glBindFramebuffer(GL_FRAMEBUFFER, m_targetFBO);
+    return true;
+}
 
-    m_prog = glCreateProgram();
-    glAttachShader(m_prog, vs);
-    glAttachShader(m_prog, fs);
-    glLinkProgram(m_prog);
-    glGetProgramiv(fs, GL_LINK_STATUS, &res);
-    if (res != GL_TRUE) {
+bool TextBoxRenderer::loadFontTexture() {
+    uint8_t* texImg = static_cast<uint8_t*>(::malloc(FontData::TexWidth * FontData::TexHeight * 3));
+    if (!texImg) { return false; }
+    if (!DecodeFontTexture(texImg)) {
         #ifdef _DEBUG
-            printf("Shader Program linking failed.\n");
-            glGetProgramiv(fs, GL_INFO_LOG_LENGTH, &res);
-            char* msg = new(std::nothrow) char[res];
-            if (msg) {
-                glGetProgramInfoLog(fs, res, nullptr, msg);
-                ::puts(msg);
-                delete[] msg;
-            }
+            printf("font texture decoding failed\n");
         #endif
+        ::free(texImg);
         return false;
     }
-    glDeleteShader(fs);
-    glDeleteShader(vs);
 
-    int texStride = FontData::TexWidth * 3;
-    int texSize = FontData::TexHeight * texStride;
-    int texOffset = texStride + 16;
-    void *texBuffer = ::calloc(texSize + texOffset, 1);
-    if (!texBuffer) { return false; }
-    uint8_t* texImg = &(static_cast<uint8_t*>(texBuffer))[texOffset];
-    const uint8_t* dataPos = FontData::TexData;
-    for (int c = 0;  c < 3;  ++c) {
-        int texPos = c;
-        while (texPos < texSize) {
-            // zero run
-            int length = *dataPos++;
-            texPos += length * 3;
-            if (texPos >= texSize) { break; }
-            // literal run
-            length = *dataPos++;
-            while ((length--) && (texPos < texSize)) {
-                texImg[texPos] = *dataPos++;
-                texPos += 3;
-            }
-        }
-    }
-    for (int texPos = 0;  texPos < texSize;  ++texPos) {
-        int w  = texImg[texPos - 3];
-        int n  = texImg[texPos - texStride];
-        int nw = texImg[texPos - texStride - 3];
-        int p = n + w - nw;
-        p = std::max(p, std::min(std::min(n, w), nw));
-        p = std::min(p, std::max(std::max(n, w), nw));
-        texImg[texPos] += uint8_t(p);
+    if (m_soft) {
+        m_soft->setTexture(texImg, FontData::TexWidth, FontData::TexHeight);
+        ::free(texImg);
+        return true;
     }
-    //{FILE *f = fopen("abfall.ppm", "wb"); fprintf(f, "P6\n%d %d\n255\n", FontData::TexWidth, FontData::TexHeight); fwrite((const void*)texImg, texSize, 1, f); fclose(f);}
-
     glGenTextures(1, &m_tex);
     glBindTexture(GL_TEXTURE_2D, m_tex);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -211,82 +553,840 @@ bool TextBoxRenderer::init() {
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, FontData::TexWidth, FontData::TexHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, (const void*)texImg);
     glBindTexture(GL_TEXTURE_2D, 0);
     glFlush(); glFinish();
-    ::free(texBuffer);
-
-    m_glyphCache = static_cast<int*>(::calloc(GlyphCacheMax - GlyphCacheMin + 1u, sizeof(int)));
+    ::free(texImg);
     return true;
 }
 
 void TextBoxRenderer::viewportChanged() {
-    GLint vp[4];
-    glGetIntegerv(GL_VIEWPORT, vp);
-    m_vpWidth  = vp[2];
-    m_vpHeight = vp[3];
-    m_vpScaleX =  2.0f / float(m_vpWidth);
-    m_vpScaleY = -2.0f / float(m_vpHeight);
+    if (m_soft) {
+        m_vpWidth  = m_soft->width();
+        m_vpHeight = m_soft->height();
+    } else {
+        GLint vp[4];
+        glGetIntegerv(GL_VIEWPORT, vp);
+        m_vpWidth  = vp[2];
+        m_vpHeight = vp[3];
+    }
+    setViewportTransform(0.0f, 0.0f, m_vpWidth, m_vpHeight);
+}
+
+void TextBoxRenderer::setViewportTransform(float x0, float y0, int width, int height) {
+    // maps (x0, y0) to the top-left and (x0 + width, y0 + height) to the
+    // bottom-right corner in normalized device coordinates
+    m_vpScaleX =  2.0f / float(width);
+    m_vpScaleY = -2.0f / float(height);
+    m_vpBiasX = -1.0f - x0 * m_vpScaleX;
+    m_vpBiasY =  1.0f - y0 * m_vpScaleY;
+    ++m_animVersion;  // the shaders' pixel scale has changed
+}
+
+void TextBoxRenderer::setClearColor(float r, float g, float b) {
+    auto toByte = [] (float f) { return uint32_t(std::min(1.f, std::max(0.f, f)) * 255.f + .5f); };
+    m_clearColor = 0xFF000000u | (toByte(r) << 16) | (toByte(g) << 8) | toByte(b);
+    if (!m_soft && !m_deferred) { glClearColor(r, g, b, 1.0f); }
+}
+
+void TextBoxRenderer::setTiming(bool enable) {
+    if (enable && !m_soft && !m_deferred && !m_timerQueries[0]) {
+        glGenQueries(2, m_timerQueries);
+    }
+    m_timing = enable;
+    m_gpuTime = -1.0;
 }
 
 void TextBoxRenderer::flush() {
-    glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-    glUnmapBuffer(GL_ARRAY_BUFFER);
+    if (m_deferred || (!m_vertices && !m_composites && !m_glyphs && m_runs.empty())) { return; }
+    FrameScheduler::Time t0 = m_timing ? FrameScheduler::now() : 0.0;
+    m_stats.quads += m_quadCount + m_compositeCount + m_glyphCount;
+    ++m_stats.batches;
+    if (m_soft) {
+        applyAnimation(m_vertices, m_quadCount);
+        applyAnimation(m_composites, m_compositeCount);
+        // draw in the order of the runs, with adjacent runs of the same
+        // kind of quads merged into a single call
+        for (size_t i = 0;  i < m_runs.size();) {
+            bool composite = compositePipeline(m_runs[i].pipeline);
+            int start = m_runs[i].start, end = m_runs[i].end;
+            while ((++i < m_runs.size()) && (compositePipeline(m_runs[i].pipeline) == composite) && (m_runs[i].start == end)) { end = m_runs[i].end; }
+            if (composite) {
+                m_soft->draw(&m_composites[4 * start], end - start, m_scissorRects);
+            } else {
+                m_soft->draw(&m_vertices[4 * start], end - start, m_scissorRects);
+            }
+            ++m_stats.drawCalls;
+        }
+        m_vertices = nullptr;
+        m_composites = nullptr;
+        m_quadCount = 0;
+        m_compositeCount = 0;
+        m_runs.clear();
+        if (m_timing) { m_stats.flushTime += (FrameScheduler::now() - t0) * 1000.0; }
+        return;
+    }
+    if (m_vertices) {
+        glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        m_vertices = nullptr;
+    }
+    if (m_composites) {
+        glBindBuffer(GL_ARRAY_BUFFER, m_compositeVBO);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        m_composites = nullptr;
+    }
+    if (m_glyphs) {
+        glBindBuffer(GL_ARRAY_BUFFER, m_glyphVBO);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        m_glyphs = nullptr;
+    }
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-    glBindTexture(GL_TEXTURE_2D, m_tex);
-    glBindVertexArray(m_vao);
-    glUseProgram(m_prog);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
-    glDrawElements(GL_TRIANGLES, m_quadCount * 6, GL_UNSIGNED_SHORT, nullptr);
+    updateAnimUniforms(m_uniforms);
+    m_stats.drawCalls += drawRuns(m_runs, m_scissorRects);
+    m_runs.clear();
     glFinish();
     m_quadCount = 0;
+    m_compositeCount = 0;
+    m_glyphCount = 0;
+    if (m_timing) { m_stats.flushTime += (FrameScheduler::now() - t0) * 1000.0; }
+}
+
+int TextBoxRenderer::drawRuns(const std::vector<Run>& runs, const std::vector<Rect>& scissorRects) {
+    // draws the runs of the batch (which is in m_vbo, m_compositeVBO and m_glyphVBO)
+    // and returns the number of draw calls
+    int drawCalls = 0;
+    m_boundTexture = 0;
+    m_boundVAO = 0;
+    if (!scissorRects.empty()) { glEnable(GL_SCISSOR_TEST); }
+    for (const Run& run : runs) {
+        if (!run.stream) {
+            drawCalls += drawRun(run, m_vao, m_compositeVAO, m_glyphVAO, m_glyphVBO, scissorRects);
+            continue;
+        }
+        // retained stream: drawn from its own buffers, with its own runs
+        const Stream& stream = m_streams[run.stream - 1];
+        for (const Run& sr : stream.runs) { drawCalls += drawRun(sr, stream.vao, stream.compositeVAO, stream.glyphVAO, stream.glyphVBO, scissorRects); }
+    }
+    if (!scissorRects.empty()) { glDisable(GL_SCISSOR_TEST); }
+    glBindVertexArray(0);
+    return drawCalls;
+}
+
+int TextBoxRenderer::drawRun(const Run& run, GLuint vao, GLuint compositeVAO, GLuint glyphVAO, GLuint glyphVBO, const std::vector<Rect>& scissorRects) {
+    // draws quads from a (composite) vertex array, or glyph instances from
+    // a glyph vertex array; the index buffer only covers one batch, so
+    // longer runs of quads are split into several draws
+    bool glyphs = (run.pipeline == Pipeline::Glyphs);
+    bool composite = compositePipeline(run.pipeline);
+    int drawCalls = 0;
+    useProgram((composite && m_uberShader) ? Pipeline::Uber : run.pipeline);
+    if (run.texture != m_boundTexture) {
+        glBindTexture(GL_TEXTURE_2D, run.texture);
+        m_boundTexture = run.texture;
+    }
+    GLuint runVAO = glyphs ? glyphVAO : composite ? compositeVAO : vao;
+    if (runVAO != m_boundVAO) {
+        glBindVertexArray(runVAO);
+        m_boundVAO = runVAO;
+    }
+    int rects = std::max(1, int(scissorRects.size()));
+    if (glyphs) {
+        glBindBuffer(GL_ARRAY_BUFFER, glyphVBO);
+        setupGlyphAttributes(run.start);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        for (int r = 0;  r < rects;  ++r) {
+            if (!scissorRects.empty()) { setScissor(scissorRects[r]); }
+            glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GLsizei(run.end - run.start));
+            ++drawCalls;
+        }
+        return drawCalls;
+    }
+    for (int start = run.start;  start < run.end;  start += BatchSize) {
+        GLsizei n = GLsizei(std::min(run.end - start, BatchSize)) * 6;
+        for (int r = 0;  r < rects;  ++r) {
+            if (!scissorRects.empty()) { setScissor(scissorRects[r]); }
+            glDrawElementsBaseVertex(GL_TRIANGLES, n, GL_UNSIGNED_SHORT, nullptr, start * 4);
+            ++drawCalls;
+        }
+    }
+    return drawCalls;
+}
+
+void TextBoxRenderer::setScissor(const Rect& r) {
+    glScissor(r.x0, m_vpHeight - r.y1, r.x1 - r.x0, r.y1 - r.y0);
+}
+
+void TextBoxRenderer::beginFrame(const DamageTracker& damage) {
+    m_scissorRects.clear();
+    if ((m_frameFBO || m_soft) && !damage.full()) { m_scissorRects = damage.rects(); }
+    // a recorded frame with moving animation channels may be drawn again
+    // later, with the channels further along, so it must be complete
+    if (m_deferred && animMoving()) { m_scissorRects.clear(); }
+    m_cull = !m_scissorRects.empty();
+    if (m_cull) { m_cullRect = damage.bounds(); }
+
+    // collect finished GPU timer queries, and start a new one
+    if (m_timing && !m_soft && !m_deferred) {
+        for (int i = 0;  i < 2;  ++i) {
+            if (!m_queryPending[i]) { continue; }
+            GLuint available = 0;
+            glGetQueryObjectuiv(m_timerQueries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) { continue; }
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(m_timerQueries[i], GL_QUERY_RESULT, &ns);
+            // some drivers (e.g. llvmpipe) return nonsense for the very
+            // first query in a context, so ignore anything above 1 second
+            if (ns < 1000000000u) { m_gpuTime = double(ns) * 1E-6; }
+            m_queryPending[i] = false;
+        }
+        glBeginQuery(GL_TIME_ELAPSED, m_timerQueries[m_queryIndex]);
+        m_queryActive = true;
+    }
+    m_stats = FrameStats();
+    m_stats.gpuTime = m_gpuTime;
+
+    if (m_soft) {
+        m_soft->clear(m_scissorRects, m_clearColor);
+        return;
+    }
+    if (m_deferred) {
+        m_frame->quads.clear();
+        m_frame->scissorRects = m_scissorRects;
+        return;
+    }
+    clearFrame(m_scissorRects);
+}
+
+void TextBoxRenderer::clearFrame(const std::vector<Rect>& scissorRects) {
+    glBindFramebuffer(GL_FRAMEBUFFER, m_frameFBO ? GLuint(m_frameFBO) : GLuint(m_targetFBO));
+    if (scissorRects.empty()) {
+        glClear(GL_COLOR_BUFFER_BIT);
+    } else {
+        glEnable(GL_SCISSOR_TEST);
+        for (const auto& r : scissorRects) {
+            setScissor(r);
+            glClear(GL_COLOR_BUFFER_BIT);
+        }
+        glDisable(GL_SCISSOR_TEST);
+    }
+}
+
+void TextBoxRenderer::endFrame() {
+    flush();
+    m_scissorRects.clear();
+    m_cull = false;
+    if (m_soft) { return; }
+    if (m_deferred) {
+        // the statistics are what drawFrame() is going to do
+        const Recording& q = m_frame->quads;
+        int rects = std::max(1, int(m_frame->scissorRects.size()));
+        m_stats.quads = int(q.vertices.size() / 4u) + int(q.composites.size() / 4u) + int(q.glyphs.size());
+        m_stats.batches = q.runs.empty() ? 0 : 1;
+        for (const Run& run : q.runs) {
+            m_stats.drawCalls += rects * ((run.pipeline == Pipeline::Glyphs) ? 1 : ((run.end - run.start + BatchSize - 1) / BatchSize));
+        }
+        updateAnimUniforms(m_frame->anim);
+        m_frame->clearColor = m_clearColor;
+        m_frame->moving = m_frame->scissorRects.empty() && animMoving();
+        m_frame->time = FrameScheduler::now();
+        return;
+    }
+    blitFrame();
+    if (m_queryActive) {
+        glEndQuery(GL_TIME_ELAPSED);
+        m_queryPending[m_queryIndex] = true;
+        m_queryIndex ^= 1;
+        m_queryActive = false;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, m_targetFBO);
+}
+
+void TextBoxRenderer::blitFrame() {
+    if (!m_frameFBO) { return; }
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_frameFBO);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_targetFBO);
+    glBlitFramebuffer(0, 0, m_vpWidth, m_vpHeight, 0, 0, m_vpWidth, m_vpHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+}
+
+void TextBoxRenderer::setDeferred() {
+    if (m_soft) { return; }
+    flush();
+    m_deferred = true;
+}
+
+void TextBoxRenderer::drawFrame(const Frame& frame, double timeOffset) {
+    // apply the dynamic glyph atlas updates that have been made so far
+    // (they are older than the frame, or at least as old)
+    std::vector<GlyphAtlas::Upload> uploads;
+    std::vector<GlyphMetrics> metrics;
+    {
+        std::lock_guard<std::mutex> lock(m_pendingGlyphMutex);
+        uploads.swap(m_pendingGlyphUploads);
+        metrics.swap(m_pendingGlyphMetrics);
+    }
+    m_atlas.upload(uploads);
+    uploadGlyphMetrics(metrics);
+
+    const Recording& q = frame.quads;
+    m_uniforms.channels = frame.anim.channels;
+    m_uniforms.time     = frame.anim.time + float(timeOffset);
+    m_uniforms.scale[0] = frame.anim.scale[0];  m_uniforms.scale[1] = frame.anim.scale[1];
+    m_uniforms.bias[0]  = frame.anim.bias[0];   m_uniforms.bias[1]  = frame.anim.bias[1];
+    m_uniforms.version  = frame.anim.version;
+    auto channel = [&] (int shift) { return float((frame.clearColor >> shift) & 0xFFu) * (1.0f / 255.0f); };
+    glClearColor(channel(16), channel(8), channel(0), 1.0f);
+    clearFrame(frame.scissorRects);
+
+    // the whole frame is uploaded at once, replacing the buffers' contents
+    if (!q.vertices.empty()) {
+        glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+        glBufferData(GL_ARRAY_BUFFER, q.vertices.size() * sizeof(Vertex), static_cast<const void*>(q.vertices.data()), GL_STREAM_DRAW);
+    }
+    if (!q.composites.empty()) {
+        glBindBuffer(GL_ARRAY_BUFFER, m_compositeVBO);
+        glBufferData(GL_ARRAY_BUFFER, q.composites.size() * sizeof(CompositeVertex), static_cast<const void*>(q.composites.data()), GL_STREAM_DRAW);
+    }
+    if (!q.glyphs.empty()) {
+        glBindBuffer(GL_ARRAY_BUFFER, m_glyphVBO);
+        glBufferData(GL_ARRAY_BUFFER, q.glyphs.size() * sizeof(GlyphInstance), static_cast<const void*>(q.glyphs.data()), GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    drawRuns(q.runs, frame.scissorRects);
+    blitFrame();
+    glBindFramebuffer(GL_FRAMEBUFFER, m_targetFBO);
 }
 
 void TextBoxRenderer::shutdown() {
-    glBindTexture(GL_TEXTURE_2D, 0);           glDeleteTextures(1, &m_tex);
-    glBindVertexArray(0);                      glDeleteVertexArrays(1, &m_vao);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);          glDeleteBuffers(1, &m_vbo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);  glDeleteBuffers(1, &m_ibo);
-    glUseProgram(0);                           glDeleteProgram(m_prog);
+    for (int i = 0;  i < int(m_streams.size());  ++i) { deleteStream(i + 1); }
+    m_streams.clear();
+    if (m_soft) {
+        m_softVertices.clear();
+        m_softComposites.clear();
+        m_soft = nullptr;
+    } else {
+        glBindTexture(GL_TEXTURE_2D, 0);           glDeleteTextures(1, &m_tex);
+        glBindVertexArray(0);                      glDeleteVertexArrays(1, &m_vao);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);          glDeleteBuffers(1, &m_vbo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);  glDeleteBuffers(1, &m_ibo);
+        glDeleteVertexArrays(1, &m_compositeVAO);  glDeleteBuffers(1, &m_compositeVBO);
+        m_compositeVAO = m_compositeVBO = 0;
+        glDeleteVertexArrays(1, &m_glyphVAO);      glDeleteBuffers(1, &m_glyphVBO);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);       glDeleteTextures(1, &m_glyphMetricsTex);
+        glActiveTexture(GL_TEXTURE0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);        glDeleteBuffers(1, &m_glyphMetricsBuffer);
+        m_glyphVAO = m_glyphVBO = m_glyphMetricsTex = m_glyphMetricsBuffer = 0;
+        m_atlas.shutdown();
+        glUseProgram(0);
+        for (auto& prog : m_prog) { glDeleteProgram(prog);  prog = 0; }
+        glBindFramebuffer(GL_FRAMEBUFFER, m_targetFBO);
+        if (m_frameFBO) { glDeleteFramebuffers(1, &m_frameFBO); }
+        if (m_frameRB)  { glDeleteRenderbuffers(1, &m_frameRB); }
+        if (m_timerQueries[0]) { glDeleteQueries(2, m_timerQueries); }
+    }
+    for (int i = 0;  i < int(m_layers.size());  ++i) { deleteLayer(i + 1); }
+    m_layers.clear();
+    m_anims.clear();
     ::free(static_cast<void*>(m_glyphCache));
+    m_glyphCache = nullptr;
+    delete m_ascii;
+    m_ascii = nullptr;
+    #ifdef _DEBUG
+        printf("text width cache: %u hits, %u misses\n", m_widthCacheHits, m_widthCacheMisses);
+    #endif
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
-TextBoxRenderer::Vertex* TextBoxRenderer::newVertices() {
-    if (m_quadCount >= BatchSize) { flush(); }
-    if (!m_vertices) {
+TextBoxRenderer::Pipeline TextBoxRenderer::modePipeline(uint32_t mode) {
+    return modePipelines[mode];
+}
+
+void TextBoxRenderer::trackRun(Pipeline pipeline, GLuint texture, int start, int count) {
+    // quads (or glyph instances) start..start+count have been added to the
+    // batch or to the calling thread's recording
+    Recording* rec = recordingTarget();
+    std::vector<Run>& runs = rec ? rec->runs : m_runs;
+    if (!texture) { texture = m_tex; }
+    Run* last = runs.empty() ? nullptr : &runs.back();
+    if (last && !last->stream && (last->pipeline == pipeline) && (last->texture == texture) && (last->end == start)) {
+        last->end = start + count;
+    } else {
+        runs.push_back({ start, start + count, pipeline, texture, 0 });
+    }
+}
+
+TextBoxRenderer::Recording* TextBoxRenderer::recordingTarget() const {
+    // the calling thread's recording, if any; in deferred mode, the frame
+    // is recorded, too
+    return t_staging ? t_staging : (m_deferred ? &m_frame->quads : nullptr);
+}
+
+TextBoxRenderer::Vertex* TextBoxRenderer::newVertices(int quads, Pipeline pipeline, GLuint texture) {
+    Recording* rec = recordingTarget();
+    if (rec) {
+        size_t pos = rec->vertices.size();
+        rec->vertices.resize(pos + 4u * size_t(quads));
+        trackRun(pipeline, texture, int(pos / 4u), quads);
+        return &rec->vertices[pos];
+    }
+    if ((m_quadCount + quads) > BatchSize) { flush(); }
+    if (!m_vertices && m_soft) {
+        m_vertices = m_softVertices.data();
+    } else if (!m_vertices) {
         glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
         m_vertices = (Vertex*) glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
         glBindBuffer(GL_ARRAY_BUFFER, 0);
     }
-    return &m_vertices[4 * (m_quadCount++)];
+    Vertex* v = &m_vertices[4 * m_quadCount];
+    trackRun(pipeline, texture, m_quadCount, quads);
+    m_quadCount += quads;
+    return v;
+}
+
+TextBoxRenderer::CompositeVertex* TextBoxRenderer::newComposites(int quads, Pipeline pipeline) {
+    Recording* rec = recordingTarget();
+    if (rec) {
+        size_t pos = rec->composites.size();
+        rec->composites.resize(pos + 4u * size_t(quads));
+        trackRun(pipeline, 0, int(pos / 4u), quads);
+        return &rec->composites[pos];
+    }
+    if ((m_compositeCount + quads) > BatchSize) { flush(); }
+    if (!m_composites && m_soft) {
+        m_composites = m_softComposites.data();
+    } else if (!m_composites) {
+        glBindBuffer(GL_ARRAY_BUFFER, m_compositeVBO);
+        m_composites = (CompositeVertex*) glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    CompositeVertex* v = &m_composites[4 * m_compositeCount];
+    trackRun(pipeline, 0, m_compositeCount, quads);
+    m_compositeCount += quads;
+    return v;
+}
+
+TextBoxRenderer::GlyphInstance* TextBoxRenderer::newGlyphs(int count) {
+    Recording* rec = recordingTarget();
+    if (rec) {
+        size_t pos = rec->glyphs.size();
+        rec->glyphs.resize(pos + size_t(count));
+        trackRun(Pipeline::Glyphs, 0, int(pos), count);
+        return &rec->glyphs[pos];
+    }
+    if ((m_glyphCount + count) > GlyphBatchSize) { flush(); }
+    if (!m_glyphs) {
+        glBindBuffer(GL_ARRAY_BUFFER, m_glyphVBO);
+        m_glyphs = (GlyphInstance*) glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    GlyphInstance* g = &m_glyphs[m_glyphCount];
+    trackRun(Pipeline::Glyphs, 0, m_glyphCount, count);
+    m_glyphCount += count;
+    return g;
 }
 
-TextBoxRenderer::Vertex* TextBoxRenderer::newVertices(uint8_t mode, float x0, float y0, float x1, float y1) {
-    x0 = x0 * m_vpScaleX - 1.0f;
-    y0 = y0 * m_vpScaleY + 1.0f;
-    x1 = x1 * m_vpScaleX - 1.0f;
-    y1 = y1 * m_vpScaleY + 1.0f;
-    Vertex* v = newVertices();
+bool TextBoxRenderer::culled(float x0, float y0, float x1, float y1) const {
+    // true if a quad is completely outside of the damaged area
+    return m_cull && !(t_anim & AnimPositionMask) && !m_cullRect.intersects(std::min(x0, x1), std::min(y0, y1), std::max(x0, x1), std::max(y0, y1));
+}
+
+template <typename V> static inline void setQuad(V* v, uint32_t mode, float x0, float y0, float x1, float y1) {
+    // positions are in NDC already; the calling thread's animation
+    // channels go into the upper bits of the mode
+    mode |= t_anim << TextBoxRenderer::AnimShift;
     v[0].pos[0] = x0;  v[0].pos[1] = y0;  v[0].mode = mode;
     v[1].pos[0] = x1;  v[1].pos[1] = y0;  v[1].mode = mode;
     v[2].pos[0] = x0;  v[2].pos[1] = y1;  v[2].mode = mode;
     v[3].pos[0] = x1;  v[3].pos[1] = y1;  v[3].mode = mode;
+}
+
+template <typename V> static inline void setQuadTC(V* v, float u0, float v0, float u1, float v1) {
+    v[0].tc[0] = u0;  v[0].tc[1] = v0;
+    v[1].tc[0] = u1;  v[1].tc[1] = v0;
+    v[2].tc[0] = u0;  v[2].tc[1] = v1;
+    v[3].tc[0] = u1;  v[3].tc[1] = v1;
+}
+
+TextBoxRenderer::Vertex* TextBoxRenderer::newVertices(uint8_t mode, float x0, float y0, float x1, float y1, GLuint texture) {
+    if (culled(x0, y0, x1, y1)) { return t_scratch; }
+    Vertex* v = newVertices(1, quadPipeline(mode), texture);
+    setQuad(v, mode, x0 * m_vpScaleX + m_vpBiasX, y0 * m_vpScaleY + m_vpBiasY,
+                     x1 * m_vpScaleX + m_vpBiasX, y1 * m_vpScaleY + m_vpBiasY);
     return v;
 }
 
 TextBoxRenderer::Vertex* TextBoxRenderer::newVertices(uint8_t mode, float x0, float y0, float x1, float y1, float u0, float v0, float u1, float v1) {
     Vertex* v = newVertices(mode, x0, y0, x1, y1);
-    v[0].tc[0] = u0;  v[0].tc[1] = v0;  v[0].mode = mode;
-    v[1].tc[0] = u1;  v[1].tc[1] = v0;  v[1].mode = mode;
-    v[2].tc[0] = u0;  v[2].tc[1] = v1;  v[2].mode = mode;
-    v[3].tc[0] = u1;  v[3].tc[1] = v1;  v[3].mode = mode;
+    setQuadTC(v, u0, v0, u1, v1);
+    return v;
+}
+
+TextBoxRenderer::CompositeVertex* TextBoxRenderer::newComposites(uint8_t mode, float x0, float y0, float x1, float y1, float u0, float v0, float u1, float v1) {
+    // composite quads keep their own pipeline even in uber-shader mode, as
+    // that's what tells their runs apart from the ones in the vertex buffer
+    if (culled(x0, y0, x1, y1)) { return t_compositeScratch; }
+    CompositeVertex* v = newComposites(1, modePipeline(mode));
+    setQuad(v, mode, x0 * m_vpScaleX + m_vpBiasX, y0 * m_vpScaleY + m_vpBiasY,
+                     x1 * m_vpScaleX + m_vpBiasX, y1 * m_vpScaleY + m_vpBiasY);
+    setQuadTC(v, u0, v0, u1, v1);
     return v;
 }
 
+void TextBoxRenderer::beginRecording(Recording& staging) {
+    staging.clear();
+    t_staging = &staging;
+}
+
+void TextBoxRenderer::endRecording() {
+    t_staging = nullptr;
+}
+
+void TextBoxRenderer::submit(const Recording& staging) {
+    submitRuns(staging.runs, staging.vertices.data(), staging.composites.data(), staging.glyphs.data());
+}
+
+void TextBoxRenderer::submitRuns(const std::vector<Run>& runs, const Vertex* vertices, const CompositeVertex* composites, const GlyphInstance* glyphs) {
+    // copy the runs one by one, split wherever the batch is full
+    for (const Run& run : runs) {
+        bool isGlyphs = (run.pipeline == Pipeline::Glyphs);
+        bool isComposite = compositePipeline(run.pipeline);
+        int maxCount = isGlyphs ? GlyphBatchSize : BatchSize;
+        for (int start = run.start;  start < run.end;) {
+            int used = isGlyphs ? m_glyphCount : isComposite ? m_compositeCount : m_quadCount;
+            int n = std::min(run.end - start, (used < maxCount) ? (maxCount - used) : maxCount);
+            if (isGlyphs) {
+                memcpy(static_cast<void*>(newGlyphs(n)), static_cast<const void*>(&glyphs[start]), size_t(n) * sizeof(GlyphInstance));
+            } else if (isComposite) {
+                memcpy(static_cast<void*>(newComposites(n, run.pipeline)), static_cast<const void*>(&composites[size_t(start) * 4u]), size_t(n) * 4u * sizeof(CompositeVertex));
+            } else {
+                memcpy(static_cast<void*>(newVertices(n, run.pipeline, run.texture)), static_cast<const void*>(&vertices[size_t(start) * 4u]), size_t(n) * 4u * sizeof(Vertex));
+            }
+            start += n;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+TextBoxRenderer::LayerRef TextBoxRenderer::createLayer(int width, int height) {
+    if (m_soft || m_deferred || (width <= 0) || (height <= 0)) { return 0; }
+    Layer layer;
+    layer.width  = width;
+    layer.height = height;
+    glGenTextures(1, &layer.tex);
+    glBindTexture(GL_TEXTURE_2D, layer.tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    GLint prevFBO = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prevFBO);
+    glGenFramebuffers(1, &layer.fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, layer.fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, layer.tex, 0);
+    bool complete = (glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+    glBindFramebuffer(GL_FRAMEBUFFER, GLuint(prevFBO));
+    if (!complete) {
+        #ifdef _DEBUG
+            printf("render layer FBO (%dx%d) incomplete\n", width, height);
+        #endif
+        glDeleteFramebuffers(1, &layer.fbo);
+        glDeleteTextures(1, &layer.tex);
+        return 0;
+    }
+
+    for (size_t i = 0;  i < m_layers.size();  ++i) {
+        if (!m_layers[i].fbo) { m_layers[i] = layer;  return LayerRef(i + 1u); }
+    }
+    m_layers.push_back(layer);
+    return LayerRef(m_layers.size());
+}
+
+void TextBoxRenderer::deleteLayer(LayerRef ref) {
+    if ((ref < 1) || (ref > int(m_layers.size())) || !m_layers[ref - 1].fbo) { return; }
+    flush();  // the current batch might still use the layer
+    Layer& layer = m_layers[ref - 1];
+    glDeleteFramebuffers(1, &layer.fbo);
+    glDeleteTextures(1, &layer.tex);
+    layer = Layer();
+}
+
+bool TextBoxRenderer::beginLayer(LayerRef ref, float x0, float y0) {
+    if ((ref < 1) || (ref > int(m_layers.size())) || !m_layers[ref - 1].fbo || m_currentLayer || t_staging) { return false; }
+    const Layer& layer = m_layers[ref - 1];
+    flush();
+    m_currentLayer = ref;
+    m_savedScissorRects.swap(m_scissorRects);
+    m_scissorRects.clear();
+    m_savedCull = m_cull;
+    m_cull = false;
+    glBindFramebuffer(GL_FRAMEBUFFER, layer.fbo);
+    glViewport(0, 0, layer.width, layer.height);
+    static const GLfloat transparent[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    glClearBufferfv(GL_COLOR, 0, transparent);
+    setViewportTransform(x0, y0, layer.width, layer.height);
+    return true;
+}
+
+void TextBoxRenderer::endLayer() {
+    if (!m_currentLayer) { return; }
+    flush();
+    m_currentLayer = 0;
+    m_scissorRects.swap(m_savedScissorRects);
+    m_cull = m_savedCull;
+    glBindFramebuffer(GL_FRAMEBUFFER, m_frameFBO ? GLuint(m_frameFBO) : GLuint(m_targetFBO));
+    glViewport(0, 0, m_vpWidth, m_vpHeight);
+    setViewportTransform(0.0f, 0.0f, m_vpWidth, m_vpHeight);
+}
+
+void TextBoxRenderer::drawLayer(LayerRef ref, float x, float y, float alpha) {
+    if ((ref < 1) || (ref > int(m_layers.size())) || !m_layers[ref - 1].fbo || (ref == m_currentLayer) || t_staging) { return; }
+    const Layer& layer = m_layers[ref - 1];
+    // texture coordinates are upside down, as usual for render targets
+    Vertex* v = newVertices(ModeImage, x, y, x + float(layer.width), y + float(layer.height), layer.tex);
+    v[0].tc[0] = 0.0f;  v[0].tc[1] = 1.0f;
+    v[1].tc[0] = 1.0f;  v[1].tc[1] = 1.0f;
+    v[2].tc[0] = 0.0f;  v[2].tc[1] = 0.0f;
+    v[3].tc[0] = 1.0f;  v[3].tc[1] = 0.0f;
+    v[0].color = v[1].color = v[2].color = v[3].color = makeAlpha(alpha) | 0xFFFFFFu;
+}
+
+void TextBoxRenderer::drawCached(CachedLayer& cache, float x, float y, int width, int height, uint32_t key, const std::function<void()>& draw) {
+    if (!layers() || m_currentLayer || t_staging) { draw();  return; }
+
+    // The layer is one pixel larger than requested in each direction, so
+    // that the contents can be shifted such that the layer is composited
+    // on even pixel coordinates. This way, the layer's 2x2 pixel blocks
+    // (which the text shader's derivatives are computed over) match the
+    // screen's, and the result is exactly the same as drawing directly.
+    // Only possible at integer positions, of course; while moving at
+    // subpixel precision, the layer is just composited as it is.
+    width += 1;
+    height += 1;
+    bool integral = (x == std::floor(x)) && (y == std::floor(y));
+    int padX = integral ? (int(x) & 1) : cache.padX;
+    int padY = integral ? ((m_vpHeight - height - int(y)) & 1) : cache.padY;  // GL rows go bottom-up
+
+    if (cache.layer && ((m_layers[cache.layer - 1].width != width) || (m_layers[cache.layer - 1].height != height))) {
+        releaseCached(cache);
+    }
+    if (!cache.layer) {
+        cache.layer = createLayer(width, height);
+        cache.valid = false;
+    }
+    if (!cache.valid || (cache.key != key) || (cache.padX != padX) || (cache.padY != padY)) {
+        if (!beginLayer(cache.layer, x - float(padX), y - float(padY))) { draw();  return; }
+        draw();
+        endLayer();
+        cache.key = key;
+        cache.valid = true;
+        cache.padX = padX;
+        cache.padY = padY;
+    }
+    drawLayer(cache.layer, x - float(cache.padX), y - float(cache.padY));
+}
+
+void TextBoxRenderer::releaseCached(CachedLayer& cache) {
+    deleteLayer(cache.layer);
+    cache = CachedLayer();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+TextBoxRenderer::AnimRef TextBoxRenderer::createAnim(const AnimValue& value) {
+    if (!m_gpuAnimation) { return 0; }
+    AnimRef ref = 1;
+    while ((ref < int(m_anims.size())) && m_anims[ref].used) { ++ref; }
+    if (ref >= MaxAnimChannels) { return 0; }
+    if (ref >= int(m_anims.size())) { m_anims.resize(ref + 1); }
+    m_anims[ref].used = true;
+    m_anims[ref].value = value;
+    ++m_animVersion;
+    return ref;
+}
+
+void TextBoxRenderer::deleteAnim(AnimRef ref) {
+    if ((ref < 1) || (ref >= int(m_anims.size()))) { return; }
+    m_anims[ref] = AnimChannel();
+}
+
+void TextBoxRenderer::setAnim(AnimRef ref, const AnimValue& value) {
+    if ((ref < 1) || (ref >= int(m_anims.size())) || (m_anims[ref].value == value)) { return; }
+    m_anims[ref].value = value;
+    ++m_animVersion;
+}
+
+float TextBoxRenderer::animValue(AnimRef ref) const {
+    if ((ref < 1) || (ref >= int(m_anims.size()))) { return 0.0f; }
+    return m_anims[ref].value.at(m_animTime);
+}
+
+void TextBoxRenderer::setAnimTime(double t) {
+    m_animTime = t;
+    if (m_animEpoch == t) { return; }
+    for (const auto& ch : m_anims) {
+        if (ch.used && (ch.value.at(t) != ch.value.target)) { return; }
+    }
+    // nothing is running at the moment -> start a new epoch
+    m_animEpoch = t;
+    ++m_animVersion;
+}
+
+void TextBoxRenderer::bindAnim(AnimRef x, AnimRef y, AnimRef alpha) {
+    t_anim = uint32_t(x) | (uint32_t(y) << 8) | (uint32_t(alpha) << 16);
+}
+
+void TextBoxRenderer::updateAnimUniforms(AnimUniforms& u) const {
+    if (u.version != m_animVersion) {
+        u.channels.resize(m_anims.size() * 4u);
+        float* c = u.channels.data();
+        for (const auto& ch : m_anims) {
+            *c++ = ch.value.start;
+            *c++ = ch.value.target;
+            *c++ = float(ch.value.t0 - m_animEpoch);
+            *c++ = 0.0f;
+        }
+        u.scale[0] = m_vpScaleX;  u.scale[1] = m_vpScaleY;
+        u.bias[0]  = m_vpBiasX;   u.bias[1]  = m_vpBiasY;
+        u.version = m_animVersion;
+    }
+    u.time = float(m_animTime - m_animEpoch);
+}
+
+bool TextBoxRenderer::animMoving() const {
+    for (const auto& ch : m_anims) {
+        if (ch.used && (ch.value.at(m_animTime) != ch.value.target)) { return true; }
+    }
+    return false;
+}
+
+void TextBoxRenderer::useProgram(Pipeline pipeline) {
+    int p = int(pipeline);
+    glUseProgram(m_prog[p]);
+    if (m_progAnimVersion[p] != m_uniforms.version) {
+        glUniform4fv(m_uAnim[p], GLsizei(m_uniforms.channels.size() / 4u), m_uniforms.channels.data());
+        glUniform2f(m_uAnimScale[p], m_uniforms.scale[0], m_uniforms.scale[1]);
+        glUniform2f(m_uViewBias[p], m_uniforms.bias[0], m_uniforms.bias[1]);
+        m_progAnimVersion[p] = m_uniforms.version;
+        m_progAnimTime[p] = -1.0f;
+    }
+    if (m_progAnimTime[p] != m_uniforms.time) {
+        glUniform1f(m_uAnimTime[p], m_uniforms.time);
+        m_progAnimTime[p] = m_uniforms.time;
+    }
+}
+
+template <typename V> void TextBoxRenderer::applyAnimation(V* v, int quads) const {
+    // software rendering mode: do what the vertex shader does
+    float values[MaxAnimChannels];
+    int count = int(m_anims.size());
+    values[0] = 0.0f;
+    for (int i = 1;  i < count;  ++i) { values[i] = m_anims[i].value.at(m_animTime); }
+    for (int i = quads * 4;  i;  --i, ++v) {
+        uint32_t anim = v->mode >> AnimShift;
+        if (!anim) { continue; }
+        int x = int(anim & 255u), y = int((anim >> 8) & 255u), a = int((anim >> 16) & 255u);
+        if (x < count) { v->pos[0] += values[x] * m_vpScaleX; }
+        if (y < count) { v->pos[1] += values[y] * m_vpScaleY; }
+        if (a && (a < count)) {
+            float alpha = float(v->color >> 24);
+            alpha += (255.0f - alpha) * values[a];
+            v->color = (v->color & 0xFFFFFFu) | (uint32_t(std::min(255.0f, std::max(0.0f, alpha)) + 0.5f) << 24);
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+TextBoxRenderer::StreamRef TextBoxRenderer::createStream() {
+    if (!m_gpuAnimation) { return 0; }
+    Stream stream;
+    stream.used = true;
+    if (!m_soft && !m_deferred) {
+        glGenBuffers(1, &stream.vbo);
+        stream.vao = createVertexArray(stream.vbo, m_ibo, false);
+        glGenBuffers(1, &stream.compositeVBO);
+        stream.compositeVAO = createVertexArray(stream.compositeVBO, m_ibo, true);
+        glGenBuffers(1, &stream.glyphVBO);
+        stream.glyphVAO = createGlyphArray(stream.glyphVBO);
+    }
+    for (size_t i = 0;  i < m_streams.size();  ++i) {
+        if (!m_streams[i].used) { m_streams[i] = stream;  return StreamRef(i + 1u); }
+    }
+    m_streams.push_back(stream);
+    return StreamRef(m_streams.size());
+}
+
+void TextBoxRenderer::deleteStream(StreamRef ref) {
+    if ((ref < 1) || (ref > int(m_streams.size())) || !m_streams[ref - 1].used) { return; }
+    if (streamQueued(ref)) { flush(); }
+    Stream& stream = m_streams[ref - 1];
+    if (stream.vao) {
+        glDeleteVertexArrays(1, &stream.vao);
+        glDeleteBuffers(1, &stream.vbo);
+        glDeleteVertexArrays(1, &stream.compositeVAO);
+        glDeleteBuffers(1, &stream.compositeVBO);
+        glDeleteVertexArrays(1, &stream.glyphVAO);
+        glDeleteBuffers(1, &stream.glyphVBO);
+    }
+    stream = Stream();
+}
+
+void TextBoxRenderer::updateStream(StreamRef ref, const Recording& staging) {
+    if ((ref < 1) || (ref > int(m_streams.size())) || !m_streams[ref - 1].used) { return; }
+    if (streamQueued(ref)) { flush(); }  // the batch must still draw the old contents
+    Stream& stream = m_streams[ref - 1];
+    stream.quads = int(staging.vertices.size() / 4u) + int(staging.composites.size() / 4u) + int(staging.glyphs.size());
+    stream.runs = staging.runs;
+    // dynamic glyphs must be kept in the atlas while the stream is drawn
+    stream.dynamicGlyphs.clear();
+    for (const auto& g : staging.glyphs) {
+        if (g.glyph >= uint32_t(FontData::NumGlyphs)) { stream.dynamicGlyphs.push_back(int(g.glyph) - FontData::NumGlyphs); }
+    }
+    std::sort(stream.dynamicGlyphs.begin(), stream.dynamicGlyphs.end());
+    stream.dynamicGlyphs.erase(std::unique(stream.dynamicGlyphs.begin(), stream.dynamicGlyphs.end()), stream.dynamicGlyphs.end());
+    if (m_soft || m_deferred) {
+        stream.vertices = staging.vertices;
+        stream.composites = staging.composites;
+        if (m_deferred) { stream.glyphs = staging.glyphs; }
+        return;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, stream.vbo);
+    glBufferData(GL_ARRAY_BUFFER, staging.vertices.size() * sizeof(Vertex), static_cast<const void*>(staging.vertices.data()), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, stream.compositeVBO);
+    glBufferData(GL_ARRAY_BUFFER, staging.composites.size() * sizeof(CompositeVertex), static_cast<const void*>(staging.composites.data()), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, stream.glyphVBO);
+    glBufferData(GL_ARRAY_BUFFER, staging.glyphs.size() * sizeof(GlyphInstance), static_cast<const void*>(staging.glyphs.data()), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void TextBoxRenderer::drawStream(StreamRef ref) {
+    if ((ref < 1) || (ref > int(m_streams.size())) || !m_streams[ref - 1].used || m_currentLayer || t_staging) { return; }
+    const Stream& stream = m_streams[ref - 1];
+    if (!stream.quads) { return; }
+    if (m_soft) { submitRuns(stream.runs, stream.vertices.data(), stream.composites.data(), nullptr);  return; }
+    for (int id : stream.dynamicGlyphs) { m_atlas.touch(id); }
+    if (m_deferred) { submitRuns(stream.runs, stream.vertices.data(), stream.composites.data(), stream.glyphs.data());  return; }
+    // queue the stream as a run of its own, which keeps the drawing order
+    // without having to flush the current batch
+    m_stats.quads += stream.quads;
+    m_runs.push_back({ m_quadCount, m_quadCount, Pipeline::Uber, m_tex, ref });
+}
+
+bool TextBoxRenderer::streamQueued(StreamRef ref) const {
+    for (const auto& run : m_runs) {
+        if (run.stream == ref) { return true; }
+    }
+    return false;
+}
+
 void TextBoxRenderer::box(int x0, int y0, int x1, int y1, uint32_t colorUpper, uint32_t colorLower, int borderRadius, float blur, float offset) {
     float w = 0.5f * (float(x1) - float(x0));
     float h = 0.5f * (float(y1) - float(y0));
-    Vertex* v = newVertices(0, float(x0), float(y0), float(x1), float(y1), -w, -h, w, h);
+    Vertex* v = newVertices(ModeBox, float(x0), float(y0), float(x1), float(y1), -w, -h, w, h);
     v[0].color = v[1].color = colorUpper;
     v[2].color = v[3].color = colorLower;
     for (int i = 4;  i;  --i, ++v) {
@@ -297,10 +1397,69 @@ void TextBoxRenderer::box(int x0, int y0, int x1, int y1, uint32_t colorUpper, u
     }
 }
 
+// extrapolate a vertical color gradient that goes from y0 to y1 to the
+// range qy0...qy1; fails if the result isn't representable
+static bool extrapolateGradient(uint32_t upper, uint32_t lower, float y0, float y1, float qy0, float qy1, uint32_t& qUpper, uint32_t& qLower) {
+    if ((upper == lower) || (y1 <= y0)) { qUpper = upper;  qLower = lower;  return true; }
+    float t0 = (qy0 - y0) / (y1 - y0);
+    float t1 = (qy1 - y0) / (y1 - y0);
+    qUpper = qLower = 0u;
+    for (int shift = 0;  shift < 32;  shift += 8) {
+        float u = float((upper >> shift) & 0xFFu);
+        float l = float((lower >> shift) & 0xFFu);
+        int c0 = int(std::floor(u + (l - u) * t0 + 0.5f));
+        int c1 = int(std::floor(u + (l - u) * t1 + 0.5f));
+        if ((c0 < 0) || (c0 > 255) || (c1 < 0) || (c1 > 255)) { return false; }
+        qUpper |= uint32_t(c0) << shift;
+        qLower |= uint32_t(c1) << shift;
+    }
+    return true;
+}
+
 void TextBoxRenderer::outlineBox(int x0, int y0, int x1, int y1, uint32_t colorUpper, uint32_t colorLower, uint32_t colorOutline, int outlineWidth, int borderRadius, int shadowOffset, float shadowBlur, float shadowAlpha, int shadowGrow) {
     int cOuter = std::max(0,  outlineWidth);
     int cInner = std::max(0, -outlineWidth);
-    if ((shadowOffset || shadowGrow) && (shadowAlpha > 0.0f)) {
+    bool shadow = (shadowOffset || shadowGrow) && (shadowAlpha > 0.0f);
+    colorUpper |= 0xFF000000u;
+    colorLower |= 0xFF000000u;
+
+    // single-pass mode: one quad that covers the outline and the shadow;
+    // all three layers are derived from the distance to the box itself
+    Rect q(x0 - cOuter, y0 - cOuter, x1 + cOuter, y1 + cOuter);
+    if (shadow) {
+        q.unite(Rect(x0 - cOuter + shadowOffset - shadowGrow, y0 - cOuter + shadowOffset - shadowGrow,
+                     x1 + cOuter + shadowOffset + shadowGrow, y1 + cOuter + shadowOffset + shadowGrow));
+    }
+    uint32_t qUpper, qLower;
+    if (m_composite && extrapolateGradient(colorUpper, colorLower, float(y0 + cInner), float(y1 - cInner), float(q.y0), float(q.y1), qUpper, qLower)) {
+        float w = 0.5f * (float(x1) - float(x0));
+        float h = 0.5f * (float(y1) - float(y0));
+        float cx = 0.5f * (float(x0) + float(x1));
+        float cy = 0.5f * (float(y0) + float(y1));
+        CompositeVertex* v = newComposites(ModeCompositeBox, float(q.x0), float(q.y0), float(q.x1), float(q.y1),
+                                           float(q.x0) - cx, float(q.y0) - cy, float(q.x1) - cx, float(q.y1) - cy);
+        v[0].color = v[1].color = qUpper;
+        v[2].color = v[3].color = qLower;
+        uint32_t outlineColor = outlineWidth ? (colorOutline | 0xFF000000u) : 0u;
+        uint32_t shadowColor = shadow ? makeAlpha(shadowAlpha) : 0u;
+        for (int i = 4;  i;  --i, ++v) {
+            v->size[0] = w;  v->size[1] = h;
+            v->size[2] = std::min(std::min(w, h), float(borderRadius));
+            v->br[0] = float(cInner);
+            v->br[1] = 1.0f;
+            v->outlineColor = outlineColor;
+            v->shadowColor = shadowColor;
+            v->outline[0] = float(-cOuter);
+            v->outline[1] = 1.0f;
+            v->shadow[0] = shadowBlur - float(cOuter + shadowGrow);
+            v->shadow[1] = 1.0f / std::max(shadowBlur + 1.0f, 1.0f/256);
+            v->shadow[2] = v->shadow[3] = float(shadowOffset);
+        }
+        return;
+    }
+
+    // multi-pass mode: shadow, outline and fill are separate boxes
+    if (shadow) {
         uint32_t shadowColor = makeAlpha(shadowAlpha);
         box(x0 - cOuter + shadowOffset - shadowGrow,
             y0 - cOuter + shadowOffset - shadowGrow,
@@ -315,7 +1474,7 @@ void TextBoxRenderer::outlineBox(int x0, int y0, int x1, int y1, uint32_t colorU
             colorOutline | 0xFF000000u, colorOutline | 0xFF000000u, borderRadius + cOuter);
     }
     box(x0 + cInner, y0 + cInner, x1 - cInner, y1 - cInner,
-        colorUpper | 0xFF000000u, colorLower | 0xFF000000u, borderRadius - cInner);
+        colorUpper, colorLower, borderRadius - cInner);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -355,18 +1514,50 @@ uint32_t TextBoxRenderer::nextCodepoint(const char* &utf8string) {
         uint8_t byte = uint8_t(*utf8string);
         if ((byte & 0xC0) != 0x80) { return 0xFFFD; }  // truncated UTF-8 sequence; keep the offending byte
         ++utf8string;  // *now* consume the byte
-        cp = (cp << 6) | byte;
+        cp = (cp << 6) | (byte & 0x3F);
     }
     return cp;
 }
 
-float TextBoxRenderer::textWidth(const char* text) {
+float TextBoxRenderer::measureText(const char* text) {
     float w = 0.0f;
     const FontData::Glyph* g;
     while ((g = getGlyph(nextCodepoint(text))) != 0u) { w += g->advance; }
     return w;
 }
 
+float TextBoxRenderer::textWidth(const char* text) {
+    if (!text || !text[0]) { return 0.0f; }
+    if (m_widthCache.empty() || t_staging) { return measureText(text); }  // the cache isn't thread-safe
+
+    // FNV-1a hash over the raw bytes -- much cheaper than decoding the
+    // UTF-8 sequence and looking up every glyph
+    uint32_t hash = 2166136261u;
+    for (const char* pos = text;  *pos;  ++pos) {
+        hash = (hash ^ uint8_t(*pos)) * 16777619u;
+    }
+    WidthCacheEntry& entry = m_widthCache[hash & (WidthCacheSize - 1u)];
+    if ((entry.hash == hash) && (entry.text == text)) {
+        ++m_widthCacheHits;
+        return entry.width;
+    }
+    ++m_widthCacheMisses;
+    entry.hash  = hash;
+    entry.text  = text;
+    entry.width = measureText(text);
+    return entry.width;
+}
+
+TextBoxRenderer::TextRef TextBoxRenderer::internText(const char* text) {
+    if (!text) { text = ""; }
+    auto it = m_internMap.find(text);
+    if (it != m_internMap.end()) { return it->second; }
+    TextRef ref = TextRef(m_internedTexts.size());
+    m_internedTexts.push_back(InternedText{ text, measureText(text) });
+    m_internMap[text] = ref;
+    return ref;
+}
+
 void TextBoxRenderer::alignText(float &x, float &y, float size, const char* text, uint8_t align) {
     switch (align & Align::HMask) {
         case Align::Center:   x -= size * textWidth(text) * 0.5f; break;
@@ -381,12 +1572,194 @@ void TextBoxRenderer::alignText(float &x, float &y, float size, const char* text
     }
 }
 
+///////////////////////////////////////////////////////////////////////////////
+
+// minimal 4-wide float vectors for asciiText()
+namespace {
+#if defined(RENDERER_SSE2)
+    typedef __m128 V4;
+    inline V4   vset(float f)          { return _mm_set1_ps(f); }
+    inline V4   vload(const float* p)  { return _mm_loadu_ps(p); }
+    inline void vstore(float* p, V4 a) { _mm_storeu_ps(p, a); }
+    inline V4   vadd(V4 a, V4 b)       { return _mm_add_ps(a, b); }
+    inline V4   vmul(V4 a, V4 b)       { return _mm_mul_ps(a, b); }
+    inline V4   vmin(V4 a, V4 b)       { return _mm_min_ps(a, b); }
+    inline V4   vmax(V4 a, V4 b)       { return _mm_max_ps(a, b); }
+    inline void vtranspose(V4& a, V4& b, V4& c, V4& d) { _MM_TRANSPOSE4_PS(a, b, c, d); }
+    #ifdef __AVX2__
+    inline V4 vgather(const float* table, const int* idx)
+        { return _mm_i32gather_ps(table, _mm_loadu_si128(reinterpret_cast<const __m128i*>(idx)), 4); }
+    #else
+    inline V4 vgather(const float* table, const int* idx)
+        { return _mm_setr_ps(table[idx[0]], table[idx[1]], table[idx[2]], table[idx[3]]); }
+    #endif
+#elif defined(RENDERER_NEON)
+    typedef float32x4_t V4;
+    inline V4   vset(float f)          { return vdupq_n_f32(f); }
+    inline V4   vload(const float* p)  { return vld1q_f32(p); }
+    inline void vstore(float* p, V4 a) { vst1q_f32(p, a); }
+    inline V4   vadd(V4 a, V4 b)       { return vaddq_f32(a, b); }
+    inline V4   vmul(V4 a, V4 b)       { return vmulq_f32(a, b); }
+    inline V4   vmin(V4 a, V4 b)       { return vminq_f32(a, b); }
+    inline V4   vmax(V4 a, V4 b)       { return vmaxq_f32(a, b); }
+    inline void vtranspose(V4& a, V4& b, V4& c, V4& d) {
+        float32x4x2_t ab = vtrnq_f32(a, b), cd = vtrnq_f32(c, d);
+        a = vcombine_f32(vget_low_f32 (ab.val[0]), vget_low_f32 (cd.val[0]));
+        b = vcombine_f32(vget_low_f32 (ab.val[1]), vget_low_f32 (cd.val[1]));
+        c = vcombine_f32(vget_high_f32(ab.val[0]), vget_high_f32(cd.val[0]));
+        d = vcombine_f32(vget_high_f32(ab.val[1]), vget_high_f32(cd.val[1]));
+    }
+    inline V4 vgather(const float* table, const int* idx) {
+        V4 r = vdupq_n_f32(table[idx[0]]);
+        r = vsetq_lane_f32(table[idx[1]], r, 1);
+        r = vsetq_lane_f32(table[idx[2]], r, 2);
+        return vsetq_lane_f32(table[idx[3]], r, 3);
+    }
+#else
+    struct V4 { float v[4]; };
+    #define V4_OP(expr) V4 r; for (int i = 0;  i < 4;  ++i) { r.v[i] = (expr); } return r
+    inline V4   vset(float f)          { V4_OP(f); }
+    inline V4   vload(const float* p)  { V4_OP(p[i]); }
+    inline void vstore(float* p, V4 a) { memcpy(static_cast<void*>(p), static_cast<const void*>(a.v), sizeof(a.v)); }
+    inline V4   vadd(V4 a, V4 b)       { V4_OP(a.v[i] + b.v[i]); }
+    inline V4   vmul(V4 a, V4 b)       { V4_OP(a.v[i] * b.v[i]); }
+    inline V4   vmin(V4 a, V4 b)       { V4_OP(std::min(a.v[i], b.v[i])); }
+    inline V4   vmax(V4 a, V4 b)       { V4_OP(std::max(a.v[i], b.v[i])); }
+    inline void vtranspose(V4& a, V4& b, V4& c, V4& d) {
+        V4 m[4] = { a, b, c, d };
+        for (int i = 0;  i < 4;  ++i) { a.v[i] = m[i].v[0];  b.v[i] = m[i].v[1];  c.v[i] = m[i].v[2];  d.v[i] = m[i].v[3]; }
+    }
+    inline V4 vgather(const float* table, const int* idx) { V4_OP(table[idx[i]]); }
+    #undef V4_OP
+#endif
+}  // anonymous namespace
+
+size_t TextBoxRenderer::asciiRun(const char* text, size_t maxLen) {
+    // check 16 (or 8) bytes at once for set high bits; the last few
+    // bytes, and the block with the first non-ASCII byte, are then
+    // scanned one by one
+    size_t n = 0u;
+    #if defined(RENDERER_SSE2)
+        while ((n + 16u) <= maxLen) {
+            if (_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&text[n])))) { break; }
+            n += 16u;
+        }
+    #elif defined(RENDERER_NEON)
+        while ((n + 16u) <= maxLen) {
+            if (vmaxvq_u8(vld1q_u8(reinterpret_cast<const uint8_t*>(&text[n]))) & 0x80u) { break; }
+            n += 16u;
+        }
+    #else
+        while ((n + 8u) <= maxLen) {
+            uint64_t block;
+            memcpy(&block, &text[n], 8u);
+            if (block & 0x8080808080808080ull) { break; }
+            n += 8u;
+        }
+    #endif
+    while ((n < maxLen) && !(uint8_t(text[n]) & 0x80u)) { ++n; }
+    return n;
+}
+
+float TextBoxRenderer::asciiText(float x, float y, float size, const char* text, size_t len, uint32_t colorUpper, uint32_t colorLower, float blur, float offset) {
+    // same results as the scalar loop in text(), but four glyphs at a time:
+    // the position and texture coordinates of each vertex are computed as
+    // vectors over the four glyphs, then transposed into per-vertex rows
+    // that are stored with a single 16-byte write each
+    static_assert(offsetof(Vertex, tc) == (offsetof(Vertex, pos) + 2u * sizeof(float)), "unexpected vertex layout");
+    static_assert(offsetof(Vertex, mode) == (offsetof(Vertex, br) + 3u * sizeof(float)), "unexpected vertex layout");
+    const AsciiGlyphs& a = *m_ascii;
+    const V4 vSize = vset(size), vY = vset(y);
+    const V4 vScaleX = vset(m_vpScaleX), vScaleY = vset(m_vpScaleY);
+    const V4 vBiasX = vset(m_vpBiasX), vBiasY = vset(m_vpBiasY);
+
+    // the blend range, color and mode fields are the same for all glyphs
+    uint32_t attrUpper[4], attrLower[4];
+    float br[2] = { offset, 1.33f / blur };
+    memcpy(attrUpper, br, sizeof(br));
+    attrUpper[2] = colorUpper;
+    attrUpper[3] = ModeText | (t_anim << AnimShift);
+    memcpy(attrLower, attrUpper, sizeof(attrLower));
+    attrLower[2] = colorLower;
+    const bool cull = m_cull && !(t_anim & AnimPositionMask);
+
+    while (len) {
+        int n = int(std::min(len, size_t(4u)));
+        int c[4] = { ' ', ' ', ' ', ' ' };  // padding lanes are never emitted
+        for (int i = 0;  i < n;  ++i) { c[i] = uint8_t(text[i]); }
+
+        // glyph origins; summed up sequentially, exactly like the scalar path
+        float adv[4], ox[4];
+        vstore(adv, vmul(vgather(a.advance, c), vSize));
+        for (int i = 0;  i < 4;  ++i) {
+            ox[i] = x;
+            if (i < n) { x += adv[i]; }
+        }
+
+        // quad corners in pixels
+        V4 vX = vload(ox);
+        V4 px0 = vadd(vX, vmul(vgather(a.x0, c), vSize));
+        V4 px1 = vadd(vX, vmul(vgather(a.x1, c), vSize));
+        V4 py0 = vadd(vY, vmul(vgather(a.y0, c), vSize));
+        V4 py1 = vadd(vY, vmul(vgather(a.y1, c), vSize));
+
+        // select the glyphs that are visible and not culled
+        bool emit[4];
+        int count = 0;
+        float cx0[4], cy0[4], cx1[4], cy1[4];
+        if (cull) {
+            vstore(cx0, vmin(px0, px1));  vstore(cy0, vmin(py0, py1));
+            vstore(cx1, vmax(px0, px1));  vstore(cy1, vmax(py0, py1));
+        }
+        for (int i = 0;  i < 4;  ++i) {
+            emit[i] = (i < n) && !a.space[c[i]]
+                   && (!cull || m_cullRect.intersects(cx0[i], cy0[i], cx1[i], cy1[i]));
+            if (emit[i]) { ++count; }
+        }
+        text += n;
+        len -= size_t(n);
+        if (!count) { continue; }
+
+        // vertex rows: (x, y, u, v) for each of the four corners
+        V4 nx0 = vadd(vmul(px0, vScaleX), vBiasX), nx1 = vadd(vmul(px1, vScaleX), vBiasX);
+        V4 ny0 = vadd(vmul(py0, vScaleY), vBiasY), ny1 = vadd(vmul(py1, vScaleY), vBiasY);
+        V4 u0 = vgather(a.u0, c), v0 = vgather(a.v0, c), u1 = vgather(a.u1, c), v1 = vgather(a.v1, c);
+        V4 rows[4][4] = {  // [corner][glyph]
+            { nx0, ny0, u0, v0 }, { nx1, ny0, u1, v0 },
+            { nx0, ny1, u0, v1 }, { nx1, ny1, u1, v1 },
+        };
+        for (auto& r : rows) { vtranspose(r[0], r[1], r[2], r[3]); }
+
+        Vertex* v = newVertices(count, quadPipeline(ModeText));
+        for (int i = 0;  i < 4;  ++i) {
+            if (!emit[i]) { continue; }
+            for (int corner = 0;  corner < 4;  ++corner) {
+                char* dest = reinterpret_cast<char*>(&v[corner]);
+                vstore(reinterpret_cast<float*>(dest + offsetof(Vertex, pos)), rows[corner][i]);
+                memcpy(static_cast<void*>(dest + offsetof(Vertex, br)), (corner < 2) ? attrUpper : attrLower, sizeof(attrUpper));
+            }
+            v += 4;
+        }
+    }
+    return x;
+}
+
 float TextBoxRenderer::text(float x, float y, float size, const char* text, uint8_t align, uint32_t colorUpper, uint32_t colorLower, float blur, float offset) {
     alignText(x, y, size, text, align);
-    const FontData::Glyph* g;
-    while ((g = getGlyph(nextCodepoint(text))) != 0u) {
+    const char* end = (m_simdText && m_ascii && text) ? (text + strlen(text)) : nullptr;
+    for (;;) {
+        if (end) {
+            // fast path for runs of ASCII characters
+            size_t n = asciiRun(text, size_t(end - text));
+            if (n) {
+                x = asciiText(x, y, size, text, n, colorUpper, colorLower, blur, offset);
+                text += n;
+            }
+        }
+        const FontData::Glyph* g = getGlyph(nextCodepoint(text));
+        if (!g) { break; }
         if (!g->space) {
-            Vertex* v = newVertices(1, x + g->pos.x0 * size, y + g->pos.y0 * size, x + g->pos.x1 * size, y + g->pos.y1 * size);
+            Vertex* v = newVertices(ModeText, x + g->pos.x0 * size, y + g->pos.y0 * size, x + g->pos.x1 * size, y + g->pos.y1 * size);
             v[0].color = v[1].color = colorUpper;
             v[2].color = v[3].color = colorLower;
             v[0].br[0] = v[1].br[0] = v[2].br[0] = v[3].br[0] = offset;
@@ -401,9 +1774,154 @@ float TextBoxRenderer::text(float x, float y, float size, const char* text, uint
     return x;
 }
 
+bool TextBoxRenderer::toGlyphs(const char* text, GlyphString& glyphs) {
+    glyphs.clear();
+    bool dynamic = false;
+    uint32_t cp;
+    while ((cp = nextCodepoint(text)) != 0u) {
+        const FontData::Glyph* g = getGlyph(cp);
+        int id;
+        if ((g->codepoint != cp) && (cp >= 32u) && (cp != 0xFFFD) && ((id = m_atlas.lookup(cp)) >= 0)) {
+            glyphs.push_back(uint16_t(FontData::NumGlyphs + id));
+            dynamic = true;
+        } else {
+            glyphs.push_back(uint16_t(g - FontData::GlyphData));
+        }
+    }
+    return dynamic;
+}
+
+float TextBoxRenderer::glyphWidth(const GlyphString& glyphs) const {
+    float w = 0.0f;
+    for (uint16_t index : glyphs) { w += glyphData(index).advance; }
+    return w;
+}
+
+void TextBoxRenderer::updateGlyphAtlas() {
+    if (!m_atlas.active()) { return; }
+    m_atlas.update(m_changedGlyphs, m_glyphUploads);
+    if (m_changedGlyphs.empty()) { return; }
+    m_glyphMetrics.resize(m_changedGlyphs.size());
+    for (size_t i = 0;  i < m_changedGlyphs.size();  ++i) {
+        m_glyphMetrics[i].id = m_changedGlyphs[i];
+        m_atlas.metrics(m_changedGlyphs[i], m_glyphMetrics[i].m);
+    }
+    if (m_deferred) {
+        // drawFrame() applies them on the thread that holds the context
+        std::lock_guard<std::mutex> lock(m_pendingGlyphMutex);
+        m_pendingGlyphUploads.insert(m_pendingGlyphUploads.end(),
+            std::make_move_iterator(m_glyphUploads.begin()), std::make_move_iterator(m_glyphUploads.end()));
+        m_pendingGlyphMetrics.insert(m_pendingGlyphMetrics.end(), m_glyphMetrics.begin(), m_glyphMetrics.end());
+        return;
+    }
+    m_atlas.upload(m_glyphUploads);
+    uploadGlyphMetrics(m_glyphMetrics);
+}
+
+void TextBoxRenderer::uploadGlyphMetrics(const std::vector<GlyphMetrics>& metrics) {
+    if (metrics.empty()) { return; }
+    glBindBuffer(GL_TEXTURE_BUFFER, m_glyphMetricsBuffer);
+    for (const auto& g : metrics) {
+        glBufferSubData(GL_TEXTURE_BUFFER, GLintptr(FontData::NumGlyphs + g.id) * GLintptr(sizeof(g.m)), sizeof(g.m), static_cast<const void*>(g.m));
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+float TextBoxRenderer::glyphText(float x, float y, float size, const uint16_t* glyphs, size_t count, uint32_t color) {
+    if (!gpuGlyphs()) {
+        // generate the quads on the CPU, exactly like text() does;
+        // dynamic glyphs keep their advance, but look like the fallback glyph
+        for (;  count;  --count, ++glyphs) {
+            const FontData::Glyph* g = &glyphData(*glyphs);
+            const FontData::Glyph* q = (*glyphs < FontData::NumGlyphs) ? g : &FontData::GlyphData[FontData::FallbackGlyphIndex];
+            if (!g->space) {
+                Vertex* v = newVertices(ModeText, x + q->pos.x0 * size, y + q->pos.y0 * size, x + q->pos.x1 * size, y + q->pos.y1 * size,
+                                        q->tc.x0, q->tc.y0, q->tc.x1, q->tc.y1);
+                for (int i = 4;  i;  --i, ++v) {
+                    v->color = color;
+                    v->br[0] = 0.0f;
+                    v->br[1] = 1.33f;
+                }
+            }
+            x += g->advance * size;
+        }
+        return x;
+    }
+
+    // only the pen positions are computed here (sequentially, so that they
+    // are exactly the same as in text()); instances are collected in
+    // blocks, culled glyphs and spaces are left out; dynamic glyphs are
+    // marked as used (and requested, if they aren't in the atlas yet)
+    constexpr int BlockSize = 64;
+    GlyphInstance block[BlockSize];
+    int n = 0;
+    const bool cull = m_cull && !(t_anim & AnimPositionMask);
+    for (;  count;  --count, ++glyphs) {
+        const FontData::Glyph& g = glyphData(*glyphs);
+        if (!g.space && (!cull || m_cullRect.intersects(
+            std::min(x + g.pos.x0 * size, x + g.pos.x1 * size), std::min(y + g.pos.y0 * size, y + g.pos.y1 * size),
+            std::max(x + g.pos.x0 * size, x + g.pos.x1 * size), std::max(y + g.pos.y0 * size, y + g.pos.y1 * size))))
+        {
+            if (*glyphs >= FontData::NumGlyphs) { m_atlas.touch(*glyphs - FontData::NumGlyphs); }
+            block[n++] = { { x, y }, size, color, uint32_t(*glyphs), t_anim };
+            if (n == BlockSize) {
+                memcpy(static_cast<void*>(newGlyphs(n)), static_cast<const void*>(block), sizeof(block));
+                n = 0;
+            }
+        }
+        x += g.advance * size;
+    }
+    if (n) { memcpy(static_cast<void*>(newGlyphs(n)), static_cast<const void*>(block), size_t(n) * sizeof(GlyphInstance)); }
+    return x;
+}
+
 float TextBoxRenderer::outlineText(float x, float y, float size, const char* text, uint8_t align, uint32_t colorUpper, uint32_t colorLower, uint32_t colorOutline, float outlineWidth, int shadowOffset, float shadowBlur, float shadowAlpha, float shadowGrow) {
     alignText(x, y, size, text, align);
-    if ((shadowOffset || (shadowGrow >= 0.0f)) && (shadowAlpha > 0.0f)) {
+    bool shadow = (shadowOffset || (shadowGrow >= 0.0f)) && (shadowAlpha > 0.0f);
+
+    // single-pass mode: one quad per glyph that covers the glyph and its
+    // shadow; texture coordinates are clamped to the glyph's atlas cell,
+    // so the enlarged quad never picks up neighboring glyphs
+    // (vertical gradients are only supported in multi-pass mode)
+    if (m_composite && (colorUpper == colorLower)) {
+        uint32_t outlineColor = (outlineWidth >= 0.0f) ? colorOutline : 0u;
+        uint32_t shadowColor = shadow ? makeAlpha(shadowAlpha) : 0u;
+        float so = shadow ? float(shadowOffset) : 0.0f;
+        const FontData::Glyph* g;
+        while ((g = getGlyph(nextCodepoint(text))) != 0u) {
+            if (!g->space) {
+                float gx0 = x + g->pos.x0 * size, gy0 = y + g->pos.y0 * size;
+                float gx1 = x + g->pos.x1 * size, gy1 = y + g->pos.y1 * size;
+                float qx0 = std::min(gx0, gx0 + so), qy0 = std::min(gy0, gy0 + so);
+                float qx1 = std::max(gx1, gx1 + so), qy1 = std::max(gy1, gy1 + so);
+                float du = (g->tc.x1 - g->tc.x0) / (gx1 - gx0);  // texture coordinate units per pixel
+                float dv = (g->tc.y1 - g->tc.y0) / (gy1 - gy0);
+                CompositeVertex* v = newComposites(ModeCompositeText, qx0, qy0, qx1, qy1,
+                                                   g->tc.x0 + (qx0 - gx0) * du, g->tc.y0 + (qy0 - gy0) * dv,
+                                                   g->tc.x1 + (qx1 - gx1) * du, g->tc.y1 + (qy1 - gy1) * dv);
+                for (int i = 4;  i;  --i, ++v) {
+                    v->color = colorUpper;
+                    v->br[0] = 0.0f;
+                    v->br[1] = 1.33f;
+                    v->outlineColor = outlineColor;
+                    v->shadowColor = shadowColor;
+                    v->outline[0] = -outlineWidth;
+                    v->outline[1] = 1.33f;
+                    v->shadow[0] = -shadowGrow;
+                    v->shadow[1] = 1.33f / (shadowBlur + 1.0f);
+                    v->shadow[2] = so * du;
+                    v->shadow[3] = so * dv;
+                    v->clip[0] = std::min(g->tc.x0, g->tc.x1);  v->clip[1] = std::min(g->tc.y0, g->tc.y1);
+                    v->clip[2] = std::max(g->tc.x0, g->tc.x1);  v->clip[3] = std::max(g->tc.y0, g->tc.y1);
+                }
+            }
+            x += g->advance * size;
+        }
+        return x;
+    }
+
+    // multi-pass mode: render the whole string up to three times
+    if (shadow) {
         uint32_t shadowColor = makeAlpha(shadowAlpha);
         this->text(x + float(shadowOffset), y + float(shadowOffset), size, text, 0, shadowColor, shadowColor, shadowBlur + 1.0f, -shadowGrow);
     }
@@ -5,11 +5,19 @@
 
 #include <cstdint>
 
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
 #include <algorithm>
 
 #include "glad.h"
 
 #include "font_data.h"
+#include "glyph_atlas.h"
+#include "damage.h"
+#include "geometry.h"
 
 //! text alignment constants
 namespace Align {
@@ -24,43 +32,526 @@ namespace Align {
     constexpr uint8_t VMask    = 0xF0;  //!< \private vertical alignment mask
 };
 
+class SoftRasterizer;
+
 //! a renderer that can draw two things: MSDF text, or rounded boxes
 class TextBoxRenderer {
+public:
+    //! quad modes
+    enum Mode : uint32_t {
+        ModeBox           = 0,  //!< rounded box
+        ModeText          = 1,  //!< MSDF glyph
+        ModeCompositeBox  = 2,  //!< rounded box with shadow and outline, drawn in a single pass
+        ModeCompositeText = 3,  //!< MSDF glyph with shadow and outline, drawn in a single pass
+        ModeImage         = 4,  //!< texture with premultiplied alpha (render layers only)
+    };
+
+    static constexpr uint32_t ModeBits = 0xFFu;  //!< bits of Vertex::mode that hold the quad mode
+    static constexpr int AnimShift = 8;          //!< position of the animation channels in Vertex::mode
+
+    //! vertex format, shared with the software rasterizer; quads consist
+    //! of four vertices (top-left, top-right, bottom-left, bottom-right)
+    struct Vertex {
+        float pos[2];    //!< screen position (already transformed into NDC)
+        float tc[2];     //!< texture coordinate | half-size coordinate (goes from -x/2 to x/2, with x=width or x=height)
+        float size[3];   //!< not used | xy = half size, z = border radius
+        float br[2];     //!< blend range: x = distance to outline (in pixels) that corresponds to middle gray, y = reciprocal of range
+        uint32_t color;  //!< color to draw in (composite modes: fill color; image mode: only alpha is used)
+        uint32_t mode;   //!< bits 0-7 = one of the Mode constants; bits 8-31 = animation
+                         //!< channels: 8-15 = x offset, 16-23 = y offset, 24-31 = alpha (see bindAnim())
+    };
+
+    //! vertex format of the composite modes, which need the outline and
+    //! shadow parameters on top; these quads are kept in separate buffers,
+    //! so the other modes don't pay for the extra fields
+    struct CompositeVertex : Vertex {
+        uint32_t outlineColor;  //!< outline color (alpha = 0: no outline)
+        uint32_t shadowColor;   //!< shadow color (alpha = 0: no shadow)
+        float outline[2];       //!< blend range of the outline (like br)
+        float shadow[4];        //!< xy = blend range of the shadow (like br), zw = shadow offset in texture coordinate units
+        float clip[4];          //!< text only: texture coordinate range of the glyph (x0, y0, x1, y1)
+    };
+
+    //! a glyph of text that is expanded into a quad by the vertex shader
+    //! (see glyphText()); a lot smaller than the four vertices of a quad
+    struct GlyphInstance {
+        float pen[2];    //!< pen position (in pixels)
+        float size;      //!< text size (in pixels)
+        uint32_t color;  //!< color to draw in
+        uint32_t glyph;  //!< index into FontData::GlyphData, or FontData::NumGlyphs + dynamic glyph ID
+        uint32_t anim;   //!< animation channels (like Vertex::mode >> AnimShift)
+    };
+
+    //! text, converted into glyph indices (see toGlyphs()); indices
+    //! from FontData::NumGlyphs upwards refer to dynamic glyphs
+    typedef std::vector<uint16_t> GlyphString;
+
+    //! per-frame statistics
+    struct FrameStats {
+        int quads = 0;           //!< number of quads drawn
+        int batches = 0;         //!< number of draw batches (i.e. non-empty flush() calls)
+        int drawCalls = 0;       //!< number of draw calls (batches split by pipeline, times scissor rectangles)
+        double flushTime = 0.0;  //!< CPU time spent in flush() [ms]; only if timing is enabled
+        double gpuTime = -1.0;   //!< GPU time of the most recently finished frame [ms]; -1 = unknown
+    };
+
+    //! shader pipelines; all of them are generated from the same source
+    //! template, with the unneeded parts removed by the preprocessor
+    enum class Pipeline : int {
+        Uber          = 0,  //!< single shader for everything, branches on the quad mode
+        Box           = 1,  //!< rounded boxes only
+        Text          = 2,  //!< MSDF text only
+        CompositeBox  = 3,  //!< single-pass outlined and shadowed boxes only
+        CompositeText = 4,  //!< single-pass outlined and shadowed text only
+        Image         = 5,  //!< render layers only
+        Glyphs        = 6,  //!< MSDF text from glyph instances
+    };
+    static constexpr int PipelineCount = 7;
+
+    //! handle to a render layer (see createLayer()); 0 = no layer
+    typedef int LayerRef;
+
+    //! a render layer, along with a key that identifies its contents
+    struct CachedLayer {
+        LayerRef layer = 0;
+        uint32_t key = 0u;
+        bool valid = false;
+        int padX = 0, padY = 0;  //!< offset of the contents inside the layer (see drawCached())
+    };
+
+    //! handle to an animation channel (see createAnim()); 0 = no channel
+    typedef int AnimRef;
+    static constexpr int MaxAnimChannels = 128;  //!< including the unused channel 0
+
+    //! handle to a retained vertex stream (see createStream()); 0 = no stream
+    typedef int StreamRef;
+
+private:
     int m_vpWidth, m_vpHeight;
     float m_vpScaleX, m_vpScaleY;
     GLuint m_vao;
     GLuint m_vbo;
     GLuint m_ibo;
-    GLuint m_prog;
+    GLuint m_prog[PipelineCount] = { 0 };
     GLuint m_tex;
+    GLuint m_frameFBO;
+    GLuint m_frameRB;
+    GLint m_targetFBO;
     int m_quadCount;
-    int* m_glyphCache;
+    int* m_glyphCache = nullptr;
 
-    struct Vertex {
-        float pos[2];    // screen position (already transformed into NDC)
-        float tc[2];     // texture coordinate | half-size coordinate (goes from -x/2 to x/2, with x=width or x=height)
-        float size[3];   // not used | xy = half size, z = border radius
-        float br[2];     // blend range: x = distance to outline (in pixels) that corresponds to middle gray, y = reciprocal of range
-        uint32_t color;  // color to draw in
-        uint32_t mode;   // 0 = box, 1 = text
+    // metrics of the 7-bit ASCII glyphs in structure-of-arrays form, so that
+    // text() can look up and place several glyphs at once (see asciiText())
+    struct AsciiGlyphs {
+        float advance[128];
+        float x0[128], y0[128], x1[128], y1[128];  // position box
+        float u0[128], v0[128], u1[128], v1[128];  // texture coordinate box
+        bool space[128];
+    };
+    AsciiGlyphs* m_ascii = nullptr;
+    bool m_simdText = true;
+
+    // text measurement cache: direct-mapped, keyed by string content
+    struct WidthCacheEntry {
+        uint32_t hash = 0u;
+        float width = 0.0f;
+        std::string text;
+    };
+    std::vector<WidthCacheEntry> m_widthCache;
+    uint32_t m_widthCacheHits = 0u;
+    uint32_t m_widthCacheMisses = 0u;
+
+    // interned texts: measured once, then addressed by handle
+    struct InternedText {
+        std::string text;
+        float width;
     };
+    std::vector<InternedText> m_internedTexts;
+    std::unordered_map<std::string, int> m_internMap;
 
     Vertex* m_vertices;
 
-    Vertex* newVertices();
-    Vertex* newVertices(uint8_t mode, float x0, float y0, float x1, float y1);
+    // quads in the composite modes, in their own vertex buffer
+    GLuint m_compositeVAO = 0;
+    GLuint m_compositeVBO = 0;
+    CompositeVertex* m_composites = nullptr;
+    int m_compositeCount = 0;
+
+    // glyph instances of the current batch, in their own vertex buffer;
+    // the glyph metrics are looked up by the vertex shader in a buffer
+    // texture with three texels per glyph (position and texture coordinates,
+    // and the dynamic atlas page); the baked glyphs come first, followed by
+    // the dynamic glyphs from the atlas (see toGlyphs())
+    GLuint m_glyphVAO = 0;
+    GLuint m_glyphVBO = 0;
+    GLuint m_glyphMetricsBuffer = 0;
+    GLuint m_glyphMetricsTex = 0;
+    GlyphInstance* m_glyphs = nullptr;
+    int m_glyphCount = 0;
+    bool m_gpuGlyphs = true;
+    GlyphAtlas m_atlas;
+    std::string m_fallbackFont;
+    bool m_dynamicGlyphs = true;
+    std::vector<int> m_changedGlyphs;
+    std::vector<GlyphAtlas::Upload> m_glyphUploads;
+    struct GlyphMetrics {
+        int id;
+        float m[GlyphAtlas::MetricsSize];
+    };
+    std::vector<GlyphMetrics> m_glyphMetrics;
+    void uploadGlyphMetrics(const std::vector<GlyphMetrics>& metrics);
+    inline const FontData::Glyph& glyphData(uint16_t index) const {
+        return (index < FontData::NumGlyphs) ? FontData::GlyphData[index] : m_atlas.glyph(index - FontData::NumGlyphs);
+    }
+
+    // the current batch, split into runs of quads that use the same
+    // pipeline; draw order is kept, so a run ends at each pipeline change;
+    // glyph runs count glyph instances instead of quads, composite runs
+    // count quads in the composite vertex buffer, and retained streams are
+    // drawn as runs of their own
+    struct Run {
+        int start;          // first quad or glyph instance
+        int end;            // last quad or glyph instance plus one
+        Pipeline pipeline;
+        GLuint texture;
+        int stream;         // StreamRef; 0 = quads from the batch
+    };
+    std::vector<Run> m_runs;
+    bool m_uberShader = false;
+    bool m_composite = true;
+
+    // software rendering mode: vertices are collected in system memory
+    // and rasterized by the CPU instead of OpenGL
+    SoftRasterizer* m_soft = nullptr;
+    std::vector<Vertex> m_softVertices;
+    std::vector<CompositeVertex> m_softComposites;
+    uint32_t m_clearColor = 0xFF000000u;
+    bool loadFontTexture();
+
+    // render layers: textures with premultiplied alpha, each with its own
+    // framebuffer; while drawing into one, screen coordinates are mapped
+    // into the layer with m_vpBiasX/Y, and partial redraw is suspended
+    struct Layer {
+        GLuint fbo = 0;
+        GLuint tex = 0;
+        int width = 0;
+        int height = 0;
+    };
+    std::vector<Layer> m_layers;  // index = LayerRef - 1; unused = fbo 0
+    bool m_layersEnabled = true;
+    LayerRef m_currentLayer = 0;
+    float m_vpBiasX = -1.0f, m_vpBiasY = 1.0f;
+    std::vector<Rect> m_savedScissorRects;
+    bool m_savedCull = false;
+    void setViewportTransform(float x0, float y0, int width, int height);
+
+    // animation channels, evaluated by the vertex shader (or by flush() in
+    // software rendering mode); times are passed to the shader relative to
+    // an epoch that is moved forward whenever all animations have finished,
+    // so that they always fit into a float with good precision
+    struct AnimChannel {
+        AnimValue value;
+        bool used = false;
+    };
+    std::vector<AnimChannel> m_anims;  // index = AnimRef; [0] is unused
+    bool m_gpuAnimation = true;
+    double m_animTime = 0.0;
+    double m_animEpoch = 0.0;
+    uint32_t m_animVersion = 1u;  // incremented whenever the channel uniforms change
+    uint32_t m_progAnimVersion[PipelineCount] = { 0u };
+    float m_progAnimTime[PipelineCount] = { 0.0f };
+    GLint m_uAnim[PipelineCount] = { 0 };
+    GLint m_uAnimTime[PipelineCount] = { 0 };
+    GLint m_uAnimScale[PipelineCount] = { 0 };
+    GLint m_uViewBias[PipelineCount] = { 0 };
+    void useProgram(Pipeline pipeline);
+    template <typename V> void applyAnimation(V* vertices, int quads) const;
+    bool animMoving() const;
+
+public:
+    //! \private the animation channels in the form the shaders get them:
+    //! start value, target value and start time (relative to the epoch)
+    //! of each channel, plus the current time and the pixel scale; filled
+    //! from the channels by flush(), or copied from a recorded frame
+    struct AnimUniforms {
+        std::vector<float> channels;  // four floats per channel
+        float time = 0.0f;
+        float scale[2] = { 0.0f, 0.0f };
+        float bias[2] = { 0.0f, 0.0f };
+        uint32_t version = 0u;        // m_animVersion they were made from
+    };
+private:
+    AnimUniforms m_uniforms;  // what useProgram() loads
+    void updateAnimUniforms(AnimUniforms& u) const;
+
+    // retained vertex streams, each in its own vertex, composite vertex
+    // and glyph instance buffers (or, in software rendering mode, in
+    // system memory)
+    struct Stream {
+        bool used = false;
+        GLuint vao = 0;
+        GLuint vbo = 0;
+        GLuint compositeVAO = 0;
+        GLuint compositeVBO = 0;
+        GLuint glyphVAO = 0;
+        GLuint glyphVBO = 0;
+        int quads = 0;  // including composite quads and glyph instances
+        std::vector<Run> runs;
+        std::vector<int> dynamicGlyphs;  // IDs of the dynamic glyphs in the stream
+        std::vector<Vertex> vertices;             // software rendering and deferred mode only
+        std::vector<CompositeVertex> composites;  // software rendering and deferred mode only
+        std::vector<GlyphInstance> glyphs;        // deferred mode only
+    };
+    std::vector<Stream> m_streams;  // index = StreamRef - 1
+    GLuint m_boundTexture = 0;
+    GLuint m_boundVAO = 0;
+    bool streamQueued(StreamRef stream) const;
+    void submitRuns(const std::vector<Run>& runs, const Vertex* vertices, const CompositeVertex* composites, const GlyphInstance* glyphs);
+    int drawRuns(const std::vector<Run>& runs, const std::vector<Rect>& scissorRects);
+    int drawRun(const Run& run, GLuint vao, GLuint compositeVAO, GLuint glyphVAO, GLuint glyphVBO, const std::vector<Rect>& scissorRects);
+
+    // statistics and GPU timer queries (double-buffered, so that reading
+    // back the result never stalls the pipeline)
+    FrameStats m_stats;
+    bool m_timing = false;
+    GLuint m_timerQueries[2] = { 0, 0 };
+    bool m_queryPending[2] = { false, false };
+    bool m_queryActive = false;
+    int m_queryIndex = 0;
+    double m_gpuTime = -1.0;
+
+    // partial redraw state: the frame is kept in an FBO, and only the
+    // damaged regions are rendered into it (quads outside are culled)
+    std::vector<Rect> m_scissorRects;  // empty = draw everything
+    bool m_cull = false;
+    Rect m_cullRect;
+    void setScissor(const Rect& r);
+    void clearFrame(const std::vector<Rect>& scissorRects);
+    void blitFrame();
+    inline Pipeline quadPipeline(uint32_t mode) const
+        { return m_uberShader ? Pipeline::Uber : modePipeline(mode); }  // in uber-shader mode, runs are only split when the texture changes
+    static Pipeline modePipeline(uint32_t mode);
+    static inline bool compositePipeline(Pipeline p)
+        { return (p == Pipeline::CompositeBox) || (p == Pipeline::CompositeText); }  // runs of these come from the composite buffers
+    void trackRun(Pipeline pipeline, GLuint texture, int start, int count);
+
+    Vertex* newVertices(int quads, Pipeline pipeline, GLuint texture=0);  // quads must not exceed the batch size
+    CompositeVertex* newComposites(int quads, Pipeline pipeline);  // same for composite quads
+    GlyphInstance* newGlyphs(int count);  // count must not exceed the glyph batch size
+    Vertex* newVertices(uint8_t mode, float x0, float y0, float x1, float y1, GLuint texture=0);
     Vertex* newVertices(uint8_t mode, float x0, float y0, float x1, float y1, float u0, float v0, float u1, float v1);
+    CompositeVertex* newComposites(uint8_t mode, float x0, float y0, float x1, float y1, float u0, float v0, float u1, float v1);
+    bool culled(float x0, float y0, float x1, float y1) const;
 
     const FontData::Glyph* getGlyph(uint32_t codepoint);
     static uint32_t nextCodepoint(const char* &utf8string);
     void alignText(float &x, float &y, float size, const char* text, uint8_t align);
+    static size_t asciiRun(const char* text, size_t maxLen);
+    float asciiText(float x, float y, float size, const char* text, size_t len,
+                    uint32_t colorUpper, uint32_t colorLower, float blur, float offset);
 
 public:
-    bool init();
+    //! handle to an interned string (see internText())
+    typedef int TextRef;
+
+    //! quads and glyph instances that have been recorded with
+    //! beginRecording(), in drawing order
+    struct Recording {
+        std::vector<Vertex> vertices;             //!< four vertices per quad
+        std::vector<CompositeVertex> composites;  //!< four vertices per composite mode quad
+        std::vector<GlyphInstance> glyphs;
+        std::vector<Run> runs;                    //!< \private
+        inline void clear() { vertices.clear();  composites.clear();  glyphs.clear();  runs.clear(); }
+    };
+
+    //! a frame that has been recorded in deferred mode (see setDeferred()):
+    //! everything drawFrame() needs to render it, without touching any of
+    //! the state that the recording thread works with
+    struct Frame {
+        Recording quads;                 //!< all quads and glyph instances, in drawing order
+        std::vector<Rect> scissorRects;  //!< damaged regions; empty = full redraw
+        AnimUniforms anim;               //!< \private
+        uint32_t clearColor = 0u;
+        double time = 0.0;               //!< FrameScheduler::now() when the frame was finished
+        bool moving = false;             //!< it's a full redraw, and animation channels are still
+                                         //!< moving, so drawing it again later looks different
+    };
+
+private:
+    // deferred mode: frames are recorded into m_frame (all quads of a frame
+    // go into a single recording) and rendered by drawFrame() on whatever
+    // thread holds the OpenGL context; dynamic glyph atlas updates are
+    // handed over separately, as they must not be lost if a frame is dropped
+    bool m_deferred = false;
+    Frame* m_frame = nullptr;
+    std::mutex m_pendingGlyphMutex;
+    std::vector<GlyphAtlas::Upload> m_pendingGlyphUploads;
+    std::vector<GlyphMetrics> m_pendingGlyphMetrics;
+    Recording* recordingTarget() const;  // where quads go instead of the batch; nullptr = batch
+
+public:
+
+    //! initialize the renderer; if a software rasterizer is specified,
+    //! no OpenGL calls are made at all, and everything is drawn by the CPU
+    bool init(SoftRasterizer* soft=nullptr);
     void shutdown();
     void viewportChanged();
     void flush();
 
+    //! start a new frame; only the damaged regions will be cleared and drawn
+    void beginFrame(const DamageTracker& damage);
+    //! finish a frame and copy it into the target framebuffer
+    void endFrame();
+
+    //! redirect all quads that are drawn by the calling thread into a
+    //! staging buffer (which is cleared first), until endRecording();
+    //! while recording, the drawing functions may be called from multiple
+    //! threads at once, as long as each one uses its own staging buffer
+    void beginRecording(Recording& staging);
+    void endRecording();
+    //! append the quads from a staging buffer to the current batch
+    void submit(const Recording& staging);
+
+    //! switch to deferred mode: frames are recorded into the frame set with
+    //! setFrameTarget() instead of being drawn, and nothing but drawFrame()
+    //! (and shutdown()) makes OpenGL calls anymore, so the context can be
+    //! handed over to a render thread; render layers aren't available then,
+    //! retained streams are kept in system memory, and the GPU time is
+    //! unknown; call once, after init(); not for software rendering
+    void setDeferred();
+    inline bool deferred() const { return m_deferred; }
+    //! set the frame that the next beginFrame() ... endFrame() records
+    //! into (deferred mode only); it's cleared by beginFrame()
+    inline void setFrameTarget(Frame* frame) { m_frame = frame; }
+    //! render a recorded frame into the target framebuffer, with the
+    //! animation channels advanced by 'timeOffset' seconds; frames that are
+    //! partial redraws must be drawn exactly once, and in order, while full
+    //! redraws may be drawn any number of times; must be called on the
+    //! thread that holds the OpenGL context, which may run concurrently
+    //! with the recording of the next frame
+    void drawFrame(const Frame& frame, double timeOffset=0.0);
+
+    //! set the background color that is used to clear the screen
+    void setClearColor(float r, float g, float b);
+
+    //! enable measurement of flush() and GPU time; this has a small cost,
+    //! so it's off by default (quad and batch counts are always collected)
+    void setTiming(bool enable);
+    inline bool timing() const { return m_timing; }
+    //! statistics of the current (or, after endFrame(), the last) frame
+    inline const FrameStats& frameStats() const { return m_stats; }
+
+    //! use the single uber-shader instead of the specialized pipelines
+    //! (for comparison purposes; the output is identical)
+    inline void setUberShader(bool enable) { m_uberShader = enable; }
+    inline bool uberShader() const { return m_uberShader; }
+
+    //! draw outlineBox() and outlineText() in a single pass (the default),
+    //! or as separate shadow, outline and fill layers
+    inline void setCompositeOutlines(bool enable) { m_composite = enable; }
+    inline bool compositeOutlines() const { return m_composite; }
+
+    //! generate the quads of ASCII text runs with SIMD code (the default),
+    //! or strictly one glyph at a time (for comparison; the output is identical)
+    inline void setSIMDText(bool enable) { m_simdText = enable; }
+    inline bool simdText() const { return m_simdText; }
+
+    //! let the vertex shader expand glyphText() strings into quads (the
+    //! default), or generate the quads on the CPU (for comparison; the
+    //! output is the same); the CPU is always used in software rendering
+    //! and uber-shader mode
+    inline void setGPUGlyphs(bool enable) { m_gpuGlyphs = enable; }
+    inline bool gpuGlyphs() const { return m_gpuGlyphs && !m_soft && !m_uberShader; }
+
+    //! font for characters that are not part of the baked font (see
+    //! toGlyphs()); call before init(); default: search the system fonts
+    inline void setFallbackFont(const char* fontFile) { m_fallbackFont = fontFile ? fontFile : ""; }
+    //! don't generate glyphs for characters that are not part of the baked
+    //! font at all, like in software rendering; call before init()
+    inline void setDynamicGlyphs(bool enable) { m_dynamicGlyphs = enable; }
+    //! move dynamic glyphs that have been generated in the background into
+    //! the atlas; call once per frame, before anything checks glyphVersion()
+    void updateGlyphAtlas();
+    //! true if dynamic glyphs are still being generated; the frame should be
+    //! redrawn a bit later then (updateGlyphAtlas() needs to be called)
+    inline bool glyphsPending() const { return (m_atlas.pending() > 0); }
+    //! set a function that's called (from a background thread) when
+    //! dynamic glyphs have been generated; call before init()
+    inline void setGlyphNotify(std::function<void()> notify) { m_atlas.setNotify(notify); }
+    //! wait until the dynamic glyphs that have been requested so far are
+    //! generated, so that the next updateGlyphAtlas() makes them available
+    inline void finishGlyphs() { m_atlas.finish(); }
+    //! incremented whenever dynamic glyphs have become available; all
+    //! glyph strings with dynamic glyphs need to be redrawn then
+    inline uint32_t glyphVersion() const { return m_atlas.version(); }
+
+    //! enable or disable the use of render layers by drawCached()
+    //! (for comparison purposes; there is hardly any visible difference)
+    inline void setLayers(bool enable) { m_layersEnabled = enable; }
+    inline bool layers() const { return m_layersEnabled && !m_soft && !m_deferred; }
+
+    //! enable or disable animation channels and retained vertex streams;
+    //! if disabled, createAnim() and createStream() always fail, so that
+    //! everything is animated on the CPU (for comparison purposes)
+    inline void setGPUAnimation(bool enable) { m_gpuAnimation = enable; }
+    inline bool gpuAnimation() const { return m_gpuAnimation; }
+
+    //! create a render layer of a specific size; returns 0 if that fails
+    //! or if layers are not supported (which is always the case in
+    //! software rendering and deferred mode)
+    LayerRef createLayer(int width, int height);
+    void deleteLayer(LayerRef layer);
+    //! redirect all drawing into a layer, which is cleared first; the
+    //! screen position (x0, y0) maps to the layer's top-left corner;
+    //! must not be used while recording
+    bool beginLayer(LayerRef layer, float x0, float y0);
+    void endLayer();
+    //! draw a layer with its top-left corner at (x, y)
+    void drawLayer(LayerRef layer, float x, float y, float alpha=1.0f);
+
+    //! create an animation channel: a value that is animated by the GPU, so
+    //! that quads which only move or fade don't need to be regenerated in
+    //! every frame; returns 0 if all channels are in use
+    AnimRef createAnim(const AnimValue& value=AnimValue());
+    void deleteAnim(AnimRef anim);
+    //! change the animation of a channel; this affects everything that is
+    //! drawn with the channel in the current frame
+    void setAnim(AnimRef anim, const AnimValue& value);
+    //! current value of a channel, as the GPU computes it
+    float animValue(AnimRef anim) const;
+    //! set the current animation time (see Geometry::animTime); call once
+    //! per frame, before drawing anything
+    void setAnimTime(double t);
+    //! bind animation channels to all quads that are drawn by the calling
+    //! thread from now on: their positions are offset by the values of the
+    //! x and y channels (in pixels), and their alpha is blended towards 1
+    //! by the value of the alpha channel; 0 = no channel; quads with an x or
+    //! y channel are never culled, as their final position isn't known yet
+    static void bindAnim(AnimRef x, AnimRef y=0, AnimRef alpha=0);
+
+    //! create a retained vertex stream: quads that are recorded once (into
+    //! a staging buffer, see beginRecording()), kept on the GPU and drawn
+    //! as often as needed; usually, the quads are bound to animation
+    //! channels, so the stream stays valid while they animate
+    StreamRef createStream();
+    void deleteStream(StreamRef stream);
+    //! replace the contents of a stream by the quads from a staging buffer;
+    //! they must have been recorded with the current viewport and not
+    //! inside a layer
+    void updateStream(StreamRef stream, const Recording& staging);
+    //! draw a stream at the current position in the drawing order;
+    //! must not be used while recording or inside a layer
+    void drawStream(StreamRef stream);
+
+    //! draw something through a cached layer of a given size at screen
+    //! position (x, y): if the layer doesn't hold the contents identified
+    //! by the key yet, draw() renders them into it first (in screen
+    //! coordinates, as usual); if layers are disabled or unavailable,
+    //! draw() simply draws directly
+    void drawCached(CachedLayer& cache, float x, float y, int width, int height, uint32_t key, const std::function<void()>& draw);
+    void releaseCached(CachedLayer& cache);
+
+    inline bool software() const { return (m_soft != nullptr); }
     int viewportWidth()  const { return m_vpWidth; }
     int viewportHeight() const { return m_vpHeight; }
 
@@ -81,7 +572,20 @@ public:
     inline void circle(int x, int y, int r, uint32_t color, float blur=1.0f, float offset=0.0f)
         { box(x - r, y - r, x + r, y + r, color, color, r, blur, offset); }
 
+    //! measure text width (in units of the text size), using the measurement cache
     float textWidth(const char* text);
+    //! measure text width without going through the cache; use for one-shot
+    //! measurements of many different strings that would only thrash the cache
+    float measureText(const char* text);
+    //! intern a string that will be measured repeatedly; the returned
+    //! handle stays valid for the lifetime of the renderer
+    TextRef internText(const char* text);
+    inline TextRef internText(const std::string& text) { return internText(text.c_str()); }
+    inline float textWidth(TextRef ref)          const { return m_internedTexts[ref].width; }
+    inline const char* internedText(TextRef ref) const { return m_internedTexts[ref].text.c_str(); }
+    inline uint32_t widthCacheHits()   const { return m_widthCacheHits; }
+    inline uint32_t widthCacheMisses() const { return m_widthCacheMisses; }
+
     float text(float x, float y, float size, const char* text,
               uint8_t align,
               uint32_t colorUpper, uint32_t colorLower,
@@ -91,6 +595,22 @@ public:
               uint32_t color=0xFFFFFFFF)
               { return this->text(x, y, size, text, align, color, color); }
 
+    //! convert text into glyph indices, for use with glyphText(); characters
+    //! that are missing from the baked font, but present in the fallback
+    //! font, become dynamic glyphs; returns true if there are any of these
+    bool toGlyphs(const char* text, GlyphString& glyphs);
+    inline GlyphString toGlyphs(const std::string& text) { GlyphString g;  toGlyphs(text.c_str(), g);  return g; }
+    //! measure the width of a glyph string (in units of the text size)
+    float glyphWidth(const GlyphString& glyphs) const;
+    //! draw text that has been converted into glyph indices; same as text()
+    //! with left/top alignment, a single color and default blur and offset,
+    //! but the glyph quads are generated by the GPU (see setGPUGlyphs());
+    //! dynamic glyphs are drawn as the fallback glyph until they have been
+    //! generated, and always if the CPU generates the quads
+    float glyphText(float x, float y, float size, const uint16_t* glyphs, size_t count, uint32_t color=0xFFFFFFFF);
+    inline float glyphText(float x, float y, float size, const GlyphString& glyphs, uint32_t color=0xFFFFFFFF)
+        { return glyphText(x, y, size, glyphs.data(), glyphs.size(), color); }
+
     float outlineText(float x, float y, float size, const char* text,
                      uint8_t align = Align::Left + Align::Top,
                      uint32_t colorUpper=0xFFFFFFFF, uint32_t colorLower=0xFFFFFFFF,
@@ -0,0 +1,114 @@
+// SPDX-FileCopyrightText: 2023 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#include <cstdio>
+
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+
+#include <SDL.h>
+
+#include "renderer.h"
+#include "scheduler.h"
+#include "renderthread.h"
+
+//! weight of a new measurement in the vsync interval estimate
+constexpr double IntervalSmoothing = 0.1;
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool RenderThread::start(SDL_Window* window, void* context, TextBoxRenderer& renderer, std::function<void()> pickup) {
+    stop();
+    m_window = window;
+    m_context = context;
+    m_renderer = &renderer;
+    m_pickup = pickup;
+    m_quit.store(false);
+    m_started = 0;
+    m_continuous.store(false);
+    m_interval.store(0.0);
+
+    SDL_GL_MakeCurrent(window, nullptr);
+    m_thread = std::thread(&RenderThread::threadMain, this);
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_wake.wait(lock, [this] { return (m_started != 0); });
+    if (m_started > 0) { return true; }
+    lock.unlock();
+    m_thread.join();
+    SDL_GL_MakeCurrent(window, static_cast<SDL_GLContext>(context));
+    return false;
+}
+
+void RenderThread::stop() {
+    if (!m_thread.joinable()) { return; }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit.store(true);
+    }
+    m_wake.notify_all();
+    m_thread.join();
+    SDL_GL_MakeCurrent(m_window, static_cast<SDL_GLContext>(m_context));
+}
+
+void RenderThread::publish() {
+    m_frames.publish();
+    // the lock only makes sure the thread can't miss the notification
+    // between checking for new frames and going to sleep
+    { std::lock_guard<std::mutex> lock(m_mutex); }
+    m_wake.notify_all();
+}
+
+FrameScheduler::Time RenderThread::nextPickup() const {
+    if (!m_continuous.load()) { return -1.0; }
+    return m_lastPresent.load() + m_interval.load();
+}
+
+void RenderThread::threadMain() {
+    bool ok = (SDL_GL_MakeCurrent(m_window, static_cast<SDL_GLContext>(m_context)) == 0);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_started = ok ? 1 : -1;
+    }
+    m_wake.notify_all();
+    if (!ok) {
+        #ifdef _DEBUG
+            printf("render thread: can't make the context current - %s\n", SDL_GetError());
+        #endif
+        return;
+    }
+
+    bool haveFrame = false;
+    for (;;) {
+        // sleep until there's a new frame, unless the current one still
+        // needs to be drawn again because animation channels are moving
+        bool moving = haveFrame && m_frames.front().moving;
+        if (!moving) {
+            m_continuous.store(false);
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this] { return m_quit.load() || m_frames.pending(); });
+        }
+        if (m_quit.load()) { break; }
+        if (m_frames.update()) {
+            haveFrame = true;
+            if (m_pickup) { m_pickup(); }
+        }
+
+        // draw the frame, with the animations advanced to the current time
+        const TextBoxRenderer::Frame& frame = m_frames.front();
+        m_renderer->drawFrame(frame, FrameScheduler::now() - frame.time);
+        SDL_GL_SwapWindow(m_window);
+
+        // track the vsync interval while drawing continuously
+        FrameScheduler::Time t = FrameScheduler::now();
+        if (m_continuous.load()) {
+            double interval = t - m_lastPresent.load();
+            double prev = m_interval.load();
+            m_interval.store((prev > 0.0) ? (prev + (interval - prev) * IntervalSmoothing) : interval);
+        }
+        m_lastPresent.store(t);
+        m_continuous.store(frame.moving);
+    }
+    SDL_GL_MakeCurrent(m_window, nullptr);
+}
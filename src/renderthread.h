@@ -0,0 +1,68 @@
+// SPDX-FileCopyrightText: 2023 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+
+#include "renderer.h"
+#include "scheduler.h"
+#include "triplebuffer.h"
+
+struct SDL_Window;
+
+//! renders and presents the frames that the main thread records (see
+//! TextBoxRenderer::setDeferred()) on a thread of its own, which holds the
+//! OpenGL context. Frames are handed over through a lock-free triple buffer,
+//! so neither thread ever waits for the other: the main thread may take as
+//! long as it needs for a frame, or do I/O in between, and meanwhile, the
+//! render thread keeps drawing the most recent frame again in every vsync
+//! interval, as long as animation channels are moving in it.
+class RenderThread {
+    TextBoxRenderer* m_renderer = nullptr;
+    SDL_Window* m_window = nullptr;
+    void* m_context = nullptr;
+    std::function<void()> m_pickup;
+    TripleBuffer<TextBoxRenderer::Frame> m_frames;
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::atomic<bool> m_quit;
+    int m_started = 0;  // 0 = not yet, 1 = running, -1 = failed to take over the context
+    std::atomic<bool> m_continuous;       // drawing in every vsync interval
+    std::atomic<double> m_lastPresent;    // time the last swap returned
+    std::atomic<double> m_interval;       // estimated vsync interval
+    void threadMain();
+
+public:
+    inline RenderThread() : m_quit(false), m_continuous(false), m_lastPresent(0.0), m_interval(0.0) {}
+    inline ~RenderThread() { stop(); }
+
+    //! release the OpenGL context from the calling thread and start the
+    //! render thread with it; 'pickup' is called (from the render thread)
+    //! whenever it has taken a new frame; returns false (with the context
+    //! current on the calling thread again) if the thread can't use it
+    bool start(SDL_Window* window, void* context, TextBoxRenderer& renderer, std::function<void()> pickup);
+
+    //! stop the render thread; the context is current on the calling
+    //! thread again afterwards
+    void stop();
+
+    inline bool active() const { return m_thread.joinable(); }
+
+    //! the frame the main thread records next (see TextBoxRenderer::setFrameTarget())
+    inline TextBoxRenderer::Frame& frame() { return m_frames.back(); }
+    //! hand the recorded frame over to the render thread
+    void publish();
+    //! true if the render thread hasn't picked up the last published frame
+    //! yet, i.e. the next one would replace it
+    inline bool pending() const { return m_frames.pending(); }
+
+    //! time at which the render thread is going to pick up the next frame,
+    //! if it's drawing continuously; -1 = as soon as it's published
+    FrameScheduler::Time nextPickup() const;
+};
@@ -0,0 +1,109 @@
+// SPDX-FileCopyrightText: 2023 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#include <cstdint>
+#include <cstdio>
+#include <cmath>
+
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+#include "scheduler.h"
+
+constexpr double MaxTimeDelta = 0.1;  // don't let animations jump after hiccups
+constexpr double CPUEstimateDecay = 0.95;  // per frame; the estimate follows increases immediately
+
+FrameScheduler::Time FrameScheduler::now() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool FrameScheduler::frameDue() const {
+    return (waitTimeout() == 0);
+}
+
+bool FrameScheduler::idle() const {
+    return (m_framesRequested <= 0) && !m_animating && (now() >= idleStart());
+}
+
+int FrameScheduler::waitTimeout() const {
+    Time wakeup = m_deadline;
+    bool due = (m_framesRequested > 0);
+    if (!due && m_animating) {
+        if ((m_maxAnimFPS <= 0.0f) || (m_lastFrameStart < 0.0)) {
+            due = true;
+        } else {
+            Time next = m_lastFrameStart + 1.0 / double(m_maxAnimFPS);
+            if ((wakeup < 0.0) || (next < wakeup)) { wakeup = next; }
+        }
+    }
+    if (due) {
+        if (m_held) { return -1; }
+        if (m_earliestStart < 0.0) { return 0; }
+        wakeup = m_earliestStart;
+    }
+    if (wakeup < 0.0) { return -1; }
+    return std::max(0, int(std::ceil((wakeup - now()) * 1000.0)));
+}
+
+double FrameScheduler::beginFrame() {
+    if (m_framesRequested > 0) { --m_framesRequested; }
+    m_frameStart = now();
+    if ((m_deadline >= 0.0) && (m_frameStart >= m_deadline)) { m_deadline = -1.0; }
+
+    // the first frame after an idle period shouldn't advance animations
+    double dt = 0.0;
+    if (m_lastFrameStart >= 0.0) {
+        double interval = m_frameStart - m_lastFrameStart;
+        if (m_continuous) {
+            dt = std::min(interval, MaxTimeDelta);
+            m_intervals.add(float(interval * 1000.0));
+        }
+    }
+    m_lastFrameStart = m_frameStart;
+    return dt;
+}
+
+void FrameScheduler::endFrame() {
+    Time cpu = now() - m_frameStart;
+    m_cpuTimes.add(float(cpu * 1000.0));
+    m_cpuEstimate = std::max(cpu, m_cpuEstimate * CPUEstimateDecay);
+    ++m_totalFrames;
+    m_continuous = m_animating || (m_framesRequested > 0);
+    if (m_continuous) { m_lastActivity = m_frameStart; }
+}
+
+void FrameScheduler::Window::add(float value) {
+    if (data.empty()) { data.resize(StatsWindow, 0.0f); }
+    data[pos] = value;
+    pos = (pos + 1) % StatsWindow;
+    if (count < StatsWindow) { ++count; }
+}
+
+void FrameScheduler::Window::evaluate(double& avg, double& p95, double& max) const {
+    if (!count) { return; }
+    std::vector<float> sorted(data.begin(), data.begin() + count);
+    std::sort(sorted.begin(), sorted.end());
+    double sum = 0.0;
+    for (float v : sorted) { sum += double(v); }
+    avg = sum / double(count);
+    p95 = double(sorted[(count * 95) / 100]);
+    max = double(sorted.back());
+}
+
+FrameScheduler::Stats FrameScheduler::stats() const {
+    Stats s;
+    s.totalFrames = m_totalFrames;
+    s.frames      = m_cpuTimes.count;
+    s.intervals   = m_intervals.count;
+    m_cpuTimes.evaluate (s.cpuAvg,      s.cpuP95,      s.cpuMax);
+    m_intervals.evaluate(s.intervalAvg, s.intervalP95, s.intervalMax);
+    return s;
+}
+
+void FrameScheduler::dumpStats(FILE* f) const {
+    Stats s = stats();
+    fprintf(f, "frame statistics (%llu frames total):\n", (unsigned long long) s.totalFrames);
+    fprintf(f, "  CPU time:  avg %7.3f ms, 95%% %7.3f ms, max %7.3f ms  (last %d frames)\n", s.cpuAvg, s.cpuP95, s.cpuMax, s.frames);
+    fprintf(f, "  interval:  avg %7.3f ms, 95%% %7.3f ms, max %7.3f ms  (last %d intervals)\n", s.intervalAvg, s.intervalP95, s.intervalMax, s.intervals);
+}
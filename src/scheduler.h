@@ -0,0 +1,103 @@
+// SPDX-FileCopyrightText: 2023 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+#include <vector>
+#include <algorithm>
+
+//! decides when the next frame needs to be produced, and how long the
+//! main loop may sleep until then; also keeps frame time statistics
+class FrameScheduler {
+public:
+    typedef double Time;  //!< seconds on a monotonic clock
+    static Time now();
+
+    struct Stats {
+        uint64_t totalFrames = 0;  //!< number of frames since startup
+        int frames = 0;            //!< number of frames in the CPU time statistics window
+        int intervals = 0;         //!< number of frame intervals in the statistics window
+        double cpuAvg = 0.0, cpuP95 = 0.0, cpuMax = 0.0;                //!< CPU time per frame [ms]
+        double intervalAvg = 0.0, intervalP95 = 0.0, intervalMax = 0.0;  //!< time between consecutive frames [ms]
+    };
+
+private:
+    static constexpr int StatsWindow = 1024;
+    static constexpr double DefaultIdleDelay = 0.3;
+    int m_framesRequested = 1;
+    bool m_animating = false;
+    bool m_continuous = false;  // previous frame was part of a continuous sequence
+    float m_maxAnimFPS = 0.0f;
+    bool m_held = false;
+    Time m_earliestStart = -1.0;
+    Time m_cpuEstimate = 0.0;
+    Time m_idleDelay = DefaultIdleDelay;
+    Time m_lastActivity = 0.0;
+    Time m_deadline = -1.0;
+    Time m_frameStart = 0.0;
+    Time m_lastFrameStart = -1.0;
+    struct Window {
+        std::vector<float> data;
+        int pos = 0;
+        int count = 0;
+        void add(float value);
+        void evaluate(double& avg, double& p95, double& max) const;
+    };
+    Window m_cpuTimes;
+    Window m_intervals;  // only for frames that directly follow each other
+    uint64_t m_totalFrames = 0u;
+
+public:
+    //! request that the next N frames are drawn, even if nothing animates
+    inline void requestFrame(int frames=1) { if (frames > m_framesRequested) { m_framesRequested = frames; } }
+    inline int framesRequested() const     { return m_framesRequested; }
+
+    //! tell the scheduler whether animations are running (i.e. whether
+    //! frames need to be produced continuously, paced by vsync)
+    inline void setAnimating(bool animating) { m_animating = animating; }
+    inline bool animating() const            { return m_animating; }
+
+    //! battery-saver mode: limit animations to the given frame rate (0 = off)
+    inline void setMaxAnimationFPS(float fps) { m_maxAnimFPS = fps; }
+
+    //! hold back all frames, e.g. while a render thread hasn't picked up
+    //! the previous one yet; the main loop needs to be woken up when this
+    //! changes
+    inline void setHeld(bool held) { m_held = held; }
+    //! don't start a frame before the given time, so that input is
+    //! sampled as late as possible (-1 = as soon as it's due)
+    inline void setEarliestStart(Time t) { m_earliestStart = t; }
+    //! estimate of the CPU time of the next frame [s], from the recent ones
+    inline Time cpuTimeEstimate() const { return m_cpuEstimate; }
+
+    //! the UI counts as idle once there has been no input (see noteInput())
+    //! and no frame that was requested or animated for the idle delay [s]
+    inline void setIdleDelay(Time delay) { m_idleDelay = delay; }
+    inline void noteInput(Time t) { m_lastActivity = std::max(m_lastActivity, t); }
+    bool idle() const;
+    //! time when the UI becomes idle if nothing happens until then
+    inline Time idleStart() const { return m_lastActivity + m_idleDelay; }
+
+    //! make sure the main loop wakes up at the given time at the latest
+    //! (e.g. for the next typematic repeat); cleared on every new frame
+    inline void addDeadline(Time t) { if ((m_deadline < 0.0) || (t < m_deadline)) { m_deadline = t; } }
+
+    //! true if a frame should be drawn right now
+    bool frameDue() const;
+
+    //! number of milliseconds the main loop may wait for events;
+    //! 0 = draw immediately, -1 = wait indefinitely
+    int waitTimeout() const;
+
+    //! mark the start of a frame; returns the animation time delta
+    double beginFrame();
+
+    //! mark the end of a frame's CPU work (i.e. just before presenting it)
+    void endFrame();
+
+    Stats stats() const;
+    void dumpStats(FILE* f) const;
+};
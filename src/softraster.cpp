@@ -0,0 +1,411 @@
+// SPDX-FileCopyrightText: 2023 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+
+#include <vector>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+    #define SOFTRASTER_SSE2
+    #include <emmintrin.h>
+#endif
+
+#include "damage.h"
+#include "workers.h"
+#include "renderer.h"
+#include "softraster.h"
+
+typedef TextBoxRenderer::Vertex Vertex;
+typedef TextBoxRenderer::CompositeVertex CompositeVertex;
+
+///////////////////////////////////////////////////////////////////////////////
+
+// All shading is done on 2x2 pixel blocks, exactly like a GPU does it:
+// the four lanes are (x,y), (x+1,y), (x,y+1), (x+1,y+1). This way, the
+// fwidth() in the text shader can be computed from the neighboring lanes,
+// without any extra texture lookups.
+
+namespace {
+
+#ifdef SOFTRASTER_SSE2 ////////////////////////////////////////////////////////
+
+struct F4 {
+    __m128 v;
+    inline F4() {}
+    inline F4(__m128 v_) : v(v_) {}
+    inline F4(float f) : v(_mm_set1_ps(f)) {}
+    inline F4(float a, float b, float c, float d) : v(_mm_setr_ps(a, b, c, d)) {}
+};
+struct M4 {
+    __m128 m;
+    inline M4(__m128 m_) : m(m_) {}
+};
+
+inline F4 operator+ (F4 a, F4 b) { return _mm_add_ps(a.v, b.v); }
+inline F4 operator- (F4 a, F4 b) { return _mm_sub_ps(a.v, b.v); }
+inline F4 operator* (F4 a, F4 b) { return _mm_mul_ps(a.v, b.v); }
+inline F4 operator/ (F4 a, F4 b) { return _mm_div_ps(a.v, b.v); }
+inline F4 vmin(F4 a, F4 b)  { return _mm_min_ps(a.v, b.v); }
+inline F4 vmax(F4 a, F4 b)  { return _mm_max_ps(a.v, b.v); }
+inline F4 vabs(F4 a)        { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+inline F4 vsqrt(F4 a)       { return _mm_sqrt_ps(a.v); }
+inline M4 operator>  (F4 a, F4 b) { return _mm_cmpgt_ps(a.v, b.v); }
+inline M4 operator>= (F4 a, F4 b) { return _mm_cmpge_ps(a.v, b.v); }
+inline M4 operator<  (F4 a, F4 b) { return _mm_cmplt_ps(a.v, b.v); }
+inline M4 operator&  (M4 a, M4 b) { return _mm_and_ps(a.m, b.m); }
+inline bool any(M4 m)             { return (_mm_movemask_ps(m.m) != 0); }
+inline F4 select(M4 m, F4 a, F4 b) { return _mm_or_ps(_mm_and_ps(m.m, a.v), _mm_andnot_ps(m.m, b.v)); }
+
+// fine derivatives within a 2x2 block
+inline F4 ddx(F4 a) { return _mm_sub_ps(_mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(3,3,1,1)), _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(2,2,0,0))); }
+inline F4 ddy(F4 a) { return _mm_sub_ps(_mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(3,2,3,2)), _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(1,0,1,0))); }
+
+inline F4 load(const float* p) { return _mm_loadu_ps(p); }
+
+inline void loadPixels(const uint32_t* row0, const uint32_t* row1, F4& r, F4& g, F4& b) {
+    __m128i px = _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(row0)),
+                                    _mm_loadl_epi64(reinterpret_cast<const __m128i*>(row1)));
+    __m128i m = _mm_set1_epi32(0xFF);
+    r = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, 16), m));
+    g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px,  8), m));
+    b = _mm_cvtepi32_ps(_mm_and_si128(px, m));
+}
+
+inline void storePixels(uint32_t* row0, uint32_t* row1, M4 mask, F4 r, F4 g, F4 b) {
+    __m128 half = _mm_set1_ps(0.5f);
+    __m128i px = _mm_or_si128(
+        _mm_or_si128(_mm_slli_epi32(_mm_cvttps_epi32(_mm_add_ps(r.v, half)), 16),
+                     _mm_slli_epi32(_mm_cvttps_epi32(_mm_add_ps(g.v, half)),  8)),
+        _mm_or_si128(_mm_cvttps_epi32(_mm_add_ps(b.v, half)),
+                     _mm_set1_epi32(int(0xFF000000u))));
+    __m128i old = _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(row0)),
+                                     _mm_loadl_epi64(reinterpret_cast<const __m128i*>(row1)));
+    __m128i mi = _mm_castps_si128(mask.m);
+    px = _mm_or_si128(_mm_and_si128(mi, px), _mm_andnot_si128(mi, old));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(row0), px);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(row1), _mm_srli_si128(px, 8));
+}
+
+#else // !SOFTRASTER_SSE2 /////////////////////////////////////////////////////
+
+struct F4 {
+    float v[4];
+    inline F4() {}
+    inline F4(float f) { v[0] = v[1] = v[2] = v[3] = f; }
+    inline F4(float a, float b, float c, float d) { v[0] = a;  v[1] = b;  v[2] = c;  v[3] = d; }
+};
+struct M4 {
+    bool m[4];
+};
+
+#define F4_OP(expr) F4 r; for (int i = 0;  i < 4;  ++i) { r.v[i] = (expr); } return r
+#define M4_OP(expr) M4 r; for (int i = 0;  i < 4;  ++i) { r.m[i] = (expr); } return r
+inline F4 operator+ (F4 a, F4 b) { F4_OP(a.v[i] + b.v[i]); }
+inline F4 operator- (F4 a, F4 b) { F4_OP(a.v[i] - b.v[i]); }
+inline F4 operator* (F4 a, F4 b) { F4_OP(a.v[i] * b.v[i]); }
+inline F4 operator/ (F4 a, F4 b) { F4_OP(a.v[i] / b.v[i]); }
+inline F4 vmin(F4 a, F4 b)  { F4_OP(std::min(a.v[i], b.v[i])); }
+inline F4 vmax(F4 a, F4 b)  { F4_OP(std::max(a.v[i], b.v[i])); }
+inline F4 vabs(F4 a)        { F4_OP(std::fabs(a.v[i])); }
+inline F4 vsqrt(F4 a)       { F4_OP(std::sqrt(a.v[i])); }
+inline M4 operator>  (F4 a, F4 b) { M4_OP(a.v[i] >  b.v[i]); }
+inline M4 operator>= (F4 a, F4 b) { M4_OP(a.v[i] >= b.v[i]); }
+inline M4 operator<  (F4 a, F4 b) { M4_OP(a.v[i] <  b.v[i]); }
+inline M4 operator&  (M4 a, M4 b) { M4_OP(a.m[i] && b.m[i]); }
+inline bool any(M4 m)             { return m.m[0] || m.m[1] || m.m[2] || m.m[3]; }
+inline F4 select(M4 m, F4 a, F4 b) { F4_OP(m.m[i] ? a.v[i] : b.v[i]); }
+#undef F4_OP
+#undef M4_OP
+
+inline F4 ddx(F4 a) { float x0 = a.v[1] - a.v[0], x1 = a.v[3] - a.v[2];  return F4(x0, x0, x1, x1); }
+inline F4 ddy(F4 a) { float y0 = a.v[2] - a.v[0], y1 = a.v[3] - a.v[1];  return F4(y0, y1, y0, y1); }
+
+inline F4 load(const float* p) { return F4(p[0], p[1], p[2], p[3]); }
+
+inline void loadPixels(const uint32_t* row0, const uint32_t* row1, F4& r, F4& g, F4& b) {
+    const uint32_t px[4] = { row0[0], row0[1], row1[0], row1[1] };
+    for (int i = 0;  i < 4;  ++i) {
+        r.v[i] = float((px[i] >> 16) & 0xFFu);
+        g.v[i] = float((px[i] >>  8) & 0xFFu);
+        b.v[i] = float( px[i]        & 0xFFu);
+    }
+}
+
+inline void storePixels(uint32_t* row0, uint32_t* row1, M4 mask, F4 r, F4 g, F4 b) {
+    uint32_t* dest[4] = { &row0[0], &row0[1], &row1[0], &row1[1] };
+    for (int i = 0;  i < 4;  ++i) {
+        if (!mask.m[i]) { continue; }
+        *dest[i] = 0xFF000000u | (uint32_t(r.v[i] + 0.5f) << 16)
+                               | (uint32_t(g.v[i] + 0.5f) <<  8)
+                               |  uint32_t(b.v[i] + 0.5f);
+    }
+}
+
+#endif // SOFTRASTER_SSE2 /////////////////////////////////////////////////////
+
+inline F4 clamp01(F4 a) { return vmin(vmax(a, F4(0.0f)), F4(1.0f)); }
+
+// bilinear texture lookup with GL_CLAMP_TO_EDGE semantics; 0...255 range
+inline void sampleTexture(const uint32_t* tex, int w, int h, float u, float v, float& r, float& g, float& b) {
+    float x = u * float(w) - 0.5f;
+    float y = v * float(h) - 0.5f;
+    float fx = std::floor(x), fy = std::floor(y);
+    float wx = x - fx, wy = y - fy;
+    int x0 = int(fx), y0 = int(fy);
+    int x1 = std::min(std::max(x0 + 1, 0), w - 1);  x0 = std::min(std::max(x0, 0), w - 1);
+    int y1 = std::min(std::max(y0 + 1, 0), h - 1);  y0 = std::min(std::max(y0, 0), h - 1);
+    uint32_t t00 = tex[y0 * w + x0], t01 = tex[y0 * w + x1];
+    uint32_t t10 = tex[y1 * w + x0], t11 = tex[y1 * w + x1];
+    float c[3];
+    for (int i = 0;  i < 3;  ++i) {
+        int s = i * 8;
+        float a0 = float((t00 >> s) & 0xFFu), a1 = float((t01 >> s) & 0xFFu);
+        float b0 = float((t10 >> s) & 0xFFu), b1 = float((t11 >> s) & 0xFFu);
+        float top = a0 + (a1 - a0) * wx;
+        float bot = b0 + (b1 - b0) * wx;
+        c[i] = top + (bot - top) * wy;
+    }
+    r = c[0];  g = c[1];  b = c[2];
+}
+
+inline float channel(uint32_t color, int shift) { return float((color >> shift) & 0xFFu); }
+
+// round a pixel coordinate to the rasterizer's sub-pixel precision (8 bits)
+constexpr float SubPixels = 256.0f;
+inline float snap(float x) { return std::floor(x * SubPixels + 0.5f) * (1.0f / SubPixels); }
+
+// rounded box signed distance, in pixels (positive = inside)
+inline F4 boxDistance(F4 u, F4 v, F4 sizeX, F4 sizeY, F4 radius) {
+    F4 px = vabs(u) - sizeX;
+    F4 py = vabs(v) - sizeY;
+    F4 cx = px + radius, cy = py + radius;
+    return select(vmin(px, py) > (F4(0.0f) - radius),
+                  radius - vsqrt(cx * cx + cy * cy),
+                  vmin(F4(0.0f) - px, F4(0.0f) - py));
+}
+
+// MSDF signed distance, in pixels (positive = inside)
+inline F4 textDistance(const uint32_t* tex, int w, int h, F4 u, F4 v) {
+    float su[4], sv[4], tr[4], tg[4], tb[4];
+    #ifdef SOFTRASTER_SSE2
+        _mm_storeu_ps(su, u.v);  _mm_storeu_ps(sv, v.v);
+    #else
+        memcpy(su, u.v, sizeof(su));  memcpy(sv, v.v, sizeof(sv));
+    #endif
+    for (int i = 0;  i < 4;  ++i) {
+        sampleTexture(tex, w, h, su[i], sv[i], tr[i], tg[i], tb[i]);
+    }
+    F4 sr = load(tr), sg = load(tg), sb = load(tb);
+    F4 d = vmax(vmin(sr, sg), vmin(vmax(sr, sg), sb)) * F4(1.0f / 255.0f) - F4(0.5f);
+    F4 fw = vabs(ddx(d)) + vabs(ddy(d));
+    return d / vmax(fw, F4(1.0f / 65536.0f));
+}
+
+}  // anonymous namespace
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool SoftRasterizer::init(int width, int height, int threads) {
+    if ((width <= 0) || (height <= 0)) { return false; }
+    m_width  = width;
+    m_height = height;
+    m_pitch  = (width + 1) & (~1);
+    m_pixels.assign(size_t(m_pitch) * size_t((height + 1) & (~1)), 0xFF000000u);
+    m_pool.init(threads);
+
+    // use a few more bands than threads, for better load balancing;
+    // bands must start at even rows, so 2x2 blocks never straddle them
+    m_bandCount = (m_pool.threads() > 1) ? (m_pool.threads() * 4) : 1;
+    m_bandHeight = (((height + m_bandCount - 1) / m_bandCount) + 1) & (~1);
+    m_bandCount = (height + m_bandHeight - 1) / m_bandHeight;
+    m_updatedRects.assign(1, Rect(0, 0, width, height));
+    return true;
+}
+
+void SoftRasterizer::shutdown() {
+    m_pool.shutdown();
+    m_pixels.clear();
+    m_tex.clear();
+}
+
+void SoftRasterizer::setTexture(const uint8_t* rgb, int width, int height) {
+    m_texWidth  = width;
+    m_texHeight = height;
+    m_tex.resize(size_t(width) * size_t(height));
+    for (auto& texel : m_tex) {
+        texel = uint32_t(rgb[0]) | (uint32_t(rgb[1]) << 8) | (uint32_t(rgb[2]) << 16);
+        rgb += 3;
+    }
+}
+
+static inline Rect intersect(const Rect& a, const Rect& b) {
+    return Rect(std::max(a.x0, b.x0), std::max(a.y0, b.y0), std::min(a.x1, b.x1), std::min(a.y1, b.y1));
+}
+
+void SoftRasterizer::clear(const std::vector<Rect>& rects, uint32_t color) {
+    if (rects.empty()) { m_updatedRects.assign(1, Rect(0, 0, m_width, m_height)); }
+    else               { m_updatedRects = rects; }
+    m_pool.parallelFor(m_bandCount, [&] (int band) {
+        Rect bandRect(0, band * m_bandHeight, m_width, std::min(m_height, (band + 1) * m_bandHeight));
+        for (const auto& r : m_updatedRects) {
+            Rect c = intersect(r, bandRect);
+            for (int y = c.y0;  y < c.y1;  ++y) {
+                uint32_t* row = &m_pixels[size_t(y) * size_t(m_pitch)];
+                std::fill(&row[c.x0], &row[std::max(c.x0, c.x1)], color);
+            }
+        }
+    });
+}
+
+void SoftRasterizer::draw(const Vertex* vertices, int quadCount, const std::vector<Rect>& clipRects) {
+    drawQuads(vertices, quadCount, clipRects);
+}
+
+void SoftRasterizer::draw(const CompositeVertex* vertices, int quadCount, const std::vector<Rect>& clipRects) {
+    drawQuads(vertices, quadCount, clipRects);
+}
+
+// the outline and shadow parameters of a quad; plain vertices don't have
+// any, so the (unused) parameters are all zero for them
+static const CompositeVertex noComposite = CompositeVertex();
+static inline const CompositeVertex& compositeParams(const Vertex&) { return noComposite; }
+static inline const CompositeVertex& compositeParams(const CompositeVertex& v) { return v; }
+
+template <typename V> void SoftRasterizer::drawQuads(const V* vertices, int quadCount, const std::vector<Rect>& clipRects) {
+    if (quadCount <= 0) { return; }
+    m_pool.parallelFor(m_bandCount, [&] (int band) {
+        Rect bandRect(0, band * m_bandHeight, m_width, std::min(m_height, (band + 1) * m_bandHeight));
+        if (clipRects.empty()) {
+            drawBand(vertices, quadCount, bandRect);
+            return;
+        }
+        for (const auto& r : clipRects) {
+            Rect c = intersect(r, bandRect);
+            if (!c.empty()) { drawBand(vertices, quadCount, c); }
+        }
+    });
+}
+
+template <typename V> void SoftRasterizer::drawBand(const V* quad, int quadCount, const Rect& clip) {
+    const float sx = 0.5f * float(m_width);
+    const float sy = 0.5f * float(m_height);
+    const float cx0 = float(clip.x0), cy0 = float(clip.y0);
+    const float cx1 = float(clip.x1), cy1 = float(clip.y1);
+    for (;  quadCount;  --quadCount, quad += 4) {
+        // reconstruct the pixel-space rectangle from the NDC coordinates
+        const V& v0 = quad[0];
+        const V& v3 = quad[3];
+        float x0 = (v0.pos[0] + 1.0f) * sx, x1 = (v3.pos[0] + 1.0f) * sx;
+        float y0 = (1.0f - v0.pos[1]) * sy, y1 = (1.0f - v3.pos[1]) * sy;
+        float minX = std::min(x0, x1), maxX = std::max(x0, x1);
+        float minY = std::min(y0, y1), maxY = std::max(y0, y1);
+        if ((maxX <= cx0) || (minX >= cx1) || (maxY <= cy0) || (minY >= cy1)) { continue; }
+
+        // covered pixels: those whose centers are inside the rectangle,
+        // with the edges snapped to the sub-pixel grid like a GPU does it;
+        // centers exactly on an edge belong to the left and bottom edges
+        // (OpenGL's window coordinates go upwards), which matters during
+        // animations, where edges end up on pixel centers quite often
+        int ix0 = std::max(clip.x0, int(std::ceil(snap(minX) - 0.5f)));
+        int ix1 = std::min(clip.x1, int(std::ceil(snap(maxX) - 0.5f)));
+        int iy0 = std::max(clip.y0, int(std::floor(snap(minY) - 0.5f)) + 1);
+        int iy1 = std::min(clip.y1, int(std::floor(snap(maxY) - 0.5f)) + 1);
+        if ((ix0 >= ix1) || (iy0 >= iy1)) { continue; }
+
+        // attribute interpolation: u = u0 + px * dudx (px = pixel index),
+        // color is always constant across the x axis
+        float dudx = (v3.tc[0] - v0.tc[0]) / (x1 - x0);
+        float dvdy = (v3.tc[1] - v0.tc[1]) / (y1 - y0);
+        float dtdy = 1.0f / (y1 - y0);
+        float u0 = v0.tc[0] + (0.5f - x0) * dudx;
+        float vb = v0.tc[1] + (0.5f - y0) * dvdy;
+        float tb = (0.5f - y0) * dtdy;
+        uint32_t cUpper = v0.color, cLower = quad[2].color;
+        F4 rU(channel(cUpper, 0)), rD(channel(cLower, 0) - channel(cUpper, 0));
+        F4 gU(channel(cUpper, 8)), gD(channel(cLower, 8) - channel(cUpper, 8));
+        F4 bU(channel(cUpper,16)), bD(channel(cLower,16) - channel(cUpper,16));
+        F4 aU(channel(cUpper,24) * (1.0f / 255.0f)), aD((channel(cLower, 24) - channel(cUpper, 24)) * (1.0f / 255.0f));
+        const uint32_t mode = v0.mode & TextBoxRenderer::ModeBits;
+        const bool text = (mode == TextBoxRenderer::ModeText) || (mode == TextBoxRenderer::ModeCompositeText);
+        const bool composite = (mode == TextBoxRenderer::ModeCompositeBox) || (mode == TextBoxRenderer::ModeCompositeText);
+        const F4 sizeX(v0.size[0]), sizeY(v0.size[1]), radius(v0.size[2]);
+        const F4 brOffset(v0.br[0]), brScale(v0.br[1]);
+        const F4 fix0 = F4(float(ix0)), fix1 = F4(float(ix1));
+
+        // composite mode parameters (the colors are constant across the quad)
+        const CompositeVertex& c0 = compositeParams(v0);
+        const F4 oR(channel(c0.outlineColor, 0)), oG(channel(c0.outlineColor, 8)), oB(channel(c0.outlineColor, 16));
+        const F4 oA(channel(c0.outlineColor, 24) * (1.0f / 255.0f));
+        const F4 sR(channel(c0.shadowColor, 0)), sG(channel(c0.shadowColor, 8)), sB(channel(c0.shadowColor, 16));
+        const F4 sA(channel(c0.shadowColor, 24) * (1.0f / 255.0f));
+        const F4 oOffset(c0.outline[0]), oScale(c0.outline[1]);
+        const F4 sOffset(c0.shadow[0]), sScale(c0.shadow[1]), sDU(c0.shadow[2]), sDV(c0.shadow[3]);
+        const F4 clipU0(c0.clip[0]), clipV0(c0.clip[1]), clipU1(c0.clip[2]), clipV1(c0.clip[3]);
+
+        for (int by = iy0 & (~1);  by < iy1;  by += 2) {
+            uint32_t* row0 = &m_pixels[size_t(by) * size_t(m_pitch)];
+            uint32_t* row1 = row0 + m_pitch;
+            F4 fy = F4(float(by), float(by), float(by + 1), float(by + 1));
+            M4 rowMask = (fy >= F4(float(iy0))) & (fy < F4(float(iy1)));
+            F4 v = F4(vb) + fy * F4(dvdy);
+            F4 t = F4(tb) + fy * F4(dtdy);
+            F4 r = rU + rD * t, g = gU + gD * t, b = bU + bD * t, a = aU + aD * t;
+
+            for (int bx = ix0 & (~1);  bx < ix1;  bx += 2) {
+                F4 fx = F4(float(bx), float(bx + 1), float(bx), float(bx + 1));
+                M4 mask = rowMask & (fx >= fix0) & (fx < fix1);
+                F4 u = F4(u0) + fx * F4(dudx);
+                F4 alpha, cr = r, cg = g, cb = b;
+                if (!composite) {
+                    F4 d = text ? textDistance(m_tex.data(), m_texWidth, m_texHeight, u, v)
+                                : boxDistance(u, v, sizeX, sizeY, radius);
+                    alpha = a * clamp01((d - brOffset) * brScale + F4(0.5f));
+                } else {
+                    // shadow, outline and fill layers, blended over each other
+                    F4 d, ds;
+                    if (text) {
+                        const uint32_t* tex = m_tex.data();
+                        F4 su = u - sDU, sv = v - sDV;
+                        d  = textDistance(tex, m_texWidth, m_texHeight, vmin(vmax(u,  clipU0), clipU1), vmin(vmax(v,  clipV0), clipV1));
+                        ds = textDistance(tex, m_texWidth, m_texHeight, vmin(vmax(su, clipU0), clipU1), vmin(vmax(sv, clipV0), clipV1));
+                    } else {
+                        d  = boxDistance(u, v, sizeX, sizeY, radius);
+                        ds = boxDistance(u - sDU, v - sDV, sizeX, sizeY, radius);
+                    }
+                    F4 aS = sA * clamp01((ds - sOffset) * sScale + F4(0.5f));
+                    F4 aO = oA * clamp01((d - oOffset) * oScale + F4(0.5f));
+                    F4 aF = a  * clamp01((d - brOffset) * brScale + F4(0.5f));
+                    cr = sR * aS;  cg = sG * aS;  cb = sB * aS;  alpha = aS;
+                    cr = cr + (oR - cr) * aO;  cg = cg + (oG - cg) * aO;  cb = cb + (oB - cb) * aO;  alpha = alpha + (F4(1.0f) - alpha) * aO;
+                    cr = cr + (r  - cr) * aF;  cg = cg + (g  - cg) * aF;  cb = cb + (b  - cb) * aF;  alpha = alpha + (F4(1.0f) - alpha) * aF;
+                    F4 inv = F4(1.0f) / vmax(alpha, F4(1.0f / 1024.0f));
+                    cr = cr * inv;  cg = cg * inv;  cb = cb * inv;
+                }
+                mask = mask & (alpha > F4(0.0f));
+                if (!any(mask)) { continue; }
+                F4 dr, dg, db;
+                loadPixels(&row0[bx], &row1[bx], dr, dg, db);
+                storePixels(&row0[bx], &row1[bx], mask,
+                            dr + (cr - dr) * alpha,
+                            dg + (cg - dg) * alpha,
+                            db + (cb - db) * alpha);
+            }
+        }
+    }
+}
+
+void SoftRasterizer::readPixels(std::vector<uint8_t>& rgb) const {
+    rgb.resize(size_t(m_width) * size_t(m_height) * 3u);
+    uint8_t* out = rgb.data();
+    for (int y = 0;  y < m_height;  ++y) {
+        const uint32_t* row = &m_pixels[size_t(y) * size_t(m_pitch)];
+        for (int x = 0;  x < m_width;  ++x) {
+            *out++ = uint8_t(row[x] >> 16);
+            *out++ = uint8_t(row[x] >>  8);
+            *out++ = uint8_t(row[x]);
+        }
+    }
+}
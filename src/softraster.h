@@ -0,0 +1,62 @@
+// SPDX-FileCopyrightText: 2023 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstdint>
+
+#include <vector>
+
+#include "damage.h"
+#include "workers.h"
+#include "renderer.h"
+
+//! CPU implementation of TextBoxRenderer's shading, for systems where
+//! OpenGL is broken or missing; evaluates the same box SDF and MSDF
+//! median math as the fragment shader (SSE2 if available, scalar
+//! otherwise), with the framebuffer split into bands across threads
+class SoftRasterizer {
+    int m_width = 0;
+    int m_height = 0;
+    int m_pitch = 0;  // in pixels; width and height are padded to even numbers
+    std::vector<uint32_t> m_pixels;  // 0xFFRRGGBB
+    std::vector<uint32_t> m_tex;     // 0x00BBGGRR
+    int m_texWidth = 0;
+    int m_texHeight = 0;
+    WorkerPool m_pool;
+    int m_bandHeight = 0;
+    int m_bandCount = 0;
+    std::vector<Rect> m_updatedRects;
+
+    template <typename V> void drawQuads(const V* vertices, int quadCount, const std::vector<Rect>& clipRects);
+    template <typename V> void drawBand(const V* vertices, int quadCount, const Rect& clip);
+
+public:
+    //! create the framebuffer and start the worker threads (0 = all cores)
+    bool init(int width, int height, int threads=0);
+    void shutdown();
+
+    inline int width()  const { return m_width; }
+    inline int height() const { return m_height; }
+    inline int threads() const { return m_pool.threads(); }
+    //! framebuffer contents, in SDL_PIXELFORMAT_RGB888 / ARGB8888 format
+    inline uint32_t* pixels() { return m_pixels.data(); }
+    inline int pitch() const { return m_pitch * int(sizeof(uint32_t)); }
+
+    //! set the font texture (tightly packed 8-bit RGB)
+    void setTexture(const uint8_t* rgb, int width, int height);
+
+    //! start a frame: fill the given rectangles (empty = everything)
+    void clear(const std::vector<Rect>& rects, uint32_t color);
+
+    //! draw a batch of quads, clipped to the given rectangles (empty = everything)
+    void draw(const TextBoxRenderer::Vertex* vertices, int quadCount, const std::vector<Rect>& clipRects);
+    //! same for quads in the composite modes
+    void draw(const TextBoxRenderer::CompositeVertex* vertices, int quadCount, const std::vector<Rect>& clipRects);
+
+    //! screen regions modified since the last clear()
+    inline const std::vector<Rect>& updatedRects() const { return m_updatedRects; }
+
+    //! read back the framebuffer contents as top-down RGB
+    void readPixels(std::vector<uint8_t>& rgb) const;
+};
@@ -0,0 +1,536 @@
+// SPDX-FileCopyrightText: 2023 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <sys/types.h>
+    #include <sys/wait.h>
+    #include <sys/socket.h>
+    #include <unistd.h>
+    #include <fcntl.h>
+    #include <poll.h>
+    #include <signal.h>
+    #include <errno.h>
+    #ifdef __linux__
+        #include <sys/syscall.h>
+        #if !defined(SYS_pidfd_open) && !defined(__alpha__)
+            #define SYS_pidfd_open 434  // same number on all other architectures
+        #endif
+    #endif
+#endif
+
+#include <cstdio>
+#include <cstring>
+
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <functional>
+
+#include "sysutil.h"
+#include "file_assoc.h"
+#include "supervisor.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _WIN32
+
+// pidfd_open() has no glibc wrapper on older systems, so use the syscall
+static int openPidFD(pid_t pid) {
+    #ifdef SYS_pidfd_open
+        return int(syscall(SYS_pidfd_open, pid, 0));
+    #else
+        (void)pid;
+        errno = ENOSYS;
+        return -1;
+    #endif
+}
+
+// write end of the self-pipe for the SIGCHLD fallback
+static volatile int g_sigchldPipe = -1;
+
+static void sigchldHandler(int) {
+    int savedErrno = errno;
+    char c = 0;
+    if (g_sigchldPipe >= 0) {
+        if (write(g_sigchldPipe, &c, 1) < 0) { /* pipe full -- that's fine */ }
+    }
+    errno = savedErrno;
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool ProcessSupervisor::init(std::function<void()> wakeup) {
+    shutdown();
+    m_wakeup = wakeup;
+    m_quit = false;
+    #ifdef _WIN32
+        m_control = CreateEventA(nullptr, FALSE, FALSE, nullptr);
+        if (!m_control) { return false; }
+    #else
+        if (pipe(m_control) < 0) { m_control[0] = m_control[1] = -1;  return false; }
+        for (int fd : m_control) {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+        // check whether the kernel supports pidfds; if not, fall back to
+        // a SIGCHLD handler that writes into the control pipe
+        int fd = openPidFD(getpid());
+        m_pidfds = (fd >= 0);
+        if (m_pidfds) {
+            close(fd);
+        } else {
+            enableSIGCHLD();
+        }
+        #ifdef _DEBUG
+            printf("process supervisor: waiting for %s\n", m_pidfds ? "pidfds" : "SIGCHLD");
+        #endif
+    #endif
+    m_thread = std::thread(&ProcessSupervisor::threadMain, this);
+    return true;
+}
+
+void ProcessSupervisor::shutdown() {
+    if (m_thread.joinable()) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_quit = true;
+        }
+        notify();
+        m_thread.join();
+    }
+    #ifndef _WIN32
+        quitResident();
+    #endif
+    #ifdef _WIN32
+        if (m_control) { CloseHandle(HANDLE(m_control));  m_control = nullptr; }
+        for (const auto& child : m_children) { CloseHandle(HANDLE(child.handle)); }
+    #else
+        if (m_sigchld) {
+            signal(SIGCHLD, SIG_DFL);
+            g_sigchldPipe = -1;
+            m_sigchld = false;
+        }
+        for (int& fd : m_control) {
+            if (fd >= 0) { close(fd);  fd = -1; }
+        }
+        for (const auto& child : m_children) {
+            if (child.pidfd >= 0) { close(child.pidfd); }
+        }
+    #endif
+    m_children.clear();
+    m_queue.clear();
+}
+
+bool ProcessSupervisor::parsePolicy(const char* name, Policy& policy) {
+    if      (!strcmp(name, "queue"))    { policy = Policy::Queue; }
+    else if (!strcmp(name, "parallel")) { policy = Policy::Parallel; }
+    else if (!strcmp(name, "replace"))  { policy = Policy::Replace; }
+    else { return false; }
+    return true;
+}
+
+void ProcessSupervisor::notify() {
+    #ifdef _WIN32
+        if (m_control) { SetEvent(HANDLE(m_control)); }
+    #else
+        char c = 0;
+        if ((m_control[1] >= 0) && (write(m_control[1], &c, 1) < 0)) { /* pipe full -- that's fine */ }
+    #endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool ProcessSupervisor::launch(const char* program, const char* argument, ViewerProtocol protocol) {
+    #ifdef _WIN32
+        protocol = ViewerProtocol::None;
+    #endif
+    if ((m_resident == Resident::Off) || !program || !program[0] || !argument || !argument[0]) {
+        protocol = ViewerProtocol::None;
+    }
+    bool busy = false;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (const auto& child : m_children) {
+            if (!child.busy) { continue; }
+            busy = true;
+            // a resident viewer doesn't need to be terminated; it gets the
+            // new file instead (if it's the one that will be used)
+            if ((m_policy == Policy::Replace) && (child.ipc < 0)) { TerminateProgram(child.handle); }
+        }
+    }
+    if ((m_policy == Policy::Queue) && (busy || !m_queue.empty())) {
+        m_queue.push_back({ program ? program : "", argument ? argument : "", protocol });
+        return true;
+    }
+    return start(program, argument, protocol);
+}
+
+bool ProcessSupervisor::start(const char* program, const char* argument, ViewerProtocol protocol) {
+    #ifndef _WIN32
+        if (protocol != ViewerProtocol::None) {
+            for (int attempt = 0;  attempt < 2;  ++attempt) {
+                if (attempt && !spawnResident(program, protocol, false)) { break; }
+                std::unique_lock<std::mutex> lock(m_mutex);
+                Child* child = findResident(program);
+                if (child && sendOpen(*child, argument)) {
+                    child->busy = true;
+                    child->playing = false;
+                    return true;
+                }
+            }
+            // if that didn't work, start the program the conventional way
+        }
+    #else
+        (void)protocol;
+    #endif
+    ProgramHandle handle = RunProgram(program, argument);
+    if (!handle) { return false; }
+    Child child;
+    child.handle = handle;
+    #ifndef _WIN32
+        watch(child);
+    #endif
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_children.push_back(child);
+    }
+    notify();
+    return true;
+}
+
+int ProcessSupervisor::update() {
+    // without the thread (i.e. if init() failed), there's nobody to
+    // collect the children, so do it here
+    if (!m_thread.joinable()) { reap(); }
+    size_t running = 0;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (const auto& child : m_children) {
+            if (child.busy) { ++running; }
+        }
+    }
+    while (!running && !m_queue.empty()) {
+        Launch next = m_queue.front();
+        m_queue.pop_front();
+        if (start(next.program.c_str(), next.argument.c_str(), next.protocol)) { running = 1; }
+    }
+    return int(running + m_queue.size());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void ProcessSupervisor::reap() {
+    // check all children, as the wakeup doesn't tell which one has exited
+    // (and with SIGCHLD, a signal may stand for several children)
+    bool exited = false;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (size_t i = 0;  i < m_children.size();) {
+            const Child& child = m_children[i];
+            #ifdef _WIN32
+                bool done = (WaitForSingleObject(HANDLE(child.handle), 0) != WAIT_TIMEOUT);
+                if (done) { CloseHandle(HANDLE(child.handle)); }
+            #else
+                pid_t res = waitpid(pid_t(child.handle), nullptr, WNOHANG);
+                bool done = (res > 0) || ((res < 0) && (errno == ECHILD));
+                if (done && (child.pidfd >= 0)) { close(child.pidfd); }
+                if (done && (child.ipc >= 0))   { close(child.ipc); }
+            #endif
+            if (done) {
+                m_children.erase(m_children.begin() + i);
+                exited = true;
+            } else {
+                ++i;
+            }
+        }
+    }
+    if (exited && m_wakeup) { m_wakeup(); }
+}
+
+void ProcessSupervisor::threadMain() {
+    #ifdef _WIN32
+        std::vector<HANDLE> handles;
+    #else
+        std::vector<struct pollfd> fds;
+        size_t firstIPC;
+    #endif
+    for (;;) {
+        // wait for the control event or pipe, and for all children
+        #ifdef _WIN32
+            handles.assign(1, HANDLE(m_control));
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                if (m_quit) { break; }
+                for (const auto& child : m_children) {
+                    if (handles.size() >= MAXIMUM_WAIT_OBJECTS) { break; }
+                    handles.push_back(HANDLE(child.handle));
+                }
+            }
+            WaitForMultipleObjects(DWORD(handles.size()), handles.data(), FALSE, INFINITE);
+        #else
+            fds.assign(1, { m_control[0], POLLIN, 0 });
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                if (m_quit) { break; }
+                for (const auto& child : m_children) {
+                    if (child.pidfd >= 0) { fds.push_back({ child.pidfd, POLLIN, 0 }); }
+                }
+                firstIPC = fds.size();
+                for (const auto& child : m_children) {
+                    if (child.ipc >= 0) { fds.push_back({ child.ipc, POLLIN, 0 }); }
+                }
+            }
+            if ((poll(fds.data(), nfds_t(fds.size()), -1) < 0) && (errno != EINTR)) { break; }
+            if (fds[0].revents) {
+                char buf[64];
+                while (read(m_control[0], buf, sizeof(buf)) > 0) {}
+            }
+
+            // handle messages from resident viewers
+            bool wake = false;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                for (size_t i = firstIPC;  i < fds.size();  ++i) {
+                    if (!fds[i].revents) { continue; }
+                    for (auto& child : m_children) {
+                        if (child.ipc != fds[i].fd) { continue; }
+                        uint32_t shown = m_framesShown.load();
+                        bool busy = child.busy;
+                        if (!receive(child)) {
+                            // connection lost: the viewer is exiting (or
+                            // has become unusable), so never use it again
+                            close(child.ipc);
+                            child.ipc = -1;
+                            child.program.clear();
+                            if (child.busy) { TerminateProgram(child.handle);  child.busy = false; }
+                        }
+                        wake = wake || (busy != child.busy) || (shown != m_framesShown.load());
+                        break;
+                    }
+                }
+            }
+            if (wake && m_wakeup) { m_wakeup(); }
+        #endif
+        reap();
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _WIN32
+
+void ProcessSupervisor::enableSIGCHLD() {
+    if (m_sigchld || (m_control[1] < 0)) { return; }
+    g_sigchldPipe = m_control[1];
+    struct sigaction sa;
+    ::memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sigchldHandler;
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGCHLD, &sa, nullptr);
+    m_sigchld = true;
+}
+
+void ProcessSupervisor::watch(Child& child) {
+    if (m_pidfds) { child.pidfd = openPidFD(pid_t(child.handle)); }
+    if (child.pidfd >= 0) { return; }
+    // no pidfd (e.g. because we ran out of file descriptors): switch to the
+    // SIGCHLD fallback for good; if the child has exited already, the
+    // reap() after the caller's notify() catches that
+    #ifdef _DEBUG
+        if (m_pidfds && !m_sigchld) { printf("process supervisor: no pidfd for pid %d, falling back to SIGCHLD\n", int(child.handle)); }
+    #endif
+    enableSIGCHLD();
+}
+
+ProcessSupervisor::Child* ProcessSupervisor::findResident(const char* program) {
+    for (auto& child : m_children) {
+        if ((child.ipc >= 0) && (child.program == program)) { return &child; }
+    }
+    return nullptr;
+}
+
+void ProcessSupervisor::prespawn(const char* program, ViewerProtocol protocol) {
+    if ((m_resident != Resident::Prespawn) || (protocol == ViewerProtocol::None) || !program || !program[0]) { return; }
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (findResident(program)) { return; }
+    }
+    spawnResident(program, protocol, false);
+}
+
+bool ProcessSupervisor::spawnResident(const char* program, ViewerProtocol protocol, bool busy) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) { return false; }
+    for (int fd : sv) { fcntl(fd, F_SETFD, FD_CLOEXEC); }
+    if (sv[1] == 3) {
+        // dup2() onto itself wouldn't clear close-on-exec, so move it away
+        int fd = fcntl(sv[1], F_DUPFD_CLOEXEC, 4);
+        close(sv[1]);
+        if (fd < 0) { close(sv[0]);  return false; }
+        sv[1] = fd;
+    }
+    #ifdef SO_NOSIGPIPE
+        int one = 1;
+        setsockopt(sv[0], SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+    #endif
+
+    std::vector<std::string> args;
+    if (protocol == ViewerProtocol::MPV) {
+        args.push_back("--idle=yes");
+        args.push_back("--input-ipc-client=fd://3");
+    } else {
+        args.push_back("--ipc-fd=3");
+    }
+    ProgramHandle handle = RunProgram(program, args, sv[1]);
+    close(sv[1]);
+    if (!handle) { close(sv[0]);  return false; }
+    #ifdef _DEBUG
+        printf("process supervisor: started resident viewer %s (pid %d)\n", program, int(handle));
+    #endif
+
+    Child child;
+    child.handle = handle;
+    watch(child);
+    child.ipc = sv[0];
+    child.protocol = protocol;
+    child.program = program;
+    child.busy = busy;
+    if (protocol == ViewerProtocol::MPV) {
+        // get notified when a file is finished (mpv goes back to idle mode),
+        // and make 'q' return to idle mode instead of quitting
+        sendMessage(child, "{\"command\":[\"observe_property\",1,\"idle-active\"]}\n");
+        sendMessage(child, "{\"command\":[\"keybind\",\"q\",\"stop\"]}\n");
+        sendMessage(child, "{\"command\":[\"keybind\",\"Q\",\"stop\"]}\n");
+    }
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_children.push_back(child);
+    }
+    notify();
+    return true;
+}
+
+void ProcessSupervisor::sendMessage(Child& child, const std::string& msg) {
+    #ifdef MSG_NOSIGNAL
+        constexpr int flags = MSG_NOSIGNAL;
+    #else
+        constexpr int flags = 0;  // SO_NOSIGPIPE has been set instead
+    #endif
+    size_t pos = 0;
+    while ((child.ipc >= 0) && (pos < msg.size())) {
+        ssize_t res = send(child.ipc, &msg[pos], msg.size() - pos, flags);
+        if (res > 0) { pos += size_t(res); continue; }
+        if ((res < 0) && (errno == EINTR)) { continue; }
+        // the viewer is gone; the thread will notice the hangup and clean up
+        ::shutdown(child.ipc, SHUT_RDWR);
+        child.program.clear();
+        return;
+    }
+}
+
+bool ProcessSupervisor::sendOpen(Child& child, const char* path) {
+    std::string msg;
+    if (child.protocol == ViewerProtocol::MPV) {
+        msg = "{\"command\":[\"loadfile\",\"";
+        for (const char* c = path;  *c;  ++c) {
+            if ((*c == '"') || (*c == '\\')) {
+                msg.push_back('\\');
+                msg.push_back(*c);
+            } else if (uint8_t(*c) < 32u) {
+                char esc[8];
+                snprintf(esc, sizeof(esc), "\\u%04x", unsigned(*c));
+                msg.append(esc);
+            } else {
+                msg.push_back(*c);
+            }
+        }
+        msg.append("\",\"replace\"]}\n");
+    } else {
+        if (strchr(path, '\n')) { return false; }  // can't be expressed in the line protocol
+        msg = "open ";
+        msg.append(path);
+        msg.push_back('\n');
+    }
+    sendMessage(child, msg);
+    return !child.program.empty();
+}
+
+bool ProcessSupervisor::receive(Child& child) {
+    char buf[1024];
+    ssize_t res;
+    do {
+        res = recv(child.ipc, buf, sizeof(buf), 0);
+    } while ((res < 0) && (errno == EINTR));
+    if (res <= 0) { return false; }
+    child.input.append(buf, size_t(res));
+    size_t start = 0, end;
+    while ((end = child.input.find('\n', start)) != std::string::npos) {
+        handleMessage(child, child.input.substr(start, end - start));
+        start = end + 1;
+    }
+    child.input.erase(0, start);
+    return true;
+}
+
+void ProcessSupervisor::handleMessage(Child& child, const std::string& line) {
+    if (child.protocol == ViewerProtocol::MPV) {
+        // mpv's JSON messages have a fixed layout without whitespace,
+        // so there's no need for a full JSON parser
+        if (line.find("\"event\":\"playback-restart\"") != std::string::npos) {
+            ++m_framesShown;
+        } else if ((line.find("\"event\":\"end-file\"") != std::string::npos)
+               &&  (line.find("\"reason\":\"error\"") != std::string::npos)) {
+            // the file couldn't be opened, so mpv never leaves idle mode
+            child.playing = false;
+            child.busy = false;
+        } else if (line.find("\"name\":\"idle-active\"") != std::string::npos) {
+            bool idle = (line.find("\"data\":true") != std::string::npos);
+            if (!idle) {
+                child.playing = true;
+            } else if (child.playing) {
+                child.playing = false;
+                child.busy = false;
+            }
+        }
+    } else {
+        if (line == "shown") { ++m_framesShown; }
+        else if (line == "done") { child.busy = false; }
+    }
+}
+
+void ProcessSupervisor::quitResident() {
+    // called after the thread has been stopped, so no locking required
+    std::vector<pid_t> pending;
+    for (auto& child : m_children) {
+        if (child.protocol == ViewerProtocol::None) { continue; }
+        if (child.ipc >= 0) {
+            sendMessage(child, (child.protocol == ViewerProtocol::MPV) ? "{\"command\":[\"quit\"]}\n" : "quit\n");
+            close(child.ipc);
+            child.ipc = -1;
+        }
+        pending.push_back(pid_t(child.handle));
+    }
+    // give them a moment to exit cleanly, so they don't linger as zombies
+    for (int wait = 0;  !pending.empty() && (wait < 100);  ++wait) {
+        for (size_t i = 0;  i < pending.size();) {
+            pid_t res = waitpid(pending[i], nullptr, WNOHANG);
+            if ((res > 0) || ((res < 0) && (errno == ECHILD))) { pending.erase(pending.begin() + i); } else { ++i; }
+        }
+        if (!pending.empty()) { usleep(10000); }
+    }
+    for (pid_t pid : pending) { kill(pid, SIGTERM); }
+}
+
+#else // _WIN32
+
+void ProcessSupervisor::prespawn(const char* program, ViewerProtocol protocol) {
+    (void)program, (void)protocol;
+}
+
+#endif
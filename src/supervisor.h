@@ -0,0 +1,136 @@
+// SPDX-FileCopyrightText: 2023 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <thread>
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "sysutil.h"
+#include "file_assoc.h"
+
+//! starts external programs and tracks them until they exit, without ever
+//! blocking the caller or polling: a background thread sleeps until one of
+//! the children terminates (on Linux, by waiting for their pidfds; on other
+//! POSIX systems, old kernels or if a pidfd can't be opened, for SIGCHLD
+//! through a self-pipe; on Windows, for the process handles) and then calls
+//! the wakeup function.
+//! On POSIX systems, programs that speak one of the viewer IPC protocols
+//! can optionally be kept resident: they keep running (invisibly) after the
+//! user is finished with a file, and the next file is sent to them over a
+//! socket instead of starting them again.
+class ProcessSupervisor {
+public:
+    //! what to do when a program is started while others are still running
+    enum class Policy {
+        Queue,     //!< start it once all previous ones have exited
+        Parallel,  //!< start it right away
+        Replace,   //!< terminate the previous ones, then start it right away
+    };
+    //! whether to keep viewers with an IPC protocol running
+    enum class Resident {
+        Off,       //!< no, start a new process for every file
+        OnDemand,  //!< yes, start them when they're needed for the first time
+        Prespawn,  //!< yes, and also start them in advance (see prespawn())
+    };
+
+private:
+    struct Child {
+        ProgramHandle handle;
+        int pidfd = -1;       // -1 if not available
+        int ipc = -1;         // socket connected to a resident viewer, or -1
+        ViewerProtocol protocol = ViewerProtocol::None;
+        std::string program;  // resident viewers only
+        bool busy = true;     // showing a file (always true for non-resident programs)
+        bool playing = false; // MPV only: left idle mode since the last file was sent
+        std::string input;    // incomplete line received from the viewer
+    };
+    struct Launch {
+        std::string program;
+        std::string argument;
+        ViewerProtocol protocol;
+    };
+    std::function<void()> m_wakeup;
+    Policy m_policy = Policy::Queue;
+    Resident m_resident = Resident::Off;
+    std::atomic<uint32_t> m_framesShown;
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::vector<Child> m_children;  // protected by m_mutex
+    std::deque<Launch> m_queue;     // main thread only
+    bool m_quit = false;
+    #ifdef _WIN32
+        void* m_control = nullptr;  // event that wakes the thread
+    #else
+        int m_control[2] = { -1, -1 };  // pipe that wakes the thread (also written by the SIGCHLD handler)
+        bool m_pidfds = false;
+        bool m_sigchld = false;  // SIGCHLD handler installed
+    #endif
+
+    void threadMain();
+    void notify();
+    bool start(const char* program, const char* argument, ViewerProtocol protocol);
+    void reap();
+    #ifndef _WIN32
+        void enableSIGCHLD();
+        void watch(Child& child);  // set up waiting for a new child's exit
+        Child* findResident(const char* program);  // caller holds m_mutex
+        bool spawnResident(const char* program, ViewerProtocol protocol, bool busy);
+        static bool sendOpen(Child& child, const char* path);
+        static void sendMessage(Child& child, const std::string& msg);
+        bool receive(Child& child);  // false if the connection is gone
+        void handleMessage(Child& child, const std::string& line);
+        void quitResident();
+    #endif
+
+public:
+    inline ProcessSupervisor() : m_framesShown(0u) {}
+    inline ~ProcessSupervisor() { shutdown(); }
+
+    //! start the background thread; 'wakeup' is called from that thread
+    //! whenever a program has exited, i.e. when update() should be called
+    bool init(std::function<void()> wakeup);
+
+    //! stop the background thread; running programs are left alone,
+    //! but resident viewers are told to quit
+    void shutdown();
+
+    //! false if the background thread isn't running, i.e. if update()
+    //! needs to be called periodically to notice that programs have exited
+    inline bool active() const { return m_thread.joinable(); }
+
+    inline void setPolicy(Policy policy) { m_policy = policy; }
+    inline Policy policy() const { return m_policy; }
+    //! parse a policy name ("queue", "parallel" or "replace")
+    static bool parsePolicy(const char* name, Policy& policy);
+
+    inline void setResident(Resident mode) { m_resident = mode; }
+    inline Resident resident() const { return m_resident; }
+
+    //! start a program (nullptr = the system's default application for
+    //! the argument), or queue it according to the policy; returns false
+    //! if it couldn't be started. If resident viewers are enabled and the
+    //! program has an IPC protocol, a running instance is re-used, and the
+    //! program counts as running only until it reports that the user is
+    //! finished viewing the file.
+    bool launch(const char* program=nullptr, const char* argument=nullptr,
+                ViewerProtocol protocol=ViewerProtocol::None);
+
+    //! start a resident viewer in advance, without a file, so that even the
+    //! first launch() doesn't need to wait for it to initialize; does nothing
+    //! unless the resident mode is Prespawn
+    void prespawn(const char* program, ViewerProtocol protocol);
+
+    //! number of times a resident viewer has reported that a file's first
+    //! frame is visible (the wakeup function is called for that, too)
+    inline uint32_t framesShown() const { return m_framesShown.load(); }
+
+    //! start queued programs whose turn has come, and return the number of
+    //! programs that are running or queued; main thread only
+    int update();
+};
@@ -12,15 +12,21 @@
     #include <sys/stat.h>
     #include <sys/wait.h>
     #include <unistd.h>
+    #include <signal.h>
+    #include <fcntl.h>
+    #include <spawn.h>
     #include <dirent.h>
     #include <errno.h>
+    extern char** environ;
 #endif
 
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 
 #include <string>
 #include <vector>
+#include <algorithm>
 #include <functional>
 
 #include "sysutil.h"
@@ -234,34 +240,42 @@ bool ScanDirectory(const char* path, std::function<void(const char*, bool, bool)
     return true;
 }
 
-ProgramHandle RunProgram(const char* program, const char* argument) {
-    if (program && program[0]) {  // run specific program
-        // glue together a command line
-        std::string cmdline("\"");
-        cmdline.append(program);
-        if (argument && argument[0]) {
-            cmdline.append("\" \"");
-            cmdline.append(argument);
-        }
+ProgramHandle RunProgram(const char* program, const std::vector<std::string>& args, int ipcFD) {
+    (void)ipcFD;  // not supported
+    if (!program || !program[0]) { return 0u; }
+
+    // glue together a command line
+    std::string cmdline("\"");
+    cmdline.append(program);
+    cmdline.append("\"");
+    for (const auto& arg : args) {
+        cmdline.append(" \"");
+        cmdline.append(arg);
         cmdline.append("\"");
+    }
+
+    // use CreateProcess to start the process
+    PROCESS_INFORMATION pi;
+    STARTUPINFOA si;
+    ::memset((void*)&si, 0, sizeof(si));
+    si.cb = sizeof(si);
+    if (!CreateProcessA(
+        program,           // lpApplicationName
+        const_cast<LPSTR>(cmdline.c_str()),  // lpCommandLine
+        nullptr, nullptr,  // lpProcessAttributes, lpThreadAttributes
+        FALSE, 0,          // bInheritHandles, dwCreationFlags
+        nullptr, nullptr,  // lpEnvironment, lpCurrentDirectory
+        &si, &pi))         // lpStartupInfo, lpProcessInformation
+        { return 0u; }
+    CloseHandle(pi.hThread);
+    return ProgramHandle(pi.hProcess);
+}
 
-        // use CreateProcess to start the process
-        PROCESS_INFORMATION pi;
-        STARTUPINFOA si;
-        ::memset((void*)&si, 0, sizeof(si));
-        si.cb = sizeof(si);
-        if (!CreateProcessA(
-            program,           // lpApplicationName
-            const_cast<LPSTR>(cmdline.c_str()),  // lpCommandLine
-            nullptr, nullptr,  // lpProcessAttributes, lpThreadAttributes
-            FALSE, 0,          // bInheritHandles, dwCreationFlags
-            nullptr, nullptr,  // lpEnvironment, lpCurrentDirectory
-            &si, &pi))         // lpStartupInfo, lpProcessInformation
-            { return false; }
-
-        // wait for the process to terminate
-        CloseHandle(pi.hThread);
-        return ProgramHandle(pi.hProcess);
+ProgramHandle RunProgram(const char* program, const char* argument) {
+    if (program && program[0]) {  // run specific program
+        std::vector<std::string> args;
+        if (argument && argument[0]) { args.push_back(argument); }
+        return RunProgram(program, args);
     } else if (argument && argument[0]) {  // use system default application
         // prepare ShellExecuteEx invocation
         SHELLEXECUTEINFOA ei;
@@ -278,18 +292,13 @@ ProgramHandle RunProgram(const char* program, const char* argument) {
     return 0u;
 }
 
-void WaitForProgram(ProgramHandle prog) {
-    if (!prog) { return; }
-    WaitForSingleObject(HANDLE(prog), INFINITE);
-    CloseHandle(HANDLE(prog));
+void TerminateProgram(ProgramHandle prog) {
+    if (prog) { TerminateProcess(HANDLE(prog), 1); }
 }
 
-bool PollForProgram(ProgramHandle& prog) {
-    if (!prog) { return true; }
-    if (WaitForSingleObject(HANDLE(prog), 0) == WAIT_TIMEOUT) { return false; }
-    CloseHandle(HANDLE(prog));
-    prog = 0u;
-    return true;
+void PrefetchFile(const char* path, uint64_t maxBytes) {
+    // Windows' own prefetcher already takes care of executables
+    (void)path, (void)maxBytes;
 }
 
 #else // POSIX ////////////////////////////////////////////////////////////////
@@ -344,41 +353,121 @@ bool ScanDirectory(const char* path, std::function<void(const char*, bool, bool)
 }
 
 ProgramHandle RunProgram(const char* program, const char* argument) {
-    if (argument && !argument[0]) { argument = nullptr; }
+    std::vector<std::string> args;
+    if (argument && argument[0]) { args.push_back(argument); }
 
     // pick a universal default application
     if (!program || !program[0]) {
-        if (!argument) { return 0u; }
+        if (args.empty()) { return 0u; }
         #ifdef __APPLE__
             program = "open";
         #else
             program = "xdg-open";
         #endif
     }
+    return RunProgram(program, args);
+}
 
-    // do the fork-exec-wait dance
-    pid_t childPID = fork();
-    if (childPID < 0) { return 0u; }
-    if (!childPID) {
-        char * const argv[3] = { const_cast<char*>(program), const_cast<char*>(argument), nullptr };
-        execv(program, argv);
-        fprintf(stderr, "\n***** child process execv() failed *****\ncommand line:  %s", program);
-        if (argument) { fprintf(stderr, " \"%s\"", argument); }
-        perror("\nerror message");
-        _exit(0xBE);
+#if !defined(__APPLE__) && !(defined(__GLIBC__) && ((__GLIBC__ > 2) || ((__GLIBC__ == 2) && (__GLIBC_MINOR__ >= 34))))
+    #define NEED_MARK_CLOEXEC
+// for C libraries whose posix_spawn() can't be told to close the other file
+// descriptors in the child: set close-on-exec on all of ours from 'firstFD'
+// upwards instead (this process never calls exec itself, so that doesn't
+// make a difference to it); on Linux, the open descriptors are listed in
+// /proc, elsewhere all possible ones are tried
+static void markCloseOnExec(int firstFD) {
+    auto mark = [] (int fd) {
+        int flags = fcntl(fd, F_GETFD);
+        if ((flags >= 0) && !(flags & FD_CLOEXEC)) { fcntl(fd, F_SETFD, flags | FD_CLOEXEC); }
+    };
+    DIR* dir = opendir("/proc/self/fd");
+    if (dir) {
+        struct dirent* item;
+        while ((item = readdir(dir))) {
+            int fd = int(strtol(item->d_name, nullptr, 10));  // "." and ".." are 0
+            if (fd >= firstFD) { mark(fd); }  // includes the directory's own descriptor, which is harmless
+        }
+        closedir(dir);
+        return;
+    }
+    long maxFD = sysconf(_SC_OPEN_MAX);
+    if ((maxFD < 0) || (maxFD > 65536)) { maxFD = 65536; }
+    for (int fd = firstFD;  fd < int(maxFD);  ++fd) { mark(fd); }
+}
+#endif
+
+ProgramHandle RunProgram(const char* program, const std::vector<std::string>& args, int ipcFD) {
+    if (!program || !program[0]) { return 0u; }
+
+    // posix_spawn() doesn't need to copy the (large) address space like
+    // fork() does; the C library uses vfork() semantics where possible.
+    // The child gets default signal handling and mask, and only inherits
+    // stdin, stdout and stderr, no matter whether the other file
+    // descriptors have been opened with close-on-exec or not (natively on
+    // macOS and glibc 2.34 or newer; elsewhere, by setting close-on-exec
+    // on all of them first, which is racy against other threads opening
+    // files at the same time, but better than nothing).
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_init(&attr);
+    posix_spawn_file_actions_init(&actions);
+    sigset_t sigs;
+    sigemptyset(&sigs);
+    posix_spawnattr_setsigmask(&attr, &sigs);
+    sigaddset(&sigs, SIGCHLD);
+    sigaddset(&sigs, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attr, &sigs);
+    short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+    // (The IPC descriptor is duplicated to 3 with dup2(), which clears
+    // close-on-exec on the copy; callers make sure it isn't 3 already.)
+    int keepFDs = 3;
+    if (ipcFD >= 0) {
+        posix_spawn_file_actions_adddup2(&actions, ipcFD, 3);
+        keepFDs = 4;
+    }
+    #if defined(__APPLE__)
+        flags |= POSIX_SPAWN_CLOEXEC_DEFAULT;
+        for (int fd = 0;  fd < keepFDs;  ++fd) { posix_spawn_file_actions_addinherit_np(&actions, fd); }
+    #elif !defined(NEED_MARK_CLOEXEC)
+        posix_spawn_file_actions_addclosefrom_np(&actions, keepFDs);
+    #else
+        markCloseOnExec(keepFDs);
+    #endif
+    posix_spawnattr_setflags(&attr, flags);
+    std::vector<char*> argv;
+    argv.push_back(const_cast<char*>(program));
+    for (const auto& arg : args) { argv.push_back(const_cast<char*>(arg.c_str())); }
+    argv.push_back(nullptr);
+    pid_t childPID = 0;
+    int err = posix_spawnp(&childPID, program, &actions, &attr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    if (err) {
+        fprintf(stderr, "ERROR: failed to start program - %s\ncommand line:  %s", strerror(err), program);
+        for (const auto& arg : args) { fprintf(stderr, " \"%s\"", arg.c_str()); }
+        fprintf(stderr, "\n");
+        return 0u;
     }
     return ProgramHandle(childPID);
 }
 
-void WaitForProgram(ProgramHandle prog) {
-    if (!prog) { return; }
-    waitpid(pid_t(prog), nullptr, 0);
+void TerminateProgram(ProgramHandle prog) {
+    if (prog) { kill(pid_t(prog), SIGTERM); }
 }
 
-bool PollForProgram(ProgramHandle &prog) {
-    if (!prog) { return true; }
-    if (waitpid(pid_t(prog), nullptr, WNOHANG) != 0) { prog = 0u; }
-    return (prog == 0u);
+void PrefetchFile(const char* path, uint64_t maxBytes) {
+    if (!path || !path[0]) { return; }
+    #if defined(POSIX_FADV_WILLNEED)
+        int fd = open(path, O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+        if (fd < 0) { return; }
+        struct stat st;
+        if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode)) {
+            posix_fadvise(fd, 0, off_t(std::min(uint64_t(st.st_size), maxBytes)), POSIX_FADV_WILLNEED);
+        }
+        close(fd);
+    #else
+        (void)maxBytes;
+    #endif
 }
 
 #endif // POSIX ///////////////////////////////////////////////////////////////
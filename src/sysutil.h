@@ -6,6 +6,7 @@
 #include <cstdint>
 
 #include <string>
+#include <vector>
 #include <functional>
 
 #ifdef _WIN32
@@ -69,5 +70,13 @@ typedef uintptr_t ProgramHandle;
 ProgramHandle RunProgram(const char* program=nullptr, const char* argument=nullptr);
 inline ProgramHandle RunProgram(const std::string& program, const std::string& argument)
     { return RunProgram(program.c_str(), argument.c_str()); }
-void WaitForProgram(ProgramHandle prog);
-bool PollForProgram(ProgramHandle &prog);
+//! start a specific program with any number of arguments; on POSIX systems,
+//! 'ipcFD' (if >= 0) is passed to the program as file descriptor 3
+ProgramHandle RunProgram(const char* program, const std::vector<std::string>& args, int ipcFD=-1);
+void TerminateProgram(ProgramHandle prog);
+
+//! ask the OS to read (the first 'maxBytes' of) a file into the page cache
+//! in the background, e.g. a program that's likely to be started soon;
+//! returns immediately and silently ignores errors
+void PrefetchFile(const char* path, uint64_t maxBytes=UINT64_MAX);
+inline void PrefetchFile(const std::string& path, uint64_t maxBytes=UINT64_MAX) { PrefetchFile(path.c_str(), maxBytes); }
@@ -0,0 +1,52 @@
+// SPDX-FileCopyrightText: 2023 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstdint>
+
+#include <atomic>
+
+//! a lock-free triple buffer: one thread (the producer) keeps writing new
+//! versions of a value, another one (the consumer) always gets the most
+//! recent complete version, and neither ever waits for the other; versions
+//! that the consumer didn't pick up in time are simply overwritten
+//!
+//! The buffers are re-used, so values that own memory (e.g. vectors) don't
+//! need to be reallocated once they have reached their working size.
+template <typename T> class TripleBuffer {
+    static constexpr uint8_t IndexMask = 3u;
+    static constexpr uint8_t Fresh = 4u;  // the shared buffer holds a version the consumer hasn't seen
+
+    T m_buffers[3];
+    std::atomic<uint8_t> m_shared;  // index of the buffer in between, plus the Fresh flag
+    uint8_t m_back = 0u;            // producer only
+    uint8_t m_front = 1u;           // consumer only
+
+public:
+    inline TripleBuffer() : m_shared(2u) {}
+
+    //! the buffer the producer writes the next version into
+    inline T& back() { return m_buffers[m_back]; }
+
+    //! make the back buffer the most recent version; the new back buffer
+    //! contains some older version afterwards; producer only
+    inline void publish() {
+        m_back = m_shared.exchange(uint8_t(m_back | Fresh), std::memory_order_acq_rel) & IndexMask;
+    }
+
+    //! true if a published version hasn't been picked up by update() yet,
+    //! i.e. if the next publish() is going to overwrite it; any thread
+    inline bool pending() const { return (m_shared.load(std::memory_order_acquire) & Fresh) != 0u; }
+
+    //! switch to the most recent version, if there is a new one; returns
+    //! false if front() is still the most recent version; consumer only
+    inline bool update() {
+        if (!pending()) { return false; }
+        m_front = m_shared.exchange(m_front, std::memory_order_acq_rel) & IndexMask;
+        return true;
+    }
+
+    //! the version the consumer currently works with
+    inline const T& front() const { return m_buffers[m_front]; }
+};
@@ -0,0 +1,76 @@
+// SPDX-FileCopyrightText: 2023 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#include <cstdint>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+#include "workers.h"
+
+void WorkerPool::init(int threads) {
+    shutdown();
+    if (threads <= 0) { threads = int(std::thread::hardware_concurrency()); }
+    m_quit = false;
+    for (int i = 1;  i < threads;  ++i) {
+        m_threads.emplace_back([this] { workerMain(); });
+    }
+}
+
+void WorkerPool::shutdown() {
+    if (m_threads.empty()) { return; }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_wake.notify_all();
+    for (auto& t : m_threads) { t.join(); }
+    m_threads.clear();
+}
+
+void WorkerPool::runItems() {
+    for (;;) {
+        int index = m_nextIndex.fetch_add(1);
+        if (index >= m_count) { break; }
+        (*m_func)(index);
+    }
+}
+
+void WorkerPool::workerMain() {
+    uint32_t seen = 0u;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_wake.wait(lock, [&] { return m_quit || (m_generation != seen); });
+        if (m_quit) { break; }
+        seen = m_generation;
+        lock.unlock();
+        runItems();
+        lock.lock();
+        if (!--m_busy) { m_done.notify_one(); }
+    }
+}
+
+void WorkerPool::parallelFor(int count, const std::function<void(int index)>& func) {
+    if (count <= 0) { return; }
+    if (m_threads.empty() || (count == 1)) {
+        for (int i = 0;  i < count;  ++i) { func(i); }
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_func = &func;
+        m_count = count;
+        m_nextIndex.store(0);
+        m_busy = int(m_threads.size());
+        ++m_generation;
+    }
+    m_wake.notify_all();
+    runItems();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this] { return (m_busy == 0); });
+    m_func = nullptr;
+}
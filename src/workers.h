@@ -0,0 +1,46 @@
+// SPDX-FileCopyrightText: 2023 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstdint>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+//! a simple fixed-size thread pool that runs data-parallel loops
+class WorkerPool {
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    const std::function<void(int index)>* m_func = nullptr;
+    int m_count = 0;
+    std::atomic<int> m_nextIndex;
+    int m_busy = 0;
+    uint32_t m_generation = 0u;
+    bool m_quit = false;
+
+    void workerMain();
+    void runItems();
+
+public:
+    inline WorkerPool() : m_nextIndex(0) {}
+    inline ~WorkerPool() { shutdown(); }
+
+    //! start the worker threads; 0 = one thread per CPU core
+    //! (the calling thread counts as one of them)
+    void init(int threads=0);
+    void shutdown();
+
+    //! total number of threads that execute work, including the caller
+    inline int threads() const { return int(m_threads.size()) + 1; }
+
+    //! call func(0) ... func(count-1) in parallel and wait until all
+    //! calls have finished; the calling thread participates in the work
+    void parallelFor(int count, const std::function<void(int index)>& func);
+};
@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+# SPDX-FileCopyrightText: 2023 Martin J. Fiedler <keyj@emphy.de>
+# SPDX-License-Identifier: MIT
+"""
+Stand-in for an image viewer that speaks GLBrowser's resident viewer
+protocol (ViewerProtocol::Line in src/file_assoc.h), for testing and for the
+'viewer' benchmark. It doesn't display anything; it only simulates the
+startup cost and viewing time of a real viewer and logs what it does.
+
+usage: stub_viewer.py FILE          show FILE, then exit (conventional mode)
+       stub_viewer.py --ipc-fd=N    resident mode: take commands from socket N
+
+environment:
+  STUB_VIEWER_STARTUP_TIME  simulated initialization time in seconds (0.25)
+  STUB_VIEWER_VIEW_TIME     simulated viewing time in seconds (1.0)
+
+To try it out in GLBrowser, set the GLBROWSER_STUB_VIEWER environment
+variable to the path of this script and run GLBrowser with
+--resident-viewers; it's then offered for images in the "Open With" menu.
+"""
+import socket
+import time
+import sys
+import os
+
+T0 = time.monotonic()
+
+def log(msg):
+    sys.stderr.write("stub viewer [%d] %8.3f: %s\n" % (os.getpid(), time.monotonic() - T0, msg))
+
+def env_time(name, default):
+    try:
+        return max(0.0, float(os.environ.get(name, default)))
+    except ValueError:
+        return default
+
+STARTUP_TIME = env_time("STUB_VIEWER_STARTUP_TIME", 0.25)
+VIEW_TIME = env_time("STUB_VIEWER_VIEW_TIME", 1.0)
+
+def init():
+    # this is where a real viewer would create its window and GL context
+    time.sleep(STARTUP_TIME)
+    log("initialized")
+
+def show(path):
+    try:
+        with open(path, "rb") as f:
+            size = len(f.read(1 << 20))
+    except EnvironmentError as e:
+        log("can't open '%s': %s" % (path, e.strerror))
+        return False
+    log("showing '%s' (%d bytes read)" % (path, size))
+    return True
+
+def resident(fd):
+    sock = socket.socket(fileno=fd)
+    init()
+    buf = b""
+    while True:
+        data = sock.recv(4096)
+        if not data:
+            log("connection closed")
+            return
+        buf += data
+        while b"\n" in buf:
+            line, buf = buf.split(b"\n", 1)
+            cmd, _, arg = line.decode("utf-8", "surrogateescape").partition(" ")
+            if cmd == "open":
+                if show(arg):
+                    sock.sendall(b"shown\n")
+                    time.sleep(VIEW_TIME)
+                log("done")
+                sock.sendall(b"done\n")
+            elif cmd == "quit":
+                log("quit")
+                return
+            else:
+                log("unknown command '%s'" % cmd)
+
+if __name__ == "__main__":
+    args = sys.argv[1:]
+    if (len(args) == 1) and args[0].startswith("--ipc-fd="):
+        resident(int(args[0][9:]))
+    elif len(args) == 1:
+        init()
+        if show(args[0]):
+            time.sleep(VIEW_TIME)
+    else:
+        print(__doc__.strip())
+        sys.exit(2)